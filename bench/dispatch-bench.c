@@ -0,0 +1,150 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Compares the ways the service can find the handler of a method of the
+ * container interface:
+ *
+ *   strcmp       a chain of string comparisons, as the handlers used to be
+ *                picked with
+ *   hash table   a GHashTable of the method names
+ *   perfect hash the table xml2h.sh generates from contejner-instance.xml
+ *
+ * All of them cover the methods of the table xml2h.sh generates, so that
+ * the comparison holds as methods are added. Every round looks up all
+ * methods once, and one unknown method, so the order of the chain does not
+ * change the average.
+ *
+ *   dispatch-bench [-n rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <gio/gio.h>
+
+typedef struct _ContejnerInstanceInterface ContejnerInstanceInterface;
+
+#define XML2H_LOOKUP_ONLY
+#include "contejner-instance.xml.h"
+
+/* The method names, NULL terminated */
+static const char *chain[INSTANCE_METHODS_TABLE_SZ + 1];
+
+/* Copies, so that no lookup can compare pointers, and an unknown name */
+static char *names[INSTANCE_METHODS_TABLE_SZ + 1];
+static int n_names;
+
+static GHashTable *table;
+
+static int lookup_strcmp(const char *name)
+{
+    int i;
+
+    for (i = 0; chain[i]; i++) {
+        if (!g_strcmp0(name, chain[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int lookup_hash_table(const char *name)
+{
+    gpointer value;
+
+    if (!g_hash_table_lookup_extended(table, name, NULL, &value)) {
+        return -1;
+    }
+    return GPOINTER_TO_INT(value);
+}
+
+static int lookup_perfect_hash(const char *name)
+{
+    const struct instance_methods_method *method =
+        instance_methods_lookup(name);
+
+    return method ? method - instance_methods_methods : -1;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void run(const char *name, int (*lookup)(const char *), int rounds)
+{
+    double start;
+    int i, j, found = 0;
+    int lookups = n_names;
+
+    start = now_us();
+    for (i = 0; i < rounds; i++) {
+        for (j = 0; j < lookups; j++) {
+            found += lookup(names[j]) != -1;
+        }
+    }
+
+    printf("%-12s %10.1f ns per lookup (%d found)\n", name,
+           (now_us() - start) * 1e3 / ((double) rounds * lookups),
+           found / rounds);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = 1000000;
+    int opt, i, n = 0;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            rounds = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (rounds <= 0) {
+        rounds = 1;
+    }
+
+    table = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = 0; i < INSTANCE_METHODS_TABLE_SZ; i++) {
+        if (!instance_methods_methods[i].name) {
+            continue;
+        }
+        chain[n] = instance_methods_methods[i].name;
+        names[n] = g_strdup(chain[n]);
+        g_hash_table_insert(table, (gpointer) chain[n], GINT_TO_POINTER(n));
+        n++;
+    }
+    names[n] = g_strdup("NoSuchMethod");
+    n_names = n + 1;
+
+    printf("%d rounds of %d lookups\n", rounds, n_names);
+    run("strcmp", lookup_strcmp, rounds);
+    run("hash table", lookup_hash_table, rounds);
+    run("perfect hash", lookup_perfect_hash, rounds);
+    return 0;
+}
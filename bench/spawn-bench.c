@@ -0,0 +1,168 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Compares the ways the service starts containers without namespaces:
+ *
+ *   clone        clone() on a private 1 MiB stack, the original path
+ *   clone3       clone3(), which copies the process like fork()
+ *   posix_spawn  the fast path, which shares the memory of the parent until
+ *                the exec, like vfork()
+ *
+ * The cost of the first two grows with the memory mapped by the parent, so
+ * the benchmark can grow its own heap to that of a busy service first.
+ *
+ *   spawn-bench [-n spawns] [-m MiB] [command]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/sched.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define STACK_SIZE 1024 * 1024
+
+static char *command_args[] = { "/bin/true", NULL };
+
+static int child_func(void *arg)
+{
+    execv(command_args[0], command_args);
+    return 127;
+}
+
+static pid_t spawn_clone(void)
+{
+    /* The service allocates one stack per container */
+    char *stack = malloc(STACK_SIZE);
+    pid_t pid = clone(child_func, stack + STACK_SIZE, SIGCHLD, NULL);
+    free(stack);
+    return pid;
+}
+
+static pid_t spawn_clone3(void)
+{
+#ifdef SYS_clone3
+    struct clone_args args = { 0 };
+    pid_t pid;
+
+    args.exit_signal = SIGCHLD;
+    pid = syscall(SYS_clone3, &args, sizeof(args));
+    if (pid == 0) {
+        _exit(child_func(NULL));
+    }
+    return pid;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static pid_t spawn_posix(void)
+{
+    pid_t pid;
+    int err = posix_spawn(&pid, command_args[0], NULL, NULL,
+                          command_args, environ);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void run(const char *name, pid_t (*spawn)(void), int spawns)
+{
+    double start, total_spawn = 0, total = 0;
+    int i, status;
+    pid_t pid;
+
+    for (i = 0; i < spawns; i++) {
+        start = now_us();
+        pid = spawn();
+        if (pid == -1) {
+            printf("%-12s failed: %s\n", name, strerror(errno));
+            return;
+        }
+        total_spawn += now_us() - start;
+        waitpid(pid, &status, 0);
+        total += now_us() - start;
+    }
+
+    printf("%-12s %10.1f us to spawn %10.1f us to exit\n",
+           name, total_spawn / spawns, total / spawns);
+}
+
+int main(int argc, char **argv)
+{
+    int spawns = 1000;
+    size_t heap_mb = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:")) != -1) {
+        switch (opt) {
+        case 'n':
+            spawns = atoi(optarg);
+            break;
+        case 'm':
+            heap_mb = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n spawns] [-m MiB] [command]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        command_args[0] = argv[optind];
+    }
+    if (spawns <= 0) {
+        spawns = 1;
+    }
+
+    /* Touched, so that it is really mapped */
+    if (heap_mb) {
+        char *heap = malloc(heap_mb * 1024 * 1024);
+        if (!heap) {
+            fprintf(stderr, "Failed to allocate %zu MiB\n", heap_mb);
+            return 1;
+        }
+        memset(heap, 1, heap_mb * 1024 * 1024);
+    }
+
+    printf("%d spawns of %s, %zu MiB heap\n", spawns, command_args[0], heap_mb);
+    run("clone", spawn_clone, spawns);
+    run("clone3", spawn_clone3, spawns);
+    run("posix_spawn", spawn_posix, spawns);
+    return 0;
+}
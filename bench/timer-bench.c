@@ -0,0 +1,162 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Compares the ways the service can keep the deadlines of containers:
+ *
+ *   GSource      a g_timeout_add() per deadline, as a client or the service
+ *                would with plain GLib
+ *   timer wheel  the ContejnerTimerWheel of the service, on one timerfd
+ *
+ * Every round arms the given number of deadlines, spread over an hour, and
+ * cancels them again. Cancelling goes in a shuffled order, the way
+ * containers exit.
+ *
+ *   timer-bench [-n deadlines] [-r rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "contejner-timer.h"
+
+static guint64 *delays;
+static guint *order;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static gboolean source_expired(gpointer user_data)
+{
+    return G_SOURCE_REMOVE;
+}
+
+static void timer_expired(ContejnerTimer *timer, gpointer user_data)
+{
+}
+
+static void report(const char *name, double arm, double cancel, int n)
+{
+    printf("%-12s %8.1f ns per arm %8.1f ns per cancel\n", name,
+           arm * 1e3 / n, cancel * 1e3 / n);
+}
+
+static void run_sources(int n, int rounds)
+{
+    guint *sources = g_new0(guint, n);
+    double arm = 0, cancel = 0, start;
+    int i, j;
+
+    for (i = 0; i < rounds; i++) {
+        start = now_us();
+        for (j = 0; j < n; j++) {
+            sources[j] = g_timeout_add(delays[j], source_expired, NULL);
+        }
+        arm += now_us() - start;
+
+        start = now_us();
+        for (j = 0; j < n; j++) {
+            g_source_remove(sources[order[j]]);
+        }
+        cancel += now_us() - start;
+    }
+
+    report("GSource", arm, cancel, n * rounds);
+    g_free(sources);
+}
+
+static void run_wheel(int n, int rounds)
+{
+    ContejnerTimerWheel *wheel = contejner_timer_wheel_new();
+    ContejnerTimer *timers = g_new0(ContejnerTimer, n);
+    double arm = 0, cancel = 0, start;
+    int i, j;
+
+    if (!wheel) {
+        return;
+    }
+
+    for (i = 0; i < rounds; i++) {
+        start = now_us();
+        for (j = 0; j < n; j++) {
+            contejner_timer_arm(wheel, &timers[j], delays[j], timer_expired, NULL);
+        }
+        arm += now_us() - start;
+
+        start = now_us();
+        for (j = 0; j < n; j++) {
+            contejner_timer_cancel(&timers[order[j]]);
+        }
+        cancel += now_us() - start;
+    }
+
+    report("timer wheel", arm, cancel, n * rounds);
+    contejner_timer_wheel_free(wheel);
+    g_free(timers);
+}
+
+int main(int argc, char **argv)
+{
+    int n = 50000, rounds = 10;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 'r':
+            rounds = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n deadlines] [-r rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (n <= 0) {
+        n = 1;
+    }
+    if (rounds <= 0) {
+        rounds = 1;
+    }
+
+    delays = g_new(guint64, n);
+    order = g_new(guint, n);
+    for (i = 0; i < n; i++) {
+        delays[i] = g_random_int_range(1000, 3600 * 1000);
+        order[i] = i;
+    }
+    for (i = n - 1; i > 0; i--) {
+        guint j = g_random_int_range(0, i + 1), tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    printf("%d rounds of %d deadlines\n", rounds, n);
+    run_sources(n, rounds);
+    run_wheel(n, rounds);
+    return 0;
+}
@@ -18,6 +18,7 @@
  */
 
 #define _GNU_SOURCE
+#include <errno.h>
 #include <stdio.h>
 #include <gio/gio.h>
 #include <gio/gunixfdlist.h>
@@ -25,10 +26,25 @@
 #include <signal.h>
 #include <poll.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib-unix.h>
+#include "libcontejner.h"
+#include "contejner-status-board.h"
+
+struct client;
+
+/* One action of the client. Actions run one after the other, each calls
+ * next_step() when it is done. */
+typedef void (*step_func)(struct client *client);
 
 struct client {
-    GDBusProxy *manager_proxy;
-    GDBusProxy *container_proxy;
+    ContejnerClient *lib;
+    GQueue steps;
+    const gchar *method;
     GMainLoop *loop;
     gchar *exec_command;
     gchar **exec_command_args;
@@ -39,8 +55,103 @@ struct client {
     gint stdout_fd;
     gint stderr_fd;
     gint kill_signal;
+    gchar *stop;
+    guint stop_grace;
+    gboolean do_freeze;
+    gboolean do_thaw;
+    gint tail_lines;
+    gint64 tail_from;
+    const gchar *tail_unit;
+    gboolean use_terminal;
+    gboolean compress_output;
+    gchar *cpuset;
+    gchar *mem_nodes;
+    gchar *nice;
+    gchar *sched_policy;
+    gchar *io_priority;
+    gchar *restart_policy;
+    gchar *timeout;
+    gchar *exec_in;
+    gint exit_status;
+    gchar **labels;
+    gchar **binds;
+    gchar **scratch;
+    gchar *selector;
+    gboolean do_destroy;
+    gboolean do_events;
+    gboolean do_board;
+    guint64 last_event;
+    gint terminal_fd;
+    struct termios saved_termios;
+    gboolean termios_saved;
+};
+
+/* Containers listed together with their status */
+struct listing {
+    struct client *client;
+    gchar **names;
+    gchar **statuses;
+    guint pending;
+};
+
+/* The status query of one listed container */
+struct listed {
+    struct listing *listing;
+    guint index;
 };
 
+static int winch_pipe[2] = { -1, -1 };
+
+static void add_step (struct client *client, step_func step)
+{
+    g_queue_push_tail(&client->steps, (gpointer) step);
+}
+
+static void next_step (struct client *client)
+{
+    step_func step = (step_func) g_queue_pop_head(&client->steps);
+
+    if (step) {
+        step(client);
+    } else {
+        g_main_loop_quit(client->loop);
+    }
+}
+
+/* Finish a call started with call(), failing on errors */
+static GVariant *call_finish (struct client *client,
+                              GAsyncResult *res,
+                              GUnixFDList **fd_list)
+{
+    GError *error = NULL;
+    GVariant *retval = contejner_client_call_finish(client->lib, res,
+                                                    fd_list, &error);
+    if (!retval) {
+        g_error("Failed to call %s: %s", client->method, error->message);
+    }
+    return retval;
+}
+
+static void call_done (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
+    g_variant_unref(call_finish(client, res, NULL));
+    next_step(client);
+}
+
+/* Call a method of the container, or of the manager when @name is NULL.
+ * Without a callback, the next step follows the reply. */
+static void call (struct client *client,
+                  const gchar *name,
+                  const gchar *method,
+                  GVariant *params,
+                  GAsyncReadyCallback callback)
+{
+    client->method = method;
+    contejner_client_call(client->lib, name, method, params, NULL,
+                          callback ? callback : call_done, client);
+}
+
 static void print_output(const int *fds)
 {
     static const char *fds_begin_text[] = {"\x1b[32m","\x1b[31m"};
@@ -67,291 +178,790 @@ static void print_output(const int *fds)
     }
 }
 
-void status_change_cb (GDBusConnection *connection,
-                       const gchar *sender_name,
-                       const gchar *object_path,
-                       const gchar *interface_name,
-                       const gchar *signal_name,
-                       GVariant *parameters,
-                       gpointer user_data)
+static gboolean process_output(gpointer user_data)
 {
     struct client *client = user_data;
-    const char *status;
 
-    g_variant_get(parameters, "(s)", &status);
-    g_debug ("Received new status: %s", status);
-    if (!g_strcmp0("STOPPED", status)) {
-        const int fds[] = {client->stdout_fd, client->stderr_fd, -1};
-        print_output(fds);
-        g_main_loop_quit(client->loop);
-    }
+    const int fds[] = {client->stdout_fd, client->stderr_fd, -1};
+
+    print_output(fds);
 
+    return G_SOURCE_CONTINUE;
 }
 
-static gboolean process_output(gpointer user_data)
+static void stopped_cb (GObject *source, GAsyncResult *res, gpointer user_data)
 {
     struct client *client = user_data;
-
     const int fds[] = {client->stdout_fd, client->stderr_fd, -1};
+    GError *error = NULL;
+
+    if (!contejner_client_wait_finish(client->lib, res, &client->exit_status,
+                                      &error)) {
+        g_error("Failed to wait for %s: %s", client->container_name,
+                error->message);
+    }
+    g_debug ("Container stopped with status %d", client->exit_status);
+    if (client->exit_status < 0) {
+        client->exit_status = 0;
+    }
 
     print_output(fds);
+    g_main_loop_quit(client->loop);
+}
 
-    return G_SOURCE_CONTINUE;
+static void connected_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
+    GError *error = NULL;
+
+    if (!contejner_client_connect_finish(client->lib, res, &client->stdout_fd,
+                                         &client->stderr_fd, &error)) {
+        g_error("Failed to call Connect: %s", error->message);
+    }
+
+    g_idle_add(process_output, client);
+    contejner_client_wait(client->lib, client->container_name, NULL,
+                          stopped_cb, client);
 }
 
 static void connect (struct client *client)
 {
+    contejner_client_connect(client->lib, client->container_name, NULL,
+                             connected_cb, client);
+}
+
+static GVariant *labels_variant (struct client *client)
+{
+    GVariantBuilder builder;
+    int i;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{ss}"));
+    for (i = 0; client->labels[i]; i++) {
+        gchar **label = g_strsplit(client->labels[i], "=", 2);
+        g_variant_builder_add(&builder, "{ss}", label[0], label[1] ? label[1] : "");
+        g_strfreev(label);
+    }
+
+    return g_variant_builder_end(&builder);
+}
+
+/* HOST:PATH, optionally followed by :ro, :rec or :ro,rec */
+static GVariant *mounts_variant (struct client *client)
+{
+    GVariantBuilder builder;
+    int i, j;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(ssu)"));
+    for (i = 0; client->binds[i]; i++) {
+        gchar **bind = g_strsplit(client->binds[i], ":", 3);
+        gchar **options = g_strsplit(bind[1] && bind[2] ? bind[2] : "", ",", -1);
+        guint32 flags = 0;
+
+        if (!bind[1]) {
+            g_error("Invalid bind mount %s, use HOST:PATH[:ro,rec]", client->binds[i]);
+        }
+        for (j = 0; options[j]; j++) {
+            if (!g_strcmp0(options[j], "ro")) {
+                flags |= 1;
+            } else if (!g_strcmp0(options[j], "rec")) {
+                flags |= 2;
+            } else {
+                g_error("Unknown bind mount option: %s", options[j]);
+            }
+        }
+        g_variant_builder_add(&builder, "(ssu)", bind[0], bind[1], flags);
+        g_strfreev(options);
+        g_strfreev(bind);
+    }
+
+    return g_variant_builder_end(&builder);
+}
+
+/* PATH=SIZE, where the size may end in K, M or G */
+static GVariant *scratch_variant (struct client *client)
+{
+    GVariantBuilder builder;
+    int i;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{st}"));
+    for (i = 0; client->scratch[i]; i++) {
+        gchar **scratch = g_strsplit(client->scratch[i], "=", 2);
+        gchar *end = NULL;
+        guint64 size = scratch[1] ? g_ascii_strtoull(scratch[1], &end, 10) : 0;
+
+        switch (end ? g_ascii_toupper(*end) : 0) {
+            case 'G': size <<= 10;
+            case 'M': size <<= 10;
+            case 'K': size <<= 10;
+        }
+        if (!size) {
+            g_error("Invalid scratch space %s, use PATH=SIZE", client->scratch[i]);
+        }
+        g_variant_builder_add(&builder, "{st}", scratch[0], size);
+        g_strfreev(scratch);
+    }
+
+    return g_variant_builder_end(&builder);
+}
+
+static void configured_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
+    GError *error = NULL;
+
+    if (!contejner_client_configure_finish(client->lib, res, &error)) {
+        g_error("Failed to configure %s: %s", client->container_name,
+                error->message);
+    }
+    next_step(client);
+}
+
+/* Send the command and all options of the container at once */
+static void configure (struct client *client)
+{
+    GVariantDict config;
+
+    g_variant_dict_init(&config, NULL);
+    if (client->exec_command) {
+        g_variant_dict_insert(&config, "Command", "s", client->exec_command);
+        g_variant_dict_insert_value(&config, "Arguments",
+                g_variant_new_strv((const gchar * const *) client->exec_command_args, -1));
+    }
+    if (client->cpuset) {
+        g_variant_dict_insert(&config, "CpuSet", "s", client->cpuset);
+    }
+    if (client->mem_nodes) {
+        g_variant_dict_insert(&config, "MemNodes", "s", client->mem_nodes);
+    }
+    if (client->nice) {
+        g_variant_dict_insert(&config, "Nice", "i",
+                              (gint32) g_ascii_strtoll(client->nice, NULL, 10));
+    }
+    if (client->sched_policy) {
+        g_variant_dict_insert(&config, "SchedPolicy", "s", client->sched_policy);
+    }
+    if (client->io_priority) {
+        g_variant_dict_insert(&config, "IOPriority", "s", client->io_priority);
+    }
+    if (client->restart_policy) {
+        g_variant_dict_insert(&config, "RestartPolicy", "s",
+                              client->restart_policy);
+    }
+    if (client->labels) {
+        g_variant_dict_insert_value(&config, "Labels", labels_variant(client));
+    }
+    if (client->timeout) {
+        /* SECONDS[:GRACE] */
+        gchar *grace = NULL;
+        g_variant_dict_insert(&config, "Timeout", "u",
+                              (guint32) g_ascii_strtoull(client->timeout, &grace, 10));
+        if (*grace == ':') {
+            g_variant_dict_insert(&config, "TimeoutGracePeriod", "u",
+                                  (guint32) g_ascii_strtoull(grace + 1, NULL, 10));
+        }
+    }
+    if (client->exec_command && client->use_terminal) {
+        g_variant_dict_insert(&config, "Terminal", "b", TRUE);
+    }
+    if (client->compress_output) {
+        g_variant_dict_insert(&config, "CompressOutput", "b", TRUE);
+    }
+    if (client->binds) {
+        g_variant_dict_insert_value(&config, "Mounts", mounts_variant(client));
+    }
+    if (client->scratch) {
+        g_variant_dict_insert_value(&config, "Scratch", scratch_variant(client));
+    }
+
+    contejner_client_configure(client->lib, client->container_name,
+                               g_variant_dict_end(&config), NULL,
+                               configured_cb, client);
+}
+
+static void resize_terminal (struct client *client)
+{
+    struct winsize ws;
+    if (ioctl(STDIN_FILENO, TIOCGWINSZ, &ws)) {
+        return;
+    }
+
+    contejner_client_call(client->lib, client->container_name, "ResizeTerminal",
+                          g_variant_new("(qq)", ws.ws_row, ws.ws_col),
+                          NULL, NULL, NULL);
+}
+
+static void terminal_attached_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
     GError *error = NULL;
-    gchar *command = g_strdup_printf("%s.Connect", client->container_name);
     GUnixFDList *fd_list = NULL;
+    GVariant *retval = call_finish(client, res, &fd_list);
 
-    g_dbus_connection_signal_subscribe (
-            g_dbus_proxy_get_connection(client->container_proxy),
-            g_dbus_proxy_get_name(client->container_proxy),
-            /* TODO: Why doesn't the below work? */
-            NULL,//g_dbus_proxy_get_interface_name(client->container_proxy),
-            "StatusChanged",
-            g_dbus_proxy_get_object_path(client->container_proxy),
-            NULL,
-            G_DBUS_SIGNAL_FLAGS_NONE,
-            status_change_cb,
-            client,
-            NULL);
-
-    g_dbus_proxy_call_with_unix_fd_list_sync (client->container_proxy,
-                                              command,
-                                              NULL,
-                                              G_DBUS_PROXY_FLAGS_NONE,
-                                              -1,
-                                              NULL,
-                                              &fd_list,
-                                              NULL,
-                                              &error);
-    g_free (command);
-    if (error) {
-        g_error("Failed to call Connect");
-    }
-
-    if (g_unix_fd_list_get_length(fd_list) != 2) {
+    if (!fd_list || g_unix_fd_list_get_length(fd_list) != 1) {
         g_error ("Received invalid fd list");
     }
-    client->stdout_fd = g_unix_fd_list_get(fd_list, 0, &error);
+    client->terminal_fd = g_unix_fd_list_get(fd_list, 0, &error);
     if (error) { g_error ("Failed to get file descriptor"); }
+    g_object_unref(fd_list);
+    g_variant_unref(retval);
 
-    client->stderr_fd = g_unix_fd_list_get(fd_list, 1, &error);
-    if (error) { g_error ("Failed to get file descriptor"); }
+    resize_terminal(client);
+    next_step(client);
+}
 
-    int flags = fcntl(client->stdout_fd, F_GETFL, 0);
-    fcntl(client->stdout_fd, F_SETFL, flags | O_NONBLOCK);
-    flags = fcntl(client->stderr_fd, F_GETFL, 0);
-    fcntl(client->stderr_fd, F_SETFL, flags | O_NONBLOCK);
+static void attach_terminal (struct client *client)
+{
+    call(client, client->container_name, "AttachTerminal", NULL,
+         terminal_attached_cb);
+}
 
-    g_idle_add(process_output, client);
+static void winch_handler (int signal)
+{
+    char c = 0;
+    if (write(winch_pipe[1], &c, 1)) { /* Nothing to do */ }
 }
 
-static gboolean open_container (struct client *client)
+static gboolean winch_cb (gint fd, GIOCondition condition, gpointer user_data)
 {
-    GError *error = NULL;
-    client->container_proxy =
-        g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
-                                       G_DBUS_PROXY_FLAGS_NONE,
-                                       NULL,
-                                       "org.jonatan.Contejner",
-                                       "/org/jonatan/Contejner/Containers",
-                                       client->container_name,
-                                       NULL,
-                                       &error);
-    if (error) {
-        g_error("Failed to create proxy for %s", client->container_name);
-        return FALSE;
-    }
+    char buf[16];
+    while (read(fd, buf, sizeof(buf)) > 0) { /* Drain */ }
+    resize_terminal(user_data);
+    return G_SOURCE_CONTINUE;
+}
 
+static gboolean write_all (int fd, const char *buf, ssize_t len)
+{
+    while (len > 0) {
+        ssize_t w = write(fd, buf, len);
+        if (w == -1) {
+            return FALSE;
+        }
+        buf += w;
+        len -= w;
+    }
     return TRUE;
 }
 
-static char *create (struct client *client)
+static void stop_terminal (struct client *client)
 {
+    if (client->termios_saved) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &client->saved_termios);
+        client->termios_saved = FALSE;
+    }
+    g_main_loop_quit(client->loop);
+}
+
+static gboolean terminal_output_cb (gint fd, GIOCondition condition, gpointer user_data)
+{
+    char buf[64 * 1024];
+    ssize_t r = read(fd, buf, sizeof(buf));
+    if (r <= 0 || !write_all(STDOUT_FILENO, buf, r)) {
+        stop_terminal(user_data);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean terminal_input_cb (gint fd, GIOCondition condition, gpointer user_data)
+{
+    struct client *client = user_data;
+    char buf[4096];
+    ssize_t r = read(fd, buf, sizeof(buf));
+    if (r <= 0) {
+        /* Out of input, but keep showing output */
+        return G_SOURCE_REMOVE;
+    }
+    if (!write_all(client->terminal_fd, buf, r)) {
+        stop_terminal(client);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static void start_terminal (struct client *client)
+{
+    if (isatty(STDIN_FILENO) &&
+        !tcgetattr(STDIN_FILENO, &client->saved_termios)) {
+        struct termios raw = client->saved_termios;
+        cfmakeraw(&raw);
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        client->termios_saved = TRUE;
+
+        if (!pipe2(winch_pipe, O_CLOEXEC | O_NONBLOCK)) {
+            struct sigaction sa = { 0 };
+            sa.sa_handler = winch_handler;
+            sa.sa_flags = SA_RESTART;
+            sigaction(SIGWINCH, &sa, NULL);
+            g_unix_fd_add(winch_pipe[0], G_IO_IN, winch_cb, client);
+        }
+    }
+
+    g_unix_fd_add(client->terminal_fd, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                  terminal_output_cb, client);
+    g_unix_fd_add(STDIN_FILENO, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                  terminal_input_cb, client);
+}
+
+static void created_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
     GError *error = NULL;
-    gchar *interface = NULL;
+    gchar *interface = contejner_client_create_finish(client->lib, res, &error);
+
+    if (!interface) {
+        g_error("Failed to call Create: %s", error->message);
+    }
+
+    if (client->do_create) {
+        g_print ("Created new container: %s", interface);
+    }
 
-    GVariant *retval = g_dbus_proxy_call_sync (client->manager_proxy,
-                                               "org.jonatan.Contejner.Create",
-                                               NULL,
-                                               G_DBUS_PROXY_FLAGS_NONE,
-                                               -1,
-                                               NULL,
-                                               &error);
-    if (retval) {
-        g_variant_get (retval, "(s)", &interface);
-        g_variant_unref (retval);
-    } else if (error) {
-        g_error("Failed to call Create");
+    /* The command is run in the new container */
+    if (!client->container_name) {
+        client->container_name = interface;
+    } else {
+        g_free (interface);
     }
+    next_step(client);
+}
 
-    return interface;
+static void create (struct client *client)
+{
+    contejner_client_create(client->lib, NULL, created_cb, client);
 }
 
-static void set_command (struct client *client)
+static void ran_cb (GObject *source, GAsyncResult *res, gpointer user_data)
 {
+    struct client *client = user_data;
     GError *error = NULL;
-    gchar *command = g_strdup_printf("%s.SetCommand", client->container_name);
-    GVariant *params = g_variant_new("(s^as)",
-                                     client->exec_command,
-                                     client->exec_command_args);
 
-    g_dbus_proxy_call_sync (client->container_proxy,
-                            command,
-                            params,
-                            G_DBUS_PROXY_FLAGS_NONE,
-                            -1,
-                            NULL,
-                            &error);
-    g_free (command);
-    if (error) {
-        g_error("Failed to call SetCommand");
+    if (!contejner_client_run_finish(client->lib, res, &error)) {
+        g_error("Failed to call Run: %s", error->message);
     }
+    next_step(client);
 }
 
 static void run (struct client *client)
 {
-    GError *error = NULL;
-    gchar *command = g_strdup_printf("%s.Run", client->container_name);
-    g_dbus_proxy_call_sync (client->container_proxy,
-                            command,
-                            NULL,
-                            G_DBUS_PROXY_FLAGS_NONE,
-                            -1,
-                            NULL,
-                            &error);
-    g_free (command);
-    if (error) {
-        g_error("Failed to call Run");
+    contejner_client_run(client->lib, client->container_name, NULL,
+                         ran_cb, client);
+}
+
+static void tail_read_cb (GObject *source, GAsyncResult *res, gpointer user_data);
+
+static void tail_read (struct client *client)
+{
+    call(client, client->container_name, "ReadOutput",
+         g_variant_new("(sxts)", "stdout", client->tail_from, (guint64) 0,
+                       client->tail_unit),
+         tail_read_cb);
+}
+
+static void tail_read_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
+    GVariant *retval = call_finish(client, res, NULL);
+    GVariant *data = NULL;
+    guint64 offset = 0, next = 0;
+    gsize len = 0;
+
+    g_variant_get(retval, "(@aytt)", &data, &offset, &next);
+    const char *buf = g_variant_get_fixed_array(data, &len, 1);
+    fwrite(buf, 1, len, stdout);
+    g_variant_unref(data);
+    g_variant_unref(retval);
+
+    /* Long output is returned in parts, continue by offset until the end */
+    if (len) {
+        client->tail_from = next;
+        client->tail_unit = "bytes";
+        tail_read(client);
+        return;
     }
+
+    fflush(stdout);
+    next_step(client);
+}
+
+static void tail (struct client *client)
+{
+    client->tail_from = -client->tail_lines;
+    client->tail_unit = "lines";
+    tail_read(client);
 }
 
 static void kill_ (struct client *client)
 {
-    GError *error = NULL;
-    gchar *command = g_strdup_printf("%s.Kill", client->container_name);
-    GVariant *params = g_variant_new("(i)", client->kill_signal);
-    g_dbus_proxy_call_sync (client->container_proxy,
-                            command,
-                            params,
-                            G_DBUS_PROXY_FLAGS_NONE,
-                            -1,
-                            NULL,
-                            &error);
-    g_free (command);
-    if (error) {
-        g_error("Failed to call Kill");
+    call(client, client->container_name, "Kill",
+         g_variant_new("(i)", client->kill_signal), NULL);
+}
+
+static void stop_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
+    GVariant *retval = call_finish(client, res, NULL);
+
+    g_variant_get(retval, "(i)", &client->exit_status);
+    g_variant_unref(retval);
+    /* Unknown for containers adopted after a restart */
+    if (client->exit_status < 0) {
+        client->exit_status = 0;
+    }
+    next_step(client);
+}
+
+static void stop (struct client *client)
+{
+    call(client, client->container_name, "Stop",
+         g_variant_new("(u)", client->stop_grace), stop_cb);
+}
+
+static void freeze (struct client *client)
+{
+    call(client, client->container_name, "Freeze", NULL, NULL);
+}
+
+static void thaw (struct client *client)
+{
+    call(client, client->container_name, "Thaw", NULL, NULL);
+}
+
+static void exec_done_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
+    GVariant *retval = call_finish(client, res, NULL);
+    GVariant *out = NULL, *err = NULL;
+    gsize len = 0;
+    const char *buf;
+
+    g_variant_get(retval, "(i@ay@ay)", &client->exit_status, &out, &err);
+    buf = g_variant_get_fixed_array(out, &len, 1);
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+    buf = g_variant_get_fixed_array(err, &len, 1);
+    fwrite(buf, 1, len, stderr);
+
+    g_variant_unref(out);
+    g_variant_unref(err);
+    g_variant_unref(retval);
+    next_step(client);
+}
+
+static void exec_in (struct client *client)
+{
+    gchar **command_and_args = g_strsplit(client->exec_in, " ", -1);
+
+    call(client, client->container_name, "Exec",
+         g_variant_new("(s^as@a{sv})",
+                       command_and_args[0],
+                       command_and_args + 1,
+                       g_variant_new("a{sv}", NULL)),
+         exec_done_cb);
+    g_strfreev (command_and_args);
+}
+
+static void kill_matching_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
+    GVariant *retval = call_finish(client, res, NULL);
+    guint count = 0;
+
+    g_variant_get(retval, "(u)", &count);
+    g_print("Killed %u containers", count);
+    g_variant_unref(retval);
+    next_step(client);
+}
+
+static void kill_matching (struct client *client)
+{
+    call(client, NULL, "KillMatching",
+         g_variant_new("(si)", client->selector, client->kill_signal),
+         kill_matching_cb);
+}
+
+static void destroy_matching_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
+    GVariant *retval = call_finish(client, res, NULL);
+    guint count = 0;
+
+    g_variant_get(retval, "(u)", &count);
+    g_print("Destroyed %u containers", count);
+    g_variant_unref(retval);
+    next_step(client);
+}
+
+static void destroy_matching (struct client *client)
+{
+    call(client, NULL, "DestroyMatching",
+         g_variant_new("(s)", client->selector),
+         destroy_matching_cb);
+}
+
+static void status_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct listed *listed = user_data;
+    struct listing *listing = listed->listing;
+    struct client *client = listing->client;
+    GVariant *status;
+    guint i;
+
+    status = contejner_client_get_property_finish(client->lib, res, NULL);
+    if (status) {
+        listing->statuses[listed->index] = g_variant_dup_string(status, NULL);
+        g_variant_unref(status);
+    }
+    g_free(listed);
+
+    if (--listing->pending) {
+        return;
+    }
+
+    for (i = 0; listing->names[i]; i++) {
+        g_print(" - %s [ %s ]", listing->names[i], listing->statuses[i]);
     }
+
+    g_strfreev(listing->names);
+    g_strfreev(listing->statuses);
+    g_free(listing);
+    next_step(client);
 }
 
-static void list_containers(struct client *client)
+static void listed_cb (GObject *source, GAsyncResult *res, gpointer user_data)
 {
+    struct client *client = user_data;
     GError *error = NULL;
-    GDBusObjectManager *mgr = g_dbus_object_manager_client_new_for_bus_sync (
-                                     G_BUS_TYPE_SESSION,
-                                     G_DBUS_OBJECT_MANAGER_CLIENT_FLAGS_NONE,
-                                     "org.jonatan.Contejner",
-                                     "/org/jonatan/Contejner",
-                                     NULL,
-                                     NULL,
-                                     NULL,
-                                     NULL,
-                                     &error);
-    if (mgr) {
-        GList *objects = g_dbus_object_manager_get_objects(mgr);
-        GList *l;
-        for (l = objects; l != NULL; l = l->next)
-        {
-            GDBusObject *o = G_DBUS_OBJECT(l->data);
-            GList *ifaces = g_dbus_object_get_interfaces(o);
-            GList *ll;
-            for (ll = ifaces; ll != NULL; ll = ll->next)
-            {
-                char *status = NULL;
-                GDBusInterface *interface = G_DBUS_INTERFACE(ll->data);
-                const char *name =
-                    g_dbus_proxy_get_interface_name(G_DBUS_PROXY(interface));
-                GDBusProxy *proxy = G_DBUS_PROXY(interface);
-                GVariant *v = g_dbus_connection_call_sync (
-                                g_dbus_proxy_get_connection(proxy),
-                                g_dbus_proxy_get_name(proxy),
-                                g_dbus_proxy_get_object_path(proxy),
-                                "org.freedesktop.DBus.Properties",
-                                "Get",
-                                g_variant_new("(ss)", name, "Status"),
-                                G_VARIANT_TYPE("(v)"),
-                                G_DBUS_CALL_FLAGS_NONE,
-                                -1,
-                                NULL,
-                                &error);
-
-                if (v) {
-                    GVariant *vv = NULL;
-                    g_variant_get_child(v, 0, "v", &vv);
-                    g_variant_get(vv, "(s)", &status);
-                }
-
-                g_print(" - %s [ %s ]", name, status);
-                g_object_unref(ll->data);
-            }
-            g_list_free(ifaces);
-            g_object_unref(l->data);
+    gchar **names = contejner_client_list_finish(client->lib, res, &error);
+    struct listing *listing;
+    guint i;
+
+    if (!names) {
+        g_error("Failed to call List: %s", error->message);
+    }
+
+    if (client->selector || !names[0]) {
+        for (i = 0; names[i]; i++) {
+            g_print(" - %s", names[i]);
         }
-        g_list_free(objects);
-    } else {
-        g_print("Failed to list containers");
+        g_strfreev(names);
+        next_step(client);
+        return;
+    }
+
+    /* Ask for the status of all containers at once */
+    listing = g_new0(struct listing, 1);
+    listing->client = client;
+    listing->names = names;
+    listing->pending = g_strv_length(names);
+    listing->statuses = g_new0(gchar *, listing->pending + 1);
+
+    for (i = 0; names[i]; i++) {
+        struct listed *listed = g_new0(struct listed, 1);
+        listed->listing = listing;
+        listed->index = i;
+        contejner_client_get_property(client->lib, names[i], "Status", NULL,
+                                      status_cb, listed);
+    }
+}
+
+static void list (struct client *client)
+{
+    contejner_client_list(client->lib, client->selector, NULL,
+                          listed_cb, client);
+}
+
+static const char *board_statuses[] = {
+    [CONTEJNER_BOARD_STATUS_RUNNING] = "RUNNING",
+    [CONTEJNER_BOARD_STATUS_STOPPED] = "STOPPED",
+    [CONTEJNER_BOARD_STATUS_CREATED] = "CREATED",
+    [CONTEJNER_BOARD_STATUS_QUEUED] = "QUEUED",
+    [CONTEJNER_BOARD_STATUS_FROZEN] = "FROZEN",
+};
+
+static void print_board (const void *board)
+{
+    const struct contejner_board_header *header = board;
+    struct contejner_board_record record;
+    guint32 used = __atomic_load_n(&header->used, __ATOMIC_ACQUIRE);
+    guint32 slot;
+
+    for (slot = 0; slot < used; slot++) {
+        contejner_board_read(board, slot, &record);
+        if (record.id == -1 || record.status < 0 ||
+            record.status >= (gint) G_N_ELEMENTS(board_statuses)) {
+            continue;
+        }
+        g_print("Container%d %s pid %d exit %d runs %" G_GUINT64_FORMAT
+                " oom-kills %" G_GUINT64_FORMAT "%s",
+                record.id, board_statuses[record.status], record.pid,
+                record.exit_status, record.runs, record.oom_kills,
+                record.flags & CONTEJNER_BOARD_TIMED_OUT ? " timed-out" : "");
     }
 }
 
-static void proxy_ready (GObject *source_object,
-                         GAsyncResult *res,
-                         gpointer user_data)
+static void status_board_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
+    GUnixFDList *fd_list = NULL;
+    GVariant *retval = call_finish(client, res, &fd_list);
+    const struct contejner_board_header *header;
+    gint32 handle = 0;
+    struct stat st;
+    void *board;
+    int fd;
+
+    g_variant_get(retval, "(h)", &handle);
+    g_variant_unref(retval);
+    fd = fd_list ? g_unix_fd_list_get(fd_list, handle, NULL) : -1;
+    if (fd == -1 || fstat(fd, &st)) {
+        g_error("Received no status board");
+    }
+    g_object_unref(fd_list);
+
+    board = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (board == MAP_FAILED) {
+        g_error("Failed to map status board: %s", strerror(errno));
+    }
+
+    header = board;
+    if (header->magic != CONTEJNER_BOARD_MAGIC ||
+        header->version != CONTEJNER_BOARD_VERSION) {
+        g_error("Unknown status board layout");
+    }
+    print_board(board);
+
+    munmap(board, st.st_size);
+    next_step(client);
+}
+
+/* Read the state of all containers from the status board */
+static void status_board (struct client *client)
+{
+    call(client, NULL, "OpenStatusBoard", NULL, status_board_cb);
+}
+
+/* Print the events not printed yet, and note when some were missed */
+static void print_events (struct client *client, GVariant *events)
+{
+    GVariantIter iter;
+    guint64 seq;
+    const gchar *container, *type, *detail;
+
+    g_variant_iter_init(&iter, events);
+    while (g_variant_iter_next(&iter, "(t&s&s&s)", &seq, &container, &type, &detail)) {
+        if (seq <= client->last_event) {
+            continue;
+        }
+        if (client->last_event && seq > client->last_event + 1) {
+            g_print("Missed %" G_GUINT64_FORMAT " events", seq - client->last_event - 1);
+        }
+        if (*detail) {
+            g_print("%" G_GUINT64_FORMAT " %s %s %s", seq, container, type, detail);
+        } else {
+            g_print("%" G_GUINT64_FORMAT " %s %s", seq, container, type);
+        }
+        client->last_event = seq;
+    }
+}
+
+static void events_cb (ContejnerClient *lib,
+                       GVariant *events,
+                       gpointer user_data)
+{
+    print_events(user_data, events);
+}
+
+static void kept_events_cb (GObject *source, GAsyncResult *res, gpointer user_data)
+{
+    struct client *client = user_data;
+    GVariant *retval = call_finish(client, res, NULL);
+    GVariant *events = g_variant_get_child_value(retval, 0);
+
+    print_events(client, events);
+    g_variant_unref(events);
+    g_variant_unref(retval);
+}
+
+/* Print the events kept by the service, then new events as they come. The
+ * client is subscribed to the events already, so nothing is missed. */
+static void watch_events (struct client *client)
+{
+    g_signal_connect(client->lib, "events", G_CALLBACK(events_cb), client);
+    call(client, NULL, "GetEventsSince", g_variant_new("(t)", (guint64) 0),
+         kept_events_cb);
+}
+
+static void client_ready (GObject *source_object,
+                          GAsyncResult *res,
+                          gpointer user_data)
 {
     GError *error = NULL;
     struct client *client = user_data;
-    client->manager_proxy = g_dbus_proxy_new_for_bus_finish(res, &error);
-    if (error) {
+    client->lib = contejner_client_new_finish(res, &error);
+    if (!client->lib) {
         g_error ("Failed to connect to Contejner service");
     }
 
     if (client->do_create) {
-            gchar *interface = create(client);
-            g_print ("Created new container: %s", interface);
-            g_free (interface);
+        add_step(client, create);
     }
     if (client->do_list) {
-            list_containers(client);
+        add_step(client, list);
+    }
+    if (client->selector && client->kill_signal) {
+        add_step(client, kill_matching);
+    }
+    if (client->do_destroy) {
+        add_step(client, destroy_matching);
+    }
+    if (client->do_board) {
+        add_step(client, status_board);
     }
     if (client->exec_command) {
-        if (!client->container_name) {
-            client->container_name = create(client);
+        if (!client->container_name && !client->do_create) {
+            add_step(client, create);
         }
-
-        open_container(client);
-        set_command(client);
-        run(client);
-    } if (client->kill_signal) {
-        open_container(client);
-        kill_(client);
+        add_step(client, configure);
+        if (client->use_terminal) {
+            /* Attach before running, so that no output is missed */
+            add_step(client, attach_terminal);
+        }
+        add_step(client, run);
+    } else if (client->use_terminal) {
+        add_step(client, attach_terminal);
+    } else if (client->labels) {
+        add_step(client, configure);
+    } if (client->kill_signal && !client->selector) {
+        add_step(client, kill_);
+    } if (client->stop) {
+        add_step(client, stop);
+    } if (client->do_freeze) {
+        add_step(client, freeze);
+    } if (client->do_thaw) {
+        add_step(client, thaw);
+    } if (client->tail_lines) {
+        add_step(client, tail);
+    } if (client->exec_in) {
+        add_step(client, exec_in);
     }
 
-    /* Stop main loop if we are not connecting */
-    if (client->do_connect) {
-        open_container(client);
-        connect (client);
-    } else {
-        g_main_loop_quit(client->loop);
+    /* The main loop stops after the last step, unless it keeps running */
+    if (client->use_terminal) {
+        add_step(client, start_terminal);
+    } else if (client->do_connect) {
+        add_step(client, connect);
+    } else if (client->do_events) {
+        add_step(client, watch_events);
     }
+
+    next_step(client);
 }
 
 static void print_func (const gchar *string)
 {
     printf("%s\n", string);
 }
-
 int main(int argc, char **argv) {
     GError *error = NULL;
     GOptionContext *context;
@@ -365,8 +975,29 @@ int main(int argc, char **argv) {
         { "list", 'l', 0, G_OPTION_ARG_NONE, &client.do_list, "List available containers", NULL },
         { "new", 'n', 0, G_OPTION_ARG_NONE, &client.do_create, "Create new container", NULL },
         { "container", 'c', 0, G_OPTION_ARG_STRING, &container_name, "Container to operate on", NULL },
-        { "connect-output", 'o', 0, G_OPTION_ARG_NONE, &client.do_connect, "Connect to stdout & stderr on container", NULL },
+        { "connect-output", 'o', 0, G_OPTION_ARG_NONE, &client.do_connect, "Connect to stdout & stderr on container until it stops, and exit with its status", NULL },
         { "kill", 'k', 0, G_OPTION_ARG_INT, &client.kill_signal, "Kill container with the supplied signal. Use integer value for signal. ", NULL },
+        { "stop", 0, 0, G_OPTION_ARG_STRING, &client.stop, "Stop the container with SIGTERM, and SIGKILL after GRACE milliseconds, and exit with its status once all its processes are gone", "GRACE" },
+        { "freeze", 0, 0, G_OPTION_ARG_NONE, &client.do_freeze, "Freeze all processes of the container", NULL },
+        { "thaw", 0, 0, G_OPTION_ARG_NONE, &client.do_thaw, "Thaw a frozen container", NULL },
+        { "label", 0, 0, G_OPTION_ARG_STRING_ARRAY, &client.labels, "Label the container, can be repeated", "KEY=VALUE" },
+        { "selector", 's', 0, G_OPTION_ARG_STRING, &client.selector, "Operate on the containers with matching labels (--list, --kill and --destroy), e.g. team=x,stage!=prod", "SELECTOR" },
+        { "destroy", 0, 0, G_OPTION_ARG_NONE, &client.do_destroy, "Destroy the stopped containers matching --selector", NULL },
+        { "status-board", 0, 0, G_OPTION_ARG_NONE, &client.do_board, "Print the state of all containers, as read from the shared status board", NULL },
+        { "events", 'w', 0, G_OPTION_ARG_NONE, &client.do_events, "Watch the lifecycle events of all containers", NULL },
+        { "exec", 'x', 0, G_OPTION_ARG_STRING, &client.exec_in, "Run a command in a running container, and exit with its status", "CMD" },
+        { "terminal", 't', 0, G_OPTION_ARG_NONE, &client.use_terminal, "Run with, or attach to, an interactive terminal", NULL },
+        { "tail", 0, 0, G_OPTION_ARG_INT, &client.tail_lines, "Print the last N lines of output of the container", "N" },
+        { "bind", 0, 0, G_OPTION_ARG_STRING_ARRAY, &client.binds, "Bind mount the HOST directory at PATH in the container, read-only (ro) and/or with the mounts below it (rec), can be repeated", "HOST:PATH[:ro,rec]" },
+        { "scratch", 0, 0, G_OPTION_ARG_STRING_ARRAY, &client.scratch, "Mount a tmpfs of at most SIZE bytes (or K, M, G) at PATH in the container, can be repeated", "PATH=SIZE" },
+        { "compress-output", 0, 0, G_OPTION_ARG_NONE, &client.compress_output, "Keep the output of the command compressed", NULL },
+        { "cpus", 0, 0, G_OPTION_ARG_STRING, &client.cpuset, "CPUs the command may run on, e.g. 0-3,8", "LIST" },
+        { "mem-nodes", 0, 0, G_OPTION_ARG_STRING, &client.mem_nodes, "NUMA nodes the command may allocate memory on", "LIST" },
+        { "nice", 0, 0, G_OPTION_ARG_STRING, &client.nice, "Nice value of the command, -20 to 19", "N" },
+        { "sched-policy", 0, 0, G_OPTION_ARG_STRING, &client.sched_policy, "Scheduling policy of the command: OTHER, BATCH or IDLE", "POLICY" },
+        { "timeout", 0, 0, G_OPTION_ARG_STRING, &client.timeout, "Send SIGTERM to the command after SECONDS, and SIGKILL GRACE seconds later (10 by default)", "SECONDS[:GRACE]" },
+        { "io-priority", 0, 0, G_OPTION_ARG_STRING, &client.io_priority, "I/O priority of the command, e.g. best-effort/7 or idle", "CLASS[/LEVEL]" },
+        { "restart", 0, 0, G_OPTION_ARG_STRING, &client.restart_policy, "Run the command again when it stops: never, on-failure or always", "POLICY" },
         { NULL }
     };
 
@@ -380,13 +1011,94 @@ int main(int argc, char **argv) {
 
     if (client.kill_signal) {
         if (client.do_connect || client.do_create || client.do_list || command) {
-            g_error("--kill must only be used together with --container");
+            g_error("--kill must only be used together with --container or --selector");
+        }
+        if (!container_name && !client.selector) {
+            g_error("--container or --selector is required when supplying --kill");
+        }
+    }
+
+    if (client.stop) {
+        guint64 grace;
+
+        if (!g_ascii_string_to_unsigned(client.stop, 10, 0, G_MAXUINT32,
+                                        &grace, NULL)) {
+            g_error("--stop requires a number of milliseconds");
+        }
+        if (!container_name || command || client.do_create) {
+            g_error("--stop must only be used together with --container");
+        }
+        client.stop_grace = grace;
+    }
+
+    if (client.do_events) {
+        if (client.do_connect || client.use_terminal) {
+            g_error("--events can not be combined with --connect-output or --terminal");
+        }
+        /* Events are printed as they come, also when piped */
+        setvbuf(stdout, NULL, _IOLBF, 0);
+    }
+
+    if (client.do_destroy && !client.selector) {
+        g_error("--selector is required when supplying --destroy");
+    }
+
+    if (client.selector && container_name) {
+        g_error("--selector can not be combined with --container");
+    }
+
+    if (client.labels && !command && !container_name) {
+        g_error("--label requires --execute or --container");
+    }
+
+    if (client.do_freeze || client.do_thaw) {
+        if (client.do_freeze && client.do_thaw) {
+            g_error("--freeze and --thaw can not be combined");
         }
         if (!container_name) {
-            g_error("--container is required when supplying --kill");
+            g_error("--container is required when supplying --freeze or --thaw");
         }
     }
 
+    if (client.tail_lines) {
+        if (client.tail_lines < 0) {
+            g_error("--tail requires a positive number of lines");
+        }
+        if (!container_name) {
+            g_error("--container is required when supplying --tail");
+        }
+    }
+
+    if (client.exec_in) {
+        if (command || client.do_create) {
+            g_error("--exec can not be combined with --execute or --new");
+        }
+        if (!container_name) {
+            g_error("--container is required when supplying --exec");
+        }
+    }
+
+    if (client.use_terminal) {
+        if (client.do_connect) {
+            g_error("--terminal can not be combined with --connect-output");
+        }
+        if (!command && !container_name) {
+            g_error("--terminal requires --execute or --container");
+        }
+    }
+
+    if ((client.cpuset || client.mem_nodes) && !command) {
+        g_error("--cpus and --mem-nodes require --execute");
+    }
+
+    if ((client.nice || client.sched_policy || client.io_priority) && !command) {
+        g_error("--nice, --sched-policy and --io-priority require --execute");
+    }
+
+    if (client.restart_policy && !command) {
+        g_error("--restart requires --execute");
+    }
+
     if (command) {
         gchar **command_and_args = g_strsplit(command, " ", -1);
         client.exec_command = command_and_args[0];
@@ -405,17 +1117,10 @@ int main(int argc, char **argv) {
 
     g_set_print_handler(print_func);
 
-    g_dbus_proxy_new_for_bus (G_BUS_TYPE_SESSION,
-                              G_DBUS_PROXY_FLAGS_NONE,
-                              NULL,
-                              "org.jonatan.Contejner",
-                              "/org/jonatan/Contejner",
-                              "org.jonatan.Contejner",
-                              NULL,
-                              proxy_ready,
-                              &client);
+    g_queue_init(&client.steps);
+    contejner_client_new(NULL, client_ready, &client);
 
     client.loop = g_main_loop_new (NULL, FALSE);
     g_main_loop_run (client.loop);
-    return 0;
+    return client.exit_status;
 }
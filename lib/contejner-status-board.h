@@ -0,0 +1,110 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CONTEJNER_STATUS_BOARD_H
+#define CONTEJNER_STATUS_BOARD_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * The status board: a table of the state of all containers, which the
+ * service keeps in a memfd. OpenStatusBoard of the manager returns a read
+ * only descriptor of it, which readers map once, after which they see the
+ * current state without any system calls.
+ *
+ * The board is a header followed by records of fixed size. A record is
+ * in use when its id is not -1. Slots are reused once their container is
+ * destroyed, and only slots below the used field have ever been in use.
+ * The service updates each record under a sequence lock: the sequence
+ * number is odd while the record is being written, so readers copy a
+ * record with contejner_board_read() and retry when it changed meanwhile.
+ *
+ * The layout only changes together with the version.
+ */
+
+#define CONTEJNER_BOARD_MAGIC 0x424a5443  /* "CTJB" */
+#define CONTEJNER_BOARD_VERSION 1
+
+/* Values of the status field, as the Status property */
+enum {
+    CONTEJNER_BOARD_STATUS_RUNNING,
+    CONTEJNER_BOARD_STATUS_STOPPED,
+    CONTEJNER_BOARD_STATUS_CREATED,
+    CONTEJNER_BOARD_STATUS_QUEUED,
+    CONTEJNER_BOARD_STATUS_FROZEN,
+};
+
+/* Bits of the flags field, about the current or last run */
+enum {
+    CONTEJNER_BOARD_OOM_KILLED = 1 << 0,
+    CONTEJNER_BOARD_TIMED_OUT = 1 << 1,
+};
+
+struct contejner_board_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t record_size;
+    uint32_t capacity;
+    uint32_t used;
+    uint32_t reserved[10];
+};
+
+struct contejner_board_record {
+    uint32_t seq;
+    int32_t id;
+    int32_t status;
+    /* Of the init process, 0 when the container is not running */
+    int32_t pid;
+    /* Of the last run, 128 + signal if killed, -1 if unknown */
+    int32_t exit_status;
+    uint32_t flags;
+    /* Wall clock time in microseconds, 0 if the container never ran. The
+     * stop time is 0 while the container runs. */
+    int64_t start_time;
+    int64_t stop_time;
+    uint64_t runs;
+    /* Of the current or last run */
+    uint64_t oom_kills;
+    uint64_t memory_high_events;
+    uint64_t memory_max_events;
+    uint64_t reserved[6];
+};
+
+/* Copy record @slot of the board mapped at @board into @record */
+static inline void contejner_board_read(const void *board,
+                                        uint32_t slot,
+                                        struct contejner_board_record *record)
+{
+    const struct contejner_board_header *header = board;
+    const struct contejner_board_record *shared =
+        (const struct contejner_board_record *)
+        ((const char *) board + header->header_size +
+         (size_t) slot * header->record_size);
+    uint32_t seq;
+
+    do {
+        while ((seq = __atomic_load_n(&shared->seq, __ATOMIC_ACQUIRE)) & 1);
+        memcpy(record, shared, sizeof(*record));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&shared->seq, __ATOMIC_RELAXED) != seq);
+}
+
+#endif /* CONTEJNER_STATUS_BOARD_H */
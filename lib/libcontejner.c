@@ -0,0 +1,992 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <fcntl.h>
+#include <gio/gunixinputstream.h>
+#include "libcontejner.h"
+
+#define CONTEJNER_BUS_NAME "org.jonatan.Contejner"
+#define CONTEJNER_MANAGER_PATH "/org/jonatan/Contejner"
+#define CONTEJNER_CONTAINERS_PATH "/org/jonatan/Contejner/Containers"
+
+struct _ContejnerClient
+{
+  GObject parent_instance;
+
+  // instance variables for subclass go here
+};
+
+typedef struct _ContejnerClientPrivate ContejnerClientPrivate;
+
+struct _ContejnerClientPrivate {
+    GDBusProxy *manager;
+
+    /* Container name -> GDBusProxy */
+    GHashTable *proxies;
+
+    /* Container name -> list of struct waiter */
+    GHashTable *waiters;
+};
+
+/* A contejner_client_wait() call */
+struct waiter {
+    GTask *task;
+    gchar *name;
+    GSource *cancelled;
+
+    /* Replies to the status query sent when the wait starts */
+    guint pending;
+    GVariant *status;
+    GVariant *exit_status;
+    GError *error;
+};
+
+/* Calls sent together, completing the task when all have replied */
+struct batch {
+    GTask *task;
+    guint pending;
+    GError *error;
+};
+
+struct call_result {
+    GVariant *value;
+    GUnixFDList *fd_list;
+};
+
+struct open_output_result {
+    GInputStream *stream;
+    guint64 offset;
+};
+
+enum {
+    SIGNAL_EVENTS,
+    N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+#define CONTEJNER_CLIENT_GET_PRIVATE(object)                           \
+          (G_TYPE_INSTANCE_GET_PRIVATE((object),                       \
+                                       contejner_client_get_type(),     \
+                                       ContejnerClientPrivate))
+
+G_DEFINE_TYPE(ContejnerClient, contejner_client, G_TYPE_OBJECT)
+
+static void contejner_client_init (ContejnerClient *client)
+{
+    ContejnerClientPrivate *priv = CONTEJNER_CLIENT_GET_PRIVATE(client);
+
+    priv->proxies = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          g_free, g_object_unref);
+    priv->waiters = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          g_free, NULL);
+}
+
+static void contejner_client_finalize (GObject *object)
+{
+    ContejnerClientPrivate *priv = CONTEJNER_CLIENT_GET_PRIVATE(object);
+
+    /* Every waiter holds a reference to the client through its task, so
+     * there are none left here */
+    g_hash_table_unref(priv->waiters);
+    g_hash_table_unref(priv->proxies);
+
+    if (priv->manager) {
+        g_signal_handlers_disconnect_by_data(priv->manager, object);
+        g_object_unref(priv->manager);
+    }
+
+    G_OBJECT_CLASS(contejner_client_parent_class)->finalize(object);
+}
+
+static void contejner_client_class_init (ContejnerClientClass *class)
+{
+    g_type_class_add_private(class, sizeof(ContejnerClientPrivate));
+    G_OBJECT_CLASS(class)->finalize = contejner_client_finalize;
+
+    signals[SIGNAL_EVENTS] = g_signal_new("events",
+                                          G_TYPE_FROM_CLASS(class),
+                                          G_SIGNAL_RUN_LAST,
+                                          0, NULL, NULL, NULL,
+                                          G_TYPE_NONE, 1, G_TYPE_VARIANT);
+}
+
+static void waiter_free (gpointer data)
+{
+    struct waiter *waiter = data;
+
+    g_free(waiter->name);
+    if (waiter->cancelled) {
+        g_source_destroy(waiter->cancelled);
+        g_source_unref(waiter->cancelled);
+    }
+    if (waiter->status) {
+        g_variant_unref(waiter->status);
+    }
+    if (waiter->exit_status) {
+        g_variant_unref(waiter->exit_status);
+    }
+    if (waiter->error) {
+        g_error_free(waiter->error);
+    }
+    g_free(waiter);
+}
+
+/* Complete a wait, unless it already is. Takes @error. */
+static void finish_waiter (ContejnerClient *client,
+                           struct waiter *waiter,
+                           gint exit_status,
+                           GError *error)
+{
+    ContejnerClientPrivate *priv = CONTEJNER_CLIENT_GET_PRIVATE(client);
+    GList *waiters = g_hash_table_lookup(priv->waiters, waiter->name);
+    GList *link = g_list_find(waiters, waiter);
+
+    if (!link) {
+        if (error) {
+            g_error_free(error);
+        }
+        return;
+    }
+
+    waiters = g_list_delete_link(waiters, link);
+    if (waiters) {
+        g_hash_table_insert(priv->waiters, g_strdup(waiter->name), waiters);
+    } else {
+        g_hash_table_remove(priv->waiters, waiter->name);
+    }
+
+    if (waiter->cancelled) {
+        g_source_destroy(waiter->cancelled);
+    }
+
+    if (error) {
+        g_task_return_error(waiter->task, error);
+    } else {
+        g_task_return_int(waiter->task, exit_status);
+    }
+
+    /* The reference of the waiter list */
+    g_object_unref(waiter->task);
+}
+
+/* Complete the waits for a container which stopped, or went away */
+static void container_gone (ContejnerClient *client,
+                            const gchar *name,
+                            const gchar *type,
+                            const gchar *detail)
+{
+    ContejnerClientPrivate *priv = CONTEJNER_CLIENT_GET_PRIVATE(client);
+    GList *waiters = g_list_copy(g_hash_table_lookup(priv->waiters, name));
+    GList *l;
+
+    for (l = waiters; l; l = l->next) {
+        if (!g_strcmp0(type, "stopped")) {
+            finish_waiter(client, l->data,
+                          *detail ? (gint) g_ascii_strtoll(detail, NULL, 10) : -1,
+                          NULL);
+        } else {
+            finish_waiter(client, l->data, -1,
+                          g_error_new(G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                                      "Container %s was destroyed", name));
+        }
+    }
+    g_list_free(waiters);
+}
+
+static void manager_signal (GDBusProxy *proxy,
+                            gchar *sender_name,
+                            gchar *signal_name,
+                            GVariant *parameters,
+                            gpointer user_data)
+{
+    ContejnerClient *client = user_data;
+    GVariant *events;
+    GVariantIter iter;
+    const gchar *name, *type, *detail;
+    guint64 seq;
+
+    if (g_strcmp0(signal_name, "ContainerEvents")) {
+        return;
+    }
+
+    events = g_variant_get_child_value(parameters, 0);
+
+    g_variant_iter_init(&iter, events);
+    while (g_variant_iter_next(&iter, "(t&s&s&s)", &seq, &name, &type, &detail)) {
+        if (!g_strcmp0(type, "stopped") || !g_strcmp0(type, "destroyed")) {
+            container_gone(client, name, type, detail);
+        }
+    }
+
+    g_signal_emit(client, signals[SIGNAL_EVENTS], 0, events);
+    g_variant_unref(events);
+}
+
+/* The service was restarted, or went away. The cached proxies are bound to
+ * the unique name of the old service. */
+static void name_owner_changed (GObject *proxy,
+                                GParamSpec *property,
+                                gpointer user_data)
+{
+    ContejnerClientPrivate *priv = CONTEJNER_CLIENT_GET_PRIVATE(user_data);
+    g_hash_table_remove_all(priv->proxies);
+}
+
+static void manager_ready (GObject *source,
+                           GAsyncResult *result,
+                           gpointer user_data)
+{
+    GTask *task = user_data;
+    ContejnerClient *client = g_task_get_source_object(task);
+    ContejnerClientPrivate *priv = CONTEJNER_CLIENT_GET_PRIVATE(client);
+    GError *error = NULL;
+
+    priv->manager = g_dbus_proxy_new_for_bus_finish(result, &error);
+    if (!priv->manager) {
+        g_task_return_error(task, error);
+        g_object_unref(task);
+        return;
+    }
+
+    g_signal_connect(priv->manager, "g-signal",
+                     G_CALLBACK(manager_signal), client);
+    g_signal_connect(priv->manager, "notify::g-name-owner",
+                     G_CALLBACK(name_owner_changed), client);
+
+    g_task_return_pointer(task, g_object_ref(client), g_object_unref);
+    g_object_unref(task);
+}
+
+void contejner_client_new (GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data)
+{
+    ContejnerClient *client = g_object_new(CONTEJNER_TYPE_CLIENT, NULL);
+    GTask *task = g_task_new(client, cancellable, callback, user_data);
+
+    g_dbus_proxy_new_for_bus(G_BUS_TYPE_SESSION,
+                             G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES,
+                             NULL,
+                             CONTEJNER_BUS_NAME,
+                             CONTEJNER_MANAGER_PATH,
+                             CONTEJNER_BUS_NAME,
+                             cancellable,
+                             manager_ready,
+                             task);
+    g_object_unref(client);
+}
+
+ContejnerClient *contejner_client_new_finish (GAsyncResult *result,
+                                              GError **error)
+{
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+/* The proxy of a container, or of the manager when @name is NULL */
+static GDBusProxy *get_proxy (ContejnerClient *client,
+                              const gchar *name,
+                              GError **error)
+{
+    ContejnerClientPrivate *priv = CONTEJNER_CLIENT_GET_PRIVATE(client);
+    GDBusProxy *proxy;
+    gchar *owner;
+
+    if (!name) {
+        return priv->manager;
+    }
+
+    proxy = g_hash_table_lookup(priv->proxies, name);
+    if (proxy) {
+        return proxy;
+    }
+
+    if (!g_dbus_is_interface_name(name)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                    "Invalid container name: %s", name);
+        return NULL;
+    }
+
+    /* Bound to the unique name of the service, and with neither properties
+     * to load nor signals to subscribe to, a new proxy needs no round trip
+     * to the bus */
+    owner = g_dbus_proxy_get_name_owner(priv->manager);
+    proxy = g_dbus_proxy_new_sync(g_dbus_proxy_get_connection(priv->manager),
+                                  G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                  G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                  NULL,
+                                  owner ? owner : CONTEJNER_BUS_NAME,
+                                  CONTEJNER_CONTAINERS_PATH,
+                                  name,
+                                  NULL,
+                                  error);
+    g_free(owner);
+
+    if (proxy) {
+        g_hash_table_insert(priv->proxies, g_strdup(name), proxy);
+    }
+    return proxy;
+}
+
+static void call_result_free (gpointer data)
+{
+    struct call_result *result = data;
+
+    g_variant_unref(result->value);
+    if (result->fd_list) {
+        g_object_unref(result->fd_list);
+    }
+    g_free(result);
+}
+
+static void call_done (GObject *source,
+                       GAsyncResult *res,
+                       gpointer user_data)
+{
+    GTask *task = user_data;
+    struct call_result *result = g_new0(struct call_result, 1);
+    GError *error = NULL;
+
+    result->value = g_dbus_proxy_call_with_unix_fd_list_finish(G_DBUS_PROXY(source),
+                                                               &result->fd_list,
+                                                               res,
+                                                               &error);
+    if (result->value) {
+        g_task_return_pointer(task, result, call_result_free);
+    } else {
+        g_free(result);
+        g_task_return_error(task, error);
+    }
+    g_object_unref(task);
+}
+
+void contejner_client_call (ContejnerClient *client,
+                            const gchar *name,
+                            const gchar *method,
+                            GVariant *parameters,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data)
+{
+    GTask *task = g_task_new(client, cancellable, callback, user_data);
+    GError *error = NULL;
+    GDBusProxy *proxy = get_proxy(client, name, &error);
+
+    if (!proxy) {
+        if (parameters) {
+            g_variant_unref(g_variant_ref_sink(parameters));
+        }
+        g_task_return_error(task, error);
+        g_object_unref(task);
+        return;
+    }
+
+    g_dbus_proxy_call_with_unix_fd_list(proxy,
+                                        method,
+                                        parameters,
+                                        G_DBUS_CALL_FLAGS_NONE,
+                                        -1,
+                                        NULL,
+                                        cancellable,
+                                        call_done,
+                                        task);
+}
+
+GVariant *contejner_client_call_finish (ContejnerClient *client,
+                                        GAsyncResult *result,
+                                        GUnixFDList **out_fd_list,
+                                        GError **error)
+{
+    struct call_result *call = g_task_propagate_pointer(G_TASK(result), error);
+    GVariant *value;
+
+    if (!call) {
+        return NULL;
+    }
+
+    if (out_fd_list) {
+        *out_fd_list = call->fd_list;
+    } else if (call->fd_list) {
+        g_object_unref(call->fd_list);
+    }
+    value = call->value;
+    g_free(call);
+
+    return value;
+}
+
+static void create_done (GObject *source,
+                         GAsyncResult *res,
+                         gpointer user_data)
+{
+    GTask *task = user_data;
+    GError *error = NULL;
+    GVariant *reply = contejner_client_call_finish(CONTEJNER_CLIENT(source),
+                                                   res, NULL, &error);
+    gchar *name = NULL;
+
+    if (reply) {
+        g_variant_get(reply, "(s)", &name);
+        g_variant_unref(reply);
+        g_task_return_pointer(task, name, g_free);
+    } else {
+        g_task_return_error(task, error);
+    }
+    g_object_unref(task);
+}
+
+void contejner_client_create (ContejnerClient *client,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data)
+{
+    GTask *task = g_task_new(client, cancellable, callback, user_data);
+    contejner_client_call(client, NULL, "Create", NULL,
+                          cancellable, create_done, task);
+}
+
+gchar *contejner_client_create_finish (ContejnerClient *client,
+                                       GAsyncResult *result,
+                                       GError **error)
+{
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+/* One call of a batch has replied */
+static void batch_done (GObject *source,
+                        GAsyncResult *res,
+                        gpointer user_data)
+{
+    struct batch *batch = user_data;
+    GError *error = NULL;
+    GVariant *reply;
+
+    if (res) {
+        reply = contejner_client_call_finish(CONTEJNER_CLIENT(source),
+                                             res, NULL, &error);
+        if (reply) {
+            g_variant_unref(reply);
+        } else if (!batch->error) {
+            batch->error = error;
+        } else {
+            g_error_free(error);
+        }
+    }
+
+    if (--batch->pending) {
+        return;
+    }
+
+    if (batch->error) {
+        g_task_return_error(batch->task, batch->error);
+    } else {
+        g_task_return_boolean(batch->task, TRUE);
+    }
+    g_object_unref(batch->task);
+    g_free(batch);
+}
+
+static void batch_call (ContejnerClient *client,
+                        struct batch *batch,
+                        const gchar *name,
+                        const gchar *method,
+                        GVariant *parameters)
+{
+    batch->pending++;
+    contejner_client_call(client, name, method, parameters,
+                          g_task_get_cancellable(batch->task),
+                          batch_done, batch);
+}
+
+void contejner_client_configure (ContejnerClient *client,
+                                 const gchar *name,
+                                 GVariant *config,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data)
+{
+    struct batch *batch = g_new0(struct batch, 1);
+    const gchar *command = NULL;
+    GVariant *arguments = NULL;
+    GVariantIter iter;
+    const gchar *key;
+    GVariant *value;
+
+    batch->task = g_task_new(client, cancellable, callback, user_data);
+
+    /* Held until every call is sent, so that early replies can not complete
+     * the batch */
+    batch->pending = 1;
+
+    g_variant_ref_sink(config);
+    g_variant_iter_init(&iter, config);
+    while (g_variant_iter_next(&iter, "{&sv}", &key, &value)) {
+        if (!g_strcmp0(key, "Command") &&
+            g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+            command = g_variant_get_string(value, NULL);
+        } else if (!g_strcmp0(key, "Arguments") &&
+                   g_variant_is_of_type(value, G_VARIANT_TYPE_STRING_ARRAY)) {
+            if (arguments) {
+                g_variant_unref(arguments);
+            }
+            arguments = g_variant_ref(value);
+        } else if (!g_strcmp0(key, "Root") &&
+                   g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+            batch_call(client, batch, name, "SetRoot",
+                       g_variant_new("(@s)", value));
+        } else if (!g_strcmp0(key, "Labels") &&
+                   g_variant_is_of_type(value, G_VARIANT_TYPE("a{ss}"))) {
+            batch_call(client, batch, name, "SetLabels",
+                       g_variant_new("(@a{ss})", value));
+        } else if (!g_strcmp0(key, "Command") || !g_strcmp0(key, "Arguments") ||
+                   !g_strcmp0(key, "Root") || !g_strcmp0(key, "Labels")) {
+            if (!batch->error) {
+                g_set_error(&batch->error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                            "Invalid type of %s", key);
+            }
+        } else {
+            batch_call(client, batch, name, "org.freedesktop.DBus.Properties.Set",
+                       g_variant_new("(ssv)", name, key, value));
+        }
+        g_variant_unref(value);
+    }
+
+    if (command) {
+        batch_call(client, batch, name, "SetCommand",
+                   arguments ? g_variant_new("(s@as)", command, arguments)
+                             : g_variant_new("(sas)", command, NULL));
+    }
+
+    if (arguments) {
+        g_variant_unref(arguments);
+    }
+    g_variant_unref(config);
+
+    batch_done(G_OBJECT(client), NULL, batch);
+}
+
+gboolean contejner_client_configure_finish (ContejnerClient *client,
+                                           GAsyncResult *result,
+                                           GError **error)
+{
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+static void run_done (GObject *source,
+                      GAsyncResult *res,
+                      gpointer user_data)
+{
+    GTask *task = user_data;
+    GError *error = NULL;
+    GVariant *reply = contejner_client_call_finish(CONTEJNER_CLIENT(source),
+                                                   res, NULL, &error);
+    gint code = 0;
+    const gchar *message = NULL;
+
+    if (!reply) {
+        g_task_return_error(task, error);
+        g_object_unref(task);
+        return;
+    }
+
+    g_variant_get(reply, "(i&s)", &code, &message);
+    if (code) {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                "%s", message);
+    } else {
+        g_task_return_boolean(task, TRUE);
+    }
+    g_variant_unref(reply);
+    g_object_unref(task);
+}
+
+void contejner_client_run (ContejnerClient *client,
+                           const gchar *name,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data)
+{
+    GTask *task = g_task_new(client, cancellable, callback, user_data);
+    contejner_client_call(client, name, "Run", NULL,
+                          cancellable, run_done, task);
+}
+
+gboolean contejner_client_run_finish (ContejnerClient *client,
+                                     GAsyncResult *result,
+                                     GError **error)
+{
+    return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+/* The value of a Properties.Get reply. The service sends property values as
+ * one element tuples, which are unpacked. */
+static GVariant *property_value (GVariant *reply)
+{
+    GVariant *value = NULL;
+    GVariant *inner;
+
+    g_variant_get(reply, "(v)", &value);
+    if (g_variant_is_of_type(value, G_VARIANT_TYPE_TUPLE) &&
+        g_variant_n_children(value) == 1) {
+        inner = g_variant_get_child_value(value, 0);
+        g_variant_unref(value);
+        value = inner;
+    }
+
+    return value;
+}
+
+static void get_property_done (GObject *source,
+                               GAsyncResult *res,
+                               gpointer user_data)
+{
+    GTask *task = user_data;
+    GError *error = NULL;
+    GVariant *reply = contejner_client_call_finish(CONTEJNER_CLIENT(source),
+                                                   res, NULL, &error);
+
+    if (reply) {
+        g_task_return_pointer(task, property_value(reply),
+                              (GDestroyNotify) g_variant_unref);
+        g_variant_unref(reply);
+    } else {
+        g_task_return_error(task, error);
+    }
+    g_object_unref(task);
+}
+
+void contejner_client_get_property (ContejnerClient *client,
+                                    const gchar *name,
+                                    const gchar *property,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data)
+{
+    GTask *task = g_task_new(client, cancellable, callback, user_data);
+    contejner_client_call(client, name, "org.freedesktop.DBus.Properties.Get",
+                          g_variant_new("(ss)", name, property),
+                          cancellable, get_property_done, task);
+}
+
+GVariant *contejner_client_get_property_finish (ContejnerClient *client,
+                                                GAsyncResult *result,
+                                                GError **error)
+{
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+/* A reply to the status query of a wait */
+static void wait_query_done (GObject *source,
+                             GAsyncResult *res,
+                             gpointer user_data)
+{
+    GTask *task = user_data;
+    ContejnerClient *client = CONTEJNER_CLIENT(source);
+    struct waiter *waiter = g_task_get_task_data(task);
+    GError *error = NULL;
+    GVariant *value = contejner_client_get_property_finish(client, res, &error);
+
+    if (!value) {
+        if (!waiter->error) {
+            waiter->error = error;
+        } else {
+            g_error_free(error);
+        }
+    } else if (g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+        waiter->status = value;
+    } else {
+        waiter->exit_status = value;
+    }
+
+    if (--waiter->pending == 0) {
+        if (waiter->status &&
+            !g_strcmp0(g_variant_get_string(waiter->status, NULL), "STOPPED")) {
+            finish_waiter(client, waiter,
+                          waiter->exit_status ? g_variant_get_int32(waiter->exit_status)
+                                              : -1,
+                          NULL);
+        } else if (!waiter->status) {
+            finish_waiter(client, waiter, -1, waiter->error);
+            waiter->error = NULL;
+        }
+    }
+
+    g_object_unref(task);
+}
+
+static gboolean wait_cancelled (GCancellable *cancellable,
+                                gpointer user_data)
+{
+    struct waiter *waiter = user_data;
+    ContejnerClient *client = g_task_get_source_object(waiter->task);
+
+    finish_waiter(client, waiter, -1,
+                  g_error_new(G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                              "Operation was cancelled"));
+    return G_SOURCE_REMOVE;
+}
+
+void contejner_client_wait (ContejnerClient *client,
+                            const gchar *name,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data)
+{
+    ContejnerClientPrivate *priv = CONTEJNER_CLIENT_GET_PRIVATE(client);
+    struct waiter *waiter = g_new0(struct waiter, 1);
+    GList *waiters;
+
+    waiter->task = g_task_new(client, cancellable, callback, user_data);
+    waiter->name = g_strdup(name);
+    g_task_set_task_data(waiter->task, waiter, waiter_free);
+
+    /* The waiter list holds a reference to the task until it completes */
+    waiters = g_hash_table_lookup(priv->waiters, name);
+    g_hash_table_insert(priv->waiters, g_strdup(name),
+                        g_list_prepend(waiters, waiter));
+
+    if (cancellable) {
+        waiter->cancelled = g_cancellable_source_new(cancellable);
+        g_source_set_callback(waiter->cancelled, (GSourceFunc) wait_cancelled,
+                              waiter, NULL);
+        g_source_attach(waiter->cancelled, g_task_get_context(waiter->task));
+    }
+
+    /* The stopped event of the container is only sent after this, since the
+     * events are subscribed to already. So if the container has not stopped
+     * by the time the query is answered, the event will complete the wait. */
+    waiter->pending = 2;
+    contejner_client_get_property(client, name, "Status", cancellable,
+                                  wait_query_done, g_object_ref(waiter->task));
+    contejner_client_get_property(client, name, "ExitStatus", cancellable,
+                                  wait_query_done, g_object_ref(waiter->task));
+}
+
+gboolean contejner_client_wait_finish (ContejnerClient *client,
+                                      GAsyncResult *result,
+                                      gint *exit_status,
+                                      GError **error)
+{
+    GTask *task = G_TASK(result);
+    gboolean failed = g_task_had_error(task);
+    gssize status = g_task_propagate_int(task, error);
+
+    if (failed) {
+        return FALSE;
+    }
+
+    if (exit_status) {
+        *exit_status = status;
+    }
+    return TRUE;
+}
+
+static void connect_done (GObject *source,
+                          GAsyncResult *res,
+                          gpointer user_data)
+{
+    GTask *task = user_data;
+    GError *error = NULL;
+    GUnixFDList *fd_list = NULL;
+    GVariant *reply = contejner_client_call_finish(CONTEJNER_CLIENT(source),
+                                                   res, &fd_list, &error);
+
+    if (!reply) {
+        g_task_return_error(task, error);
+    } else if (!fd_list || g_unix_fd_list_get_length(fd_list) != 2) {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                                "Received invalid fd list");
+    } else {
+        g_task_return_pointer(task, g_object_ref(fd_list), g_object_unref);
+    }
+
+    if (reply) {
+        g_variant_unref(reply);
+    }
+    if (fd_list) {
+        g_object_unref(fd_list);
+    }
+    g_object_unref(task);
+}
+
+void contejner_client_connect (ContejnerClient *client,
+                               const gchar *name,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data)
+{
+    GTask *task = g_task_new(client, cancellable, callback, user_data);
+    contejner_client_call(client, name, "Connect", NULL,
+                          cancellable, connect_done, task);
+}
+
+gboolean contejner_client_connect_finish (ContejnerClient *client,
+                                         GAsyncResult *result,
+                                         gint *stdout_fd,
+                                         gint *stderr_fd,
+                                         GError **error)
+{
+    GUnixFDList *fd_list = g_task_propagate_pointer(G_TASK(result), error);
+    gint *fds;
+    int i;
+
+    if (!fd_list) {
+        return FALSE;
+    }
+
+    fds = g_unix_fd_list_steal_fds(fd_list, NULL);
+    for (i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL, 0) | O_NONBLOCK);
+    }
+    *stdout_fd = fds[0];
+    *stderr_fd = fds[1];
+
+    g_free(fds);
+    g_object_unref(fd_list);
+    return TRUE;
+}
+
+static void open_output_result_free (gpointer data)
+{
+    struct open_output_result *result = data;
+
+    g_object_unref(result->stream);
+    g_free(result);
+}
+
+static void open_output_done (GObject *source,
+                              GAsyncResult *res,
+                              gpointer user_data)
+{
+    GTask *task = user_data;
+    GError *error = NULL;
+    GUnixFDList *fd_list = NULL;
+    GVariant *reply = contejner_client_call_finish(CONTEJNER_CLIENT(source),
+                                                   res, &fd_list, &error);
+    struct open_output_result *result;
+    gint32 handle = 0;
+    gint fd;
+
+    if (!reply) {
+        g_task_return_error(task, error);
+        g_object_unref(task);
+        return;
+    }
+
+    result = g_new0(struct open_output_result, 1);
+    g_variant_get(reply, "(ht)", &handle, &result->offset);
+    g_variant_unref(reply);
+
+    fd = fd_list ? g_unix_fd_list_get(fd_list, handle, &error) : -1;
+    if (fd == -1) {
+        g_free(result);
+        if (error) {
+            g_task_return_error(task, error);
+        } else {
+            g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                                    "Received invalid fd list");
+        }
+    } else {
+        result->stream = g_unix_input_stream_new(fd, TRUE);
+        g_task_return_pointer(task, result, open_output_result_free);
+    }
+
+    if (fd_list) {
+        g_object_unref(fd_list);
+    }
+    g_object_unref(task);
+}
+
+void contejner_client_open_output (ContejnerClient *client,
+                                   const gchar *name,
+                                   const gchar *stream,
+                                   gint64 from,
+                                   const gchar *unit,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data)
+{
+    GTask *task = g_task_new(client, cancellable, callback, user_data);
+    contejner_client_call(client, name, "OpenOutput",
+                          g_variant_new("(sxs)", stream, from, unit),
+                          cancellable, open_output_done, task);
+}
+
+GInputStream *contejner_client_open_output_finish (ContejnerClient *client,
+                                                   GAsyncResult *result,
+                                                   guint64 *offset,
+                                                   GError **error)
+{
+    struct open_output_result *output = g_task_propagate_pointer(G_TASK(result),
+                                                                 error);
+    GInputStream *stream;
+
+    if (!output) {
+        return NULL;
+    }
+
+    if (offset) {
+        *offset = output->offset;
+    }
+    stream = output->stream;
+    g_free(output);
+
+    return stream;
+}
+
+static void list_done (GObject *source,
+                       GAsyncResult *res,
+                       gpointer user_data)
+{
+    GTask *task = user_data;
+    GError *error = NULL;
+    GVariant *reply = contejner_client_call_finish(CONTEJNER_CLIENT(source),
+                                                   res, NULL, &error);
+    GVariant *names;
+
+    if (reply) {
+        names = g_variant_get_child_value(reply, 0);
+        g_task_return_pointer(task, g_variant_dup_strv(names, NULL),
+                              (GDestroyNotify) g_strfreev);
+        g_variant_unref(names);
+        g_variant_unref(reply);
+    } else {
+        g_task_return_error(task, error);
+    }
+    g_object_unref(task);
+}
+
+void contejner_client_list (ContejnerClient *client,
+                            const gchar *selector,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data)
+{
+    GTask *task = g_task_new(client, cancellable, callback, user_data);
+    contejner_client_call(client, NULL, "List",
+                          g_variant_new("(s)", selector ? selector : ""),
+                          cancellable, list_done, task);
+}
+
+gchar **contejner_client_list_finish (ContejnerClient *client,
+                                      GAsyncResult *result,
+                                      GError **error)
+{
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
@@ -0,0 +1,210 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef LIBCONTEJNER_H
+#define LIBCONTEJNER_H
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <gio/gunixfdlist.h>
+
+G_BEGIN_DECLS
+
+/*
+ * An asynchronous client of the Contejner service, for programs which run
+ * many containers. One client uses one bus connection, and a cached proxy
+ * per container. Calls which do not depend on each other are sent without
+ * waiting for the replies in between.
+ *
+ * Containers are named by their D-Bus interface, as returned by
+ * contejner_client_create(), e.g. "org.jonatan.Contejner.Container0".
+ *
+ * Every call takes a #GCancellable and completes with a #GAsyncReadyCallback
+ * in the thread-default main context of the caller, and its result is
+ * taken with the matching _finish() function.
+ */
+
+#define CONTEJNER_TYPE_CLIENT (contejner_client_get_type ())
+G_DECLARE_FINAL_TYPE(ContejnerClient,
+                     contejner_client,
+                     CONTEJNER,
+                     CLIENT, GObject)
+
+/**
+ * Connect to the service on the session bus
+ */
+void contejner_client_new (GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data);
+
+ContejnerClient *contejner_client_new_finish (GAsyncResult *result,
+                                              GError **error);
+
+/**
+ * Create a new container. Returns the name of the container.
+ */
+void contejner_client_create (ContejnerClient *client,
+                              GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data);
+
+gchar *contejner_client_create_finish (ContejnerClient *client,
+                                       GAsyncResult *result,
+                                       GError **error);
+
+/**
+ * Configure a container which is not running. @config is a dictionary keyed
+ * by the container property names, plus "Command" (s), "Arguments" (as),
+ * "Root" (s) and "Labels" (a{ss}), like the templates of the manager. All
+ * entries are sent at once, and the call fails with the first error.
+ */
+void contejner_client_configure (ContejnerClient *client,
+                                 const gchar *name,
+                                 GVariant *config,
+                                 GCancellable *cancellable,
+                                 GAsyncReadyCallback callback,
+                                 gpointer user_data);
+
+gboolean contejner_client_configure_finish (ContejnerClient *client,
+                                           GAsyncResult *result,
+                                           GError **error);
+
+/**
+ * Run a container. Completes once the container is started, or queued by
+ * the run queue of the manager.
+ */
+void contejner_client_run (ContejnerClient *client,
+                           const gchar *name,
+                           GCancellable *cancellable,
+                           GAsyncReadyCallback callback,
+                           gpointer user_data);
+
+gboolean contejner_client_run_finish (ContejnerClient *client,
+                                     GAsyncResult *result,
+                                     GError **error);
+
+/**
+ * Wait for a container to stop. Completes right away if it already has.
+ * @exit_status is set to the exit status of the container, 128 + signal if
+ * it was killed, or -1 if it is not known.
+ */
+void contejner_client_wait (ContejnerClient *client,
+                            const gchar *name,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data);
+
+gboolean contejner_client_wait_finish (ContejnerClient *client,
+                                      GAsyncResult *result,
+                                      gint *exit_status,
+                                      GError **error);
+
+/**
+ * Get the live output of a container, as non-blocking file descriptors
+ * owned by the caller
+ */
+void contejner_client_connect (ContejnerClient *client,
+                               const gchar *name,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer user_data);
+
+gboolean contejner_client_connect_finish (ContejnerClient *client,
+                                         GAsyncResult *result,
+                                         gint *stdout_fd,
+                                         gint *stderr_fd,
+                                         GError **error);
+
+/**
+ * Open the output log of a container ("stdout" or "stderr") for reading,
+ * from a position in "bytes", "lines" or "time" (see OpenOutput of the
+ * container interface). @offset is set to the byte offset the stream
+ * starts at.
+ */
+void contejner_client_open_output (ContejnerClient *client,
+                                   const gchar *name,
+                                   const gchar *stream,
+                                   gint64 from,
+                                   const gchar *unit,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer user_data);
+
+GInputStream *contejner_client_open_output_finish (ContejnerClient *client,
+                                                   GAsyncResult *result,
+                                                   guint64 *offset,
+                                                   GError **error);
+
+/**
+ * List the containers matching a label selector, "" for all containers.
+ * Returns a NULL terminated array of names.
+ */
+void contejner_client_list (ContejnerClient *client,
+                            const gchar *selector,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data);
+
+gchar **contejner_client_list_finish (ContejnerClient *client,
+                                      GAsyncResult *result,
+                                      GError **error);
+
+/**
+ * Get a property of a container
+ */
+void contejner_client_get_property (ContejnerClient *client,
+                                    const gchar *name,
+                                    const gchar *property,
+                                    GCancellable *cancellable,
+                                    GAsyncReadyCallback callback,
+                                    gpointer user_data);
+
+GVariant *contejner_client_get_property_finish (ContejnerClient *client,
+                                                GAsyncResult *result,
+                                                GError **error);
+
+/**
+ * Call any other method, of a container, or of the manager when @name is
+ * NULL. @method is the plain method name, like "Kill". @callback may be
+ * NULL when the result is not needed.
+ */
+void contejner_client_call (ContejnerClient *client,
+                            const gchar *name,
+                            const gchar *method,
+                            GVariant *parameters,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data);
+
+GVariant *contejner_client_call_finish (ContejnerClient *client,
+                                        GAsyncResult *result,
+                                        GUnixFDList **out_fd_list,
+                                        GError **error);
+
+/*
+ * Signals:
+ *
+ * "events" (ContejnerClient *client, GVariant *events, gpointer user_data)
+ *     A batch of lifecycle events of all containers, as the a(tsss) array
+ *     of the ContainerEvents signal of the manager
+ */
+
+G_END_DECLS
+
+#endif /* LIBCONTEJNER_H */
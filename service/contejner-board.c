@@ -0,0 +1,156 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "contejner-board.h"
+
+struct _ContejnerBoard {
+    int fd;
+    gsize size;
+    struct contejner_board_header *header;
+    struct contejner_board_record *records;
+    /* Slots below header->used that are free again */
+    GArray *free_slots;
+};
+
+ContejnerBoard *contejner_board_new(guint capacity)
+{
+    ContejnerBoard *board;
+    gsize size = sizeof(struct contejner_board_header) +
+                 (gsize) capacity * sizeof(struct contejner_board_record);
+    void *map;
+    int fd;
+
+    fd = memfd_create("contejner-board", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) {
+        g_warning("Failed to create status board: %s", strerror(errno));
+        return NULL;
+    }
+
+    /* Sealed at its size, so that a reader's mapping can not be cut short */
+    if (ftruncate(fd, size) ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) {
+        g_warning("Failed to size status board: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        g_warning("Failed to map status board: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    board = g_new0(ContejnerBoard, 1);
+    board->fd = fd;
+    board->size = size;
+    board->header = map;
+    board->records = (struct contejner_board_record *) (board->header + 1);
+    board->free_slots = g_array_new(FALSE, FALSE, sizeof(gint));
+
+    board->header->magic = CONTEJNER_BOARD_MAGIC;
+    board->header->version = CONTEJNER_BOARD_VERSION;
+    board->header->header_size = sizeof(struct contejner_board_header);
+    board->header->record_size = sizeof(struct contejner_board_record);
+    board->header->capacity = capacity;
+
+    return board;
+}
+
+gint contejner_board_add(ContejnerBoard *board, int id)
+{
+    struct contejner_board_record *record;
+    gint slot;
+
+    if (board->free_slots->len > 0) {
+        slot = g_array_index(board->free_slots, gint,
+                             board->free_slots->len - 1);
+        g_array_set_size(board->free_slots, board->free_slots->len - 1);
+    } else if (board->header->used < board->header->capacity) {
+        slot = board->header->used;
+    } else {
+        g_warning("Status board is full, container %d is left out", id);
+        return -1;
+    }
+
+    record = contejner_board_begin(board, slot);
+    memset((char *) record + sizeof(record->seq), 0,
+           sizeof(*record) - sizeof(record->seq));
+    record->id = id;
+    record->exit_status = -1;
+    contejner_board_commit(board, slot);
+
+    /* Only once the record is there, so that readers never see it half
+     * written */
+    if ((guint) slot == board->header->used) {
+        __atomic_store_n(&board->header->used, slot + 1, __ATOMIC_RELEASE);
+    }
+
+    return slot;
+}
+
+void contejner_board_remove(ContejnerBoard *board, gint slot)
+{
+    contejner_board_begin(board, slot)->id = -1;
+    contejner_board_commit(board, slot);
+    g_array_append_val(board->free_slots, slot);
+}
+
+/* The service is the only writer, so the sequence number only needs to be
+ * made odd before and even after the changes, in that order as seen by the
+ * readers */
+struct contejner_board_record *contejner_board_begin(ContejnerBoard *board,
+                                                     gint slot)
+{
+    struct contejner_board_record *record = &board->records[slot];
+
+    __atomic_store_n(&record->seq, record->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return record;
+}
+
+void contejner_board_commit(ContejnerBoard *board, gint slot)
+{
+    struct contejner_board_record *record = &board->records[slot];
+
+    __atomic_store_n(&record->seq, record->seq + 1, __ATOMIC_RELEASE);
+}
+
+int contejner_board_open(ContejnerBoard *board)
+{
+    gchar path[32];
+    int fd;
+
+    /* A new open file description, which can not be mapped writable */
+    g_snprintf(path, sizeof(path), "/proc/self/fd/%d", board->fd);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        g_warning("Failed to open status board: %s", strerror(errno));
+    }
+
+    return fd;
+}
@@ -0,0 +1,62 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CONTEJNER_BOARD_H
+#define CONTEJNER_BOARD_H
+
+#include <glib.h>
+
+#include "contejner-status-board.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ContejnerBoard ContejnerBoard;
+
+/**
+ * contejner_board_new:
+ * @capacity: number of records
+ *
+ * Create a status board in a memfd, see contejner-status-board.h for its
+ * layout. The memfd is sealed at its size, and its pages are only
+ * allocated as records are taken into use.
+ *
+ * Returns: a new #ContejnerBoard, or NULL if no memfd could be set up
+ */
+ContejnerBoard *contejner_board_new (guint capacity);
+
+/* Take a free record for container @id. Returns its slot, or -1 when the
+ * board is full. */
+gint contejner_board_add (ContejnerBoard *board, int id);
+
+/* Free the record in @slot, for reuse by another container */
+void contejner_board_remove (ContejnerBoard *board, gint slot);
+
+/* Update the record in @slot. The record returned by begin may be changed
+ * until commit, during which readers retry. */
+struct contejner_board_record *contejner_board_begin (ContejnerBoard *board,
+                                                      gint slot);
+
+void contejner_board_commit (ContejnerBoard *board, gint slot);
+
+/* A new read only descriptor of the board, owned by the caller, or -1 */
+int contejner_board_open (ContejnerBoard *board);
+
+G_END_DECLS
+
+#endif /* CONTEJNER_BOARD_H */
@@ -0,0 +1,624 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <glib-unix.h>
+
+#include "contejner-cgroup.h"
+
+#define CGROUP_MOUNT "/sys/fs/cgroup"
+#define STATS_BUF_SZ 4096
+#define EVENTS_BUF_SZ 256
+#define INOTIFY_BUF_SZ 4096
+/* Leaf below the group of the service that the service moves itself to */
+#define SERVICE_LEAF "service"
+
+enum stats_file {
+    STATS_CPU,
+    STATS_MEMORY,
+    STATS_IO,
+    STATS_FILES,
+};
+
+static const char *stats_files[STATS_FILES] = {
+    "cpu.stat", "memory.current", "io.stat",
+};
+
+/* Counters of memory.events that are reported, in the order of
+ * ContejnerCgroupEvent */
+static const char *memory_events[] = {
+    "high", "max", "oom_kill",
+};
+
+static const char *event_names[] = {
+    "memory-high", "memory-max", "oom", "drained",
+};
+
+/* Controllers enabled for the container cgroups, for memory.events and the
+ * stats files */
+static const char *controllers[] = {
+    "memory", "io", "cpu",
+};
+
+/* The inotify descriptor shared by all watched cgroups, and the cgroup of
+ * each watch descriptor */
+static int inotify_fd = -1;
+static GHashTable *watches;
+
+struct _ContejnerCgroup {
+    char *path;
+    int dir_fd;
+    /* Opened on the first read of the stats, -1 until then or if missing */
+    gboolean stats_opened;
+    int stats_fds[STATS_FILES];
+    /* Watch descriptors of memory.events and cgroup.events, and the state
+     * last seen in them */
+    int memory_wd;
+    int events_wd;
+    guint64 memory_counts[G_N_ELEMENTS(memory_events)];
+    gboolean populated;
+    ContejnerCgroupEventFunc event_func;
+    gpointer event_data;
+};
+
+/* Write a short value to a file below a directory */
+static gboolean write_at(int dir_fd, const char *dir,
+                         const char *file, const char *value)
+{
+    gsize len = strlen(value);
+    gboolean ok;
+    int fd, saved_errno;
+
+    fd = openat(dir_fd, file, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        g_debug("Failed to open %s/%s: %s", dir, file, strerror(errno));
+        return FALSE;
+    }
+
+    ok = write(fd, value, len) == (ssize_t) len;
+    saved_errno = errno;
+    if (!ok) {
+        g_debug("Failed to write %s/%s: %s", dir, file, strerror(errno));
+    }
+
+    close(fd);
+    errno = saved_errno;
+    return ok;
+}
+
+/* Controllers are only handed down to the children of a cgroup that has no
+ * processes of its own, so move the service to a leaf next to the container
+ * cgroups and then enable the controllers in the group of the service.
+ * Without them, the stats files and memory.events are missing in the
+ * container cgroups. */
+static void enable_controllers(const char *parent)
+{
+    gchar *leaf = g_build_filename(parent, SERVICE_LEAF, NULL);
+    gchar *path, *contents = NULL;
+    gchar **available = NULL;
+    gchar pid[16];
+    guint i;
+    int fd;
+
+    fd = open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        g_warning("Failed to open cgroup %s: %s", parent, strerror(errno));
+        goto out;
+    }
+
+    /* The root cgroup may have processes and hand down controllers */
+    g_snprintf(pid, sizeof(pid), "%d", getpid());
+    if (g_strcmp0(parent, CGROUP_MOUNT) &&
+        ((mkdir(leaf, S_IRWXU) && errno != EEXIST) ||
+         !write_at(fd, parent, SERVICE_LEAF "/cgroup.procs", pid))) {
+        g_warning("Failed to move the service to cgroup %s: %s. Container "
+                  "cgroups get no memory, I/O or CPU controllers",
+                  leaf, strerror(errno));
+        goto out;
+    }
+
+    path = g_build_filename(parent, "cgroup.controllers", NULL);
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        available = g_strsplit_set(g_strstrip(contents), " ", -1);
+    }
+    g_free(path);
+
+    for (i = 0; i < G_N_ELEMENTS(controllers); i++) {
+        gchar *enable;
+
+        if (!available ||
+            !g_strv_contains((const gchar * const *) available,
+                             controllers[i])) {
+            g_warning("The %s controller is not delegated to cgroup %s, "
+                      "containers are not accounted for it",
+                      controllers[i], parent);
+            continue;
+        }
+
+        enable = g_strconcat("+", controllers[i], NULL);
+        if (!write_at(fd, parent, "cgroup.subtree_control", enable)) {
+            g_warning("Failed to enable the %s controller in cgroup %s: %s. "
+                      "No process but the service may run in it",
+                      controllers[i], parent, strerror(errno));
+        }
+        g_free(enable);
+    }
+
+out:
+    if (fd != -1) {
+        close(fd);
+    }
+    g_strfreev(available);
+    g_free(contents);
+    g_free(leaf);
+}
+
+/* Find the cgroup v2 group of the service, once */
+static const char *get_parent_path(void)
+{
+    static gboolean initialized = FALSE;
+    static char *parent = NULL;
+
+    if (!initialized) {
+        gchar *contents = NULL;
+        gchar **lines = NULL;
+        int i;
+
+        if (access(CGROUP_MOUNT "/cgroup.controllers", F_OK)) {
+            g_debug("No cgroup v2 hierarchy mounted at %s", CGROUP_MOUNT);
+        } else if (g_file_get_contents("/proc/self/cgroup", &contents,
+                                       NULL, NULL)) {
+            lines = g_strsplit(contents, "\n", -1);
+            for (i = 0; lines[i]; i++) {
+                if (g_str_has_prefix(lines[i], "0::")) {
+                    parent = g_build_filename(CGROUP_MOUNT, lines[i] + 3, NULL);
+                    break;
+                }
+            }
+        }
+
+        if (parent && access(parent, W_OK)) {
+            g_debug("cgroup %s is not writable, cgroups disabled", parent);
+            g_free(parent);
+            parent = NULL;
+        }
+
+        if (parent) {
+            enable_controllers(parent);
+        }
+
+        g_strfreev(lines);
+        g_free(contents);
+        initialized = TRUE;
+    }
+
+    return parent;
+}
+
+/* Write a short value to a file of the cgroup */
+static gboolean write_file(ContejnerCgroup *cgroup,
+                           const char *file,
+                           const char *value)
+{
+    return write_at(cgroup->dir_fd, cgroup->path, file, value);
+}
+
+ContejnerCgroup *contejner_cgroup_new(const char *name)
+{
+    const char *parent = get_parent_path();
+    ContejnerCgroup *cgroup;
+
+    if (!parent) {
+        return NULL;
+    }
+
+    cgroup = g_new0(ContejnerCgroup, 1);
+    cgroup->path = g_build_filename(parent, name, NULL);
+    cgroup->memory_wd = cgroup->events_wd = -1;
+
+    if (mkdir(cgroup->path, S_IRWXU) && errno != EEXIST) {
+        g_warning("Failed to create cgroup %s: %s", cgroup->path, strerror(errno));
+        goto fail;
+    }
+
+    cgroup->dir_fd = open(cgroup->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cgroup->dir_fd == -1) {
+        g_warning("Failed to open cgroup %s: %s", cgroup->path, strerror(errno));
+        rmdir(cgroup->path);
+        goto fail;
+    }
+
+    return cgroup;
+
+fail:
+    g_free(cgroup->path);
+    g_free(cgroup);
+    return NULL;
+}
+
+const char *contejner_cgroup_get_path(const ContejnerCgroup *cgroup)
+{
+    return cgroup->path;
+}
+
+int contejner_cgroup_get_fd(const ContejnerCgroup *cgroup)
+{
+    return cgroup->dir_fd;
+}
+
+gboolean contejner_cgroup_add_pid(ContejnerCgroup *cgroup, pid_t pid)
+{
+    char value[16];
+    g_snprintf(value, sizeof(value), "%d", pid);
+    return write_file(cgroup, "cgroup.procs", value);
+}
+
+gboolean contejner_cgroup_freeze(ContejnerCgroup *cgroup, gboolean freeze)
+{
+    return write_file(cgroup, "cgroup.freeze", freeze ? "1" : "0");
+}
+
+/* Signal a process listed in cgroup.procs. Through a pidfd, a process
+ * that exits meanwhile can not be confused with a new one given its pid. */
+static gboolean signal_pid(pid_t pid, int signal)
+{
+    gboolean ok;
+    int pidfd;
+
+    pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd == -1) {
+        return errno == ENOSYS && kill(pid, signal) == 0;
+    }
+
+    ok = syscall(SYS_pidfd_send_signal, pidfd, signal, NULL, 0) == 0;
+    close(pidfd);
+    return ok;
+}
+
+gboolean contejner_cgroup_signal(ContejnerCgroup *cgroup, int signal)
+{
+    gchar *path, *procs = NULL;
+    gboolean signalled = FALSE;
+    char *p, *end;
+
+    if (signal == SIGKILL && write_file(cgroup, "cgroup.kill", "1")) {
+        return TRUE;
+    }
+
+    path = g_build_filename(cgroup->path, "cgroup.procs", NULL);
+    if (!g_file_get_contents(path, &procs, NULL, NULL)) {
+        g_debug("Failed to read %s", path);
+        g_free(path);
+        return FALSE;
+    }
+    g_free(path);
+
+    for (p = procs; *p; p = end) {
+        pid_t pid = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        if (signal_pid(pid, signal)) {
+            signalled = TRUE;
+        }
+    }
+
+    g_free(procs);
+    return signalled;
+}
+
+/* Read a stats file from the start, into buf */
+static gboolean read_stats_file(ContejnerCgroup *cgroup, enum stats_file file,
+                                char *buf, gsize size)
+{
+    ssize_t len;
+
+    if (cgroup->stats_fds[file] == -1) {
+        return FALSE;
+    }
+
+    len = pread(cgroup->stats_fds[file], buf, size - 1, 0);
+    if (len < 0) {
+        return FALSE;
+    }
+
+    buf[len] = '\0';
+    return TRUE;
+}
+
+/* The value of the first "key value" line starting with key */
+static guint64 stats_value(const char *stats, const char *key)
+{
+    const char *line = stats;
+    gsize len = strlen(key);
+
+    while (line) {
+        if (!strncmp(line, key, len) && line[len] == ' ') {
+            return g_ascii_strtoull(line + len + 1, NULL, 10);
+        }
+        line = strchr(line, '\n');
+        line = line ? line + 1 : NULL;
+    }
+    return 0;
+}
+
+gboolean contejner_cgroup_read_stats(ContejnerCgroup *cgroup,
+                                     ContejnerCgroupStats *stats)
+{
+    char buf[STATS_BUF_SZ];
+    char *field;
+    int i;
+
+    if (!cgroup->stats_opened) {
+        for (i = 0; i < STATS_FILES; i++) {
+            cgroup->stats_fds[i] = openat(cgroup->dir_fd, stats_files[i],
+                                          O_RDONLY | O_CLOEXEC);
+        }
+        cgroup->stats_opened = TRUE;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    if (!read_stats_file(cgroup, STATS_CPU, buf, sizeof(buf))) {
+        return FALSE;
+    }
+    stats->cpu_usec = stats_value(buf, "usage_usec");
+
+    if (read_stats_file(cgroup, STATS_MEMORY, buf, sizeof(buf))) {
+        stats->memory_bytes = g_ascii_strtoull(buf, NULL, 10);
+    }
+
+    /* One line per device, e.g. "8:0 rbytes=1 wbytes=2 rios=3 ..." */
+    if (read_stats_file(cgroup, STATS_IO, buf, sizeof(buf))) {
+        for (field = buf; (field = strchr(field, ' ')); ) {
+            field++;
+            if (g_str_has_prefix(field, "rbytes=")) {
+                stats->io_read_bytes += g_ascii_strtoull(field + 7, NULL, 10);
+            } else if (g_str_has_prefix(field, "wbytes=")) {
+                stats->io_write_bytes += g_ascii_strtoull(field + 7, NULL, 10);
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+/* Read one of the small "key value" files of the cgroup, like
+ * cgroup.events, into buf */
+static gboolean read_events(ContejnerCgroup *cgroup, const char *name,
+                            char *buf, gsize size)
+{
+    ssize_t len;
+    int fd;
+
+    fd = openat(cgroup->dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        g_debug("Failed to open %s/%s: %s", cgroup->path, name, strerror(errno));
+        return FALSE;
+    }
+
+    len = read(fd, buf, size - 1);
+    close(fd);
+    if (len < 0) {
+        return FALSE;
+    }
+
+    buf[len] = '\0';
+    return TRUE;
+}
+
+gboolean contejner_cgroup_is_frozen(ContejnerCgroup *cgroup)
+{
+    char events[256];
+
+    if (!read_events(cgroup, "cgroup.events", events, sizeof(events))) {
+        return FALSE;
+    }
+
+    return stats_value(events, "frozen") != 0;
+}
+
+gboolean contejner_cgroup_is_populated(ContejnerCgroup *cgroup)
+{
+    char events[EVENTS_BUF_SZ];
+
+    if (!read_events(cgroup, "cgroup.events", events, sizeof(events))) {
+        return FALSE;
+    }
+
+    return stats_value(events, "populated") != 0;
+}
+
+const char *contejner_cgroup_event_to_string(ContejnerCgroupEvent event)
+{
+    return event_names[event];
+}
+
+guint64 contejner_cgroup_get_event_count(ContejnerCgroup *cgroup,
+                                         ContejnerCgroupEvent event)
+{
+    return event < G_N_ELEMENTS(memory_events) ? cgroup->memory_counts[event]
+                                               : 0;
+}
+
+/* Report the counters of memory.events that went up */
+static void memory_events_changed(ContejnerCgroup *cgroup, gboolean report)
+{
+    char events[EVENTS_BUF_SZ];
+    guint i;
+
+    if (!read_events(cgroup, "memory.events", events, sizeof(events))) {
+        return;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(memory_events); i++) {
+        guint64 count = stats_value(events, memory_events[i]);
+        if (count > cgroup->memory_counts[i]) {
+            cgroup->memory_counts[i] = count;
+            if (report) {
+                cgroup->event_func(cgroup, i, count, cgroup->event_data);
+            }
+        }
+    }
+}
+
+static void cgroup_events_changed(ContejnerCgroup *cgroup)
+{
+    gboolean was_populated = cgroup->populated;
+
+    cgroup->populated = contejner_cgroup_is_populated(cgroup);
+    if (was_populated && !cgroup->populated) {
+        cgroup->event_func(cgroup, CONTEJNER_CGROUP_EVENT_DRAINED, 0,
+                           cgroup->event_data);
+    }
+}
+
+static gboolean inotify_readable(gint fd,
+                                 GIOCondition condition,
+                                 gpointer user_data)
+{
+    char buf[INOTIFY_BUF_SZ]
+        __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    ssize_t len;
+    char *p;
+
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (p = buf; p < buf + len; p += sizeof(*event) + event->len) {
+            ContejnerCgroup *cgroup;
+
+            event = (const struct inotify_event *) p;
+            /* A callback may have freed the cgroup, which removed its
+             * watches from the table */
+            cgroup = g_hash_table_lookup(watches, GINT_TO_POINTER(event->wd));
+            if (!cgroup || !(event->mask & IN_MODIFY)) {
+                continue;
+            }
+
+            if (event->wd == cgroup->memory_wd) {
+                memory_events_changed(cgroup, TRUE);
+            } else {
+                cgroup_events_changed(cgroup);
+            }
+        }
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+static int add_watch(ContejnerCgroup *cgroup, const char *name)
+{
+    gchar *path = g_build_filename(cgroup->path, name, NULL);
+    int wd = inotify_add_watch(inotify_fd, path, IN_MODIFY);
+
+    if (wd == -1) {
+        g_debug("Failed to watch %s: %s", path, strerror(errno));
+    } else {
+        g_hash_table_insert(watches, GINT_TO_POINTER(wd), cgroup);
+    }
+    g_free(path);
+    return wd;
+}
+
+static void remove_watch(int wd)
+{
+    if (wd != -1) {
+        g_hash_table_remove(watches, GINT_TO_POINTER(wd));
+        inotify_rm_watch(inotify_fd, wd);
+    }
+}
+
+gboolean contejner_cgroup_watch(ContejnerCgroup *cgroup,
+                                ContejnerCgroupEventFunc func,
+                                gpointer user_data)
+{
+    if (inotify_fd == -1) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd == -1) {
+            g_warning("Failed to set up inotify: %s", strerror(errno));
+            return FALSE;
+        }
+        watches = g_hash_table_new(NULL, NULL);
+        g_unix_fd_add(inotify_fd, G_IO_IN, inotify_readable, NULL);
+    }
+
+    cgroup->event_func = func;
+    cgroup->event_data = user_data;
+    if (cgroup->events_wd != -1) {
+        return TRUE;
+    }
+
+    /* Only what happens from here on is reported */
+    cgroup->events_wd = add_watch(cgroup, "cgroup.events");
+    if (cgroup->events_wd == -1) {
+        return FALSE;
+    }
+    cgroup->populated = contejner_cgroup_is_populated(cgroup);
+
+    /* Without the memory controller there is no memory.events */
+    cgroup->memory_wd = add_watch(cgroup, "memory.events");
+    if (cgroup->memory_wd != -1) {
+        memory_events_changed(cgroup, FALSE);
+    }
+
+    return TRUE;
+}
+
+guint64 contejner_cgroup_get_oom_kills(ContejnerCgroup *cgroup)
+{
+    char events[EVENTS_BUF_SZ];
+
+    if (!read_events(cgroup, "memory.events", events, sizeof(events))) {
+        return 0;
+    }
+
+    return stats_value(events, "oom_kill");
+}
+
+void contejner_cgroup_free(ContejnerCgroup *cgroup)
+{
+    int i;
+
+    if (!cgroup) {
+        return;
+    }
+
+    for (i = 0; cgroup->stats_opened && i < STATS_FILES; i++) {
+        if (cgroup->stats_fds[i] != -1) {
+            close(cgroup->stats_fds[i]);
+        }
+    }
+    remove_watch(cgroup->memory_wd);
+    remove_watch(cgroup->events_wd);
+    close(cgroup->dir_fd);
+    if (rmdir(cgroup->path)) {
+        g_debug("Failed to remove cgroup %s: %s", cgroup->path, strerror(errno));
+    }
+    g_free(cgroup->path);
+    g_free(cgroup);
+}
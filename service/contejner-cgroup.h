@@ -0,0 +1,132 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CONTEJNER_CGROUP_H
+#define CONTEJNER_CGROUP_H
+
+#include <glib.h>
+#include <sys/types.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ContejnerCgroup ContejnerCgroup;
+
+/* Resource usage of a cgroup. CPU time and I/O are totals since the cgroup
+ * was created. Counters of controllers not enabled for the cgroup are 0. */
+typedef struct {
+    guint64 cpu_usec;
+    guint64 memory_bytes;
+    guint64 io_read_bytes;
+    guint64 io_write_bytes;
+} ContejnerCgroupStats;
+
+/**
+ * contejner_cgroup_new:
+ * @name: name of the cgroup
+ *
+ * Create (or reuse) a cgroup called @name below the cgroup v2 group the
+ * service runs in. The service needs to own that group, e.g. through
+ * systemd's Delegate=yes. The first call moves the service to a "service"
+ * leaf below the group and enables the memory, io and cpu controllers for
+ * the containers, warning about those that can not be.
+ *
+ * Returns: a new #ContejnerCgroup, or NULL if no writable cgroup v2
+ *          hierarchy is available
+ */
+ContejnerCgroup *contejner_cgroup_new (const char *name);
+
+const char *contejner_cgroup_get_path (const ContejnerCgroup *cgroup);
+
+/* A descriptor of the cgroup directory, e.g. for CLONE_INTO_CGROUP */
+int contejner_cgroup_get_fd (const ContejnerCgroup *cgroup);
+
+/* Move a process into the cgroup */
+gboolean contejner_cgroup_add_pid (ContejnerCgroup *cgroup, pid_t pid);
+
+/* Freeze or thaw every process of the cgroup. The kernel completes the
+ * freeze asynchronously, shortly after this returns. */
+gboolean contejner_cgroup_freeze (ContejnerCgroup *cgroup, gboolean freeze);
+
+/* Send @signal to every process of the cgroup. SIGKILL goes through
+ * cgroup.kill where the kernel has it, which also catches processes forked
+ * meanwhile. Other signals, and SIGKILL on older kernels, are sent through
+ * a pidfd per process in cgroup.procs.
+ *
+ * Returns: whether any process was signalled */
+gboolean contejner_cgroup_signal (ContejnerCgroup *cgroup, int signal);
+
+/* Whether the processes of the cgroup are currently frozen */
+gboolean contejner_cgroup_is_frozen (ContejnerCgroup *cgroup);
+
+/* Number of processes of the cgroup killed by the OOM killer. 0 when the
+ * memory controller is not enabled for the cgroup. */
+guint64 contejner_cgroup_get_oom_kills (ContejnerCgroup *cgroup);
+
+typedef enum {
+    CONTEJNER_CGROUP_EVENT_MEMORY_HIGH,
+    CONTEJNER_CGROUP_EVENT_MEMORY_MAX,
+    CONTEJNER_CGROUP_EVENT_OOM_KILL,
+    CONTEJNER_CGROUP_EVENT_DRAINED,
+} ContejnerCgroupEvent;
+
+/* @count is the number of times the event happened in the cgroup so far, 0
+ * for CONTEJNER_CGROUP_EVENT_DRAINED */
+typedef void (*ContejnerCgroupEventFunc)(ContejnerCgroup *cgroup,
+                                         ContejnerCgroupEvent event,
+                                         guint64 count,
+                                         gpointer user_data);
+
+/**
+ * contejner_cgroup_watch:
+ * @cgroup: a #ContejnerCgroup
+ * @func: called for every event
+ * @user_data: passed to @func
+ *
+ * Watch memory.events and cgroup.events of the cgroup with inotify, from the
+ * main loop. The memory.high and memory.max limits being hit and processes
+ * being OOM killed are reported as they happen, as is the cgroup running
+ * out of processes. All cgroups share one inotify descriptor. The watch
+ * ends when the cgroup is freed.
+ *
+ * Returns: whether the cgroup is watched
+ */
+gboolean contejner_cgroup_watch (ContejnerCgroup *cgroup,
+                                 ContejnerCgroupEventFunc func,
+                                 gpointer user_data);
+
+const char *contejner_cgroup_event_to_string (ContejnerCgroupEvent event);
+
+/* Times the event happened in a watched cgroup, as last seen */
+guint64 contejner_cgroup_get_event_count (ContejnerCgroup *cgroup,
+                                          ContejnerCgroupEvent event);
+
+/* Whether any process is in the cgroup, or in one below it */
+gboolean contejner_cgroup_is_populated (ContejnerCgroup *cgroup);
+
+/* Read cpu.stat, memory.current and io.stat. The files are kept open after
+ * the first read, so that sampling a cgroup takes one read per file. */
+gboolean contejner_cgroup_read_stats (ContejnerCgroup *cgroup,
+                                      ContejnerCgroupStats *stats);
+
+/* Close the cgroup and remove it, if it has no processes left */
+void contejner_cgroup_free (ContejnerCgroup *cgroup);
+
+G_END_DECLS
+
+#endif /* CONTEJNER_CGROUP_H */
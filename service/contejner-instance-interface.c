@@ -19,10 +19,11 @@
 
 #define _GNU_SOURCE
 #include <sched.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "contejner-instance-interface.h"
 #include <gio/gunixfdlist.h>
-#include "contejner-instance.xml.h"
 
 struct _ContejnerInstanceInterface
 {
@@ -31,6 +32,10 @@ struct _ContejnerInstanceInterface
   // instance variables for subclass go here
 };
 
+/* Declares the handle_* functions below, and the generated
+ * instance_methods_dispatch() which unpacks the arguments for them */
+#include "contejner-instance.xml.h"
+
 typedef struct _ContejnerInstanceInterfacePrivate ContejnerInstanceInterfacePrivate;
 
 struct _ContejnerInstanceInterfacePrivate {
@@ -38,6 +43,7 @@ struct _ContejnerInstanceInterfacePrivate {
         gchar *dbus_name;
         gchar *dbus_object_path;
         ContejnerInstance *container;
+        ContejnerManager *manager;
         GDBusConnection *connection;
 };
 
@@ -46,6 +52,21 @@ struct _ContejnerInstanceInterfacePrivate {
                                        contejner_instance_interface_get_type(),    \
                                        ContejnerInstanceInterfacePrivate))
 
+/* Largest amount of output returned by a single ReadOutput call */
+#define READ_OUTPUT_MAX_SZ 4 * 1024 * 1024
+#define EXEC_OUTPUT_MAX_SZ 1024 * 1024
+
+static void return_error(GDBusMethodInvocation *invocation,
+                         const char *name,
+                         const char *message)
+{
+    gchar *func = g_strdup_printf("%s.Error.%s",
+                g_dbus_method_invocation_get_method_name(invocation),
+                name);
+    g_dbus_method_invocation_return_dbus_error(invocation, func, message);
+    g_free(func);
+}
+
 static void container_running_cb(ContejnerInstance *container,
                                  enum contejner_error_code error,
                                  const char *message,
@@ -60,58 +81,57 @@ static void container_running_cb(ContejnerInstance *container,
     g_variant_unref(value);
 }
 
-static void handle_Run(GDBusMethodInvocation *invocation,
-                       ContejnerInstanceInterface *self,
-                       ContejnerInstanceInterfacePrivate *priv)
+static void handle_Run(ContejnerInstanceInterface *self,
+                       GDBusMethodInvocation *invocation)
 {
+    ContejnerInstanceInterfacePrivate *priv =
+        CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
     void *created_data[] = {(void *) self, (void *) invocation};
-    contejner_instance_run(priv->container,
-                           container_running_cb,
-                           created_data);
+    contejner_manager_run(priv->manager,
+                          priv->container,
+                          g_dbus_method_invocation_get_sender(invocation),
+                          container_running_cb,
+                          created_data);
 }
 
-
-static void handle_SetCommand(GVariant *parameters,
-                              GDBusMethodInvocation *invocation,
-                              ContejnerInstanceInterfacePrivate *priv)
+static void handle_Rerun(ContejnerInstanceInterface *self,
+                         GDBusMethodInvocation *invocation)
 {
-    gchar *command = NULL;
-    GVariantIter *iter = NULL;
-    gchar *str = NULL;
-
-    g_variant_get(parameters, "(sas)", &command, &iter);
-
-    if (!iter) {
-        g_error ("Failed to parse");
-    }
-
-    int num_args = g_variant_iter_n_children(iter)+2;
-
-    char *args[num_args];
+    ContejnerInstanceInterfacePrivate *priv =
+        CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+    void *created_data[] = {(void *) self, (void *) invocation};
+    contejner_manager_rerun(priv->manager,
+                            priv->container,
+                            g_dbus_method_invocation_get_sender(invocation),
+                            container_running_cb,
+                            created_data);
+}
 
-    args[0] = g_strdup(command);
 
-    int i = 1;
-    while (g_variant_iter_loop (iter, "s", &str)) {
-        args[i++] = g_strdup(str);
-    }
-    args[i] = NULL;
-    g_variant_iter_free (iter);
+static void handle_SetCommand(ContejnerInstanceInterface *self,
+                              GDBusMethodInvocation *invocation,
+                              const gchar *command,
+                              const gchar **arguments)
+{
+    ContejnerInstanceInterfacePrivate *priv =
+        CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+    guint n = g_strv_length((gchar **) arguments);
+    const gchar **args = g_new(const gchar *, n + 2);
 
-    contejner_instance_set_command(priv->container,
-                                   command,
-                                   (const gchar **)args);
+    /* The strings belong to the message, set_command copies them */
+    args[0] = command;
+    memcpy(args + 1, arguments, (n + 1) * sizeof(*args));
 
-    i = 0;
-    for (i = 0; i < num_args - 1; i++) {
-        g_free(args[i]);
-    }
+    contejner_instance_set_command(priv->container, command, args);
+    g_free(args);
 
     g_dbus_method_invocation_return_value (invocation, NULL);
 }
-static void handle_Connect(GDBusMethodInvocation *invocation,
-                           ContejnerInstanceInterfacePrivate *priv)
+static void handle_Connect(ContejnerInstanceInterface *self,
+                           GDBusMethodInvocation *invocation)
 {
+    ContejnerInstanceInterfacePrivate *priv =
+        CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
     int fds[2] = { 0 };
     GValue v = G_VALUE_INIT;
     g_value_init(&v, G_TYPE_INT);
@@ -126,26 +146,25 @@ static void handle_Connect(GDBusMethodInvocation *invocation,
                                                              NULL,
                                                              fd_list);
 }
-static void handle_SetRoot(GVariant *parameters,
+static void handle_SetRoot(ContejnerInstanceInterface *self,
                            GDBusMethodInvocation *invocation,
-                           ContejnerInstanceInterfacePrivate *priv)
+                           const gchar *path)
 {
+        ContejnerInstanceInterfacePrivate *priv =
+            CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
         GValue status = G_VALUE_INIT;
-        gchar *path = NULL;
         g_value_init(&status, G_TYPE_INT);
         const char *m = g_dbus_method_invocation_get_method_name (invocation);
         char *func = NULL, *error = NULL;
 
         g_object_get_property(G_OBJECT(priv->container), "status", &status);
 
-        if (g_value_get_int(&status) == CONTEJNER_INSTANCE_STATUS_RUNNING) {
+        if (contejner_instance_is_active(priv->container)) {
             func = g_strdup_printf("%s.Error.AlreadyRunning", m);
             error = "Container already running";
             goto setroot_error;
         }
 
-        g_variant_get(parameters, "(s)", &path);
-
         GFile *f = g_file_new_for_path(path);
         gboolean ok = contejner_instance_set_root(priv->container, f);
         g_object_unref(f);
@@ -163,24 +182,317 @@ setroot_error:
                                                    error);
         g_free(func);
 }
-static void handle_Kill(GVariant *parameters,
+static void handle_Kill(ContejnerInstanceInterface *self,
                         GDBusMethodInvocation *invocation,
-                        ContejnerInstanceInterfacePrivate *priv)
+                        gint32 signal)
 {
-        int signal = 0;
-        g_variant_get(parameters, "(i)", &signal);
+        ContejnerInstanceInterfacePrivate *priv =
+            CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
         gboolean ret = contejner_instance_kill(priv->container, signal);
         if (ret) {
             g_dbus_method_invocation_return_value (invocation, NULL);
         } else {
-            gchar *func = g_strdup_printf("%s.Error.KillFailed",
-                        g_dbus_method_invocation_get_method_name(invocation));
-            gchar *error = "Failed to send kill signal";
-            g_dbus_method_invocation_return_dbus_error(invocation,
-                                                       func,
-                                                       error);
-            g_free(func);
+            return_error(invocation, "KillFailed", "Failed to send kill signal");
+        }
+}
+
+static void stop_done_cb(ContejnerInstance *container,
+                         int exit_status,
+                         gpointer user_data)
+{
+    GDBusMethodInvocation *invocation = user_data;
+
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new("(i)", exit_status));
+}
+
+static void handle_Stop(ContejnerInstanceInterface *self,
+                        GDBusMethodInvocation *invocation,
+                        guint32 grace_ms)
+{
+        ContejnerInstanceInterfacePrivate *priv =
+            CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+
+        /* A queued container only has to leave the queue */
+        if (contejner_manager_dequeue(priv->manager, priv->container)) {
+            stop_done_cb(priv->container, -1, invocation);
+        } else if (!contejner_instance_stop(priv->container, grace_ms,
+                                            stop_done_cb, invocation)) {
+            return_error(invocation, "NotRunning", "Container is not running");
+        }
+}
+
+static void handle_AddMount(ContejnerInstanceInterface *self,
+                            GDBusMethodInvocation *invocation,
+                            const gchar *host_path,
+                            const gchar *container_path,
+                            guint32 flags)
+{
+        ContejnerInstanceInterfacePrivate *priv =
+            CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+
+        if (contejner_instance_is_active(priv->container)) {
+            return_error(invocation, "AlreadyRunning", "Container already running");
+        } else if (!contejner_instance_add_mount(priv->container, host_path,
+                                                 container_path, flags)) {
+            return_error(invocation, "InvalidMount", "Invalid paths or flags");
+        } else {
+            g_dbus_method_invocation_return_value (invocation, NULL);
+        }
+}
+
+static void handle_SetLabels(ContejnerInstanceInterface *self,
+                             GDBusMethodInvocation *invocation,
+                             GVariant *labels)
+{
+        ContejnerInstanceInterfacePrivate *priv =
+            CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+        contejner_manager_set_labels(priv->manager, priv->container, labels);
+        g_dbus_method_invocation_return_value (invocation, NULL);
+}
+
+static void set_frozen(ContejnerInstanceInterface *self,
+                       GDBusMethodInvocation *invocation,
+                       gboolean freeze)
+{
+    ContejnerInstanceInterfacePrivate *priv =
+        CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+    ContejnerInstanceStatus status;
+
+    g_object_get(G_OBJECT(priv->container), "status", &status, NULL);
+    if (freeze && status != CONTEJNER_INSTANCE_STATUS_RUNNING) {
+        return_error(invocation, "NotRunning", "Container is not running");
+    } else if (!freeze && status != CONTEJNER_INSTANCE_STATUS_FROZEN) {
+        return_error(invocation, "NotFrozen", "Container is not frozen");
+    } else if (!contejner_instance_freeze(priv->container, freeze)) {
+        return_error(invocation, "Failed", "The cgroup freezer is not available");
+    } else {
+        g_dbus_method_invocation_return_value (invocation, NULL);
+    }
+}
+
+static void handle_Freeze(ContejnerInstanceInterface *self,
+                          GDBusMethodInvocation *invocation)
+{
+    set_frozen(self, invocation, TRUE);
+}
+
+static void handle_Thaw(ContejnerInstanceInterface *self,
+                        GDBusMethodInvocation *invocation)
+{
+    set_frozen(self, invocation, FALSE);
+}
+
+static void handle_AttachTerminal(ContejnerInstanceInterface *self,
+                                  GDBusMethodInvocation *invocation)
+{
+        ContejnerInstanceInterfacePrivate *priv =
+            CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+        int fd = contejner_instance_attach_terminal(priv->container);
+        if (fd == -1) {
+            return_error(invocation, "NoTerminal", "Container has no terminal");
+            return;
+        }
+
+        GUnixFDList *fd_list = g_unix_fd_list_new_from_array(&fd, 1);
+        g_dbus_method_invocation_return_value_with_unix_fd_list (invocation,
+                                                                 g_variant_new("(h)", 0),
+                                                                 fd_list);
+        g_object_unref(fd_list);
+}
+static void handle_ResizeTerminal(ContejnerInstanceInterface *self,
+                                  GDBusMethodInvocation *invocation,
+                                  guint16 rows,
+                                  guint16 columns)
+{
+        ContejnerInstanceInterfacePrivate *priv =
+            CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+        if (contejner_instance_resize_terminal(priv->container, rows, columns)) {
+            g_dbus_method_invocation_return_value (invocation, NULL);
+        } else {
+            return_error(invocation, "ResizeFailed", "Failed to resize terminal");
+        }
+}
+static gboolean lookup_output(GDBusMethodInvocation *invocation,
+                              ContejnerInstanceInterfacePrivate *priv,
+                              const gchar *stream,
+                              const gchar *unit_name,
+                              ContejnerLog **log,
+                              ContejnerLogUnit *unit)
+{
+        *log = contejner_instance_get_output_log(priv->container, stream);
+        if (!*log) {
+            return_error(invocation, "BadStream", "Unknown output stream");
+            return FALSE;
+        }
+
+        if (!contejner_log_unit_from_string(unit_name, unit)) {
+            return_error(invocation, "BadUnit", "Unit must be bytes, lines or time");
+            return FALSE;
+        }
+
+        return TRUE;
+}
+static void handle_ReadOutput(ContejnerInstanceInterface *self,
+                              GDBusMethodInvocation *invocation,
+                              const gchar *stream,
+                              gint64 from,
+                              guint64 count,
+                              const gchar *unit_name)
+{
+        ContejnerInstanceInterfacePrivate *priv =
+            CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+        guint64 start = 0, end = 0;
+        ContejnerLog *log = NULL;
+        ContejnerLogUnit unit;
+
+        if (!lookup_output(invocation, priv, stream, unit_name, &log, &unit)) {
+            return;
+        }
+
+        contejner_log_resolve(log, from, count, unit, &start, &end);
+        GBytes *data = contejner_log_read(log, start,
+                                          MIN(MAX(end, start) - start,
+                                              READ_OUTPUT_MAX_SZ));
+        if (!data) {
+            return_error(invocation, "ReadFailed", "Failed to read output");
+            return;
+        }
+
+        /* A short read is reported through next, so that the caller can
+         * continue from there with a byte range */
+        gsize len = 0;
+        gconstpointer buf = g_bytes_get_data(data, &len);
+        g_dbus_method_invocation_return_value (invocation,
+                g_variant_new("(@aytt)",
+                              g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
+                                                        buf, len, 1),
+                              start,
+                              start + len));
+        g_bytes_unref(data);
+}
+static void handle_GetSeries(ContejnerInstanceInterface *self,
+                             GDBusMethodInvocation *invocation,
+                             const gchar *metric,
+                             gint64 since)
+{
+        ContejnerInstanceInterfacePrivate *priv =
+            CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+        GVariant *series = contejner_instance_get_series(priv->container,
+                                                         metric, since);
+
+        if (!series) {
+            return_error(invocation, "UnknownMetric", "No such metric");
+            return;
+        }
+        g_dbus_method_invocation_return_value (invocation, series);
+}
+static void handle_OpenOutput(ContejnerInstanceInterface *self,
+                              GDBusMethodInvocation *invocation,
+                              const gchar *stream,
+                              gint64 from,
+                              const gchar *unit_name)
+{
+        ContejnerInstanceInterfacePrivate *priv =
+            CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+        guint64 start = 0, end = 0;
+        ContejnerLog *log = NULL;
+        ContejnerLogUnit unit;
+
+        if (!lookup_output(invocation, priv, stream, unit_name, &log, &unit)) {
+            return;
+        }
+
+        contejner_log_resolve(log, from, 0, unit, &start, &end);
+
+        /* Compressed output is only available through ReadOutput, the
+         * returned offset tells where the descriptor really starts */
+        start = MAX(start, contejner_log_get_plain_offset(log));
+
+        /* Every caller gets its own file description, and with it its own
+         * file offset */
+        int fd = contejner_log_open(log);
+        if (fd == -1 || lseek(fd, start, SEEK_SET) == -1) {
+            if (fd != -1) {
+                close(fd);
+            }
+            return_error(invocation, "OpenFailed", "Failed to open output");
+            return;
+        }
+
+        GUnixFDList *fd_list = g_unix_fd_list_new_from_array(&fd, 1);
+        g_dbus_method_invocation_return_value_with_unix_fd_list (invocation,
+                                                                 g_variant_new("(ht)", 0, start),
+                                                                 fd_list);
+        g_object_unref(fd_list);
+}
+
+static void exec_done_cb(ContejnerInstance *container,
+                         enum contejner_error_code error,
+                         const char *message,
+                         int status,
+                         GBytes *out,
+                         GBytes *err,
+                         gpointer user_data)
+{
+    GDBusMethodInvocation *invocation = user_data;
+
+    if (error != CONTEJNER_OK) {
+        return_error(invocation, "Failed", message);
+        return;
+    }
+
+    g_dbus_method_invocation_return_value (invocation,
+            g_variant_new("(i@ay@ay)",
+                          status,
+                          g_variant_new_from_bytes(G_VARIANT_TYPE_BYTESTRING,
+                                                   out, TRUE),
+                          g_variant_new_from_bytes(G_VARIANT_TYPE_BYTESTRING,
+                                                   err, TRUE)));
+}
+
+static void handle_Exec(ContejnerInstanceInterface *self,
+                        GDBusMethodInvocation *invocation,
+                        const gchar *command,
+                        const gchar **arguments,
+                        GVariant *options)
+{
+        ContejnerInstanceInterfacePrivate *priv =
+            CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+        GVariantIter iter;
+        const gchar *key;
+        GVariant *value;
+        guint32 timeout = 0;
+        guint32 max_output = EXEC_OUTPUT_MAX_SZ;
+        ContejnerInstanceStatus status;
+
+        g_object_get(G_OBJECT(priv->container), "status", &status, NULL);
+        if (status != CONTEJNER_INSTANCE_STATUS_RUNNING) {
+            return_error(invocation, "NotRunning", "Container is not running");
+            return;
         }
+
+        /* Timeout is in milliseconds, MaxOutput in bytes per stream */
+        g_variant_iter_init(&iter, options);
+        while (g_variant_iter_next(&iter, "{&sv}", &key, &value)) {
+            gboolean ok = g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32);
+            if (ok && !g_strcmp0(key, "Timeout")) {
+                timeout = g_variant_get_uint32(value);
+            } else if (ok && !g_strcmp0(key, "MaxOutput")) {
+                max_output = MIN(g_variant_get_uint32(value), EXEC_OUTPUT_MAX_SZ);
+            } else {
+                ok = FALSE;
+            }
+            g_variant_unref(value);
+
+            if (!ok) {
+                return_error(invocation, "BadOption", "Unknown option or wrong type");
+                return;
+            }
+        }
+
+        contejner_instance_exec(priv->container, command, arguments, timeout,
+                                max_output, exec_done_cb, invocation);
 }
 
 static void dbus_method_call(G_GNUC_UNUSED GDBusConnection *connection,
@@ -193,18 +505,16 @@ static void dbus_method_call(G_GNUC_UNUSED GDBusConnection *connection,
                              gpointer user_data)
 {
     ContejnerInstanceInterface *self = user_data;
-    ContejnerInstanceInterfacePrivate *priv = CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
 
-    if (!g_strcmp0(method_name, "Run")) {
-        handle_Run(invocation, self, priv);
-    } else if (!g_strcmp0(method_name, "SetCommand")) {
-        handle_SetCommand(parameters, invocation, priv);
-    } else if (!g_strcmp0(method_name, "Connect")) {
-        handle_Connect(invocation, priv);
-    } else if (!g_strcmp0(method_name, "SetRoot")) {
-        handle_SetRoot(parameters, invocation, priv);
-    } else if (!g_strcmp0(method_name, "Kill")) {
-        handle_Kill(parameters, invocation, priv);
+    /* GDBus has checked the method and its arguments against the
+     * introspection data, which the table is generated from, and refused
+     * unknown methods already. The error only guards against the two
+     * getting out of step. */
+    if (!instance_methods_dispatch(self, method_name, parameters, invocation)) {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_UNKNOWN_METHOD,
+                                              "No such method: %s",
+                                              method_name);
     }
 }
 
@@ -229,17 +539,11 @@ static GVariant *dbus_get_property (GDBusConnection *connection,
         contejner_instance_get_unshared_namespaces(priv->container);
 
     if (!g_strcmp0(property_name, "Status")) {
-        switch (status) {
-            case CONTEJNER_INSTANCE_STATUS_RUNNING:
-                v = g_variant_new ("(s)", "RUNNING");
-                break;
-            case CONTEJNER_INSTANCE_STATUS_STOPPED:
-                v = g_variant_new ("(s)", "STOPPED");
-                break;
-            case CONTEJNER_INSTANCE_STATUS_CREATED:
-                v = g_variant_new ("(s)", "CREATED");
-                break;
-            default: g_warning ("Illegal status received");
+        const char *status_str = contejner_instance_status_to_string(status);
+        if (status_str) {
+            v = g_variant_new ("(s)", status_str);
+        } else {
+            g_warning ("Illegal status received");
         }
     } else if (!g_strcmp0(property_name, "MountNamespaceEnabled")) {
         v = g_variant_new ("(b)", (current_namespaces & CLONE_NEWNS) > 0);
@@ -253,6 +557,88 @@ static GVariant *dbus_get_property (GDBusConnection *connection,
         v = g_variant_new ("(b)", (current_namespaces & CLONE_NEWUTS) > 0);
     } else if (!g_strcmp0(property_name, "UserNamespaceEnabled")) {
         v = g_variant_new ("(b)", (current_namespaces & CLONE_NEWUSER) > 0);
+    } else if (!g_strcmp0(property_name, "Terminal")) {
+        v = g_variant_new ("(b)",
+                           contejner_instance_get_terminal(priv->container));
+    } else if (!g_strcmp0(property_name, "Mounts")) {
+        v = g_variant_new ("(@a(ssu))",
+                           contejner_instance_get_mounts(priv->container));
+    } else if (!g_strcmp0(property_name, "Scratch")) {
+        v = g_variant_new ("(@a{st})",
+                           contejner_instance_get_scratch(priv->container));
+    } else if (!g_strcmp0(property_name, "CompressOutput")) {
+        v = g_variant_new ("(b)",
+                           contejner_instance_get_compress_output(priv->container));
+    } else if (!g_strcmp0(property_name, "OutputSize")) {
+        v = g_variant_new ("(t)",
+                           contejner_instance_get_output_size(priv->container, FALSE));
+    } else if (!g_strcmp0(property_name, "StoredOutputSize")) {
+        v = g_variant_new ("(t)",
+                           contejner_instance_get_output_size(priv->container, TRUE));
+    } else if (!g_strcmp0(property_name, "Timeout")) {
+        v = g_variant_new ("(u)",
+                           contejner_instance_get_timeout(priv->container));
+    } else if (!g_strcmp0(property_name, "TimeoutGracePeriod")) {
+        v = g_variant_new ("(u)",
+                           contejner_instance_get_timeout_grace(priv->container));
+    } else if (!g_strcmp0(property_name, "TimedOut")) {
+        v = g_variant_new ("(b)",
+                           contejner_instance_get_timed_out(priv->container));
+    } else if (!g_strcmp0(property_name, "MemoryHighEvents")) {
+        v = g_variant_new ("(t)",
+                           contejner_instance_get_cgroup_event_count(priv->container,
+                                                                     CONTEJNER_CGROUP_EVENT_MEMORY_HIGH));
+    } else if (!g_strcmp0(property_name, "MemoryMaxEvents")) {
+        v = g_variant_new ("(t)",
+                           contejner_instance_get_cgroup_event_count(priv->container,
+                                                                     CONTEJNER_CGROUP_EVENT_MEMORY_MAX));
+    } else if (!g_strcmp0(property_name, "OOMKills")) {
+        v = g_variant_new ("(t)",
+                           contejner_instance_get_cgroup_event_count(priv->container,
+                                                                     CONTEJNER_CGROUP_EVENT_OOM_KILL));
+    } else if (!g_strcmp0(property_name, "RestartPolicy")) {
+        v = g_variant_new ("(s)",
+                           contejner_instance_get_restart_policy(priv->container));
+    } else if (!g_strcmp0(property_name, "Restarts")) {
+        v = g_variant_new ("(u)",
+                           contejner_instance_get_restarts(priv->container));
+    } else if (!g_strcmp0(property_name, "OutputRateLimit")) {
+        v = g_variant_new ("(t)",
+                           contejner_instance_get_output_rate_limit(priv->container));
+    } else if (!g_strcmp0(property_name, "OutputVolumeLimit")) {
+        v = g_variant_new ("(t)",
+                           contejner_instance_get_output_volume_limit(priv->container));
+    } else if (!g_strcmp0(property_name, "OutputLimitPolicy")) {
+        v = g_variant_new ("(s)",
+                           contejner_instance_get_output_limit_policy(priv->container));
+    } else if (!g_strcmp0(property_name, "OutputDropped")) {
+        v = g_variant_new ("(t)",
+                           contejner_instance_get_output_dropped(priv->container));
+    } else if (!g_strcmp0(property_name, "OutputLimitHits")) {
+        v = g_variant_new ("(u)",
+                           contejner_instance_get_output_limit_hits(priv->container));
+    } else if (!g_strcmp0(property_name, "CpuSet")) {
+        v = g_variant_new ("(s)",
+                           contejner_instance_get_cpuset(priv->container));
+    } else if (!g_strcmp0(property_name, "MemNodes")) {
+        v = g_variant_new ("(s)",
+                           contejner_instance_get_mem_nodes(priv->container));
+    } else if (!g_strcmp0(property_name, "Nice")) {
+        v = g_variant_new ("(i)",
+                           contejner_instance_get_nice(priv->container));
+    } else if (!g_strcmp0(property_name, "SchedPolicy")) {
+        v = g_variant_new ("(s)",
+                           contejner_instance_get_sched_policy(priv->container));
+    } else if (!g_strcmp0(property_name, "IOPriority")) {
+        gchar *priority = contejner_instance_get_io_priority(priv->container);
+        v = g_variant_new ("(s)", priority);
+        g_free(priority);
+    } else if (!g_strcmp0(property_name, "ExitStatus")) {
+        v = g_variant_new ("(i)",
+                           contejner_instance_get_exit_status(priv->container));
+    } else if (!g_strcmp0(property_name, "Labels")) {
+        v = g_variant_new ("(@a{ss})",
+                           contejner_instance_get_labels_variant(priv->container));
     } else {
         g_error("Unknown D-Bus property: %s", property_name);
     }
@@ -268,6 +654,114 @@ static gboolean dbus_set_property (GDBusConnection *connection,
                              GError **error,
                              gpointer user_data)
 {
+    ContejnerInstanceInterface *self = user_data;
+    ContejnerInstanceInterfacePrivate *priv = CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(self);
+    int ns;
+
+    if ((ns = contejner_instance_namespace_from_string(property_name))) {
+        gboolean ok = g_variant_get_boolean(value) ?
+            contejner_instance_enable_ns(priv->container, ns) :
+            contejner_instance_disable_ns(priv->container, ns);
+        if (!ok) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                        "Container already running");
+        }
+        return ok;
+    } else if (!g_strcmp0(property_name, "Terminal")) {
+        if (!contejner_instance_set_terminal(priv->container,
+                                             g_variant_get_boolean(value))) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                        "Container already running");
+            return FALSE;
+        }
+        return TRUE;
+    } else if (!g_strcmp0(property_name, "Scratch")) {
+        if (!contejner_instance_set_scratch(priv->container, value)) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Invalid scratch space, or container already running");
+            return FALSE;
+        }
+        return TRUE;
+    } else if (!g_strcmp0(property_name, "CompressOutput")) {
+        if (!contejner_instance_set_compress_output(priv->container,
+                                                    g_variant_get_boolean(value))) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                        "Failed to create compressed output");
+            return FALSE;
+        }
+        return TRUE;
+    } else if (!g_strcmp0(property_name, "Timeout")) {
+        return contejner_instance_set_timeout(priv->container,
+                                              g_variant_get_uint32(value));
+    } else if (!g_strcmp0(property_name, "TimeoutGracePeriod")) {
+        return contejner_instance_set_timeout_grace(priv->container,
+                                                    g_variant_get_uint32(value));
+    } else if (!g_strcmp0(property_name, "OutputRateLimit")) {
+        return contejner_instance_set_output_rate_limit(priv->container,
+                                                        g_variant_get_uint64(value));
+    } else if (!g_strcmp0(property_name, "OutputVolumeLimit")) {
+        return contejner_instance_set_output_volume_limit(priv->container,
+                                                          g_variant_get_uint64(value));
+    } else if (!g_strcmp0(property_name, "OutputLimitPolicy")) {
+        if (!contejner_instance_set_output_limit_policy(priv->container,
+                                                        g_variant_get_string(value, NULL))) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Policy must be block, drop or kill");
+            return FALSE;
+        }
+        return TRUE;
+    } else if (!g_strcmp0(property_name, "RestartPolicy")) {
+        if (!contejner_instance_set_restart_policy(priv->container,
+                                                   g_variant_get_string(value, NULL))) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Policy must be never, on-failure or always");
+            return FALSE;
+        }
+        return TRUE;
+    } else if (!g_strcmp0(property_name, "CpuSet")) {
+        if (!contejner_instance_set_cpuset(priv->container,
+                                           g_variant_get_string(value, NULL))) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Invalid CPU list, or container already running");
+            return FALSE;
+        }
+        return TRUE;
+    } else if (!g_strcmp0(property_name, "MemNodes")) {
+        if (!contejner_instance_set_mem_nodes(priv->container,
+                                              g_variant_get_string(value, NULL))) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Invalid node list, or container already running");
+            return FALSE;
+        }
+        return TRUE;
+    } else if (!g_strcmp0(property_name, "Nice")) {
+        if (!contejner_instance_set_nice(priv->container,
+                                         g_variant_get_int32(value))) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Invalid nice value, or container already running");
+            return FALSE;
+        }
+        return TRUE;
+    } else if (!g_strcmp0(property_name, "SchedPolicy")) {
+        if (!contejner_instance_set_sched_policy(priv->container,
+                                                 g_variant_get_string(value, NULL))) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Invalid policy, or container already running");
+            return FALSE;
+        }
+        return TRUE;
+    } else if (!g_strcmp0(property_name, "IOPriority")) {
+        if (!contejner_instance_set_io_priority(priv->container,
+                                                g_variant_get_string(value, NULL))) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Invalid I/O priority, or container already running");
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_PROPERTY_READ_ONLY,
+                "Property %s can not be changed", property_name);
     return FALSE;
 }
 
@@ -350,26 +844,14 @@ static void status_changed(GObject *instance,
     g_value_init(&new_value, G_TYPE_INT);
     g_object_get_property(instance, "status", &new_value);
     ContejnerInstanceStatus status = g_value_get_int(&new_value);
-    switch (status) {
-        case CONTEJNER_INSTANCE_STATUS_RUNNING:
-            g_variant_builder_add (builder,
-                                 "{sv}",
-                                 "status",
-                                 g_variant_new_string ("RUNNING"));
-            break;
-        case CONTEJNER_INSTANCE_STATUS_STOPPED:
-            g_variant_builder_add (builder,
-                                   "{sv}",
-                                   "status",
-                                   g_variant_new_string ("STOPPED"));
-            break;
-        case CONTEJNER_INSTANCE_STATUS_CREATED:
-            g_variant_builder_add (builder,
-                                   "{sv}",
-                                   "status",
-                                   g_variant_new_string ("CREATED"));
-            break;
-        default: g_warning ("Illegal status received");
+    const char *status_str = contejner_instance_status_to_string(status);
+    if (status_str) {
+        g_variant_builder_add (builder,
+                               "{sv}",
+                               "status",
+                               g_variant_new_string (status_str));
+    } else {
+        g_warning ("Illegal status received");
     }
 
     gboolean dbus_status =
@@ -389,9 +871,47 @@ static void status_changed(GObject *instance,
 
 }
 
+static void cgroup_event(ContejnerInstance *instance,
+                         ContejnerCgroupEvent event,
+                         guint64 count,
+                         gpointer user_data)
+{
+    ContejnerInstanceInterfacePrivate *priv =
+        CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(user_data);
+    GError *error = NULL;
+
+    if (!g_dbus_connection_emit_signal(priv->connection,
+                                       NULL,
+                                       priv->dbus_object_path,
+                                       priv->dbus_name,
+                                       "CgroupEvent",
+                                       g_variant_new("(st)",
+                                                     contejner_cgroup_event_to_string(event),
+                                                     count),
+                                       &error)) {
+        g_warning("Failed to emit signal: %s", error->message);
+        g_error_free(error);
+    }
+}
+
+static void contejner_instance_interface_finalize (GObject *object)
+{
+    ContejnerInstanceInterfacePrivate *priv =
+        CONTEJNER_INSTANCE_INTERFACE_GET_PRIVATE(object);
+
+    g_signal_handlers_disconnect_by_data(priv->container, object);
+    g_object_unref(priv->container);
+
+    /* Also frees dbus_name, which the interface info took over */
+    g_dbus_node_info_unref(priv->node_info);
+
+    G_OBJECT_CLASS(contejner_instance_interface_parent_class)->finalize(object);
+}
+
 static void contejner_instance_interface_class_init (ContejnerInstanceInterfaceClass *class)
 {
     g_type_class_add_private(class, sizeof(ContejnerInstanceInterfacePrivate));
+    G_OBJECT_CLASS(class)->finalize = contejner_instance_interface_finalize;
     G_DBUS_INTERFACE_SKELETON_CLASS(class)->flush = flush;
     G_DBUS_INTERFACE_SKELETON_CLASS(class)->get_info = get_info;
     G_DBUS_INTERFACE_SKELETON_CLASS(class)->get_vtable = get_vtable;
@@ -399,6 +919,7 @@ static void contejner_instance_interface_class_init (ContejnerInstanceInterfaceC
 }
 
 ContejnerInstanceInterface * contejner_instance_interface_new (ContejnerInstance *container,
+                                                               ContejnerManager *manager,
                                                                GDBusConnection *connection)
 {
    ContejnerInstanceInterface *svc = g_object_new (CONTEJNER_TYPE_INSTANCE_INTERFACE, NULL);
@@ -413,7 +934,8 @@ ContejnerInstanceInterface * contejner_instance_interface_new (ContejnerInstance
    priv->dbus_object_path = CONTEJNER_INSTANCE_INTERFACE_PATH;
 
    priv->connection = connection;
-   priv->container = container;
+   priv->container = g_object_ref(container);
+   priv->manager = manager;
 
    load_node_info(svc);
 
@@ -421,6 +943,10 @@ ContejnerInstanceInterface * contejner_instance_interface_new (ContejnerInstance
                     "notify::status",
                     G_CALLBACK(status_changed),
                     svc);
+   g_signal_connect (container,
+                    "cgroup-event",
+                    G_CALLBACK(cgroup_event),
+                    svc);
 
    return svc;
 }
@@ -33,6 +33,7 @@ G_DECLARE_FINAL_TYPE(ContejnerInstanceInterface,
                      INSTANCE_INTERFACE, GDBusInterfaceSkeleton)
 
 ContejnerInstanceInterface *contejner_instance_interface_new (ContejnerInstance *intance,
+                                                              ContejnerManager *manager,
                                                               GDBusConnection *connection);
 
 const char *contejner_instance_interface_get_dbus_interface (const ContejnerInstanceInterface *i);
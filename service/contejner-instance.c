@@ -20,22 +20,56 @@
 #define _GNU_SOURCE
 #include <error.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sched.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <sys/mman.h>
+#include <limits.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mount.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <linux/ioprio.h>
+#include <linux/sched.h>
+#include <linux/mempolicy.h>
+#include <glib-unix.h>
 
 #include "contejner-instance.h"
 #include "contejner-common.h"
+#include "contejner-pty.h"
+#include "contejner-log.h"
+#include "contejner-cgroup.h"
+#include "contejner-timer.h"
+#include "contejner-series.h"
 
 #define CONTAINER_NAME_SZ 20
 #define STACK_SIZE 1024 * 1024
 #define STDOUT_BUF_SZ 1024
 #define STDERR_BUF_SZ 1024
+#define OUTPUT_BUF_SZ 64 * 1024
+#define OUTPUT_MAX_READS 16
+#define MAX_NUMA_NODES 1024
+#define LONG_BITS (8 * sizeof(unsigned long))
+#define DEFAULT_TIMEOUT_GRACE 10
+/* Samples of resource usage kept, 15 minutes at one sample per second */
+#define SERIES_SZ 900
+/* Delay of the first automatic restart, doubled with every restart in a row
+ * up to the maximum. A run that lasts the reset time ends the row. */
+#define RESTART_DELAY_MIN_MS 100
+#define RESTART_DELAY_MAX_MS 60000
+#define RESTART_RESET_US (10 * G_USEC_PER_SEC)
+
+/* Messages about a container are logged with its name as the log domain */
+#define instance_debug(priv, ...) \
+    g_log((priv)->name, G_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define instance_warning(priv, ...) \
+    g_log((priv)->name, G_LOG_LEVEL_WARNING, __VA_ARGS__)
 
 /* List of namepaces to unshare */
 #define DEFAULT_UNSHARED_NAMESPACES     \
@@ -55,14 +89,61 @@ struct _ContejnerInstance
 
 typedef struct _ContejnerInstancePrivate ContejnerInstancePrivate;
 
+/* A directory of the host, bind mounted at @path_in_container under the root
+ * directory of the container */
 struct mount {
     char *path_in_host;
     char *path_in_container;
+    ContejnerMountFlags flags;
+};
+
+/* A tmpfs mounted in the container, at @path under its root directory */
+struct scratch {
+    char *path;
+    guint64 size;
+};
+
+/* Output of the container is read from a pipe and stored in a log */
+struct output {
+    ContejnerInstance *instance;
+    ContejnerLog *log;
+    int fd;
+    int write_fd;
+    guint watch;
+    /* Not read, because of an output limit */
+    gboolean paused;
+    guint resume;
+};
+
+enum restart_policy {
+    RESTART_NEVER,
+    RESTART_ON_FAILURE,
+    RESTART_ALWAYS,
+};
+
+enum output_limit_policy {
+    OUTPUT_LIMIT_BLOCK,
+    OUTPUT_LIMIT_DROP,
+    OUTPUT_LIMIT_KILL,
+};
+
+/* Limits on the output kept of a run of the container. The rate is
+ * enforced with a token bucket holding up to a second of output. */
+struct output_limits {
+    guint64 rate;
+    guint64 volume;
+    enum output_limit_policy policy;
+    guint64 tokens;
+    gint64 refilled;
+    guint64 kept;
+    guint64 dropped;
+    guint hits;
+    gboolean limited;
 };
 
 struct _ContejnerInstancePrivate {
-    gint stderr_fd;
-    gint stdout_fd;
+    struct output stderr_output;
+    struct output stdout_output;
     int id;
     char name[CONTAINER_NAME_SZ];
     char *command;
@@ -71,10 +152,111 @@ struct _ContejnerInstancePrivate {
     char *stack;
     int unshared_namespaces;
     GSList *mounts;
+    /* Sorted by path, so that a path goes before the ones under it */
+    struct scratch *scratch;
+    guint n_scratch;
     char stdout_buf[STDOUT_BUF_SZ];
     char stderr_buf[STDERR_BUF_SZ];
     ContejnerInstanceStatus status;
     pid_t pid;
+    guint64 start_time;
+    int exit_status;
+    /* The init process was reaped, while the rest of the process tree may
+     * still be running */
+    gboolean reaped;
+    /* Whether the cgroup reports its events, so that the container stops
+     * once the cgroup is drained. Counts of the events, of the current or
+     * last run. */
+    gboolean cgroup_watched;
+    guint64 cgroup_events[CONTEJNER_CGROUP_EVENT_DRAINED];
+    /* Seconds a run may take, 0 for no limit, and the seconds between
+     * SIGTERM and SIGKILL once it is up. The deadline is wall clock time, so
+     * that it survives a restart of the service. */
+    guint timeout;
+    guint timeout_grace;
+    gboolean timed_out;
+    gint64 deadline;
+    ContejnerTimer timeout_timer;
+    /* Callbacks of Stop calls, waiting for the container to stop, and the
+     * end of their grace period */
+    GSList *stops;
+    ContejnerTimer stop_timer;
+    /* A stop that was asked for is not undone by a restart */
+    gboolean stop_requested;
+    enum restart_policy restart_policy;
+    guint restarts;
+    gint64 run_started;
+    /* Delay of the restart planned when the last run stopped, or -1 */
+    gint64 restart_delay;
+    int pidfd;
+    guint exit_watch;
+    char *output_path;
+    gboolean terminal;
+    gboolean compress_output;
+    struct output_limits output_limits;
+    ContejnerPty *pty;
+    ContejnerCgroup *cgroup;
+    ContejnerSeries *series;
+    int sync_pipe[2];
+    char *cpuset;
+    cpu_set_t cpu_mask;
+    char *mem_nodes;
+    unsigned long node_mask[MAX_NUMA_NODES / LONG_BITS];
+    gboolean nice_set;
+    int nice;
+    int sched_policy;
+    int io_priority;
+    GHashTable *labels;
+};
+
+static const struct {
+    const char *name;
+    enum output_limit_policy policy;
+} output_limit_policies[] = {
+    { "block", OUTPUT_LIMIT_BLOCK },
+    { "drop", OUTPUT_LIMIT_DROP },
+    { "kill", OUTPUT_LIMIT_KILL },
+};
+
+static const struct {
+    const char *name;
+    enum restart_policy policy;
+} restart_policies[] = {
+    { "never", RESTART_NEVER },
+    { "on-failure", RESTART_ON_FAILURE },
+    { "always", RESTART_ALWAYS },
+};
+
+static const struct {
+    const char *name;
+    int policy;
+} sched_policies[] = {
+    { "OTHER", SCHED_OTHER },
+    { "BATCH", SCHED_BATCH },
+    { "IDLE", SCHED_IDLE },
+};
+
+/* Namespaces, by the name of their D-Bus property and their file in
+ * /proc/<pid>/ns. The user namespace goes first, since joining it gives the
+ * capabilities needed to join the others. */
+static const struct {
+    const char *property;
+    int flag;
+    const char *file;
+} namespaces[] = {
+    { "UserNamespaceEnabled", CLONE_NEWUSER, "user" },
+    { "MountNamespaceEnabled", CLONE_NEWNS, "mnt" },
+    { "NetworkNamespaceEnabled", CLONE_NEWNET, "net" },
+    { "IPCNamespaceEnabled", CLONE_NEWIPC, "ipc" },
+    { "PIDNamespaceEnabled", CLONE_NEWPID, "pid" },
+    { "UTSNamespaceEnabled", CLONE_NEWUTS, "uts" },
+};
+
+static const char *io_classes[] = {
+    [IOPRIO_CLASS_NONE] = "none",
+    [IOPRIO_CLASS_RT] = "realtime",
+    [IOPRIO_CLASS_BE] = "best-effort",
+    [IOPRIO_CLASS_IDLE] = "idle",
 };
 
 enum {
@@ -88,6 +270,13 @@ enum {
 
 static GParamSpec *obj_properties[PROP_LAST] = { NULL, };
 
+enum {
+    SIGNAL_CGROUP_EVENT,
+    N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
 #define CONTEJNER_INSTANCE_GET_PRIVATE(object)                           \
           (G_TYPE_INSTANCE_GET_PRIVATE((object),                       \
                                        contejner_instance_get_type(),    \
@@ -97,38 +286,212 @@ G_DEFINE_TYPE(ContejnerInstance,
               contejner_instance,
               G_TYPE_OBJECT)
 
+/* Whether the container has a process, running or frozen */
+static gboolean is_active(ContejnerInstancePrivate *priv)
+{
+    return priv->status == CONTEJNER_INSTANCE_STATUS_RUNNING ||
+           priv->status == CONTEJNER_INSTANCE_STATUS_FROZEN;
+}
+
+
+struct stop {
+    ContejnerInstanceStopCallback cb;
+    gpointer user_data;
+};
 
-static gboolean reaper(gpointer data)
+static void finish_stops(ContejnerInstance *self)
 {
-    ContejnerInstance *self = CONTEJNER_INSTANCE(data);
     ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(self);
+    GSList *stops = g_slist_reverse(priv->stops);
+    GSList *l;
+
+    contejner_timer_cancel(&priv->stop_timer);
+    priv->stops = NULL;
+    for (l = stops; l; l = l->next) {
+        struct stop *stop = l->data;
+        stop->cb(self, priv->exit_status, stop->user_data);
+    }
+    g_slist_free_full(stops, g_free);
+}
 
-    int status = 0;
-    pid_t child_pid = waitpid(priv->pid, &status, WNOHANG);
-    if (child_pid > 0) {
-        if WIFEXITED(status) {
-            g_debug("Child exited with status: %d", WEXITSTATUS(status));
+static void record_cgroup_event(ContejnerInstance *self,
+                                ContejnerCgroupEvent event,
+                                guint64 count)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(self);
+
+    if (event < CONTEJNER_CGROUP_EVENT_DRAINED) {
+        priv->cgroup_events[event] = count;
+    }
+    g_signal_emit(self, signals[SIGNAL_CGROUP_EVENT], 0, event, count);
+}
+
+/* Decide, once per stopped run, whether and when the restart policy runs
+ * the container again. Runs that failed before a process was started never
+ * get here, and are not restarted. */
+static void plan_restart(ContejnerInstancePrivate *priv)
+{
+    priv->restart_delay = -1;
+    /* The exit status of a container adopted after a restart of the service
+     * is unknown (-1), which is not taken for a failure */
+    if (priv->stop_requested ||
+        priv->restart_policy == RESTART_NEVER ||
+        (priv->restart_policy == RESTART_ON_FAILURE && priv->exit_status <= 0)) {
+        return;
+    }
+
+    if (g_get_monotonic_time() - priv->run_started >= RESTART_RESET_US) {
+        priv->restarts = 0;
+    }
+
+    priv->restart_delay = MIN((gint64) RESTART_DELAY_MIN_MS << MIN(priv->restarts, 16),
+                              RESTART_DELAY_MAX_MS);
+    priv->restarts++;
+}
+
+static void container_stopped(ContejnerInstance *self)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(self);
+
+    contejner_timer_cancel(&priv->timeout_timer);
+    if (priv->cgroup) {
+        /* Kills the watch has not reported yet, or that there was no watch
+         * for */
+        guint64 kills = contejner_cgroup_get_oom_kills(priv->cgroup);
+        if (kills > priv->cgroup_events[CONTEJNER_CGROUP_EVENT_OOM_KILL]) {
+            record_cgroup_event(self, CONTEJNER_CGROUP_EVENT_OOM_KILL, kills);
         }
+    }
+    contejner_cgroup_free(priv->cgroup);
+    priv->cgroup = NULL;
+    priv->cgroup_watched = FALSE;
+    priv->reaped = FALSE;
 
-        priv->status = CONTEJNER_INSTANCE_STATUS_STOPPED;
-        g_object_notify_by_pspec(G_OBJECT(self),
-                                 obj_properties[PROP_STATUS]);
+    plan_restart(priv);
+    priv->status = CONTEJNER_INSTANCE_STATUS_STOPPED;
+    g_object_notify_by_pspec(G_OBJECT(self),
+                             obj_properties[PROP_STATUS]);
+
+    finish_stops(self);
+}
+
+/* The init process of the container is gone. Processes it left behind in
+ * the cgroup keep the container running, until the cgroup is drained. */
+static void init_exited(ContejnerInstance *self)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(self);
+
+    priv->reaped = TRUE;
+    if (priv->cgroup_watched && contejner_cgroup_is_populated(priv->cgroup)) {
+        instance_debug(priv, "Waiting for the processes to exit");
+        return;
     }
 
-    return G_SOURCE_CONTINUE;
+    container_stopped(self);
+}
+
+static void cgroup_event(ContejnerCgroup *cgroup,
+                         ContejnerCgroupEvent event,
+                         guint64 count,
+                         gpointer user_data)
+{
+    ContejnerInstance *self = CONTEJNER_INSTANCE(user_data);
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(self);
+
+    instance_debug(priv, "%s (%" G_GUINT64_FORMAT ")",
+                   contejner_cgroup_event_to_string(event), count);
+    record_cgroup_event(self, event, count);
+
+    if (event == CONTEJNER_CGROUP_EVENT_DRAINED && priv->reaped) {
+        container_stopped(self);
+    }
+}
+
+static void watch_cgroup(ContejnerInstance *self)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(self);
+    guint i;
+
+    priv->cgroup_watched = priv->cgroup &&
+                           contejner_cgroup_watch(priv->cgroup, cgroup_event,
+                                                  self);
+    for (i = 0; i < G_N_ELEMENTS(priv->cgroup_events); i++) {
+        priv->cgroup_events[i] = priv->cgroup_watched ?
+            contejner_cgroup_get_event_count(priv->cgroup, i) : 0;
+    }
+}
+
+/* Exit status the way a shell reports it, 128 + signal if killed */
+static int wait_status_to_exit_status(int status)
+{
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                               : WEXITSTATUS(status);
+}
+
+/* The pidfd of the container became readable, i.e. it exited */
+static gboolean process_exited(gint fd,
+                               GIOCondition condition,
+                               gpointer user_data)
+{
+    ContejnerInstance *self = CONTEJNER_INSTANCE(user_data);
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(self);
+    int status = 0;
+
+    /* Containers adopted after a restart are not our children, and are
+     * reaped by someone else, so their exit status stays unknown */
+    if (waitpid(priv->pid, &status, WNOHANG) > 0) {
+        priv->exit_status = wait_status_to_exit_status(status);
+        instance_debug(priv, "Child exited with status: %d", priv->exit_status);
+    }
+
+    close(priv->pidfd);
+    priv->pidfd = -1;
+    priv->exit_watch = 0;
+
+    init_exited(self);
+    return G_SOURCE_REMOVE;
 }
 
-void log_func (const gchar *log_domain,
-               GLogLevelFlags log_level,
-               const gchar *message,
-               gpointer user_data)
+/* Fallback for kernels without pidfds */
+static void child_exited(GPid pid, gint status, gpointer user_data)
 {
     ContejnerInstance *self = CONTEJNER_INSTANCE(user_data);
     ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(self);
-    char *new_domain = g_strdup_printf("%s%s", priv->name,
-                                       log_domain ? log_domain : "");
-    g_log_default_handler(new_domain, log_level, message, NULL);
-    g_free (new_domain);
+
+    priv->exit_status = wait_status_to_exit_status(status);
+    instance_debug(priv, "Child exited with status: %d", priv->exit_status);
+    g_spawn_close_pid(pid);
+
+    priv->exit_watch = 0;
+    init_exited(self);
+}
+
+/* Start time of a process, in clock ticks since boot. Together with the pid
+ * it identifies the process, since pids are reused. Returns 0 on failure. */
+static guint64 read_start_time(pid_t pid)
+{
+    gchar *path = g_strdup_printf("/proc/%d/stat", pid);
+    gchar *contents = NULL;
+    guint64 start_time = 0;
+
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        /* The command name may contain anything, the fields after it are
+         * plain. The start time is field 22, the 20th after the name. */
+        char *p = strrchr(contents, ')');
+        int field = 2;
+
+        while (p && field < 22) {
+            p = strchr(p + 1, ' ');
+            field++;
+        }
+        if (p) {
+            start_time = g_ascii_strtoull(p + 1, NULL, 10);
+        }
+    }
+
+    g_free(contents);
+    g_free(path);
+    return start_time;
 }
 
 static void contejner_instance_get_property (GObject *object,
@@ -144,14 +507,10 @@ static void contejner_instance_get_property (GObject *object,
             g_value_set_string (value, priv->name);
             break;
         case PROP_STDERR: {
-            int fd = dup(priv->stderr_fd);
-            lseek(fd, 0, SEEK_SET);
-            g_value_set_int(value, fd);
+            g_value_set_int(value, contejner_log_open(priv->stderr_output.log));
             break;
         } case PROP_STDOUT: {
-            int fd = dup(priv->stdout_fd);
-            lseek(fd, 0, SEEK_SET);
-            g_value_set_int(value, fd);
+            g_value_set_int(value, contejner_log_open(priv->stdout_output.log));
             break;
         } case PROP_STATUS: {
             g_value_set_int(value, priv->status);
@@ -175,7 +534,7 @@ static void contejner_instance_set_property (GObject *object,
             const gchar *v = g_value_get_string(value);
             int strl = strlen(v);
             if (strl >= CONTAINER_NAME_SZ) {
-                g_warning ("Container name too long");
+                instance_warning(priv, "Container name too long");
             } else {
                 memcpy(priv->name, v, strlen(v));
             }
@@ -186,14 +545,74 @@ static void contejner_instance_set_property (GObject *object,
     }
 }
 
+static void free_mount (gpointer data)
+{
+    struct mount *mount = data;
+
+    g_free(mount->path_in_host);
+    g_free(mount->path_in_container);
+    g_free(mount);
+}
+
+static void free_scratch (ContejnerInstancePrivate *priv)
+{
+    guint i;
+
+    for (i = 0; i < priv->n_scratch; i++) {
+        g_free(priv->scratch[i].path);
+    }
+    g_free(priv->scratch);
+    priv->scratch = NULL;
+    priv->n_scratch = 0;
+}
+
+static void contejner_instance_finalize (GObject *object)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(object);
+
+    if (priv->stdout_output.log) {
+        contejner_log_free(priv->stdout_output.log);
+    }
+    if (priv->stderr_output.log) {
+        contejner_log_free(priv->stderr_output.log);
+    }
+    if (priv->pty) {
+        contejner_pty_free(priv->pty);
+    }
+    contejner_cgroup_free(priv->cgroup);
+    if (priv->exit_watch) {
+        g_source_remove(priv->exit_watch);
+    }
+    if (priv->pidfd != -1) {
+        close(priv->pidfd);
+    }
+    contejner_timer_cancel(&priv->timeout_timer);
+    contejner_timer_cancel(&priv->stop_timer);
+    g_slist_free_full(priv->stops, g_free);
+    if (priv->series) {
+        contejner_series_free(priv->series);
+    }
+
+    g_free(priv->command);
+    g_strfreev(priv->command_args);
+    g_free(priv->rootfs_path);
+    g_free(priv->stack);
+    g_free(priv->cpuset);
+    g_free(priv->mem_nodes);
+    g_free(priv->output_path);
+    g_hash_table_unref(priv->labels);
+    g_slist_free_full(priv->mounts, free_mount);
+    free_scratch(priv);
+
+    G_OBJECT_CLASS(contejner_instance_parent_class)->finalize(object);
+}
+
 static void contejner_instance_init (ContejnerInstance *svc) {
     ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE (svc);
 
-    g_log_set_default_handler(log_func, svc);
-
-    priv->rootfs_path = "/";
+    priv->rootfs_path = g_strdup("/");
     priv->command = NULL;
-    priv->stack = g_malloc(STACK_SIZE);
+    priv->labels = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
     priv->unshared_namespaces = DEFAULT_UNSHARED_NAMESPACES;
 }
 
@@ -204,6 +623,7 @@ static void contejner_instance_class_init (ContejnerInstanceClass *class)
 
     object_class->set_property = contejner_instance_set_property;
     object_class->get_property = contejner_instance_get_property;
+    object_class->finalize = contejner_instance_finalize;
 
     obj_properties[PROP_NAME] =
         g_param_spec_string ("name",
@@ -234,214 +654,2744 @@ static void contejner_instance_class_init (ContejnerInstanceClass *class)
                                        PROP_LAST,
                                        obj_properties);
 
+    /* An event of the cgroup of the running container, as a
+     * ContejnerCgroupEvent and the number of times it happened in the run */
+    signals[SIGNAL_CGROUP_EVENT] = g_signal_new("cgroup-event",
+                                                G_TYPE_FROM_CLASS(class),
+                                                G_SIGNAL_RUN_LAST,
+                                                0, NULL, NULL, NULL,
+                                                G_TYPE_NONE, 2,
+                                                G_TYPE_INT, G_TYPE_UINT64);
+
+}
+
+/* Append a string to buf, which holds len bytes, as far as it fits */
+static gsize append_str (char *buf, gsize size, gsize len, const char *str)
+{
+    while (*str && len + 1 < size) {
+        buf[len++] = *str++;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static gsize append_u64 (char *buf, gsize size, gsize len, guint64 value)
+{
+    char digits[21];
+    int i = sizeof(digits) - 1;
+
+    digits[i] = '\0';
+    do {
+        digits[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    return append_str(buf, size, len, digits + i);
+}
+
+/* Report a failed call of the child on its stderr, the output of the
+ * container by then. Between clone() or fork() and exec the child of the
+ * threaded service may only make async-signal-safe calls, so this is used
+ * instead of perror() and g_error(). */
+static void child_error (const char *what)
+{
+    char buf[128];
+    int err = errno;
+    gsize len = 0;
+
+    len = append_str(buf, sizeof(buf), len, what);
+    len = append_str(buf, sizeof(buf), len, " failed, errno ");
+    len = append_u64(buf, sizeof(buf), len, err);
+    len = append_str(buf, sizeof(buf), len, "\n");
+    if (write(STDERR_FILENO, buf, len) < 0) { /* Nothing to do */ }
+    errno = err;
+}
+
+/* Apply the placement and scheduling settings of the container to the
+ * calling process. Runs in the child. */
+static int apply_scheduling (ContejnerInstancePrivate *priv)
+{
+    int status = 0;
+
+    /* Restrict the CPUs and memory nodes the container may use. These are
+     * inherited by everything the container starts. */
+    if (priv->cpuset &&
+        (status = sched_setaffinity(0, sizeof(priv->cpu_mask), &priv->cpu_mask))) {
+        child_error("sched_setaffinity");
+        return status;
+    }
+
+    if (priv->mem_nodes &&
+        (status = syscall(SYS_set_mempolicy, MPOL_BIND, priv->node_mask,
+                          MAX_NUMA_NODES + 1))) {
+        child_error("set_mempolicy");
+        return status;
+    }
+
+    /* Scheduling settings are applied to the process itself, and need no
+     * cgroup support */
+    if (priv->sched_policy != -1) {
+        struct sched_param param = { 0 };
+        if ((status = sched_setscheduler(0, priv->sched_policy, &param))) {
+            child_error("sched_setscheduler");
+            return status;
+        }
+    }
+
+    if (priv->nice_set &&
+        (status = setpriority(PRIO_PROCESS, 0, priv->nice))) {
+        child_error("setpriority");
+        return status;
+    }
+
+    if (priv->io_priority != -1 &&
+        (status = syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+                          priv->io_priority))) {
+        child_error("ioprio_set");
+        return status;
+    }
+
+    return status;
+}
+
+/* Make a bind mount read-only. Only mount_setattr() reaches the mounts below
+ * it, and keeps the other flags of the bind mount as they are. */
+static int make_read_only (const char *target, gboolean recursive)
+{
+#ifdef MOUNT_ATTR_RDONLY
+    struct mount_attr attr = { .attr_set = MOUNT_ATTR_RDONLY };
+
+    return mount_setattr(AT_FDCWD, target, recursive ? AT_RECURSIVE : 0,
+                         &attr, sizeof(attr));
+#else
+    if (recursive) {
+        errno = ENOSYS;
+        return -1;
+    }
+    return mount(NULL, target, NULL, MS_REMOUNT | MS_BIND | MS_RDONLY, NULL);
+#endif
+}
+
+/* Set up the bind mounts and scratch space in the mount namespace of the
+ * container, where they live as long as the container does. Bind mounts go
+ * first, parents before children, so scratch space may be mounted in them.
+ * Runs in the child, so it only uses memory prepared by the parent. */
+static int mount_filesystems (ContejnerInstancePrivate *priv)
+{
+    const char *root = g_strcmp0(priv->rootfs_path, "/") ? priv->rootfs_path : "";
+    char target[PATH_MAX];
+    char options[64];
+    GSList *l;
+    guint i;
+
+    if (!priv->mounts && !priv->n_scratch) {
+        return 0;
+    }
+
+    /* Mounts must not propagate back to the host */
+    if (mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL)) {
+        child_error("mount");
+        return -1;
+    }
+
+    for (l = priv->mounts; l; l = l->next) {
+        struct mount *m = l->data;
+        gboolean recursive = (m->flags & CONTEJNER_MOUNT_RECURSIVE) != 0;
+
+        append_str(target, sizeof(target),
+                   append_str(target, sizeof(target), 0, root),
+                   m->path_in_container);
+        if (mount(m->path_in_host, target, NULL,
+                  MS_BIND | (recursive ? MS_REC : 0), NULL)) {
+            child_error("bind mount");
+            return -1;
+        }
+        if ((m->flags & CONTEJNER_MOUNT_READ_ONLY) &&
+            make_read_only(target, recursive)) {
+            child_error("read-only bind mount");
+            return -1;
+        }
+    }
+
+    for (i = 0; i < priv->n_scratch; i++) {
+        gsize len;
+
+        append_str(target, sizeof(target),
+                   append_str(target, sizeof(target), 0, root),
+                   priv->scratch[i].path);
+        len = append_str(options, sizeof(options), 0, "size=");
+        len = append_u64(options, sizeof(options), len, priv->scratch[i].size);
+        append_str(options, sizeof(options), len, ",mode=1777");
+        if (mount("tmpfs", target, "tmpfs", MS_NOSUID | MS_NODEV, options)) {
+            child_error("mount scratch");
+            return -1;
+        }
+    }
+
+    return 0;
 }
 
 static int child_func (void *arg) {
     ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(arg);
     int status = 0;
+    char c;
+
+    /* Wait until the parent has moved us into the cgroup of the container,
+     * so that nothing escapes it */
+    if (priv->sync_pipe[0] != -1) {
+        close(priv->sync_pipe[1]);
+        while (read(priv->sync_pipe[0], &c, 1) == -1 && errno == EINTR);
+        close(priv->sync_pipe[0]);
+    }
+
+    if (priv->pty) {
+        /* Make the terminal our controlling terminal and use it for
+         * stdin, stdout & stderr */
+        int slave = contejner_pty_get_slave(priv->pty);
+        if (setsid() == -1) {
+            child_error("setsid");
+            return -1;
+        }
+        if (ioctl(slave, TIOCSCTTY, 0)) {
+            child_error("TIOCSCTTY");
+            return -1;
+        }
+        if (dup2(slave, STDIN_FILENO) == -1 ||
+            dup2(slave, STDOUT_FILENO) == -1 ||
+            dup2(slave, STDERR_FILENO) == -1) {
+            child_error("dup2 terminal");
+            return -1;
+        }
+    } else {
+        /* Set up stdout & stderr. Failures before this end up in the
+         * stderr of the service. */
+        if (dup2(priv->stdout_output.write_fd, STDOUT_FILENO) == -1) {
+            child_error("dup2 stdout");
+            return -1;
+        }
+        if (dup2(priv->stderr_output.write_fd, STDERR_FILENO) == -1) {
+            child_error("dup2 stderr");
+            return -1;
+        }
+    }
 
-    /* Set up stdout & stderr */
-    if (close(STDOUT_FILENO)) { g_error ("Failed to close stdout in child"); }
-    if (dup2(priv->stdout_fd, STDOUT_FILENO) == -1) {
-        g_error ("Failed to dup stdout");
+    if ((status = apply_scheduling(priv))) {
+        return status;
     }
 
-    if (close(STDERR_FILENO)) { g_error ("Failed to close stderr in child"); }
-    if (dup2(priv->stderr_fd, STDERR_FILENO) == -1) {
-        g_error ("Failed to dup stderr");
+    if ((status = mount_filesystems(priv))) {
+        return status;
     }
 
     /* Change the root directory */
     if ((status = chroot(priv->rootfs_path))) {
-        perror("chroot");
+        child_error("chroot");
         return status;
     }
 
     /* Execute command with namespace unshared */
     if ((status = execv(priv->command, priv->command_args))) {
-        perror("exec");
+        child_error("exec");
         return status;
     }
 
     return status;
 }
 
-ContejnerInstance * contejner_instance_new (int id)
+static ContejnerInstance *instance_alloc (int id)
 {
     ContejnerInstance *instance = g_object_new (CONTEJNER_TYPE_INSTANCE, NULL);
     ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE (instance);
 
     priv->status = CONTEJNER_INSTANCE_STATUS_CREATED;
     priv->id = id;
+    priv->sched_policy = -1;
+    priv->io_priority = -1;
+    priv->sync_pipe[0] = priv->sync_pipe[1] = -1;
+    priv->pidfd = -1;
+    priv->exit_status = -1;
+    priv->restart_delay = -1;
+    priv->timeout_grace = DEFAULT_TIMEOUT_GRACE;
+    priv->stdout_output.fd = priv->stdout_output.write_fd = -1;
+    priv->stderr_output.fd = priv->stderr_output.write_fd = -1;
+    priv->stdout_output.instance = priv->stderr_output.instance = instance;
+    g_snprintf(priv->name,CONTAINER_NAME_SZ,"Container %d", id);
+
+    return instance;
+}
+
+static void timeout_expired (ContejnerTimer *timer, gpointer user_data);
+
+static void arm_timeout (ContejnerInstance *instance, gint64 delay_ms)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    ContejnerTimerWheel *wheel = contejner_timer_wheel_get_default();
+
+    if (!wheel) {
+        instance_warning(priv, "No timer for the timeout");
+        return;
+    }
+    delay_ms = MAX(delay_ms, 0);
+    priv->deadline = g_get_real_time() + delay_ms * 1000;
+    contejner_timer_arm(wheel, &priv->timeout_timer, delay_ms,
+                        timeout_expired, instance);
+}
+
+/* The container ran out of time. It is asked to stop first, and killed if
+ * it is still there when the grace period is over. */
+static void timeout_expired (ContejnerTimer *timer, gpointer user_data)
+{
+    ContejnerInstance *instance = CONTEJNER_INSTANCE(user_data);
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+
+    if (!priv->timed_out && priv->timeout_grace) {
+        instance_debug(priv, "Timed out, terminating it");
+        priv->timed_out = TRUE;
+        contejner_instance_kill(instance, SIGTERM);
+        arm_timeout(instance, priv->timeout_grace * 1000);
+    } else {
+        instance_debug(priv, "Timed out, killing it");
+        priv->timed_out = TRUE;
+        contejner_instance_kill(instance, SIGKILL);
+    }
+}
+
+/* Open the output logs in priv->output_path. Existing logs are continued
+ * when @reopen is set. */
+static void open_logs (ContejnerInstancePrivate *priv, gboolean reopen)
+{
+    gchar *stdout_fname = g_strdup_printf("%s/stdout", priv->output_path);
+    gchar *stderr_fname = g_strdup_printf("%s/stderr", priv->output_path);
 
-    gchar *stdout_fname = g_strdup_printf("/stdout-%d-%d",getpid(),id);
-    gchar *stderr_fname = g_strdup_printf("/stderr-%d-%d",getpid(),id);
+    if (reopen) {
+        priv->stdout_output.log = contejner_log_reopen(stdout_fname);
+        priv->stderr_output.log = contejner_log_reopen(stderr_fname);
+    }
 
-    priv->stdout_fd = shm_open(stdout_fname,
-                               O_CREAT | O_RDWR | O_EXCL,
-                               S_IRUSR | S_IWUSR);
-    if (priv->stdout_fd == -1) {
+    if (!priv->stdout_output.log) {
+        priv->stdout_output.log = contejner_log_new(stdout_fname);
+    }
+    if (!priv->stdout_output.log) {
         g_error("Failed to create stdout buffer for container");
     }
-    priv->stderr_fd = shm_open(stderr_fname,
-                               O_CREAT | O_RDWR | O_EXCL,
-                               S_IRUSR | S_IWUSR);
-    if (priv->stderr_fd == -1) {
+
+    if (!priv->stderr_output.log) {
+        priv->stderr_output.log = contejner_log_new(stderr_fname);
+    }
+    if (!priv->stderr_output.log) {
         g_error("Failed to create stderr buffer for container");
     }
 
     g_free(stdout_fname);
     g_free(stderr_fname);
-
-    g_snprintf(priv->name,CONTAINER_NAME_SZ,"Container %d", id);
-
-    return instance;
 }
 
-void contejner_instance_run (ContejnerInstance *instance,
-                           ContejnerInstanceRunCallback cb,
-                           gpointer user_data)
+ContejnerInstance * contejner_instance_new (int id, const char *output_dir)
 {
-    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
-    char *message = "OK";
-    enum contejner_error_code error = CONTEJNER_OK;
+    ContejnerInstance *instance = instance_alloc (id);
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE (instance);
 
-    if (!priv->command || !priv->command_args) {
-        message = "No command supplied";
-        g_debug("%s", message);
-        error = CONTEJNER_ERR_FAILED_TO_START;
-        priv->status = CONTEJNER_INSTANCE_STATUS_STOPPED;
-        goto contejner_instance_run_return;
+    /* Prototypes only hold configuration, and never run */
+    if (!output_dir) {
+        return instance;
     }
 
-    priv->pid = clone(child_func,
-                      priv->stack + STACK_SIZE,
-                      priv->unshared_namespaces | SIGCHLD,
-                      instance);
-    if (priv->pid == -1) {
-        message = "Error from clone() call";
-        g_warning("%s: %s", message, strerror(errno));
-        error = CONTEJNER_ERR_FAILED_TO_START;
-        priv->status = CONTEJNER_INSTANCE_STATUS_STOPPED;
-        goto contejner_instance_run_return;
+    priv->output_path = g_strdup_printf("%s/%d-%d", output_dir, getpid(), id);
+    if (g_mkdir_with_parents(priv->output_path, S_IRWXU)) {
+        g_error("Failed to create output directory %s", priv->output_path);
     }
 
-    priv->status = CONTEJNER_INSTANCE_STATUS_RUNNING;
-    g_idle_add(reaper, instance);
+    open_logs(priv, FALSE);
 
-contejner_instance_run_return:
-        g_object_notify_by_pspec(G_OBJECT(instance),
-                                 obj_properties[PROP_STATUS]);
-        cb (instance, error, message, user_data);
+    return instance;
 }
 
-int contejner_instance_get_id (const ContejnerInstance *instance)
+/* Bytes of output that may be kept now, out of @len */
+static gsize output_allowance (struct output_limits *limits, gsize len)
 {
-    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
-    return priv->id;
+    if (limits->volume) {
+        len = MIN(len, limits->volume - MIN(limits->kept, limits->volume));
+    }
+
+    if (limits->rate) {
+        gint64 now = g_get_monotonic_time();
+        gint64 elapsed = MIN(now - limits->refilled, G_USEC_PER_SEC);
+        guint64 add = elapsed * limits->rate / G_USEC_PER_SEC;
+
+        /* Fractions of a byte are kept for the next refill */
+        if (add) {
+            limits->tokens = MIN(limits->tokens + add, limits->rate);
+            limits->refilled = now;
+        }
+        len = MIN(len, limits->tokens);
+    }
+
+    return len;
 }
 
-gboolean contejner_instance_set_command (ContejnerInstance *instance,
-                                         const gchar *command,
-                                         const gchar **args)
+static void output_limit_reached (ContejnerInstance *instance)
 {
     ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
-    priv->command = g_strdup(command);
-    if (!priv->command) {
-        return FALSE;
-    }
+    struct output_limits *limits = &priv->output_limits;
 
-    priv->command_args = g_strdupv((char **)args);
-    if (!priv->command_args) {
-        return FALSE;
+    if (limits->limited) {
+        return;
     }
 
-    return TRUE;
+    limits->limited = TRUE;
+    limits->hits++;
+    instance_debug(priv, "Reached the output limit");
+
+    if (limits->policy == OUTPUT_LIMIT_KILL) {
+        contejner_instance_kill(instance, SIGKILL);
+    }
 }
 
-gboolean contejner_instance_set_root(ContejnerInstance *instance,
-                                     const GFile *path)
+/* Keep what the limits allow of @len bytes of output, @allowed as returned
+ * by output_allowance() */
+static void keep_output (ContejnerInstance *instance,
+                         ContejnerLog *log,
+                         const char *buf,
+                         gsize len,
+                         gsize allowed)
 {
     ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
-    if (priv->status == CONTEJNER_INSTANCE_STATUS_RUNNING) {
-        g_warning ("Container already running");
-        return FALSE;
-    }
+    struct output_limits *limits = &priv->output_limits;
+    gsize keep = MIN(len, allowed);
 
-    if (g_file_query_exists((GFile *)path, NULL)) {
-        priv->rootfs_path = g_file_get_path ((GFile *)path);
-        return TRUE;
-    } else {
-        g_warning ("Path does not exist: %s", g_file_get_path ((GFile *)path));
+    if (keep) {
+        contejner_log_append(log, buf, keep);
+        limits->kept += keep;
+        limits->tokens -= MIN(limits->tokens, keep);
     }
 
-    return FALSE;
+    if (keep < len) {
+        limits->dropped += len - keep;
+        output_limit_reached(instance);
+    }
+}
+
+static void terminal_output (const char *buf, gsize len, gpointer user_data)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(user_data);
+    struct output_limits *limits = &priv->output_limits;
+    gsize allowed = output_allowance(limits, len);
+
+    /* Keep a copy of terminal output in the stdout log, so that it can
+     * still be read after the fact. It is relayed to the clients as it
+     * comes, so it can only be dropped, not blocked. */
+    keep_output(user_data, priv->stdout_output.log, buf, len, allowed);
+    if (allowed >= len) {
+        limits->limited = FALSE;
+    }
+}
+
+static gboolean output_readable (gint fd,
+                                 GIOCondition condition,
+                                 gpointer user_data);
+
+static void watch_output (struct output *output)
+{
+    output->watch = g_unix_fd_add(output->fd,
+                                  G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                  output_readable,
+                                  output);
+}
+
+static gboolean resume_output (gpointer user_data)
+{
+    struct output *output = user_data;
+
+    output->resume = 0;
+    output->paused = FALSE;
+    watch_output(output);
+    return G_SOURCE_REMOVE;
+}
+
+/* Stop reading the output until the rate limit allows more. The container
+ * blocks once the FIFO is full. */
+static void pause_output (struct output *output)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(output->instance);
+    struct output_limits *limits = &priv->output_limits;
+
+    output->paused = TRUE;
+
+    /* Reaching the volume limit blocks for good, unless it is raised */
+    if (limits->rate && (!limits->volume || limits->kept < limits->volume)) {
+        guint64 want = MIN(limits->rate, OUTPUT_BUF_SZ);
+        guint64 missing = want - MIN(want, limits->tokens);
+        output->resume = g_timeout_add(missing * 1000 / limits->rate + 1,
+                                       resume_output, output);
+    }
+}
+
+/* Read paused output again after the limits changed */
+static void output_limits_changed (ContejnerInstancePrivate *priv)
+{
+    struct output *outputs[] = { &priv->stdout_output, &priv->stderr_output };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(outputs); i++) {
+        if (outputs[i]->resume) {
+            g_source_remove(outputs[i]->resume);
+            outputs[i]->resume = 0;
+        }
+        if (outputs[i]->paused) {
+            resume_output(outputs[i]);
+        }
+    }
+}
+
+static void close_output (struct output *output)
+{
+    if (output->watch) {
+        g_source_remove(output->watch);
+        output->watch = 0;
+    }
+    if (output->resume) {
+        g_source_remove(output->resume);
+        output->resume = 0;
+    }
+    output->paused = FALSE;
+    if (output->fd != -1) {
+        close(output->fd);
+        output->fd = -1;
+    }
+    if (output->write_fd != -1) {
+        close(output->write_fd);
+        output->write_fd = -1;
+    }
+}
+
+static gboolean output_readable (gint fd,
+                                 GIOCondition condition,
+                                 gpointer user_data)
+{
+    struct output *output = user_data;
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(output->instance);
+    struct output_limits *limits = &priv->output_limits;
+    gboolean block = limits->policy == OUTPUT_LIMIT_BLOCK;
+    char buf[OUTPUT_BUF_SZ];
+    int i;
+
+    /* Bound the work per wakeup, so a chatty container can not starve the
+     * main loop */
+    for (i = 0; i < OUTPUT_MAX_READS; i++) {
+        gsize allowed = output_allowance(limits, sizeof(buf));
+        if (block && !allowed) {
+            output_limit_reached(output->instance);
+            output->watch = 0;
+            pause_output(output);
+            return G_SOURCE_REMOVE;
+        }
+
+        ssize_t r = read(fd, buf, block ? allowed : sizeof(buf));
+        if (r > 0) {
+            keep_output(output->instance, output->log, buf, r, allowed);
+        } else if (r == -1 && errno == EINTR) {
+            continue;
+        } else if (r == -1 && errno == EAGAIN) {
+            /* The reader caught up with the writer */
+            limits->limited = FALSE;
+            return G_SOURCE_CONTINUE;
+        } else {
+            /* All writers are gone */
+            output->watch = 0;
+            close_output(output);
+            return G_SOURCE_REMOVE;
+        }
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/* Output is passed through a FIFO next to the log, rather than a pipe, so
+ * that a restarted service can open it again. The container gets a
+ * read-write descriptor, which keeps the FIFO open while the service is
+ * away: the container then blocks once the FIFO is full, instead of dying
+ * from SIGPIPE. */
+static gboolean open_output (struct output *output)
+{
+    gchar *fifo = g_strdup_printf("%s.fifo", contejner_log_get_path(output->log));
+
+    close_output(output);
+    unlink(fifo);
+    if (mkfifo(fifo, S_IRUSR | S_IWUSR)) {
+        g_warning("Failed to create output FIFO %s: %s", fifo, strerror(errno));
+        g_free(fifo);
+        return FALSE;
+    }
+
+    /* The read end goes first, so that opening the write end does not
+     * block */
+    output->fd = open(fifo, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    output->write_fd = open(fifo, O_RDWR | O_CLOEXEC);
+    if (output->fd == -1 || output->write_fd == -1) {
+        g_warning("Failed to open output FIFO %s: %s", fifo, strerror(errno));
+        close_output(output);
+        g_free(fifo);
+        return FALSE;
+    }
+
+    g_free(fifo);
+    return TRUE;
+}
+
+/* Continue reading the output of a container started by an earlier run of
+ * the service */
+static void reattach_output (struct output *output)
+{
+    gchar *fifo = g_strdup_printf("%s.fifo", contejner_log_get_path(output->log));
+
+    output->fd = open(fifo, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (output->fd == -1) {
+        g_warning("Failed to reopen output FIFO %s: %s", fifo, strerror(errno));
+    } else {
+        watch_output(output);
+    }
+
+    g_free(fifo);
+}
+
+/* Called in the parent once the container has its copy of the write end */
+static void start_output (struct output *output)
+{
+    close(output->write_fd);
+    output->write_fd = -1;
+    watch_output(output);
+}
+
+static gboolean ensure_cgroup (ContejnerInstancePrivate *priv)
+{
+    if (!priv->cgroup) {
+        gchar *name = g_strdup_printf("%d-%d", getpid(), priv->id);
+        priv->cgroup = contejner_cgroup_new(name);
+        g_free(name);
+    }
+
+    return priv->cgroup != NULL;
+}
+
+static void close_sync_pipe (ContejnerInstancePrivate *priv)
+{
+    if (priv->sync_pipe[0] != -1) {
+        close(priv->sync_pipe[0]);
+        close(priv->sync_pipe[1]);
+        priv->sync_pipe[0] = priv->sync_pipe[1] = -1;
+    }
+}
+
+static gboolean ensure_pty (ContejnerInstancePrivate *priv)
+{
+    if (!priv->pty) {
+        priv->pty = contejner_pty_new();
+    }
+
+    return priv->pty != NULL;
+}
+
+/* Set once clone3() turned out not to support what we need, so that it is
+ * not tried again. CONTEJNER_NO_CLONE3 in the environment of the service
+ * sets it from the start, to use the clone() fallback. */
+static gboolean clone3_unsupported = FALSE;
+static gboolean clone3_checked = FALSE;
+
+/* Start the container with clone3(), which places it in its cgroup before
+ * it runs and returns a pidfd for it. Needs Linux 5.7. */
+static pid_t spawn_clone3 (ContejnerInstance *instance)
+{
+#if defined(SYS_clone3) && defined(CLONE_INTO_CGROUP)
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    struct clone_args args = { 0 };
+    pid_t pid;
+
+    if (!clone3_checked) {
+        clone3_unsupported = g_getenv("CONTEJNER_NO_CLONE3") != NULL;
+        clone3_checked = TRUE;
+    }
+    if (clone3_unsupported) {
+        return -1;
+    }
+
+    args.flags = priv->unshared_namespaces | CLONE_PIDFD;
+    args.pidfd = (guint64) (uintptr_t) &priv->pidfd;
+    args.exit_signal = SIGCHLD;
+    if (priv->cgroup) {
+        args.flags |= CLONE_INTO_CGROUP;
+        args.cgroup = contejner_cgroup_get_fd(priv->cgroup);
+    }
+
+    pid = syscall(SYS_clone3, &args, sizeof(args));
+    if (pid == 0) {
+        _exit(child_func(instance));
+    } else if (pid == -1 && (errno == ENOSYS || errno == E2BIG ||
+                             (errno == EINVAL && priv->cgroup))) {
+        instance_debug(priv, "clone3() not usable: %s, falling back to clone()",
+                strerror(errno));
+        clone3_unsupported = TRUE;
+    }
+
+    return pid;
+#else
+    clone3_unsupported = TRUE;
+    return -1;
+#endif
+}
+
+/* Containers without namespaces, terminal or settings that only the child
+ * itself can apply, are plain processes. posix_spawn() starts them without
+ * copying the page tables of the service, at vfork() speed. */
+static gboolean can_spawn_fast (ContejnerInstancePrivate *priv)
+{
+#ifndef POSIX_SPAWN_SETCGROUP
+    /* The process must not run outside its cgroup */
+    if (priv->cgroup) {
+        return FALSE;
+    }
+#endif
+    return !priv->unshared_namespaces && !priv->pty && !priv->n_scratch &&
+        !priv->mounts &&
+        !g_strcmp0(priv->rootfs_path, "/") &&
+        !priv->cpuset && !priv->mem_nodes && !priv->nice_set &&
+        priv->io_priority == -1;
+}
+
+static pid_t spawn_posix (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    short flags = 0;
+    pid_t pid = -1;
+    int err;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    posix_spawn_file_actions_adddup2(&actions, priv->stdout_output.write_fd,
+                                     STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, priv->stderr_output.write_fd,
+                                     STDERR_FILENO);
+
+    if (priv->sched_policy != -1) {
+        struct sched_param param = { 0 };
+        posix_spawnattr_setschedpolicy(&attr, priv->sched_policy);
+        posix_spawnattr_setschedparam(&attr, &param);
+        flags |= POSIX_SPAWN_SETSCHEDULER;
+    }
+
+#ifdef POSIX_SPAWN_SETCGROUP
+    if (priv->cgroup) {
+        posix_spawnattr_setcgroup_np(&attr, contejner_cgroup_get_fd(priv->cgroup));
+        flags |= POSIX_SPAWN_SETCGROUP;
+    }
+#endif
+
+    posix_spawnattr_setflags(&attr, flags);
+
+    err = posix_spawn(&pid, priv->command, &actions, &attr,
+                      priv->command_args, environ);
+    if (err) {
+        errno = err;
+        pid = -1;
+    } else {
+        priv->pidfd = syscall(SYS_pidfd_open, pid, 0);
+        if (priv->pidfd != -1) {
+            fcntl(priv->pidfd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return pid;
+}
+
+/* Start the container with clone(), and move it into its cgroup before
+ * letting it continue */
+static pid_t spawn_clone (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    pid_t pid;
+
+    if (priv->cgroup && pipe2(priv->sync_pipe, O_CLOEXEC)) {
+        priv->sync_pipe[0] = priv->sync_pipe[1] = -1;
+        return -1;
+    }
+
+    if (!priv->stack) {
+        priv->stack = g_malloc(STACK_SIZE);
+    }
+
+    pid = clone(child_func,
+                priv->stack + STACK_SIZE,
+                priv->unshared_namespaces | SIGCHLD,
+                instance);
+    if (pid != -1 && priv->cgroup &&
+        !contejner_cgroup_add_pid(priv->cgroup, pid)) {
+        instance_warning(priv, "Failed to move container into its cgroup");
+    }
+    close_sync_pipe(priv);
+
+    if (pid != -1) {
+        priv->pidfd = syscall(SYS_pidfd_open, pid, 0);
+        if (priv->pidfd != -1) {
+            fcntl(priv->pidfd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+    return pid;
+}
+
+void contejner_instance_run (ContejnerInstance *instance,
+                           ContejnerInstanceRunCallback cb,
+                           gpointer user_data)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    char *message = "OK";
+    enum contejner_error_code error = CONTEJNER_OK;
+
+    priv->run_started = g_get_monotonic_time();
+    priv->stop_requested = FALSE;
+    priv->restart_delay = -1;
+
+    if (!priv->command || !priv->command_args) {
+        message = "No command supplied";
+        instance_debug(priv, "%s", message);
+        error = CONTEJNER_ERR_FAILED_TO_START;
+        priv->status = CONTEJNER_INSTANCE_STATUS_STOPPED;
+        goto contejner_instance_run_return;
+    }
+
+    /* Without a mount namespace of its own, bind mounts and scratch space
+     * would be mounted on the host */
+    if ((priv->mounts || priv->n_scratch) &&
+        !(priv->unshared_namespaces & CLONE_NEWNS)) {
+        message = "Mounts need the mount namespace";
+        instance_debug(priv, "%s", message);
+        error = CONTEJNER_ERR_FAILED_TO_START;
+        priv->status = CONTEJNER_INSTANCE_STATUS_STOPPED;
+        goto contejner_instance_run_return;
+    }
+
+    if (priv->terminal && !ensure_pty(priv)) {
+        message = "Failed to allocate terminal";
+        error = CONTEJNER_ERR_FAILED_TO_START;
+        priv->status = CONTEJNER_INSTANCE_STATUS_STOPPED;
+        goto contejner_instance_run_return;
+    }
+
+    if (!priv->terminal && (!open_output(&priv->stdout_output) ||
+                            !open_output(&priv->stderr_output))) {
+        message = "Failed to set up output";
+        error = CONTEJNER_ERR_FAILED_TO_START;
+        priv->status = CONTEJNER_INSTANCE_STATUS_STOPPED;
+        goto contejner_instance_run_return;
+    }
+
+    /* Containers run without a cgroup when the service has none to
+     * delegate */
+    ensure_cgroup(priv);
+    watch_cgroup(instance);
+
+    if (can_spawn_fast(priv)) {
+        priv->pid = spawn_posix(instance);
+    } else {
+        priv->pid = spawn_clone3(instance);
+        if (priv->pid == -1 && clone3_unsupported) {
+            priv->pid = spawn_clone(instance);
+        }
+    }
+
+    if (priv->pid == -1) {
+        close_output(&priv->stdout_output);
+        close_output(&priv->stderr_output);
+        message = "Error from clone() call";
+        instance_warning(priv, "%s: %s", message, strerror(errno));
+        error = CONTEJNER_ERR_FAILED_TO_START;
+        priv->status = CONTEJNER_INSTANCE_STATUS_STOPPED;
+        goto contejner_instance_run_return;
+    }
+
+    if (priv->pty) {
+        /* The container holds the only slave now, so that the terminal hangs
+         * up once the container is gone */
+        contejner_pty_close_slave(priv->pty);
+        contejner_pty_start(priv->pty, terminal_output, instance);
+    } else {
+        start_output(&priv->stdout_output);
+        start_output(&priv->stderr_output);
+    }
+
+    if (priv->pidfd != -1) {
+        priv->exit_watch = g_unix_fd_add(priv->pidfd, G_IO_IN,
+                                         process_exited, instance);
+    } else {
+        priv->exit_watch = g_child_watch_add(priv->pid, child_exited, instance);
+    }
+
+    priv->start_time = read_start_time(priv->pid);
+    priv->exit_status = -1;
+    priv->output_limits.kept = 0;
+    priv->output_limits.dropped = 0;
+    priv->output_limits.hits = 0;
+    priv->output_limits.limited = FALSE;
+    priv->timed_out = FALSE;
+    if (priv->series) {
+        contejner_series_clear(priv->series);
+    }
+    if (priv->timeout) {
+        arm_timeout(instance, priv->timeout * 1000);
+    }
+    priv->status = CONTEJNER_INSTANCE_STATUS_RUNNING;
+
+contejner_instance_run_return:
+        g_object_notify_by_pspec(G_OBJECT(instance),
+                                 obj_properties[PROP_STATUS]);
+        cb (instance, error, message, user_data);
+}
+
+/* A command run in the namespaces of a running container */
+struct exec {
+    ContejnerInstance *instance;
+    pid_t pid;
+    gboolean exited;
+    int status;
+    guint timeout;
+    gsize max_output;
+    struct exec_stream {
+        struct exec *exec;
+        GByteArray *data;
+        int fd;
+        guint watch;
+    } out, err;
+    ContejnerInstanceExecCallback cb;
+    gpointer user_data;
+};
+
+/* Runs in the forked child. Only returns on failure, with 127 if the
+ * command could not be executed and 126 for other errors, like a shell. */
+static int exec_child (ContejnerInstancePrivate *priv,
+                       const int *ns_fds,
+                       int sync_fd,
+                       const int *fds,
+                       char **argv)
+{
+    gboolean new_pid_ns = FALSE;
+    int status = 0;
+    guint i;
+    char c;
+
+    /* Wait until the parent has moved us into the cgroup of the
+     * container */
+    while (read(sync_fd, &c, 1) == -1 && errno == EINTR);
+
+    /* A process group of its own, so that a timeout kills the command
+     * along with the process started in the PID namespace below */
+    setpgid(0, 0);
+
+    if (dup2(fds[0], STDIN_FILENO) == -1 ||
+        dup2(fds[1], STDOUT_FILENO) == -1 ||
+        dup2(fds[2], STDERR_FILENO) == -1) {
+        return 126;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(namespaces); i++) {
+        if (ns_fds[i] == -1) {
+            continue;
+        }
+        if (setns(ns_fds[i], namespaces[i].flag)) {
+            child_error("setns");
+            return 126;
+        }
+        new_pid_ns |= namespaces[i].flag == CLONE_NEWPID;
+    }
+
+    /* Joining a PID namespace only applies to the children of the caller,
+     * so the command runs in a child of ours, whose exit status we pass
+     * on */
+    if (new_pid_ns) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            child_error("fork");
+            return 126;
+        } else if (pid > 0) {
+            while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+            _exit(wait_status_to_exit_status(status));
+        }
+    }
+
+    if (apply_scheduling(priv)) {
+        return 126;
+    }
+
+    if (chroot(priv->rootfs_path) || chdir("/")) {
+        child_error("chroot");
+        return 126;
+    }
+
+    execv(argv[0], argv);
+    child_error("exec");
+    return 127;
+}
+
+static void exec_finish (struct exec *exec)
+{
+    GBytes *out, *err;
+
+    if (!exec->exited || exec->out.fd != -1 || exec->err.fd != -1) {
+        return;
+    }
+
+    if (exec->timeout) {
+        g_source_remove(exec->timeout);
+    }
+
+    out = g_byte_array_free_to_bytes(exec->out.data);
+    err = g_byte_array_free_to_bytes(exec->err.data);
+    exec->cb(exec->instance, CONTEJNER_OK, "OK", exec->status,
+             out, err, exec->user_data);
+
+    g_bytes_unref(out);
+    g_bytes_unref(err);
+    g_object_unref(exec->instance);
+    g_free(exec);
+}
+
+static void exec_stream_close (struct exec_stream *stream)
+{
+    if (stream->watch) {
+        g_source_remove(stream->watch);
+        stream->watch = 0;
+    }
+    close(stream->fd);
+    stream->fd = -1;
+}
+
+/* Read what is available, keeping at most max_output bytes. Returns FALSE
+ * at the end of the stream. */
+static gboolean exec_stream_read (struct exec_stream *stream)
+{
+    char buf[4096];
+    ssize_t r;
+
+    while (TRUE) {
+        r = read(stream->fd, buf, sizeof(buf));
+        if (r > 0) {
+            gsize room = stream->exec->max_output -
+                MIN(stream->exec->max_output, stream->data->len);
+            g_byte_array_append(stream->data, (guint8 *) buf, MIN((gsize) r, room));
+        } else if (r == -1 && errno == EINTR) {
+            continue;
+        } else {
+            return r == -1 && errno == EAGAIN;
+        }
+    }
+}
+
+static gboolean exec_output_readable (gint fd,
+                                      GIOCondition condition,
+                                      gpointer user_data)
+{
+    struct exec_stream *stream = user_data;
+
+    if (exec_stream_read(stream)) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    stream->watch = 0;
+    exec_stream_close(stream);
+    exec_finish(stream->exec);
+    return G_SOURCE_REMOVE;
+}
+
+static void exec_exited (GPid pid, gint wait_status, gpointer user_data)
+{
+    struct exec *exec = user_data;
+
+    exec->exited = TRUE;
+    exec->status = wait_status_to_exit_status(wait_status);
+    g_spawn_close_pid(pid);
+
+    /* Processes left behind by the command may keep the output open.
+     * What was written until now is all the caller gets. */
+    if (exec->out.fd != -1) {
+        exec_stream_read(&exec->out);
+        exec_stream_close(&exec->out);
+    }
+    if (exec->err.fd != -1) {
+        exec_stream_read(&exec->err);
+        exec_stream_close(&exec->err);
+    }
+    exec_finish(exec);
+}
+
+static gboolean exec_timed_out (gpointer user_data)
+{
+    struct exec *exec = user_data;
+
+    g_debug("Exec in container timed out, killing %d", exec->pid);
+    exec->timeout = 0;
+    kill(-exec->pid, SIGKILL);
+    return G_SOURCE_REMOVE;
+}
+
+void contejner_instance_exec (ContejnerInstance *instance,
+                              const char *command,
+                              const gchar **args,
+                              guint timeout,
+                              gsize max_output,
+                              ContejnerInstanceExecCallback cb,
+                              gpointer user_data)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    int ns_fds[G_N_ELEMENTS(namespaces)];
+    int out[2] = { -1, -1 }, err[2] = { -1, -1 }, sync[2] = { -1, -1 };
+    int null_fd = -1;
+    const char *message = NULL;
+    struct exec *exec;
+    gchar **argv;
+    pid_t pid;
+    guint i;
+
+    if (priv->status != CONTEJNER_INSTANCE_STATUS_RUNNING) {
+        cb(instance, CONTEJNER_ERR_FAILED_TO_START, "Container is not running",
+           -1, NULL, NULL, user_data);
+        return;
+    }
+
+    /* Everything the child needs is prepared here, since only async-signal
+     * safe functions may be used after fork() */
+    argv = g_new0(gchar *, args ? g_strv_length((gchar **) args) + 2 : 2);
+    argv[0] = g_strdup(command);
+    for (i = 0; args && args[i]; i++) {
+        argv[i + 1] = g_strdup(args[i]);
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(namespaces); i++) {
+        ns_fds[i] = -1;
+        if ((priv->unshared_namespaces & namespaces[i].flag) && !message) {
+            gchar *path = g_strdup_printf("/proc/%d/ns/%s", priv->pid,
+                                          namespaces[i].file);
+            ns_fds[i] = open(path, O_RDONLY | O_CLOEXEC);
+            if (ns_fds[i] == -1) {
+                instance_warning(priv, "Failed to open %s: %s", path, strerror(errno));
+                message = "Failed to open container namespaces";
+            }
+            g_free(path);
+        }
+    }
+
+    if (!message &&
+        ((null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC)) == -1 ||
+         pipe2(out, O_CLOEXEC) || pipe2(err, O_CLOEXEC) ||
+         pipe2(sync, O_CLOEXEC))) {
+        instance_warning(priv, "Failed to set up exec: %s", strerror(errno));
+        message = "Failed to set up output";
+    }
+
+    if (!message) {
+        pid = fork();
+        if (pid == 0) {
+            int fds[] = { null_fd, out[1], err[1] };
+            close(sync[1]);
+            _exit(exec_child(priv, ns_fds, sync[0], fds, argv));
+        } else if (pid == -1) {
+            instance_warning(priv, "Failed to fork: %s", strerror(errno));
+            message = "Failed to start command";
+        } else if (priv->cgroup && !contejner_cgroup_add_pid(priv->cgroup, pid)) {
+            instance_warning(priv, "Failed to move command into the cgroup of the container");
+        }
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(namespaces); i++) {
+        if (ns_fds[i] != -1) {
+            close(ns_fds[i]);
+        }
+    }
+    if (null_fd != -1) {
+        close(null_fd);
+    }
+    for (i = 0; i < 2; i++) {
+        if (sync[i] != -1) {
+            close(sync[i]);
+        }
+    }
+    if (out[1] != -1) {
+        close(out[1]);
+    }
+    if (err[1] != -1) {
+        close(err[1]);
+    }
+    g_strfreev(argv);
+
+    if (message) {
+        if (out[0] != -1) {
+            close(out[0]);
+        }
+        if (err[0] != -1) {
+            close(err[0]);
+        }
+        cb(instance, CONTEJNER_ERR_FAILED_TO_START, message,
+           -1, NULL, NULL, user_data);
+        return;
+    }
+
+    exec = g_new0(struct exec, 1);
+    exec->instance = g_object_ref(instance);
+    exec->pid = pid;
+    exec->max_output = max_output;
+    exec->cb = cb;
+    exec->user_data = user_data;
+
+    exec->out.exec = exec;
+    exec->out.data = g_byte_array_new();
+    exec->out.fd = out[0];
+    exec->err.exec = exec;
+    exec->err.data = g_byte_array_new();
+    exec->err.fd = err[0];
+
+    fcntl(out[0], F_SETFL, O_NONBLOCK);
+    fcntl(err[0], F_SETFL, O_NONBLOCK);
+    exec->out.watch = g_unix_fd_add(out[0], G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                    exec_output_readable, &exec->out);
+    exec->err.watch = g_unix_fd_add(err[0], G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                    exec_output_readable, &exec->err);
+    g_child_watch_add(pid, exec_exited, exec);
+
+    if (timeout) {
+        exec->timeout = g_timeout_add(timeout, exec_timed_out, exec);
+    }
+
+    instance_debug(priv, "Started %s as %d", command, pid);
+}
+
+void contejner_instance_set_queued (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+
+    priv->status = CONTEJNER_INSTANCE_STATUS_QUEUED;
+    g_object_notify_by_pspec(G_OBJECT(instance),
+                             obj_properties[PROP_STATUS]);
+}
+
+void contejner_instance_set_dequeued (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+
+    /* Nothing ran, so there is nothing to restart */
+    priv->restart_delay = -1;
+    priv->status = CONTEJNER_INSTANCE_STATUS_STOPPED;
+    g_object_notify_by_pspec(G_OBJECT(instance),
+                             obj_properties[PROP_STATUS]);
+}
+
+const char *contejner_instance_status_to_string (ContejnerInstanceStatus status)
+{
+    switch (status) {
+        case CONTEJNER_INSTANCE_STATUS_RUNNING: return "RUNNING";
+        case CONTEJNER_INSTANCE_STATUS_STOPPED: return "STOPPED";
+        case CONTEJNER_INSTANCE_STATUS_CREATED: return "CREATED";
+        case CONTEJNER_INSTANCE_STATUS_QUEUED: return "QUEUED";
+        case CONTEJNER_INSTANCE_STATUS_FROZEN: return "FROZEN";
+        default: return NULL;
+    }
+}
+
+int contejner_instance_get_id (const ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->id;
+}
+
+int contejner_instance_get_exit_status (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->exit_status;
+}
+
+gboolean contejner_instance_was_oom_killed (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->cgroup_events[CONTEJNER_CGROUP_EVENT_OOM_KILL] > 0;
+}
+
+guint64 contejner_instance_get_cgroup_event_count (ContejnerInstance *instance,
+                                                   ContejnerCgroupEvent event)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return event < CONTEJNER_CGROUP_EVENT_DRAINED ? priv->cgroup_events[event]
+                                                  : 0;
+}
+
+gboolean contejner_instance_set_timeout (ContejnerInstance *instance,
+                                         guint seconds)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    priv->timeout = seconds;
+    return TRUE;
+}
+
+guint contejner_instance_get_timeout (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->timeout;
+}
+
+gboolean contejner_instance_set_timeout_grace (ContejnerInstance *instance,
+                                               guint seconds)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    priv->timeout_grace = seconds;
+    return TRUE;
+}
+
+guint contejner_instance_get_timeout_grace (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->timeout_grace;
+}
+
+gboolean contejner_instance_get_timed_out (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->timed_out;
+}
+
+gboolean contejner_instance_set_restart_policy (ContejnerInstance *instance,
+                                                const char *policy)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(restart_policies); i++) {
+        if (!g_strcmp0(policy, restart_policies[i].name)) {
+            priv->restart_policy = restart_policies[i].policy;
+            return TRUE;
+        }
+    }
+
+    instance_debug(priv, "Unknown restart policy: %s", policy);
+    return FALSE;
+}
+
+const char *contejner_instance_get_restart_policy (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return restart_policies[priv->restart_policy].name;
+}
+
+gint64 contejner_instance_get_restart_delay (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+
+    if (priv->status != CONTEJNER_INSTANCE_STATUS_STOPPED) {
+        return -1;
+    }
+    return priv->restart_delay;
+}
+
+void contejner_instance_reset_restarts (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    priv->restarts = 0;
+}
+
+guint contejner_instance_get_restarts (ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->restarts;
+}
+
+gboolean contejner_instance_set_command (ContejnerInstance *instance,
+                                         const gchar *command,
+                                         const gchar **args)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+
+    /* Copy first, the new values may point into the old ones */
+    gchar *new_command = g_strdup(command);
+    gchar **new_args = g_strdupv((char **)args);
+    if (!new_command || !new_args) {
+        g_free(new_command);
+        g_strfreev(new_args);
+        return FALSE;
+    }
+
+    g_free(priv->command);
+    g_strfreev(priv->command_args);
+    priv->command = new_command;
+    priv->command_args = new_args;
+
+    return TRUE;
+}
+
+gboolean contejner_instance_set_root(ContejnerInstance *instance,
+                                     const GFile *path)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    if (is_active(priv)) {
+        instance_warning(priv, "Container already running");
+        return FALSE;
+    }
+
+    if (g_file_query_exists((GFile *)path, NULL)) {
+        g_free(priv->rootfs_path);
+        priv->rootfs_path = g_file_get_path ((GFile *)path);
+        return TRUE;
+    } else {
+        instance_warning(priv, "Path does not exist: %s", g_file_get_path ((GFile *)path));
+    }
+
+    return FALSE;
+}
+
+/* An absolute path without empty, "." or ".." components, other than / */
+static gboolean is_plain_path (const char *path)
+{
+    gchar **parts;
+    gboolean plain = path[0] == '/' && path[1];
+    guint i;
+
+    parts = g_strsplit(path + 1, "/", -1);
+    for (i = 0; plain && parts[i]; i++) {
+        plain = parts[i][0] && g_strcmp0(parts[i], ".") && g_strcmp0(parts[i], "..");
+    }
+    g_strfreev(parts);
+
+    return plain;
+}
+
+static gint compare_scratch (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    return strcmp(((const struct scratch *) a)->path,
+                  ((const struct scratch *) b)->path);
+}
+
+gboolean contejner_instance_set_scratch(ContejnerInstance *instance,
+                                        GVariant *scratch)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    GVariantIter iter;
+    const gchar *path;
+    guint64 size;
+    gsize n = g_variant_n_children(scratch), i = 0;
+    struct scratch *entries;
+
+    if (is_active(priv)) {
+        instance_debug(priv, "Container is already running. Not changing scratch space");
+        return FALSE;
+    }
+
+    /* Paths are taken as they are under the root directory, so they must
+     * not lead out of it */
+    entries = g_new0(struct scratch, n);
+    g_variant_iter_init(&iter, scratch);
+    while (g_variant_iter_next(&iter, "{&st}", &path, &size)) {
+        if (!is_plain_path(path) || !size ||
+            strlen(path) + strlen(priv->rootfs_path) >= PATH_MAX) {
+            instance_debug(priv, "Invalid scratch space: %s", path);
+            while (i--) {
+                g_free(entries[i].path);
+            }
+            g_free(entries);
+            return FALSE;
+        }
+
+        entries[i].path = g_strdup(path);
+        entries[i].size = size;
+        i++;
+    }
+
+    g_qsort_with_data(entries, n, sizeof(*entries), compare_scratch, NULL);
+    free_scratch(priv);
+    priv->scratch = entries;
+    priv->n_scratch = n;
+    return TRUE;
+}
+
+GVariant *contejner_instance_get_scratch(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    GVariantBuilder builder;
+    guint i;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{st}"));
+    for (i = 0; i < priv->n_scratch; i++) {
+        g_variant_builder_add(&builder, "{st}", priv->scratch[i].path,
+                              priv->scratch[i].size);
+    }
+    return g_variant_builder_end(&builder);
+}
+
+static gint compare_mount (gconstpointer a, gconstpointer b)
+{
+    return strcmp(((const struct mount *) a)->path_in_container,
+                  ((const struct mount *) b)->path_in_container);
+}
+
+/* The host path is resolved once, here, so that the child binds the directory
+ * that was checked */
+static struct mount *new_mount (ContejnerInstancePrivate *priv,
+                                const char *host_path,
+                                const char *container_path,
+                                guint flags)
+{
+    struct mount *mount;
+    char *resolved;
+
+    if (flags & ~(CONTEJNER_MOUNT_READ_ONLY | CONTEJNER_MOUNT_RECURSIVE) ||
+        !is_plain_path(container_path) ||
+        strlen(container_path) + strlen(priv->rootfs_path) >= PATH_MAX) {
+        g_debug("Invalid mount: %s", container_path);
+        return NULL;
+    }
+#ifndef MOUNT_ATTR_RDONLY
+    if ((flags & CONTEJNER_MOUNT_READ_ONLY) && (flags & CONTEJNER_MOUNT_RECURSIVE)) {
+        g_debug("Recursive read-only bind mounts are not supported");
+        return NULL;
+    }
+#endif
+    if (!g_path_is_absolute(host_path) ||
+        !(resolved = realpath(host_path, NULL))) {
+        g_debug("Invalid host path: %s", host_path);
+        return NULL;
+    }
+
+    mount = g_new0(struct mount, 1);
+    mount->path_in_host = g_strdup(resolved);
+    mount->path_in_container = g_strdup(container_path);
+    mount->flags = flags;
+    free(resolved);
+    return mount;
+}
+
+gboolean contejner_instance_add_mount(ContejnerInstance *instance,
+                                      const char *host_path,
+                                      const char *container_path,
+                                      guint flags)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    struct mount *mount;
+
+    if (is_active(priv)) {
+        instance_debug(priv, "Container is already running. Not adding mount");
+        return FALSE;
+    }
+
+    if (!(mount = new_mount(priv, host_path, container_path, flags))) {
+        return FALSE;
+    }
+    priv->mounts = g_slist_insert_sorted(priv->mounts, mount, compare_mount);
+    return TRUE;
+}
+
+gboolean contejner_instance_set_mounts(ContejnerInstance *instance,
+                                       GVariant *mounts)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    GVariantIter iter;
+    const gchar *host_path, *container_path;
+    guint32 flags;
+    GSList *list = NULL;
+    struct mount *mount;
+
+    if (is_active(priv)) {
+        instance_debug(priv, "Container is already running. Not changing mounts");
+        return FALSE;
+    }
+
+    g_variant_iter_init(&iter, mounts);
+    while (g_variant_iter_next(&iter, "(&s&su)", &host_path, &container_path,
+                               &flags)) {
+        if (!(mount = new_mount(priv, host_path, container_path, flags))) {
+            g_slist_free_full(list, free_mount);
+            return FALSE;
+        }
+        list = g_slist_insert_sorted(list, mount, compare_mount);
+    }
+
+    g_slist_free_full(priv->mounts, free_mount);
+    priv->mounts = list;
+    return TRUE;
+}
+
+GVariant *contejner_instance_get_mounts(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    GVariantBuilder builder;
+    GSList *l;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(ssu)"));
+    for (l = priv->mounts; l; l = l->next) {
+        struct mount *m = l->data;
+        g_variant_builder_add(&builder, "(ssu)", m->path_in_host,
+                              m->path_in_container, m->flags);
+    }
+    return g_variant_builder_end(&builder);
+}
+
+gboolean contejner_instance_sample(ContejnerInstance *instance, gint64 time)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    ContejnerCgroupStats stats;
+
+    if (!is_active(priv) || !priv->cgroup ||
+        !contejner_cgroup_read_stats(priv->cgroup, &stats)) {
+        return FALSE;
+    }
+
+    if (!priv->series) {
+        priv->series = contejner_series_new(SERIES_SZ);
+    }
+    contejner_series_add(priv->series, time, &stats);
+    return TRUE;
+}
+
+GVariant *contejner_instance_get_series(ContejnerInstance *instance,
+                                        const char *metric,
+                                        gint64 since)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+
+    if (!contejner_series_is_metric(metric)) {
+        return NULL;
+    }
+    if (!priv->series) {
+        priv->series = contejner_series_new(SERIES_SZ);
+    }
+    return contejner_series_get(priv->series, metric, since);
+}
+
+gboolean contejner_instance_is_active(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return is_active(priv);
+}
+
+gboolean contejner_instance_freeze(ContejnerInstance *instance,
+                                   gboolean freeze)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    ContejnerInstanceStatus from = freeze ? CONTEJNER_INSTANCE_STATUS_RUNNING
+                                          : CONTEJNER_INSTANCE_STATUS_FROZEN;
+
+    if (priv->status != from) {
+        instance_debug(priv, "Container is not %s", freeze ? "running" : "frozen");
+        return FALSE;
+    }
+
+    if (!priv->cgroup || !contejner_cgroup_freeze(priv->cgroup, freeze)) {
+        instance_debug(priv, "Failed to %s container", freeze ? "freeze" : "thaw");
+        return FALSE;
+    }
+
+    priv->status = freeze ? CONTEJNER_INSTANCE_STATUS_FROZEN
+                          : CONTEJNER_INSTANCE_STATUS_RUNNING;
+    g_object_notify_by_pspec(G_OBJECT(instance),
+                             obj_properties[PROP_STATUS]);
+    return TRUE;
+}
+
+pid_t contejner_instance_get_pid(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return is_active(priv) && !priv->reaped ? priv->pid : 0;
 }
 
 gboolean contejner_instance_kill(ContejnerInstance *instance, int signal)
 {
     ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
-    if (priv->status == CONTEJNER_INSTANCE_STATUS_RUNNING) {
-        g_debug("Killing %d", priv->pid);
-        return kill(priv->pid, signal) == 0;
-    } else {
-        g_debug("Tried to kill non-running container");
+
+    if (!is_active(priv)) {
+        instance_debug(priv, "Tried to kill non-running container");
+        return FALSE;
+    }
+
+    /* The cgroup also holds the processes that left the process tree of
+     * the init process, or outlived it */
+    if (priv->cgroup && contejner_cgroup_signal(priv->cgroup, signal)) {
+        instance_debug(priv, "Sent signal %d to the processes", signal);
+        return TRUE;
+    }
+
+    if (priv->reaped) {
+        instance_debug(priv, "The init process has exited");
+        return FALSE;
+    }
+
+    instance_debug(priv, "Killing %d", priv->pid);
+    /* Through the pidfd, the signal can not reach another process that was
+     * given the same pid */
+    if (priv->pidfd != -1) {
+        return syscall(SYS_pidfd_send_signal, priv->pidfd, signal,
+                       NULL, 0) == 0;
+    }
+
+    /* Without pidfds, a child of ours is not reaped before container_stopped
+     * has run, but an adopted container may be gone and its pid reused */
+    if (read_start_time(priv->pid) != priv->start_time) {
+        instance_debug(priv, "Process %d is no longer the container", priv->pid);
+        return FALSE;
+    }
+    return kill(priv->pid, signal) == 0;
+}
+
+static void stop_expired (ContejnerTimer *timer, gpointer user_data)
+{
+    ContejnerInstance *instance = CONTEJNER_INSTANCE(user_data);
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+
+    instance_debug(priv, "Did not stop in time, killing it");
+    contejner_instance_kill(instance, SIGKILL);
+}
+
+gboolean contejner_instance_stop(ContejnerInstance *instance,
+                                 guint grace,
+                                 ContejnerInstanceStopCallback cb,
+                                 gpointer user_data)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    ContejnerTimerWheel *wheel = contejner_timer_wheel_get_default();
+    gboolean stopping = priv->stops != NULL;
+    struct stop *stop;
+
+    if (!is_active(priv)) {
+        instance_debug(priv, "Tried to stop non-running container");
+        return FALSE;
+    }
+
+    stop = g_new0(struct stop, 1);
+    stop->cb = cb;
+    stop->user_data = user_data;
+    priv->stops = g_slist_prepend(priv->stops, stop);
+    priv->stop_requested = TRUE;
+
+    /* Frozen processes would only see SIGTERM once thawed */
+    if (priv->status == CONTEJNER_INSTANCE_STATUS_FROZEN) {
+        contejner_instance_freeze(instance, FALSE);
+    }
+
+    if (!grace || !wheel) {
+        contejner_timer_cancel(&priv->stop_timer);
+        contejner_instance_kill(instance, SIGKILL);
+    } else if (!stopping) {
+        instance_debug(priv, "Stopping");
+        contejner_instance_kill(instance, SIGTERM);
+        contejner_timer_arm(wheel, &priv->stop_timer, grace,
+                            stop_expired, instance);
+    }
+
+    return TRUE;
+}
+
+gboolean contejner_instance_enable_ns(ContejnerInstance *instance, int ns)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    if (is_active(priv)) {
+        instance_debug(priv, "Container is already running. Not enabling new namespace");
+        return FALSE;
+    }
+
+    switch (ns) {
+        case CLONE_NEWNET:
+        case CLONE_NEWIPC:
+        case CLONE_NEWPID:
+        case CLONE_NEWUTS:
+        case CLONE_NEWNS:
+        case CLONE_NEWUSER:
+            priv->unshared_namespaces |= ns;
+            break;
+        default:
+            g_error("Unknown namespace: %d", ns);
+    }
+
+    return TRUE;
+}
+
+gboolean contejner_instance_disable_ns(ContejnerInstance *instance, int ns)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    if (is_active(priv)) {
+        instance_debug(priv, "Container is already running. Not disabling namespace");
+        return FALSE;
+    }
+
+    switch (ns) {
+        case CLONE_NEWNET:
+        case CLONE_NEWIPC:
+        case CLONE_NEWPID:
+        case CLONE_NEWUTS:
+        case CLONE_NEWNS:
+        case CLONE_NEWUSER:
+            if (priv->unshared_namespaces & ns) {
+                priv->unshared_namespaces -= ns;
+            } else {
+                instance_debug(priv, "Namespace %d is not enabled. Not disabling.", ns);
+            }
+            break;
+        default:
+            g_error("Unknown namespace: %d", ns);
+    }
+
+    return TRUE;
+}
+
+int contejner_instance_get_unshared_namespaces(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->unshared_namespaces;
+}
+
+gboolean contejner_instance_set_terminal(ContejnerInstance *instance,
+                                         gboolean enabled)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    if (is_active(priv)) {
+        instance_debug(priv, "Container is already running. Not changing terminal");
+        return FALSE;
+    }
+
+    priv->terminal = enabled;
+    return TRUE;
+}
+
+gboolean contejner_instance_get_terminal(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->terminal;
+}
+
+/* Prototypes and containers being restored have no logs yet */
+static gboolean compress_logs(ContejnerInstancePrivate *priv)
+{
+    if (!priv->stdout_output.log || !priv->stderr_output.log) {
+        return TRUE;
+    }
+
+    return contejner_log_set_compressed(priv->stdout_output.log,
+                                        priv->compress_output) &&
+           contejner_log_set_compressed(priv->stderr_output.log,
+                                        priv->compress_output);
+}
+
+gboolean contejner_instance_set_compress_output(ContejnerInstance *instance,
+                                                gboolean enabled)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+
+    priv->compress_output = enabled;
+    return compress_logs(priv);
+}
+
+gboolean contejner_instance_get_compress_output(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->compress_output;
+}
+
+gboolean contejner_instance_set_output_rate_limit(ContejnerInstance *instance,
+                                                 guint64 bytes_per_second)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+
+    priv->output_limits.rate = bytes_per_second;
+    output_limits_changed(priv);
+    return TRUE;
+}
+
+guint64 contejner_instance_get_output_rate_limit(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->output_limits.rate;
+}
+
+gboolean contejner_instance_set_output_volume_limit(ContejnerInstance *instance,
+                                                   guint64 bytes)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+
+    priv->output_limits.volume = bytes;
+    output_limits_changed(priv);
+    return TRUE;
+}
+
+guint64 contejner_instance_get_output_volume_limit(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->output_limits.volume;
+}
+
+gboolean contejner_instance_set_output_limit_policy(ContejnerInstance *instance,
+                                                   const char *policy)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(output_limit_policies); i++) {
+        if (!g_strcmp0(policy, output_limit_policies[i].name)) {
+            priv->output_limits.policy = output_limit_policies[i].policy;
+            output_limits_changed(priv);
+            return TRUE;
+        }
+    }
+
+    instance_debug(priv, "Unknown output limit policy: %s", policy);
+    return FALSE;
+}
+
+const char *contejner_instance_get_output_limit_policy(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return output_limit_policies[priv->output_limits.policy].name;
+}
+
+guint64 contejner_instance_get_output_dropped(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->output_limits.dropped;
+}
+
+guint contejner_instance_get_output_limit_hits(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->output_limits.hits;
+}
+
+guint64 contejner_instance_get_output_size(ContejnerInstance *instance,
+                                           gboolean stored)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    ContejnerLog *logs[] = { priv->stdout_output.log, priv->stderr_output.log };
+    guint64 size = 0;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(logs); i++) {
+        if (logs[i]) {
+            size += stored ? contejner_log_get_stored_size(logs[i]) :
+                             contejner_log_get_size(logs[i]);
+        }
+    }
+
+    return size;
+}
+
+int contejner_instance_attach_terminal(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    if (!priv->terminal) {
+        instance_debug(priv, "Container has no terminal");
+        return -1;
+    }
+
+    /* Attaching before Run is allowed, so that no output is missed */
+    if (!ensure_pty(priv)) {
+        return -1;
+    }
+
+    return contejner_pty_attach(priv->pty);
+}
+
+gboolean contejner_instance_resize_terminal(ContejnerInstance *instance,
+                                            guint16 rows,
+                                            guint16 cols)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    if (!priv->terminal || !ensure_pty(priv)) {
+        instance_debug(priv, "Container has no terminal");
+        return FALSE;
+    }
+
+    return contejner_pty_resize(priv->pty, rows, cols);
+}
+
+ContejnerLog *contejner_instance_get_output_log(ContejnerInstance *instance,
+                                                const char *stream)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    if (!g_strcmp0(stream, "stdout")) {
+        return priv->stdout_output.log;
+    } else if (!g_strcmp0(stream, "stderr")) {
+        return priv->stderr_output.log;
+    }
+
+    return NULL;
+}
+
+/* Parse a list such as "0-3,8,10-11" into a bit mask of @nbits bits */
+static gboolean parse_list(const char *list,
+                           unsigned long *mask,
+                           unsigned int nbits)
+{
+    gchar **ranges = g_strsplit(list, ",", -1);
+    gboolean ok = TRUE;
+    int i;
+
+    memset(mask, 0, nbits / 8);
+    for (i = 0; ok && ranges[i]; i++) {
+        char *end = NULL;
+        guint64 first = g_ascii_strtoull(ranges[i], &end, 10);
+        guint64 last = first;
+
+        if (end == ranges[i]) {
+            ok = FALSE;
+            break;
+        }
+
+        if (*end == '-') {
+            char *start = end + 1;
+            last = g_ascii_strtoull(start, &end, 10);
+            if (end == start) {
+                ok = FALSE;
+                break;
+            }
+        }
+
+        if (*end != '\0' || first > last || last >= nbits) {
+            ok = FALSE;
+            break;
+        }
+
+        for (; first <= last; first++) {
+            mask[first / LONG_BITS] |= 1UL << (first % LONG_BITS);
+        }
+    }
+
+    g_strfreev(ranges);
+    return ok;
+}
+
+gboolean contejner_instance_set_cpuset(ContejnerInstance *instance,
+                                       const char *cpus)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    unsigned long mask[CPU_SETSIZE / LONG_BITS];
+    unsigned int cpu;
+
+    if (is_active(priv)) {
+        instance_debug(priv, "Container is already running. Not changing CPU set");
+        return FALSE;
+    }
+
+    if (!cpus || !*cpus) {
+        g_free(priv->cpuset);
+        priv->cpuset = NULL;
+        return TRUE;
+    }
+
+    if (!parse_list(cpus, mask, CPU_SETSIZE)) {
+        instance_debug(priv, "Invalid CPU list: %s", cpus);
+        return FALSE;
+    }
+
+    CPU_ZERO(&priv->cpu_mask);
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (mask[cpu / LONG_BITS] & (1UL << (cpu % LONG_BITS))) {
+            CPU_SET(cpu, &priv->cpu_mask);
+        }
+    }
+
+    if (CPU_COUNT(&priv->cpu_mask) == 0) {
+        instance_debug(priv, "Empty CPU list: %s", cpus);
         return FALSE;
     }
+
+    g_free(priv->cpuset);
+    priv->cpuset = g_strdup(cpus);
+    return TRUE;
 }
 
-gboolean contejner_instance_enable_ns(ContejnerInstance *instance, int ns)
+const char *contejner_instance_get_cpuset(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->cpuset ? priv->cpuset : "";
+}
+
+gboolean contejner_instance_set_mem_nodes(ContejnerInstance *instance,
+                                          const char *nodes)
 {
     ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
-    if (priv->status == CONTEJNER_INSTANCE_STATUS_RUNNING) {
-        g_debug("Container is already running. Not enabling new namespace");
+    unsigned long mask[MAX_NUMA_NODES / LONG_BITS];
+
+    if (is_active(priv)) {
+        instance_debug(priv, "Container is already running. Not changing memory nodes");
         return FALSE;
     }
 
-    switch (ns) {
-        case CLONE_NEWNET:
-        case CLONE_NEWIPC:
-        case CLONE_NEWPID:
-        case CLONE_NEWUTS:
-        case CLONE_NEWNS:
-        case CLONE_NEWUSER:
-            priv->unshared_namespaces |= ns;
-        default:
-            g_error("Unknown namespace: %d", ns);
+    if (!nodes || !*nodes) {
+        g_free(priv->mem_nodes);
+        priv->mem_nodes = NULL;
+        return TRUE;
+    }
+
+    if (!parse_list(nodes, mask, MAX_NUMA_NODES)) {
+        instance_debug(priv, "Invalid memory node list: %s", nodes);
+        return FALSE;
     }
 
+    memcpy(priv->node_mask, mask, sizeof(mask));
+    g_free(priv->mem_nodes);
+    priv->mem_nodes = g_strdup(nodes);
     return TRUE;
 }
 
-gboolean contejner_instance_disable_ns(ContejnerInstance *instance, int ns)
+const char *contejner_instance_get_mem_nodes(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->mem_nodes ? priv->mem_nodes : "";
+}
+
+/* The scheduling getters return the values of the running container, or
+ * the values it will be started with */
+static pid_t sched_pid(ContejnerInstancePrivate *priv)
+{
+    return is_active(priv) ? priv->pid : 0;
+}
+
+gboolean contejner_instance_set_nice(ContejnerInstance *instance, int nice)
 {
     ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
-    if (priv->status == CONTEJNER_INSTANCE_STATUS_RUNNING) {
-        g_debug("Container is already running. Not disabling namespace");
+
+    if (is_active(priv)) {
+        instance_debug(priv, "Container is already running. Not changing nice value");
         return FALSE;
     }
 
-    switch (ns) {
-        case CLONE_NEWNET:
-        case CLONE_NEWIPC:
-        case CLONE_NEWPID:
-        case CLONE_NEWUTS:
-        case CLONE_NEWNS:
-        case CLONE_NEWUSER:
-            if (priv->unshared_namespaces & ns) {
-                priv->unshared_namespaces -= ns;
-            } else {
-                g_debug("Namespace %d is not enabled. Not disabling.", ns);
-            }
-        default:
-            g_error("Unknown namespace: %d", ns);
+    if (nice < -20 || nice > 19) {
+        instance_debug(priv, "Invalid nice value: %d", nice);
+        return FALSE;
     }
 
+    priv->nice_set = TRUE;
+    priv->nice = nice;
     return TRUE;
 }
 
-int contejner_instance_get_unshared_namespaces(ContejnerInstance *instance)
+int contejner_instance_get_nice(ContejnerInstance *instance)
 {
     ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
-    return priv->unshared_namespaces;
+    pid_t pid = sched_pid(priv);
+    int nice;
+
+    if (!pid && priv->nice_set) {
+        return priv->nice;
+    }
+
+    errno = 0;
+    nice = getpriority(PRIO_PROCESS, pid);
+    if (nice == -1 && errno) {
+        instance_debug(priv, "Failed to get nice value of %d: %s", pid, strerror(errno));
+        return priv->nice;
+    }
+    return nice;
+}
+
+gboolean contejner_instance_set_sched_policy(ContejnerInstance *instance,
+                                             const char *policy)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    guint i;
+
+    if (is_active(priv)) {
+        instance_debug(priv, "Container is already running. Not changing scheduling policy");
+        return FALSE;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(sched_policies); i++) {
+        if (!g_ascii_strcasecmp(policy, sched_policies[i].name)) {
+            priv->sched_policy = sched_policies[i].policy;
+            return TRUE;
+        }
+    }
+
+    instance_debug(priv, "Unknown scheduling policy: %s", policy);
+    return FALSE;
+}
+
+const char *contejner_instance_get_sched_policy(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    pid_t pid = sched_pid(priv);
+    int policy = priv->sched_policy;
+    guint i;
+
+    if (pid || policy == -1) {
+        policy = sched_getscheduler(pid);
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(sched_policies); i++) {
+        if (sched_policies[i].policy == (policy & ~SCHED_RESET_ON_FORK)) {
+            return sched_policies[i].name;
+        }
+    }
+    return "UNKNOWN";
+}
+
+gboolean contejner_instance_set_io_priority(ContejnerInstance *instance,
+                                            const char *priority)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    gchar **parts;
+    gboolean ok = FALSE;
+    guint64 level = 0;
+    int class;
+
+    if (is_active(priv)) {
+        instance_debug(priv, "Container is already running. Not changing I/O priority");
+        return FALSE;
+    }
+
+    /* "class" or "class/level", e.g. "best-effort/7" or "idle" */
+    parts = g_strsplit(priority, "/", 2);
+    for (class = 0; class < (int) G_N_ELEMENTS(io_classes); class++) {
+        if (!g_strcmp0(parts[0], io_classes[class])) {
+            break;
+        }
+    }
+
+    if (class == G_N_ELEMENTS(io_classes)) {
+        instance_debug(priv, "Unknown I/O scheduling class: %s", parts[0]);
+    } else if (parts[1] &&
+               (!g_ascii_string_to_unsigned(parts[1], 10, 0,
+                                            IOPRIO_NR_LEVELS - 1,
+                                            &level, NULL) ||
+                class == IOPRIO_CLASS_NONE || class == IOPRIO_CLASS_IDLE)) {
+        instance_debug(priv, "Invalid I/O priority level: %s", priority);
+    } else {
+        if (!parts[1] &&
+            (class == IOPRIO_CLASS_RT || class == IOPRIO_CLASS_BE)) {
+            level = IOPRIO_NORM;
+        }
+        priv->io_priority = IOPRIO_PRIO_VALUE(class, level);
+        ok = TRUE;
+    }
+
+    g_strfreev(parts);
+    return ok;
+}
+
+static gchar *io_priority_to_string(int priority)
+{
+    int class = IOPRIO_PRIO_CLASS(priority);
+
+    if (class >= (int) G_N_ELEMENTS(io_classes)) {
+        return g_strdup("unknown");
+    } else if (class == IOPRIO_CLASS_RT || class == IOPRIO_CLASS_BE) {
+        return g_strdup_printf("%s/%lu", io_classes[class],
+                               (unsigned long) IOPRIO_PRIO_DATA(priority));
+    }
+    return g_strdup(io_classes[class]);
+}
+
+gchar *contejner_instance_get_io_priority(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    pid_t pid = sched_pid(priv);
+    int priority = priv->io_priority;
+
+    if (pid || priority == -1) {
+        priority = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, pid);
+        if (priority == -1) {
+            instance_debug(priv, "Failed to get I/O priority of %d: %s", pid, strerror(errno));
+            priority = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_NONE, 0);
+        }
+    }
+
+    return io_priority_to_string(priority);
+}
+
+void contejner_instance_set_labels(ContejnerInstance *instance,
+                                   GVariant *labels)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    GVariantIter iter;
+    const gchar *key, *value;
+
+    g_hash_table_remove_all(priv->labels);
+    g_variant_iter_init(&iter, labels);
+    while (g_variant_iter_next(&iter, "{&s&s}", &key, &value)) {
+        g_hash_table_insert(priv->labels, g_strdup(key), g_strdup(value));
+    }
+}
+
+GHashTable *contejner_instance_get_labels(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return priv->labels;
+}
+
+static GVariant *labels_to_variant(GHashTable *labels)
+{
+    GVariantBuilder builder;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{ss}"));
+    g_hash_table_iter_init(&iter, labels);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        g_variant_builder_add(&builder, "{ss}", key, value);
+    }
+    return g_variant_builder_end(&builder);
+}
+
+GVariant *contejner_instance_get_labels_variant(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    return labels_to_variant(priv->labels);
+}
+
+int contejner_instance_namespace_from_string(const char *property)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(namespaces); i++) {
+        if (!g_strcmp0(property, namespaces[i].property)) {
+            return namespaces[i].flag;
+        }
+    }
+    return 0;
+}
+
+/* Check the type of a configuration value */
+static gboolean check_type(const char *key,
+                           GVariant *value,
+                           const GVariantType *type,
+                           GError **error)
+{
+    if (!g_variant_is_of_type(value, type)) {
+        g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                    "%s has the wrong type", key);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean contejner_instance_configure(ContejnerInstance *instance,
+                                      GVariant *config,
+                                      GError **error)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    const gchar *command = NULL;
+    const gchar **arguments = NULL;
+    GVariantIter iter;
+    const gchar *key;
+    GVariant *value;
+    gboolean ok = TRUE;
+    int ns;
+
+    if (is_active(priv)) {
+        g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                    "Container already running");
+        return FALSE;
+    }
+
+    g_variant_iter_init(&iter, config);
+    while (ok && g_variant_iter_next(&iter, "{&sv}", &key, &value)) {
+        if (!g_strcmp0(key, "Command")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_STRING, error);
+            if (ok) {
+                command = g_variant_get_string(value, NULL);
+            }
+        } else if (!g_strcmp0(key, "Arguments")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_STRING_ARRAY, error);
+            if (ok) {
+                g_free(arguments);
+                arguments = g_variant_get_strv(value, NULL);
+            }
+        } else if (!g_strcmp0(key, "Root")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_STRING, error);
+            if (ok) {
+                GFile *f = g_file_new_for_path(g_variant_get_string(value, NULL));
+                ok = contejner_instance_set_root(instance, f);
+                g_object_unref(f);
+            }
+        } else if ((ns = contejner_instance_namespace_from_string(key))) {
+            ok = check_type(key, value, G_VARIANT_TYPE_BOOLEAN, error);
+            if (ok) {
+                ok = g_variant_get_boolean(value) ?
+                    contejner_instance_enable_ns(instance, ns) :
+                    contejner_instance_disable_ns(instance, ns);
+            }
+        } else if (!g_strcmp0(key, "Terminal")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_BOOLEAN, error) &&
+                contejner_instance_set_terminal(instance,
+                                                g_variant_get_boolean(value));
+        } else if (!g_strcmp0(key, "CompressOutput")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_BOOLEAN, error) &&
+                contejner_instance_set_compress_output(instance,
+                                                       g_variant_get_boolean(value));
+        } else if (!g_strcmp0(key, "Timeout")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_UINT32, error) &&
+                contejner_instance_set_timeout(instance, g_variant_get_uint32(value));
+        } else if (!g_strcmp0(key, "TimeoutGracePeriod")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_UINT32, error) &&
+                contejner_instance_set_timeout_grace(instance,
+                                                     g_variant_get_uint32(value));
+        } else if (!g_strcmp0(key, "OutputRateLimit")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_UINT64, error) &&
+                contejner_instance_set_output_rate_limit(instance,
+                                                         g_variant_get_uint64(value));
+        } else if (!g_strcmp0(key, "OutputVolumeLimit")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_UINT64, error) &&
+                contejner_instance_set_output_volume_limit(instance,
+                                                           g_variant_get_uint64(value));
+        } else if (!g_strcmp0(key, "OutputLimitPolicy")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_STRING, error) &&
+                contejner_instance_set_output_limit_policy(instance,
+                                                           g_variant_get_string(value, NULL));
+        } else if (!g_strcmp0(key, "RestartPolicy")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_STRING, error) &&
+                contejner_instance_set_restart_policy(instance,
+                                                      g_variant_get_string(value, NULL));
+        } else if (!g_strcmp0(key, "CpuSet")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_STRING, error) &&
+                contejner_instance_set_cpuset(instance,
+                                              g_variant_get_string(value, NULL));
+        } else if (!g_strcmp0(key, "MemNodes")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_STRING, error) &&
+                contejner_instance_set_mem_nodes(instance,
+                                                 g_variant_get_string(value, NULL));
+        } else if (!g_strcmp0(key, "Nice")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_INT32, error) &&
+                contejner_instance_set_nice(instance, g_variant_get_int32(value));
+        } else if (!g_strcmp0(key, "SchedPolicy")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_STRING, error) &&
+                contejner_instance_set_sched_policy(instance,
+                                                    g_variant_get_string(value, NULL));
+        } else if (!g_strcmp0(key, "Mounts")) {
+            ok = check_type(key, value, G_VARIANT_TYPE("a(ssu)"), error) &&
+                contejner_instance_set_mounts(instance, value);
+        } else if (!g_strcmp0(key, "Scratch")) {
+            ok = check_type(key, value, G_VARIANT_TYPE("a{st}"), error) &&
+                contejner_instance_set_scratch(instance, value);
+        } else if (!g_strcmp0(key, "Labels")) {
+            ok = check_type(key, value, G_VARIANT_TYPE("a{ss}"), error);
+            if (ok) {
+                contejner_instance_set_labels(instance, value);
+            }
+        } else if (!g_strcmp0(key, "IOPriority")) {
+            ok = check_type(key, value, G_VARIANT_TYPE_STRING, error) &&
+                contejner_instance_set_io_priority(instance,
+                                                   g_variant_get_string(value, NULL));
+        } else {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Unknown configuration key: %s", key);
+            ok = FALSE;
+        }
+
+        if (!ok && error && !*error) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Invalid value for %s", key);
+        }
+        g_variant_unref(value);
+    }
+
+    /* The arguments are kept when only the command changes, and the other
+     * way around */
+    if (ok && (command || arguments)) {
+        const gchar **args;
+        guint i, n;
+
+        if (!command) {
+            command = priv->command;
+        }
+
+        if (!command) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Arguments given without a command");
+            ok = FALSE;
+        } else {
+            n = arguments ? g_strv_length((gchar **) arguments) :
+                (priv->command_args ? g_strv_length(priv->command_args) - 1 : 0);
+            args = g_new0(const gchar *, n + 2);
+            args[0] = command;
+            for (i = 0; i < n; i++) {
+                args[i + 1] = arguments ? arguments[i] : priv->command_args[i + 1];
+            }
+            ok = contejner_instance_set_command(instance, command, args);
+            g_free(args);
+        }
+    }
+
+    g_free(arguments);
+    return ok;
+}
+
+static void copy_label(gpointer key, gpointer value, gpointer user_data)
+{
+    g_hash_table_insert(user_data, g_strdup(key), g_strdup(value));
+}
+
+void contejner_instance_copy_config(ContejnerInstance *instance,
+                                    ContejnerInstance *source)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    ContejnerInstancePrivate *src = CONTEJNER_INSTANCE_GET_PRIVATE(source);
+    GSList *l;
+    guint i;
+
+    g_free(priv->command);
+    g_strfreev(priv->command_args);
+    g_free(priv->rootfs_path);
+    g_free(priv->cpuset);
+    g_free(priv->mem_nodes);
+
+    priv->command = g_strdup(src->command);
+    priv->command_args = g_strdupv(src->command_args);
+    priv->rootfs_path = g_strdup(src->rootfs_path);
+    g_slist_free_full(priv->mounts, free_mount);
+    priv->mounts = NULL;
+    for (l = src->mounts; l; l = l->next) {
+        struct mount *m = l->data, *copy = g_new0(struct mount, 1);
+        copy->path_in_host = g_strdup(m->path_in_host);
+        copy->path_in_container = g_strdup(m->path_in_container);
+        copy->flags = m->flags;
+        priv->mounts = g_slist_append(priv->mounts, copy);
+    }
+    free_scratch(priv);
+    priv->scratch = g_new0(struct scratch, src->n_scratch);
+    priv->n_scratch = src->n_scratch;
+    for (i = 0; i < src->n_scratch; i++) {
+        priv->scratch[i].path = g_strdup(src->scratch[i].path);
+        priv->scratch[i].size = src->scratch[i].size;
+    }
+    priv->unshared_namespaces = src->unshared_namespaces;
+    priv->terminal = src->terminal;
+    priv->compress_output = src->compress_output;
+    compress_logs(priv);
+    priv->timeout = src->timeout;
+    priv->timeout_grace = src->timeout_grace;
+    priv->restart_policy = src->restart_policy;
+    priv->output_limits.rate = src->output_limits.rate;
+    priv->output_limits.volume = src->output_limits.volume;
+    priv->output_limits.policy = src->output_limits.policy;
+    priv->cpuset = g_strdup(src->cpuset);
+    priv->cpu_mask = src->cpu_mask;
+    priv->mem_nodes = g_strdup(src->mem_nodes);
+    g_hash_table_unref(priv->labels);
+    priv->labels = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    g_hash_table_foreach(src->labels, copy_label, priv->labels);
+    memcpy(priv->node_mask, src->node_mask, sizeof(priv->node_mask));
+    priv->nice_set = src->nice_set;
+    priv->nice = src->nice;
+    priv->sched_policy = src->sched_policy;
+    priv->io_priority = src->io_priority;
+}
+
+GVariant *contejner_instance_get_config(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    GVariantBuilder builder;
+    guint i;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+
+    if (priv->command) {
+        g_variant_builder_add(&builder, "{sv}", "Command",
+                              g_variant_new_string(priv->command));
+        g_variant_builder_add(&builder, "{sv}", "Arguments",
+                              g_variant_new_strv((const gchar * const *)
+                                                 priv->command_args + 1, -1));
+    }
+    g_variant_builder_add(&builder, "{sv}", "Root",
+                          g_variant_new_string(priv->rootfs_path));
+    if (priv->mounts) {
+        g_variant_builder_add(&builder, "{sv}", "Mounts",
+                              contejner_instance_get_mounts(instance));
+    }
+    if (priv->n_scratch) {
+        g_variant_builder_add(&builder, "{sv}", "Scratch",
+                              contejner_instance_get_scratch(instance));
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(namespaces); i++) {
+        gboolean enabled = (priv->unshared_namespaces & namespaces[i].flag) != 0;
+        g_variant_builder_add(&builder, "{sv}", namespaces[i].property,
+                              g_variant_new_boolean(enabled));
+    }
+
+    g_variant_builder_add(&builder, "{sv}", "Terminal",
+                          g_variant_new_boolean(priv->terminal));
+    g_variant_builder_add(&builder, "{sv}", "CompressOutput",
+                          g_variant_new_boolean(priv->compress_output));
+    if (priv->timeout) {
+        g_variant_builder_add(&builder, "{sv}", "Timeout",
+                              g_variant_new_uint32(priv->timeout));
+    }
+    g_variant_builder_add(&builder, "{sv}", "TimeoutGracePeriod",
+                          g_variant_new_uint32(priv->timeout_grace));
+    g_variant_builder_add(&builder, "{sv}", "RestartPolicy",
+                          g_variant_new_string(
+                              restart_policies[priv->restart_policy].name));
+    if (priv->output_limits.rate) {
+        g_variant_builder_add(&builder, "{sv}", "OutputRateLimit",
+                              g_variant_new_uint64(priv->output_limits.rate));
+    }
+    if (priv->output_limits.volume) {
+        g_variant_builder_add(&builder, "{sv}", "OutputVolumeLimit",
+                              g_variant_new_uint64(priv->output_limits.volume));
+    }
+    g_variant_builder_add(&builder, "{sv}", "OutputLimitPolicy",
+                          g_variant_new_string(
+                              output_limit_policies[priv->output_limits.policy].name));
+
+    if (priv->cpuset) {
+        g_variant_builder_add(&builder, "{sv}", "CpuSet",
+                              g_variant_new_string(priv->cpuset));
+    }
+    if (priv->mem_nodes) {
+        g_variant_builder_add(&builder, "{sv}", "MemNodes",
+                              g_variant_new_string(priv->mem_nodes));
+    }
+    if (priv->nice_set) {
+        g_variant_builder_add(&builder, "{sv}", "Nice",
+                              g_variant_new_int32(priv->nice));
+    }
+    for (i = 0; i < G_N_ELEMENTS(sched_policies); i++) {
+        if (sched_policies[i].policy == priv->sched_policy) {
+            g_variant_builder_add(&builder, "{sv}", "SchedPolicy",
+                                  g_variant_new_string(sched_policies[i].name));
+        }
+    }
+    if (g_hash_table_size(priv->labels)) {
+        g_variant_builder_add(&builder, "{sv}", "Labels",
+                              labels_to_variant(priv->labels));
+    }
+    if (priv->io_priority != -1) {
+        g_variant_builder_add(&builder, "{sv}", "IOPriority",
+                              g_variant_new_take_string(
+                                  io_priority_to_string(priv->io_priority)));
+    }
+
+    return g_variant_builder_end(&builder);
+}
+
+GVariant *contejner_instance_save_state(ContejnerInstance *instance)
+{
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+    GVariantBuilder builder;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add(&builder, "{sv}", "Config",
+                          contejner_instance_get_config(instance));
+    g_variant_builder_add(&builder, "{sv}", "OutputPath",
+                          g_variant_new_string(priv->output_path));
+    g_variant_builder_add(&builder, "{sv}", "Pid",
+                          g_variant_new_int32(priv->pid));
+    g_variant_builder_add(&builder, "{sv}", "StartTime",
+                          g_variant_new_uint64(priv->start_time));
+    if (priv->cgroup) {
+        gchar *name = g_path_get_basename(contejner_cgroup_get_path(priv->cgroup));
+        g_variant_builder_add(&builder, "{sv}", "Cgroup",
+                              g_variant_new_take_string(name));
+    }
+    if (contejner_timer_is_armed(&priv->timeout_timer)) {
+        g_variant_builder_add(&builder, "{sv}", "Deadline",
+                              g_variant_new_int64(priv->deadline));
+        g_variant_builder_add(&builder, "{sv}", "TimedOut",
+                              g_variant_new_boolean(priv->timed_out));
+    }
+
+    return g_variant_builder_end(&builder);
+}
+
+/* An adopted container is not our child, so without pidfd_open it can only
+ * be polled */
+static gboolean adopted_poll(gpointer user_data)
+{
+    ContejnerInstance *self = CONTEJNER_INSTANCE(user_data);
+    ContejnerInstancePrivate *priv = CONTEJNER_INSTANCE_GET_PRIVATE(self);
+
+    if (read_start_time(priv->pid) == priv->start_time) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    priv->exit_watch = 0;
+
+    instance_debug(priv, "Adopted process %d exited", priv->pid);
+    init_exited(self);
+    return G_SOURCE_REMOVE;
+}
+
+ContejnerInstance *contejner_instance_restore(int id, GVariant *state)
+{
+    ContejnerInstance *instance;
+    ContejnerInstancePrivate *priv;
+    GVariant *config;
+    const gchar *output_path = NULL;
+    const gchar *cgroup = NULL;
+    guint64 start_time = 0;
+    gint64 deadline = 0;
+    gboolean timed_out = FALSE;
+    GError *error = NULL;
+    gint32 pid = 0;
+
+    g_variant_lookup(state, "Pid", "i", &pid);
+    g_variant_lookup(state, "StartTime", "t", &start_time);
+    g_variant_lookup(state, "OutputPath", "&s", &output_path);
+    g_variant_lookup(state, "Cgroup", "&s", &cgroup);
+    g_variant_lookup(state, "Deadline", "x", &deadline);
+    g_variant_lookup(state, "TimedOut", "b", &timed_out);
+    config = g_variant_lookup_value(state, "Config", G_VARIANT_TYPE_VARDICT);
+
+    /* Another process may have been given the pid since */
+    if (pid <= 0 || !start_time || read_start_time(pid) != start_time ||
+        !output_path || !config) {
+        g_debug("Container %d is gone", id);
+        if (config) {
+            g_variant_unref(config);
+        }
+        return NULL;
+    }
+
+    instance = instance_alloc(id);
+    priv = CONTEJNER_INSTANCE_GET_PRIVATE(instance);
+
+    if (!contejner_instance_configure(instance, config, &error)) {
+        instance_warning(priv, "Failed to restore: %s", error->message);
+        g_error_free(error);
+        g_variant_unref(config);
+        g_object_unref(instance);
+        return NULL;
+    }
+    g_variant_unref(config);
+
+    priv->output_path = g_strdup(output_path);
+    open_logs(priv, TRUE);
+    compress_logs(priv);
+    reattach_output(&priv->stdout_output);
+    reattach_output(&priv->stderr_output);
+
+    if (cgroup) {
+        priv->cgroup = contejner_cgroup_new(cgroup);
+        watch_cgroup(instance);
+    }
+
+    priv->pid = pid;
+    priv->start_time = start_time;
+
+    priv->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (priv->pidfd != -1) {
+        fcntl(priv->pidfd, F_SETFD, FD_CLOEXEC);
+        priv->exit_watch = g_unix_fd_add(priv->pidfd, G_IO_IN,
+                                         process_exited, instance);
+    } else {
+        instance_debug(priv, "pidfd_open failed: %s, polling %d",
+                strerror(errno), pid);
+        priv->exit_watch = g_timeout_add_seconds(1, adopted_poll, instance);
+    }
+
+    /* The deadline may have passed while the service was away */
+    if (deadline) {
+        priv->timed_out = timed_out;
+        arm_timeout(instance, (deadline - g_get_real_time()) / 1000);
+    }
+
+    if (priv->cgroup && contejner_cgroup_is_frozen(priv->cgroup)) {
+        priv->status = CONTEJNER_INSTANCE_STATUS_FROZEN;
+    } else {
+        priv->status = CONTEJNER_INSTANCE_STATUS_RUNNING;
+    }
+
+    return instance;
 }
@@ -24,6 +24,8 @@
 #include <gio/gio.h>
 
 #include "contejner-common.h"
+#include "contejner-log.h"
+#include "contejner-cgroup.h"
 
 
 G_BEGIN_DECLS
@@ -38,9 +40,17 @@ typedef enum {
     CONTEJNER_INSTANCE_STATUS_RUNNING,
     CONTEJNER_INSTANCE_STATUS_STOPPED,
     CONTEJNER_INSTANCE_STATUS_CREATED,
+    CONTEJNER_INSTANCE_STATUS_QUEUED,
+    CONTEJNER_INSTANCE_STATUS_FROZEN,
     CONTEJNER_INSTANCE_STATUS_LAST,
 } ContejnerInstanceStatus;
 
+/* Bind mount flags */
+typedef enum {
+    CONTEJNER_MOUNT_READ_ONLY = 1 << 0,
+    CONTEJNER_MOUNT_RECURSIVE = 1 << 1,
+} ContejnerMountFlags;
+
 /* Callbacks */
 typedef void (*ContejnerInstanceRunCallback)(ContejnerInstance *container,
                                              enum contejner_error_code,
@@ -49,14 +59,95 @@ typedef void (*ContejnerInstanceRunCallback)(ContejnerInstance *container,
 
 
 /* Functions */
-ContejnerInstance *contejner_instance_new (int id);
+/* Without an output directory, the instance is a prototype that only holds
+ * configuration and can not be run */
+ContejnerInstance *contejner_instance_new (int id, const char *output_dir);
 
 void contejner_instance_run (ContejnerInstance *instance,
                              ContejnerInstanceRunCallback cb,
                              gpointer user_data);
 
+typedef void (*ContejnerInstanceExecCallback)(ContejnerInstance *container,
+                                              enum contejner_error_code error,
+                                              const char *message,
+                                              int status,
+                                              GBytes *out,
+                                              GBytes *err,
+                                              gpointer user_data);
+
+/* Run @command in the namespaces, cgroup and root of the running container.
+ * @cb gets its exit status (128 + the signal number if it was killed) and up
+ * to @max_output bytes of each of its stdout and stderr. The command is
+ * killed after @timeout milliseconds, unless @timeout is 0. */
+void contejner_instance_exec(ContejnerInstance *instance,
+                             const char *command,
+                             const gchar **args,
+                             guint timeout,
+                             gsize max_output,
+                             ContejnerInstanceExecCallback cb,
+                             gpointer user_data);
+
+/* Mark the container as waiting for its turn to run */
+void contejner_instance_set_queued(ContejnerInstance *instance);
+
+/* Mark a queued container as taken off the queue again, which stops it */
+void contejner_instance_set_dequeued(ContejnerInstance *instance);
+
+const char *contejner_instance_status_to_string(ContejnerInstanceStatus status);
+
 int contejner_instance_get_id(const ContejnerInstance *instance);
 
+/* Exit status of the last run, 128 + signal if it was killed, or -1 if
+ * unknown, e.g. for containers adopted after a restart */
+int contejner_instance_get_exit_status(ContejnerInstance *instance);
+
+/* Whether the OOM killer killed a process of the container in its last run */
+gboolean contejner_instance_was_oom_killed(ContejnerInstance *instance);
+
+/* Times the memory.high or memory.max limit of the container was hit, or a
+ * process of it was OOM killed, in the current or last run. The counts are
+ * kept up to date while the container runs, and each change is also
+ * announced with the "cgroup-event" signal. */
+guint64 contejner_instance_get_cgroup_event_count(ContejnerInstance *instance,
+                                                  ContejnerCgroupEvent event);
+
+/* Seconds a run may take before the container is sent SIGTERM, 0 for no
+ * limit, and the seconds after which it is sent SIGKILL if it is still
+ * running. A grace period of 0 sends SIGKILL right away. Changes apply from
+ * the next run. */
+gboolean contejner_instance_set_timeout(ContejnerInstance *instance,
+                                        guint seconds);
+
+guint contejner_instance_get_timeout(ContejnerInstance *instance);
+
+gboolean contejner_instance_set_timeout_grace(ContejnerInstance *instance,
+                                              guint seconds);
+
+guint contejner_instance_get_timeout_grace(ContejnerInstance *instance);
+
+/* Whether the current or last run was stopped for taking too long */
+gboolean contejner_instance_get_timed_out(ContejnerInstance *instance);
+
+/* Whether the container is restarted when it stops: never, on-failure
+ * (a non-zero or unknown exit status) or always. A container stopped with
+ * contejner_instance_stop() is not restarted. */
+gboolean contejner_instance_set_restart_policy(ContejnerInstance *instance,
+                                               const char *policy);
+
+const char *contejner_instance_get_restart_policy(ContejnerInstance *instance);
+
+/* For a stopped container, the delay in milliseconds before its restart
+ * policy restarts it, or -1 if it does not. The delay is decided when the
+ * run stops, and doubles with every restart in a row. Runs that never
+ * started a process are not restarted. */
+gint64 contejner_instance_get_restart_delay(ContejnerInstance *instance);
+
+/* Restarts in a row, and their reset, e.g. when the container is run by
+ * hand */
+guint contejner_instance_get_restarts(ContejnerInstance *instance);
+
+void contejner_instance_reset_restarts(ContejnerInstance *instance);
+
 gboolean contejner_instance_set_command(ContejnerInstance *instance,
                                         const gchar *command,
                                         const gchar **args);
@@ -64,14 +155,205 @@ gboolean contejner_instance_set_command(ContejnerInstance *instance,
 gboolean contejner_instance_set_root(ContejnerInstance *instance,
                                      const GFile *path);
 
+/* Bind mount a directory of the host at a path under the root directory of
+ * the container, in its mount namespace, before it starts. Mounts are kept
+ * sorted by path in the container, so parents are mounted first. */
+gboolean contejner_instance_add_mount(ContejnerInstance *instance,
+                                      const char *host_path,
+                                      const char *container_path,
+                                      guint flags);
+
+/* Replaces all bind mounts, from an array of (host path, container path,
+ * flags) */
+gboolean contejner_instance_set_mounts(ContejnerInstance *instance,
+                                       GVariant *mounts);
+
+GVariant *contejner_instance_get_mounts(ContejnerInstance *instance);
+
+/* Scratch space of the container: a tmpfs of the given size in bytes at each
+ * path, mounted under the root directory in the mount namespace of the
+ * container. It is gone with the container, and needs the mount
+ * namespace. */
+gboolean contejner_instance_set_scratch(ContejnerInstance *instance,
+                                        GVariant *scratch);
+
+GVariant *contejner_instance_get_scratch(ContejnerInstance *instance);
+
+/* Add a sample of the resource usage of the container to its series, if it
+ * is running in a cgroup. @time is in microseconds of wall clock time.
+ * Returns whether a sample was taken. */
+gboolean contejner_instance_sample(ContejnerInstance *instance, gint64 time);
+
+/* The samples of a metric taken after @since, as a floating (axat) of times
+ * and values, or NULL if there is no such metric. The series starts over
+ * with every run. */
+GVariant *contejner_instance_get_series(ContejnerInstance *instance,
+                                        const char *metric,
+                                        gint64 since);
+
+/* Whether the container has a process, i.e. is running or frozen */
+gboolean contejner_instance_is_active(ContejnerInstance *instance);
+
+/* Freeze a running container, or thaw a frozen one, with the cgroup
+ * freezer. Fails if the service has no cgroup for the container. */
+gboolean contejner_instance_freeze(ContejnerInstance *instance,
+                                   gboolean freeze);
+
+/* Pid of the init process of the running container, 0 when it is not
+ * running */
+pid_t contejner_instance_get_pid(ContejnerInstance *instance);
+
+/* Send @signal to every process of the container when it has a cgroup,
+ * otherwise to its init process, through a pidfd where possible */
 gboolean contejner_instance_kill(ContejnerInstance *instance, int signal);
 
+typedef void (*ContejnerInstanceStopCallback)(ContejnerInstance *container,
+                                              int exit_status,
+                                              gpointer user_data);
+
+/* Send the container SIGTERM, and SIGKILL if it is still running after
+ * @grace milliseconds, or right away when @grace is 0. A frozen container
+ * is thawed first. @cb is called with the exit status once the container
+ * has stopped, which with a cgroup is when its whole process tree is gone.
+ * Stopping a container that is already being stopped adds @cb, and only
+ * brings the SIGKILL forward for a grace of 0. Returns FALSE, without
+ * calling @cb, if the container is not running. */
+gboolean contejner_instance_stop(ContejnerInstance *instance,
+                                 guint grace,
+                                 ContejnerInstanceStopCallback cb,
+                                 gpointer user_data);
+
 gboolean contejner_instance_enable_ns(ContejnerInstance *instance, int ns);
 
 gboolean contejner_instance_disable_ns(ContejnerInstance *instance, int ns);
 
 int contejner_instance_get_unshared_namespaces(ContejnerInstance *instance);
 
+/* Returns the CLONE_NEW* flag of a namespace property, e.g.
+ * "PIDNamespaceEnabled", or 0 */
+int contejner_instance_namespace_from_string(const char *property);
+
+/* Apply a configuration dictionary, keyed by the names of the D-Bus
+ * properties plus "Command", "Arguments" and "Root". Stops at the first
+ * invalid entry. */
+gboolean contejner_instance_configure(ContejnerInstance *instance,
+                                      GVariant *config,
+                                      GError **error);
+
+/* Copy the configuration of @source, without validating it again */
+void contejner_instance_copy_config(ContejnerInstance *instance,
+                                    ContejnerInstance *source);
+
+/* Replace the labels of the container. Labels are only for the manager to
+ * select containers by, use contejner_manager_set_labels() to keep its
+ * index up to date. */
+void contejner_instance_set_labels(ContejnerInstance *instance,
+                                   GVariant *labels);
+
+/* The labels of the container, owned by the instance */
+GHashTable *contejner_instance_get_labels(ContejnerInstance *instance);
+
+/* The labels of the container as an a{ss} dictionary */
+GVariant *contejner_instance_get_labels_variant(ContejnerInstance *instance);
+
+/* The configuration of the container, in the form taken by
+ * contejner_instance_configure() */
+GVariant *contejner_instance_get_config(ContejnerInstance *instance);
+
+/* Everything needed to take over the running container after a restart of
+ * the service: its configuration, output location and process identity */
+GVariant *contejner_instance_save_state(ContejnerInstance *instance);
+
+/* Take over a container saved by contejner_instance_save_state(). Returns
+ * NULL if its process is no longer running. */
+ContejnerInstance *contejner_instance_restore(int id, GVariant *state);
+
+gboolean contejner_instance_set_terminal(ContejnerInstance *instance,
+                                         gboolean enabled);
+
+gboolean contejner_instance_get_terminal(ContejnerInstance *instance);
+
+/* Returns a new file descriptor connected to the container's terminal, or
+ * -1 if the container has no terminal */
+int contejner_instance_attach_terminal(ContejnerInstance *instance);
+
+gboolean contejner_instance_resize_terminal(ContejnerInstance *instance,
+                                            guint16 rows,
+                                            guint16 cols);
+
+/* Compress the retained output of the container, see
+ * contejner_log_set_compressed(). Can be changed at any time. */
+gboolean contejner_instance_set_compress_output(ContejnerInstance *instance,
+                                                gboolean enabled);
+
+gboolean contejner_instance_get_compress_output(ContejnerInstance *instance);
+
+/* Limits on the output kept of each run of the container: a rate in bytes
+ * per second and a volume in bytes, 0 for no limit. The policy says what
+ * happens to output beyond a limit: "block" stops reading it, so that the
+ * container blocks on writing it, "drop" drops it, and "kill" drops it and
+ * kills the container. Terminal output is dropped rather than blocked. The
+ * limits can be changed at any time. */
+gboolean contejner_instance_set_output_rate_limit(ContejnerInstance *instance,
+                                                 guint64 bytes_per_second);
+
+guint64 contejner_instance_get_output_rate_limit(ContejnerInstance *instance);
+
+gboolean contejner_instance_set_output_volume_limit(ContejnerInstance *instance,
+                                                   guint64 bytes);
+
+guint64 contejner_instance_get_output_volume_limit(ContejnerInstance *instance);
+
+gboolean contejner_instance_set_output_limit_policy(ContejnerInstance *instance,
+                                                   const char *policy);
+
+const char *contejner_instance_get_output_limit_policy(ContejnerInstance *instance);
+
+/* Bytes of output dropped in the current or last run, and the number of
+ * times output came faster than the limits allowed */
+guint64 contejner_instance_get_output_dropped(ContejnerInstance *instance);
+
+guint contejner_instance_get_output_limit_hits(ContejnerInstance *instance);
+
+/* Size of the output of the container, as written, or as @stored after
+ * compression */
+guint64 contejner_instance_get_output_size(ContejnerInstance *instance,
+                                           gboolean stored);
+
+/* CPUs and memory nodes are given as lists, e.g. "0-3,8". An empty list
+ * removes the restriction. */
+gboolean contejner_instance_set_cpuset(ContejnerInstance *instance,
+                                       const char *cpus);
+
+const char *contejner_instance_get_cpuset(ContejnerInstance *instance);
+
+gboolean contejner_instance_set_mem_nodes(ContejnerInstance *instance,
+                                          const char *nodes);
+
+const char *contejner_instance_get_mem_nodes(ContejnerInstance *instance);
+
+/* Scheduling of the container. The policy is one of "OTHER", "BATCH" or
+ * "IDLE", the I/O priority is given as "class[/level]" where the class is
+ * one of "none", "realtime", "best-effort" or "idle". The getters return
+ * the values in effect for a running container. */
+gboolean contejner_instance_set_nice(ContejnerInstance *instance, int nice);
+
+int contejner_instance_get_nice(ContejnerInstance *instance);
+
+gboolean contejner_instance_set_sched_policy(ContejnerInstance *instance,
+                                             const char *policy);
+
+const char *contejner_instance_get_sched_policy(ContejnerInstance *instance);
+
+gboolean contejner_instance_set_io_priority(ContejnerInstance *instance,
+                                            const char *priority);
+
+gchar *contejner_instance_get_io_priority(ContejnerInstance *instance);
+
+/* Returns the log of the "stdout" or "stderr" stream, or NULL */
+ContejnerLog *contejner_instance_get_output_log(ContejnerInstance *instance,
+                                                const char *stream);
+
 G_END_DECLS
 
 #endif /* DBUS_SERVICE_INTERFACE_H */
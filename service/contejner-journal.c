@@ -0,0 +1,342 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "contejner-journal.h"
+
+#define JOURNAL_MAGIC "CTJJRNL1"
+
+/* The journal is compacted when it holds more than this many stale records,
+ * and more stale records than live ones */
+#define COMPACT_MIN_STALE 1024
+
+/* Records are padded to this, so values can be read in place */
+#define RECORD_ALIGN 8
+
+enum record_type {
+    RECORD_PUT = 1,
+    RECORD_REMOVE = 2,
+};
+
+struct record_header {
+    guint32 size;
+    guint32 checksum;
+    guint32 type;
+    gint32 key;
+};
+
+struct _ContejnerJournal {
+    char *path;
+    int fd;
+    GHashTable *entries;
+    guint records;
+};
+
+/* FNV-1a, enough to tell a torn or garbled record from a good one */
+static guint32 checksum (const struct record_header *header,
+                         const void *data)
+{
+    const guint8 *p = (const guint8 *) &header->type;
+    guint32 hash = 2166136261u;
+    gsize i;
+
+    for (i = 0; i < sizeof(header->type) + sizeof(header->key); i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+
+    p = data;
+    for (i = 0; i < header->size; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static gboolean write_all (int fd, const void *buf, gsize len)
+{
+    const char *p = buf;
+
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w == -1 && errno == EINTR) {
+            continue;
+        } else if (w == -1) {
+            return FALSE;
+        }
+        p += w;
+        len -= w;
+    }
+
+    return TRUE;
+}
+
+/* Write a record with a single write(), so that a crash leaves either the
+ * whole record or a truncated one that replay cuts off */
+static gboolean write_record (int fd,
+                              enum record_type type,
+                              gint32 key,
+                              GBytes *value)
+{
+    static const char padding[RECORD_ALIGN] = { 0 };
+    struct record_header header = { 0, 0, type, key };
+    const void *data = NULL;
+    gsize size = 0;
+    gsize pad;
+    gboolean ok;
+
+    if (value) {
+        data = g_bytes_get_data(value, &size);
+    }
+
+    header.size = size;
+    header.checksum = checksum(&header, data);
+    pad = (RECORD_ALIGN - size % RECORD_ALIGN) % RECORD_ALIGN;
+
+    GByteArray *buf = g_byte_array_sized_new(sizeof(header) + size + pad);
+    g_byte_array_append(buf, (const guint8 *) &header, sizeof(header));
+    if (size) {
+        g_byte_array_append(buf, data, size);
+    }
+    g_byte_array_append(buf, (const guint8 *) padding, pad);
+
+    ok = write_all(fd, buf->data, buf->len);
+    g_byte_array_free(buf, TRUE);
+    return ok;
+}
+
+/* Apply the records of @contents to the entries of the journal. Returns the
+ * length of the valid part of the file. */
+static gsize replay (ContejnerJournal *journal, GBytes *contents)
+{
+    gsize len;
+    const char *data = g_bytes_get_data(contents, &len);
+    gsize offset = strlen(JOURNAL_MAGIC);
+
+    while (offset + sizeof(struct record_header) <= len) {
+        struct record_header header;
+        gsize padded;
+
+        memcpy(&header, data + offset, sizeof(header));
+        padded = header.size + (RECORD_ALIGN - header.size % RECORD_ALIGN) % RECORD_ALIGN;
+
+        if (padded > len - offset - sizeof(header) ||
+            checksum(&header, data + offset + sizeof(header)) != header.checksum) {
+            g_warning("Journal %s has a damaged record at %" G_GSIZE_FORMAT
+                      ", dropping the rest", journal->path, offset);
+            break;
+        }
+
+        if (header.type == RECORD_PUT) {
+            g_hash_table_insert(journal->entries,
+                                GINT_TO_POINTER(header.key),
+                                g_bytes_new_from_bytes(contents,
+                                                       offset + sizeof(header),
+                                                       header.size));
+        } else if (header.type == RECORD_REMOVE) {
+            g_hash_table_remove(journal->entries, GINT_TO_POINTER(header.key));
+        }
+
+        journal->records++;
+        offset += sizeof(header) + padded;
+    }
+
+    return offset;
+}
+
+ContejnerJournal *contejner_journal_open (const char *path,
+                                          ContejnerJournalReplayFunc func,
+                                          gpointer user_data)
+{
+    ContejnerJournal *journal = g_new0(ContejnerJournal, 1);
+    gchar *contents = NULL;
+    gsize len = 0;
+    GList *keys, *l;
+
+    journal->path = g_strdup(path);
+    journal->entries = g_hash_table_new_full(NULL, NULL, NULL,
+                                             (GDestroyNotify) g_bytes_unref);
+
+    journal->fd = open(path, O_CREAT | O_RDWR | O_APPEND | O_CLOEXEC,
+                       S_IRUSR | S_IWUSR);
+    if (journal->fd == -1) {
+        g_warning("Failed to open journal %s: %s", path, strerror(errno));
+        contejner_journal_free(journal);
+        return NULL;
+    }
+
+    /* The whole journal is read at once and replayed in place */
+    if (!g_file_get_contents(path, &contents, &len, NULL)) {
+        len = 0;
+    }
+
+    if (len >= strlen(JOURNAL_MAGIC) &&
+        !memcmp(contents, JOURNAL_MAGIC, strlen(JOURNAL_MAGIC))) {
+        GBytes *bytes = g_bytes_new_take(contents, len);
+        gsize valid = replay(journal, bytes);
+        g_bytes_unref(bytes);
+
+        if (valid < len && ftruncate(journal->fd, valid)) {
+            g_warning("Failed to truncate journal %s: %s", path, strerror(errno));
+        }
+    } else {
+        if (len) {
+            g_warning("%s is not a journal, starting a new one", path);
+        }
+        g_free(contents);
+
+        if (ftruncate(journal->fd, 0) ||
+            !write_all(journal->fd, JOURNAL_MAGIC, strlen(JOURNAL_MAGIC))) {
+            g_warning("Failed to initialize journal %s: %s", path, strerror(errno));
+            contejner_journal_free(journal);
+            return NULL;
+        }
+    }
+
+    g_debug("Replayed %u journal records, %u entries",
+            journal->records, g_hash_table_size(journal->entries));
+
+    /* The entries are handed out from a copy of the keys, so @func may put
+     * and remove entries */
+    keys = g_hash_table_get_keys(journal->entries);
+    for (l = keys; l; l = l->next) {
+        GBytes *bytes = g_hash_table_lookup(journal->entries, l->data);
+        GVariant *v;
+
+        if (!bytes) {
+            continue;
+        }
+
+        v = g_variant_ref_sink(g_variant_new_from_bytes(G_VARIANT_TYPE_VARDICT,
+                                                        bytes, FALSE));
+        func(GPOINTER_TO_INT(l->data), v, user_data);
+        g_variant_unref(v);
+    }
+    g_list_free(keys);
+
+    return journal;
+}
+
+static void maybe_compact (ContejnerJournal *journal)
+{
+    guint live = g_hash_table_size(journal->entries);
+    guint stale = journal->records - MIN(journal->records, live);
+
+    if (stale > COMPACT_MIN_STALE && stale > live) {
+        contejner_journal_compact(journal);
+    }
+}
+
+gboolean contejner_journal_put (ContejnerJournal *journal,
+                                gint32 key,
+                                GVariant *value)
+{
+    GVariant *normal = g_variant_get_normal_form(value);
+    GBytes *bytes = g_variant_get_data_as_bytes(normal);
+    g_variant_unref(normal);
+
+    if (!write_record(journal->fd, RECORD_PUT, key, bytes)) {
+        g_warning("Failed to write journal %s: %s", journal->path, strerror(errno));
+        g_bytes_unref(bytes);
+        return FALSE;
+    }
+
+    g_hash_table_insert(journal->entries, GINT_TO_POINTER(key), bytes);
+    journal->records++;
+    maybe_compact(journal);
+    return TRUE;
+}
+
+gboolean contejner_journal_remove (ContejnerJournal *journal,
+                                   gint32 key)
+{
+    if (!g_hash_table_remove(journal->entries, GINT_TO_POINTER(key))) {
+        return TRUE;
+    }
+
+    if (!write_record(journal->fd, RECORD_REMOVE, key, NULL)) {
+        g_warning("Failed to write journal %s: %s", journal->path, strerror(errno));
+        return FALSE;
+    }
+
+    journal->records++;
+    maybe_compact(journal);
+    return TRUE;
+}
+
+gboolean contejner_journal_compact (ContejnerJournal *journal)
+{
+    gchar *tmp_path = g_strdup_printf("%s.tmp", journal->path);
+    GHashTableIter iter;
+    gpointer key, value;
+    int fd;
+
+    fd = open(tmp_path, O_CREAT | O_TRUNC | O_WRONLY | O_APPEND | O_CLOEXEC,
+              S_IRUSR | S_IWUSR);
+    if (fd == -1 || !write_all(fd, JOURNAL_MAGIC, strlen(JOURNAL_MAGIC))) {
+        goto contejner_journal_compact_error;
+    }
+
+    g_hash_table_iter_init(&iter, journal->entries);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        if (!write_record(fd, RECORD_PUT, GPOINTER_TO_INT(key), value)) {
+            goto contejner_journal_compact_error;
+        }
+    }
+
+    /* The new file must be complete before it replaces the old one */
+    if (fdatasync(fd) || rename(tmp_path, journal->path)) {
+        goto contejner_journal_compact_error;
+    }
+
+    close(journal->fd);
+    journal->fd = fd;
+    journal->records = g_hash_table_size(journal->entries);
+    g_debug("Compacted journal %s to %u records", journal->path, journal->records);
+
+    g_free(tmp_path);
+    return TRUE;
+
+contejner_journal_compact_error:
+    g_warning("Failed to compact journal %s: %s", journal->path, strerror(errno));
+    if (fd != -1) {
+        close(fd);
+        unlink(tmp_path);
+    }
+    g_free(tmp_path);
+    return FALSE;
+}
+
+void contejner_journal_free (ContejnerJournal *journal)
+{
+    if (journal->fd != -1) {
+        close(journal->fd);
+    }
+
+    g_hash_table_unref(journal->entries);
+    g_free(journal->path);
+    g_free(journal);
+}
@@ -0,0 +1,66 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CONTEJNER_JOURNAL_H
+#define CONTEJNER_JOURNAL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ContejnerJournal ContejnerJournal;
+
+typedef void (*ContejnerJournalReplayFunc)(gint32 key,
+                                           GVariant *value,
+                                           gpointer user_data);
+
+/**
+ * contejner_journal_open:
+ * @path: path of the journal file
+ * @func: called for every entry found in the journal
+ * @user_data: passed to @func
+ *
+ * Open the state journal at @path, creating it if needed, and replay it.
+ * The journal is a key-value store kept as an append-only file of put and
+ * remove records. Records left incomplete by a crash are cut off. Once the
+ * file holds mostly stale records it is compacted, by writing the live
+ * entries to a new file that atomically replaces the old one.
+ *
+ * Returns: a new #ContejnerJournal, or NULL if the file could not be opened
+ */
+ContejnerJournal *contejner_journal_open (const char *path,
+                                          ContejnerJournalReplayFunc func,
+                                          gpointer user_data);
+
+/* Store @value, which must be of type a{sv}, under @key */
+gboolean contejner_journal_put (ContejnerJournal *journal,
+                                gint32 key,
+                                GVariant *value);
+
+gboolean contejner_journal_remove (ContejnerJournal *journal,
+                                   gint32 key);
+
+/* Rewrite the journal with only the live entries */
+gboolean contejner_journal_compact (ContejnerJournal *journal);
+
+void contejner_journal_free (ContejnerJournal *journal);
+
+G_END_DECLS
+
+#endif /* CONTEJNER_JOURNAL_H */
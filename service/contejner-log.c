@@ -0,0 +1,843 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "contejner-log.h"
+
+/* A new chunk is started when the current one is full, or old enough and
+ * holding at least CHUNK_MIN_SZ bytes. A line lookup never scans more than
+ * CHUNK_MAX_SZ bytes, the index takes at most one record per CHUNK_MIN_SZ
+ * bytes of output, however slowly it is written, and the time index has a
+ * resolution of CHUNK_MAX_AGE while output flows faster than that. */
+#define CHUNK_MAX_SZ 64 * 1024
+#define CHUNK_MIN_SZ 4 * 1024
+#define CHUNK_MAX_AGE G_USEC_PER_SEC
+#define SCAN_BUF_SZ 64 * 1024
+
+#define INDEX_MAGIC "CTJLOGIX"
+#define INDEX_VERSION 1
+
+/* With compression, consecutive chunks are compressed together in frames of
+ * at least FRAME_MIN_SZ bytes, so that slow output cut into small chunks
+ * still compresses, and all but the newest HOT_SZ bytes or so are
+ * compressed, so live tails keep reading plain data from the data file */
+#define FRAME_MIN_SZ 64 * 1024
+#define HOT_SZ 1024 * 1024
+#define COMPRESSION_LEVEL Z_BEST_SPEED
+#define ZINDEX_MAGIC "CTJLOGZX"
+#define ZINDEX_VERSION 2
+
+struct log_index_header {
+    char magic[8];
+    guint32 version;
+    guint32 record_size;
+};
+
+/* One record of the index file. All fields describe the first byte of the
+ * chunk, the chunk ends where the next one starts. */
+struct log_chunk {
+    guint64 offset;
+    guint64 line;
+    gint64 time;
+};
+
+/* One record of the compressed index file, describing a frame of one or
+ * more whole chunks. The frames follow each other from the start of the
+ * log, so the compressed data is always the oldest. */
+struct log_zframe {
+    guint64 offset;
+    guint64 zoffset;
+    guint32 zlen;
+    guint32 len;
+};
+
+struct _ContejnerLog {
+    char *path;
+    char *data_path;
+    int data_fd;
+    int index_fd;
+    guint64 size;
+    guint64 lines;
+    gboolean partial_line;
+    GArray *chunks;
+
+    /* Compressed frames, in @path.z with their index in @path.zdx */
+    gboolean compress;
+    int zdata_fd;
+    int zindex_fd;
+    guint64 zsize;
+    GArray *zframes;
+    blksize_t block_size;
+
+    /* The last frame decompressed, as reads tend to continue there */
+    guint cached_frame;
+    char *cache;
+};
+
+static gboolean write_all_at (int fd,
+                              const char *buf,
+                              gsize len,
+                              off_t offset)
+{
+    while (len > 0) {
+        ssize_t w = pwrite(fd, buf, len, offset);
+        if (w == -1 && errno == EINTR) {
+            continue;
+        } else if (w == -1) {
+            return FALSE;
+        }
+        buf += w;
+        len -= w;
+        offset += w;
+    }
+
+    return TRUE;
+}
+
+static ContejnerLog *log_alloc (const char *path)
+{
+    ContejnerLog *log = g_new0(ContejnerLog, 1);
+    log->path = g_strdup(path);
+    log->data_path = g_strdup_printf("%s.log", path);
+    log->data_fd = -1;
+    log->index_fd = -1;
+    log->chunks = g_array_new(FALSE, FALSE, sizeof(struct log_chunk));
+    log->zdata_fd = -1;
+    log->zindex_fd = -1;
+    log->zframes = g_array_new(FALSE, FALSE, sizeof(struct log_zframe));
+    log->cached_frame = G_MAXUINT;
+    return log;
+}
+
+/* End of the compressed frames, where the plain data in the data file
+ * starts */
+static guint64 compressed_end (ContejnerLog *log)
+{
+    if (!log->zframes->len) {
+        return 0;
+    }
+
+    struct log_zframe *last = &g_array_index(log->zframes, struct log_zframe,
+                                             log->zframes->len - 1);
+    return last->offset + last->len;
+}
+
+/* Decompress frame @n into the cache */
+static gboolean load_frame (ContejnerLog *log, guint n)
+{
+    struct log_zframe *z = &g_array_index(log->zframes, struct log_zframe, n);
+    char *zbuf;
+    uLongf len = z->len;
+    gsize got = 0;
+
+    if (log->cached_frame == n) {
+        return TRUE;
+    }
+
+    zbuf = g_malloc(z->zlen);
+    while (got < z->zlen) {
+        ssize_t r = pread(log->zdata_fd, zbuf + got, z->zlen - got,
+                          z->zoffset + got);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        } else if (r <= 0) {
+            break;
+        }
+        got += r;
+    }
+
+    log->cached_frame = G_MAXUINT;
+    log->cache = g_realloc(log->cache, MAX(z->len, 1));
+    if (got != z->zlen ||
+        uncompress((Bytef *) log->cache, &len, (Bytef *) zbuf, z->zlen) != Z_OK ||
+        len != z->len) {
+        g_warning("Failed to decompress frame %u of %s", n, log->path);
+        g_free(zbuf);
+        return FALSE;
+    }
+
+    g_free(zbuf);
+    log->cached_frame = n;
+    return TRUE;
+}
+
+/* Read up to @len bytes at @offset, which may be in a compressed frame.
+ * Stops at the end of a compressed frame, like a short pread(). */
+static ssize_t read_at (ContejnerLog *log, char *buf, gsize len, guint64 offset)
+{
+    if (offset >= compressed_end(log)) {
+        return pread(log->data_fd, buf, len, offset);
+    }
+
+    guint lo = 0, hi = log->zframes->len;
+    while (hi - lo > 1) {
+        guint mid = lo + (hi - lo) / 2;
+        if (g_array_index(log->zframes, struct log_zframe, mid).offset <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    struct log_zframe *z = &g_array_index(log->zframes, struct log_zframe, lo);
+    if (!load_frame(log, lo)) {
+        errno = EIO;
+        return -1;
+    }
+
+    len = MIN(len, z->offset + z->len - offset);
+    memcpy(buf, log->cache + (offset - z->offset), len);
+    return len;
+}
+
+static gboolean open_zindex (ContejnerLog *log, gboolean create)
+{
+    struct log_index_header header = { ZINDEX_MAGIC,
+                                       ZINDEX_VERSION,
+                                       sizeof(struct log_zframe) };
+    struct stat st;
+    gchar *zdata_path = g_strdup_printf("%s.z", log->path);
+    gchar *zindex_path = g_strdup_printf("%s.zdx", log->path);
+    int flags = O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0);
+    gboolean ok;
+
+    log->zdata_fd = open(zdata_path, flags, S_IRUSR | S_IWUSR);
+    log->zindex_fd = open(zindex_path, flags, S_IRUSR | S_IWUSR);
+    ok = log->zdata_fd != -1 && log->zindex_fd != -1 && !fstat(log->data_fd, &st);
+    if (ok) {
+        log->block_size = st.st_blksize;
+    }
+    if (ok && create) {
+        ok = write_all_at(log->zindex_fd, (const char *) &header,
+                          sizeof(header), 0);
+    }
+
+    if (!ok && (create || errno != ENOENT)) {
+        g_warning("Failed to open %s: %s", zindex_path, strerror(errno));
+    }
+    if (!ok) {
+        if (log->zdata_fd != -1) {
+            close(log->zdata_fd);
+        }
+        if (log->zindex_fd != -1) {
+            close(log->zindex_fd);
+        }
+        log->zdata_fd = log->zindex_fd = -1;
+    }
+
+    g_free(zdata_path);
+    g_free(zindex_path);
+    return ok;
+}
+
+/* Load the compressed index of a reopened log, if it has one */
+static gboolean reopen_zindex (ContejnerLog *log)
+{
+    struct log_index_header header;
+    struct stat st;
+    gsize n;
+
+    if (!open_zindex(log, FALSE)) {
+        return TRUE;
+    }
+
+    if (pread(log->zindex_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, ZINDEX_MAGIC, sizeof(header.magic)) ||
+        header.version != ZINDEX_VERSION ||
+        header.record_size != sizeof(struct log_zframe) ||
+        fstat(log->zindex_fd, &st)) {
+        return FALSE;
+    }
+
+    /* A partly written last record is dropped, and the frame stays in the
+     * data file. So are frames beyond the data, which were never written
+     * to it. */
+    n = (st.st_size - sizeof(header)) / sizeof(struct log_zframe);
+    g_array_set_size(log->zframes, n);
+    if (n && pread(log->zindex_fd, log->zframes->data,
+                   n * sizeof(struct log_zframe), sizeof(header)) !=
+             (ssize_t) (n * sizeof(struct log_zframe))) {
+        return FALSE;
+    }
+
+    while (log->zframes->len && compressed_end(log) > log->size) {
+        g_array_set_size(log->zframes, log->zframes->len - 1);
+    }
+
+    if (log->zframes->len) {
+        struct log_zframe *last = &g_array_index(log->zframes, struct log_zframe,
+                                                 log->zframes->len - 1);
+        log->zsize = last->zoffset + last->zlen;
+    }
+    log->compress = TRUE;
+    return TRUE;
+}
+
+/* Compress the plain data from @start to @end into a frame of the compressed
+ * file, and free its space in the data file */
+static gboolean compress_frame (ContejnerLog *log, guint64 start, guint64 end)
+{
+    guint n = log->zframes->len;
+    guint32 len = end - start;
+    uLongf zlen = compressBound(len);
+    char *buf = g_malloc(len);
+    char *zbuf = g_malloc(zlen);
+    gsize got = 0;
+    gboolean ok = FALSE;
+
+    while (got < len) {
+        ssize_t r = pread(log->data_fd, buf + got, len - got, start + got);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        } else if (r <= 0) {
+            goto compress_frame_out;
+        }
+        got += r;
+    }
+
+    if (compress2((Bytef *) zbuf, &zlen, (Bytef *) buf, len,
+                  COMPRESSION_LEVEL) != Z_OK) {
+        goto compress_frame_out;
+    }
+
+    /* The data goes before its index record, and the plain copy is only
+     * dropped once both are written */
+    struct log_zframe z = { start, log->zsize, zlen, len };
+    if (!write_all_at(log->zdata_fd, zbuf, zlen, log->zsize) ||
+        !write_all_at(log->zindex_fd, (const char *) &z, sizeof(z),
+                      sizeof(struct log_index_header) + (off_t) n * sizeof(z))) {
+        g_warning("Failed to write compressed %s: %s", log->path, strerror(errno));
+        goto compress_frame_out;
+    }
+
+    g_array_append_val(log->zframes, z);
+    log->zsize += zlen;
+    ok = TRUE;
+
+    /* Leaves a hole, so offsets in the data file stay the same. Only whole
+     * blocks can be freed, and the block the frame ends in is shared with
+     * the plain data, so it is freed with the next frame. Everything before
+     * the frame is compressed already. */
+    off_t hole_start = start - start % log->block_size;
+    off_t hole_end = end - end % log->block_size;
+    if (hole_end > hole_start &&
+        fallocate(log->data_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  hole_start, hole_end - hole_start)) {
+        g_warning("Failed to free compressed data of %s: %s", log->path,
+                  strerror(errno));
+    }
+
+compress_frame_out:
+    g_free(buf);
+    g_free(zbuf);
+    return ok;
+}
+
+/* Bytes at the end of a log which are kept plain. CONTEJNER_LOG_HOT_SIZE in
+ * the environment of the service overrides HOT_SZ, to see compression of a
+ * small log. */
+static guint64 hot_size (void)
+{
+    static gboolean checked = FALSE;
+    static guint64 size = HOT_SZ;
+
+    if (!checked) {
+        const gchar *env = g_getenv("CONTEJNER_LOG_HOT_SIZE");
+        if (env) {
+            size = g_ascii_strtoull(env, NULL, 10);
+        }
+        checked = TRUE;
+    }
+
+    return size;
+}
+
+/* Index of the first chunk starting at or after @offset */
+static guint chunk_from (ContejnerLog *log, guint64 offset)
+{
+    guint lo = 0, hi = log->chunks->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (g_array_index(log->chunks, struct log_chunk, mid).offset < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* Compress the chunks which are no longer hot, in frames that end where a
+ * chunk starts */
+static void compress_frames (ContejnerLog *log)
+{
+    while (log->compress) {
+        guint64 start = compressed_end(log);
+        guint n = chunk_from(log, start + FRAME_MIN_SZ);
+        if (n == log->chunks->len) {
+            break;
+        }
+
+        guint64 end = g_array_index(log->chunks, struct log_chunk, n).offset;
+        if (end + hot_size() > log->size) {
+            break;
+        }
+
+        if (!compress_frame(log, start, end)) {
+            log->compress = FALSE;
+        }
+    }
+}
+
+ContejnerLog *contejner_log_new (const char *path)
+{
+    struct log_index_header header = { INDEX_MAGIC,
+                                       INDEX_VERSION,
+                                       sizeof(struct log_chunk) };
+    ContejnerLog *log = log_alloc(path);
+    gchar *index_path = g_strdup_printf("%s.idx", path);
+
+    log->data_fd = open(log->data_path,
+                        O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC,
+                        S_IRUSR | S_IWUSR);
+    if (log->data_fd == -1) {
+        g_warning("Failed to create %s: %s", log->data_path, strerror(errno));
+        goto contejner_log_new_error;
+    }
+
+    log->index_fd = open(index_path,
+                         O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC,
+                         S_IRUSR | S_IWUSR);
+    if (log->index_fd == -1 ||
+        !write_all_at(log->index_fd, (const char *) &header, sizeof(header), 0)) {
+        g_warning("Failed to create %s: %s", index_path, strerror(errno));
+        goto contejner_log_new_error;
+    }
+
+    g_free(index_path);
+    return log;
+
+contejner_log_new_error:
+    g_free(index_path);
+    contejner_log_free(log);
+    return NULL;
+}
+
+/* Count the lines of the data after the last chunk start, which is at most
+ * one chunk */
+static gboolean count_tail_lines (ContejnerLog *log)
+{
+    struct log_chunk *last = &g_array_index(log->chunks, struct log_chunk,
+                                            log->chunks->len - 1);
+    guint64 offset = last->offset;
+    char buf[SCAN_BUF_SZ];
+    char c = '\n';
+
+    log->lines = last->line;
+    while (offset < log->size) {
+        ssize_t r = pread(log->data_fd, buf,
+                          MIN(sizeof(buf), log->size - offset), offset);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        } else if (r <= 0) {
+            return FALSE;
+        }
+
+        const char *p = buf, *e = buf + r;
+        while ((p = memchr(p, '\n', e - p))) {
+            log->lines++;
+            p++;
+        }
+        c = buf[r - 1];
+        offset += r;
+    }
+
+    log->partial_line = c != '\n';
+    return TRUE;
+}
+
+ContejnerLog *contejner_log_reopen (const char *path)
+{
+    struct log_index_header header;
+    ContejnerLog *log = log_alloc(path);
+    gchar *index_path = g_strdup_printf("%s.idx", path);
+    struct stat st;
+    gsize n;
+
+    log->data_fd = open(log->data_path, O_RDWR | O_CLOEXEC);
+    log->index_fd = open(index_path, O_RDWR | O_CLOEXEC);
+    if (log->data_fd == -1 || log->index_fd == -1 ||
+        fstat(log->data_fd, &st) ||
+        pread(log->index_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) ||
+        header.version != INDEX_VERSION ||
+        header.record_size != sizeof(struct log_chunk)) {
+        g_warning("Failed to reopen log %s", path);
+        goto contejner_log_reopen_error;
+    }
+    log->size = st.st_size;
+
+    if (fstat(log->index_fd, &st)) {
+        goto contejner_log_reopen_error;
+    }
+
+    /* A partly written last record is dropped, and so are chunks that
+     * start beyond the data, in case the service stopped in between */
+    n = (st.st_size - sizeof(header)) / sizeof(struct log_chunk);
+    g_array_set_size(log->chunks, n);
+    if (n && pread(log->index_fd, log->chunks->data,
+                   n * sizeof(struct log_chunk), sizeof(header)) !=
+             (ssize_t) (n * sizeof(struct log_chunk))) {
+        goto contejner_log_reopen_error;
+    }
+
+    while (log->chunks->len &&
+           g_array_index(log->chunks, struct log_chunk,
+                         log->chunks->len - 1).offset > log->size) {
+        g_array_set_size(log->chunks, log->chunks->len - 1);
+    }
+
+    /* Data without any chunk yet gets one, from the start of the log */
+    if (!log->chunks->len && log->size) {
+        struct log_chunk chunk = { 0, 0, 0 };
+        if (!write_all_at(log->index_fd, (const char *) &chunk,
+                          sizeof(chunk), sizeof(header))) {
+            goto contejner_log_reopen_error;
+        }
+        g_array_append_val(log->chunks, chunk);
+    }
+
+    if (log->chunks->len && !count_tail_lines(log)) {
+        goto contejner_log_reopen_error;
+    }
+
+    if (!reopen_zindex(log)) {
+        g_warning("Failed to reopen compressed log %s", path);
+        goto contejner_log_reopen_error;
+    }
+
+    g_free(index_path);
+    return log;
+
+contejner_log_reopen_error:
+    g_free(index_path);
+    contejner_log_free(log);
+    return NULL;
+}
+
+static gboolean start_chunk (ContejnerLog *log, gint64 now)
+{
+    struct log_chunk chunk = { log->size, log->lines, now };
+    off_t at = sizeof(struct log_index_header) +
+               (off_t) log->chunks->len * sizeof(chunk);
+
+    if (!write_all_at(log->index_fd, (const char *) &chunk, sizeof(chunk), at)) {
+        g_warning("Failed to write index of %s: %s", log->path, strerror(errno));
+        return FALSE;
+    }
+
+    g_array_append_val(log->chunks, chunk);
+    compress_frames(log);
+    return TRUE;
+}
+
+gboolean contejner_log_append (ContejnerLog *log,
+                               const char *buf,
+                               gsize len)
+{
+    gint64 now = g_get_real_time();
+
+    while (len > 0) {
+        struct log_chunk *cur = NULL;
+        if (log->chunks->len > 0) {
+            cur = &g_array_index(log->chunks, struct log_chunk,
+                                 log->chunks->len - 1);
+        }
+
+        if (!cur || log->size - cur->offset >= CHUNK_MAX_SZ ||
+            (log->size - cur->offset >= CHUNK_MIN_SZ &&
+             now - cur->time >= CHUNK_MAX_AGE)) {
+            if (!start_chunk(log, now)) {
+                return FALSE;
+            }
+            cur = &g_array_index(log->chunks, struct log_chunk,
+                                 log->chunks->len - 1);
+        }
+
+        gsize n = MIN(len, CHUNK_MAX_SZ - (log->size - cur->offset));
+        if (!write_all_at(log->data_fd, buf, n, log->size)) {
+            g_warning("Failed to write %s: %s", log->data_path, strerror(errno));
+            return FALSE;
+        }
+
+        const char *p = buf, *e = buf + n;
+        while ((p = memchr(p, '\n', e - p))) {
+            log->lines++;
+            p++;
+        }
+        log->partial_line = buf[n - 1] != '\n';
+
+        log->size += n;
+        buf += n;
+        len -= n;
+    }
+
+    return TRUE;
+}
+
+int contejner_log_open (ContejnerLog *log)
+{
+    int fd = open(log->data_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        g_warning("Failed to open %s: %s", log->data_path, strerror(errno));
+    } else if (lseek(fd, compressed_end(log), SEEK_SET) == -1) {
+        g_warning("Failed to seek in %s: %s", log->data_path, strerror(errno));
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+guint64 contejner_log_get_plain_offset (ContejnerLog *log)
+{
+    return compressed_end(log);
+}
+
+gboolean contejner_log_set_compressed (ContejnerLog *log, gboolean compress)
+{
+    if (compress && log->zindex_fd == -1 && !open_zindex(log, TRUE)) {
+        return FALSE;
+    }
+
+    log->compress = compress;
+    compress_frames(log);
+    return TRUE;
+}
+
+guint64 contejner_log_get_size (const ContejnerLog *log)
+{
+    return log->size;
+}
+
+guint64 contejner_log_get_stored_size (ContejnerLog *log)
+{
+    return log->size - compressed_end(log) + log->zsize;
+}
+
+const char *contejner_log_get_path (const ContejnerLog *log)
+{
+    return log->path;
+}
+
+/* Offset of the first byte of line @line, counting from 0 */
+static guint64 line_offset (ContejnerLog *log, guint64 line)
+{
+    if (line == 0) {
+        return 0;
+    } else if (line > log->lines) {
+        return log->size;
+    }
+
+    /* Find the last chunk starting before the line's preceding newline */
+    guint lo = 0, hi = log->chunks->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (g_array_index(log->chunks, struct log_chunk, mid).line < line) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    struct log_chunk *chunk = &g_array_index(log->chunks, struct log_chunk, lo - 1);
+    guint64 needed = line - chunk->line;
+    guint64 offset = chunk->offset;
+    char buf[SCAN_BUF_SZ];
+
+    while (offset < log->size) {
+        ssize_t r = read_at(log, buf, MIN(sizeof(buf), log->size - offset), offset);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        } else if (r <= 0) {
+            break;
+        }
+
+        const char *p = buf, *e = buf + r;
+        while ((p = memchr(p, '\n', e - p))) {
+            p++;
+            if (--needed == 0) {
+                return offset + (p - buf);
+            }
+        }
+        offset += r;
+    }
+
+    return log->size;
+}
+
+/* Offset of the chunk that was being written at @time, so that no output
+ * written from then on is left out */
+static guint64 time_offset (ContejnerLog *log, gint64 time)
+{
+    if (time >= g_get_real_time()) {
+        return log->size;
+    }
+
+    guint lo = 0, hi = log->chunks->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (g_array_index(log->chunks, struct log_chunk, mid).time <= time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0) {
+        return 0;
+    }
+
+    return g_array_index(log->chunks, struct log_chunk, lo - 1).offset;
+}
+
+/* Position @from counted back from @total, when negative */
+static guint64 position (gint64 from, guint64 total)
+{
+    if (from >= 0) {
+        return MIN((guint64) from, total);
+    }
+
+    guint64 back = (guint64) 0 - (guint64) from;
+    return back >= total ? 0 : total - back;
+}
+
+static guint64 add_saturated (guint64 a, guint64 b)
+{
+    return b > G_MAXUINT64 - a ? G_MAXUINT64 : a + b;
+}
+
+void contejner_log_resolve (ContejnerLog *log,
+                            gint64 from,
+                            guint64 count,
+                            ContejnerLogUnit unit,
+                            guint64 *start,
+                            guint64 *end)
+{
+    switch (unit) {
+        case CONTEJNER_LOG_UNIT_BYTES: {
+            *start = position(from, log->size);
+            *end = count ? MIN(add_saturated(*start, count), log->size)
+                         : log->size;
+            break;
+        } case CONTEJNER_LOG_UNIT_LINES: {
+            guint64 first = position(from, log->lines + log->partial_line);
+            *start = line_offset(log, first);
+            *end = count ? line_offset(log, add_saturated(first, count))
+                         : log->size;
+            break;
+        } case CONTEJNER_LOG_UNIT_TIME: {
+            gint64 time = from >= 0 ? from : g_get_real_time() + from;
+            *start = time_offset(log, time);
+            *end = count ? time_offset(log, time + (gint64) MIN(count, G_MAXINT64 - time))
+                         : log->size;
+            break;
+        } default: {
+            g_warning("Unknown log unit: %d", unit);
+            *start = *end = log->size;
+        }
+    }
+}
+
+GBytes *contejner_log_read (ContejnerLog *log,
+                            guint64 offset,
+                            gsize len)
+{
+    if (offset >= log->size) {
+        return g_bytes_new(NULL, 0);
+    }
+
+    len = MIN(len, log->size - offset);
+    char *buf = g_malloc(len);
+    gsize got = 0;
+
+    while (got < len) {
+        ssize_t r = read_at(log, buf + got, len - got, offset + got);
+        if (r == -1 && errno == EINTR) {
+            continue;
+        } else if (r == -1) {
+            g_warning("Failed to read %s: %s", log->data_path, strerror(errno));
+            g_free(buf);
+            return NULL;
+        } else if (r == 0) {
+            break;
+        }
+        got += r;
+    }
+
+    return g_bytes_new_take(buf, got);
+}
+
+gboolean contejner_log_unit_from_string (const char *str,
+                                         ContejnerLogUnit *unit)
+{
+    if (!g_strcmp0(str, "bytes")) {
+        *unit = CONTEJNER_LOG_UNIT_BYTES;
+    } else if (!g_strcmp0(str, "lines")) {
+        *unit = CONTEJNER_LOG_UNIT_LINES;
+    } else if (!g_strcmp0(str, "time")) {
+        *unit = CONTEJNER_LOG_UNIT_TIME;
+    } else {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void contejner_log_free (ContejnerLog *log)
+{
+    if (log->data_fd != -1) {
+        close(log->data_fd);
+    }
+    if (log->index_fd != -1) {
+        close(log->index_fd);
+    }
+    if (log->zdata_fd != -1) {
+        close(log->zdata_fd);
+    }
+    if (log->zindex_fd != -1) {
+        close(log->zindex_fd);
+    }
+
+    g_array_free(log->chunks, TRUE);
+    g_array_free(log->zframes, TRUE);
+    g_free(log->cache);
+    g_free(log->data_path);
+    g_free(log->path);
+    g_free(log);
+}
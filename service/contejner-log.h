@@ -0,0 +1,125 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CONTEJNER_LOG_H
+#define CONTEJNER_LOG_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ContejnerLog ContejnerLog;
+
+typedef enum {
+    CONTEJNER_LOG_UNIT_BYTES,
+    CONTEJNER_LOG_UNIT_LINES,
+    CONTEJNER_LOG_UNIT_TIME,
+    CONTEJNER_LOG_UNIT_LAST,
+} ContejnerLogUnit;
+
+/**
+ * contejner_log_new:
+ * @path: path of the log, without extension
+ *
+ * Create a new, empty output log. The log consists of a data file
+ * (@path.log) holding the raw output and an index file (@path.idx) that
+ * splits the data into chunks of up to 64 KiB. Each chunk records its byte
+ * offset, the number of lines before it and the time its first byte was
+ * written, which makes it possible to find a position by offset, line or
+ * time without scanning the data. A time resolves to the start of the chunk
+ * that was being written then.
+ *
+ * Returns: a new #ContejnerLog, or NULL if the files could not be created
+ */
+ContejnerLog *contejner_log_new (const char *path);
+
+/* Open an existing log to continue appending to it. Returns NULL if the log
+ * does not exist or is damaged. */
+ContejnerLog *contejner_log_reopen (const char *path);
+
+gboolean contejner_log_append (ContejnerLog *log,
+                               const char *buf,
+                               gsize len);
+
+/* Returns a new read-only file descriptor of the data file, at the start
+ * of the plain data */
+int contejner_log_open (ContejnerLog *log);
+
+/**
+ * contejner_log_set_compressed:
+ * @log: a #ContejnerLog
+ * @compress: whether to compress the log
+ *
+ * Compress the log with zlib into @path.z, in frames of consecutive chunks
+ * holding at least 64 KiB each. The newest 1 MiB or so is kept as it is,
+ * so that live output can still be followed in the data file, and the
+ * space of the rest is freed in the data file. Frames compressed so far
+ * stay compressed when compression is turned off. Reads decompress only
+ * the frames they cover.
+ *
+ * Returns: FALSE if the compressed files could not be created
+ */
+gboolean contejner_log_set_compressed (ContejnerLog *log,
+                                       gboolean compress);
+
+/* Offset of the first byte which is not compressed, and can be read from
+ * the data file */
+guint64 contejner_log_get_plain_offset (ContejnerLog *log);
+
+guint64 contejner_log_get_size (const ContejnerLog *log);
+
+/* Bytes taken by the output, after compression */
+guint64 contejner_log_get_stored_size (ContejnerLog *log);
+
+const char *contejner_log_get_path (const ContejnerLog *log);
+
+/**
+ * contejner_log_resolve:
+ * @log: a #ContejnerLog
+ * @from: start position, in @unit. Negative byte and line positions count
+ *        back from the end of the log, negative times are relative to now
+ * @count: number of @unit to cover, or 0 to cover the rest of the log
+ * @unit: unit of @from and @count
+ * @start: (out): byte offset of the start of the range
+ * @end: (out): byte offset of the end of the range
+ *
+ * Translate a range given in bytes, lines or time (microseconds since the
+ * epoch) into byte offsets of the data file. Line and time lookups are done
+ * with a binary search in the chunk index and a scan of at most one chunk.
+ */
+void contejner_log_resolve (ContejnerLog *log,
+                            gint64 from,
+                            guint64 count,
+                            ContejnerLogUnit unit,
+                            guint64 *start,
+                            guint64 *end);
+
+/* Read up to @len bytes at @offset. Returns NULL on failure. */
+GBytes *contejner_log_read (ContejnerLog *log,
+                            guint64 offset,
+                            gsize len);
+
+gboolean contejner_log_unit_from_string (const char *str,
+                                         ContejnerLogUnit *unit);
+
+void contejner_log_free (ContejnerLog *log);
+
+G_END_DECLS
+
+#endif /* CONTEJNER_LOG_H */
@@ -17,10 +17,12 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <string.h>
+#include <gio/gunixfdlist.h>
+
 #include "contejner-manager-interface.h"
 #include "contejner-instance-interface.h"
 #include "contejner-instance.h"
-#include "dbus-service.xml.h"
 
 struct _ContejnerManagerInterface
 {
@@ -29,6 +31,10 @@ struct _ContejnerManagerInterface
   // instance variables for subclass go here
 };
 
+/* Declares the handle_* functions below, and the generated
+ * manager_methods_dispatch() which unpacks the arguments for them */
+#include "dbus-service.xml.h"
+
 typedef struct _ContejnerManagerInterfacePrivate ContejnerManagerInterfacePrivate;
 
 struct _ContejnerManagerInterfacePrivate {
@@ -43,6 +49,17 @@ struct _ContejnerManagerInterfacePrivate {
                                        contejner_manager_interface_get_type(),    \
                                        ContejnerManagerInterfacePrivate))
 
+static void return_error(GDBusMethodInvocation *invocation,
+                         const char *name,
+                         const char *message)
+{
+    gchar *func = g_strdup_printf("%s.Error.%s",
+                g_dbus_method_invocation_get_method_name(invocation),
+                name);
+    g_dbus_method_invocation_return_dbus_error(invocation, func, message);
+    g_free(func);
+}
+
 static void container_created_cb (ContejnerInstance *c, gpointer user_data)
 {
     ContejnerManagerInterface *self = ((void**)user_data)[0];
@@ -52,7 +69,7 @@ static void container_created_cb (ContejnerInstance *c, gpointer user_data)
         g_dbus_method_invocation_get_connection(m);
 
     ContejnerInstanceInterface *container_interface =
-        contejner_instance_interface_new (c, connection);
+        contejner_instance_interface_new (c, priv->manager, connection);
 
     g_dbus_object_skeleton_add_interface(priv->container_objects,
                                          G_DBUS_INTERFACE_SKELETON(container_interface));
@@ -64,6 +81,198 @@ static void container_created_cb (ContejnerInstance *c, gpointer user_data)
     g_variant_ref(value);
     g_dbus_method_invocation_return_value (m, value);
     g_variant_unref(value);
+    g_object_unref(container_interface);
+}
+
+static gchar *container_interface_name(ContejnerInstance *container)
+{
+    return g_strdup_printf("%s%d", CONTEJNER_INSTANCE_INTERFACE_NAME,
+                           contejner_instance_get_id(container));
+}
+
+static void handle_Create(ContejnerManagerInterface *self,
+                          GDBusMethodInvocation *invocation)
+{
+    ContejnerManagerInterfacePrivate *priv =
+        CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(self);
+    void *created_data[] = {(void *) self, (void *) invocation};
+
+    contejner_manager_create(priv->manager,
+                             container_created_cb,
+                             created_data);
+}
+
+static void handle_List(ContejnerManagerInterface *self,
+                        GDBusMethodInvocation *invocation,
+                        const gchar *selector)
+{
+    ContejnerManagerInterfacePrivate *priv =
+        CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(self);
+    GError *error = NULL;
+    GVariantBuilder builder;
+    GList *matches, *l;
+
+    matches = contejner_manager_select(priv->manager, selector, &error);
+    if (error) {
+        return_error(invocation, "BadSelector", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("as"));
+    for (l = matches; l; l = l->next) {
+        g_variant_builder_add_value(&builder,
+                g_variant_new_take_string(container_interface_name(l->data)));
+    }
+    g_list_free(matches);
+
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new("(as)", &builder));
+}
+
+static void handle_KillMatching(ContejnerManagerInterface *self,
+                                GDBusMethodInvocation *invocation,
+                                const gchar *selector,
+                                gint32 signal)
+{
+    ContejnerManagerInterfacePrivate *priv =
+        CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(self);
+    GError *error = NULL;
+    guint killed = 0;
+    GList *matches, *l;
+
+    matches = contejner_manager_select(priv->manager, selector, &error);
+    if (error) {
+        return_error(invocation, "BadSelector", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    for (l = matches; l; l = l->next) {
+        if (contejner_instance_is_active(l->data) &&
+            contejner_instance_kill(l->data, signal)) {
+            killed++;
+        }
+    }
+    g_list_free(matches);
+
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new("(u)", killed));
+}
+
+static void handle_DestroyMatching(ContejnerManagerInterface *self,
+                                   GDBusMethodInvocation *invocation,
+                                   const gchar *selector)
+{
+    ContejnerManagerInterfacePrivate *priv =
+        CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(self);
+    GError *error = NULL;
+    guint destroyed = 0;
+    GList *matches, *l;
+
+    matches = contejner_manager_select(priv->manager, selector, &error);
+    if (error) {
+        return_error(invocation, "BadSelector", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    for (l = matches; l; l = l->next) {
+        gchar *name = container_interface_name(l->data);
+        GDBusInterface *interface;
+
+        /* The interface holds the last reference to the container */
+        if (contejner_manager_destroy(priv->manager, l->data)) {
+            interface = g_dbus_object_get_interface(G_DBUS_OBJECT(priv->container_objects),
+                                                    name);
+            if (interface) {
+                g_dbus_object_skeleton_remove_interface(priv->container_objects,
+                                                        G_DBUS_INTERFACE_SKELETON(interface));
+                g_object_unref(interface);
+            }
+            destroyed++;
+        }
+        g_free(name);
+    }
+    g_list_free(matches);
+
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new("(u)", destroyed));
+}
+
+static void handle_CreateTemplate(ContejnerManagerInterface *self,
+                                  GDBusMethodInvocation *invocation,
+                                  GVariant *config)
+{
+    ContejnerManagerInterfacePrivate *priv =
+        CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(self);
+    GError *error = NULL;
+    const char *name = contejner_manager_create_template(priv->manager,
+                                                         config,
+                                                         &error);
+
+    if (!name) {
+        return_error(invocation, "InvalidConfig", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    g_dbus_method_invocation_return_value (invocation,
+                                           g_variant_new("(s)", name));
+}
+
+static void handle_CreateFromTemplate(ContejnerManagerInterface *self,
+                                      GDBusMethodInvocation *invocation,
+                                      const gchar *template_name,
+                                      GVariant *overrides)
+{
+    ContejnerManagerInterfacePrivate *priv =
+        CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(self);
+    void *created_data[] = {(void *) self, (void *) invocation};
+    GError *error = NULL;
+
+    if (!contejner_manager_create_from_template(priv->manager,
+                                                template_name,
+                                                overrides,
+                                                container_created_cb,
+                                                created_data,
+                                                &error)) {
+        return_error(invocation, "InvalidConfig", error->message);
+        g_error_free(error);
+    }
+}
+
+static void handle_GetEventsSince(ContejnerManagerInterface *self,
+                                  GDBusMethodInvocation *invocation,
+                                  guint64 seq)
+{
+    ContejnerManagerInterfacePrivate *priv =
+        CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(self);
+
+    g_dbus_method_invocation_return_value (invocation,
+            g_variant_new("(@a(tsss))",
+                          contejner_manager_get_events_since(priv->manager, seq)));
+}
+
+static void handle_OpenStatusBoard(ContejnerManagerInterface *self,
+                                   GDBusMethodInvocation *invocation)
+{
+    ContejnerManagerInterfacePrivate *priv =
+        CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(self);
+    GUnixFDList *fd_list;
+    int fd;
+
+    fd = contejner_manager_open_status_board(priv->manager);
+    if (fd == -1) {
+        return_error(invocation, "NoBoard", "No status board available");
+        return;
+    }
+
+    fd_list = g_unix_fd_list_new_from_array(&fd, 1);
+    g_dbus_method_invocation_return_value_with_unix_fd_list (invocation,
+                                                             g_variant_new("(h)", 0),
+                                                             fd_list);
+    g_object_unref(fd_list);
 }
 
 static void dbus_method_call(GDBusConnection *connection,
@@ -76,13 +285,16 @@ static void dbus_method_call(GDBusConnection *connection,
                               gpointer user_data)
 {
     ContejnerManagerInterface *self = user_data;
-    ContejnerManagerInterfacePrivate *priv = CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(self);
-    void *created_data[] = {(void *) self, (void *) invocation};
 
-    if (!g_strcmp0(method_name, "Create")) {
-        contejner_manager_create(priv->manager,
-                                 container_created_cb,
-                                 created_data);
+    /* GDBus has checked the method and its arguments against the
+     * introspection data, which the table is generated from, and refused
+     * unknown methods already. The error only guards against the two
+     * getting out of step. */
+    if (!manager_methods_dispatch(self, method_name, parameters, invocation)) {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                              G_DBUS_ERROR_UNKNOWN_METHOD,
+                                              "No such method: %s",
+                                              method_name);
     }
 }
 
@@ -94,7 +306,32 @@ static GVariant *dbus_get_property (GDBusConnection *connection,
                              GError **error,
                              gpointer user_data)
 {
-    return NULL;
+    ContejnerManagerInterface *self = user_data;
+    ContejnerManagerInterfacePrivate *priv = CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(self);
+    struct contejner_manager_queue_stats stats;
+    GVariant *v = NULL;
+
+    contejner_manager_get_queue_stats(priv->manager, &stats);
+
+    if (!g_strcmp0(property_name, "MaxRunning")) {
+        v = g_variant_new ("(u)", contejner_manager_get_max_running(priv->manager));
+    } else if (!g_strcmp0(property_name, "Running")) {
+        v = g_variant_new ("(u)", stats.running);
+    } else if (!g_strcmp0(property_name, "QueueDepth")) {
+        v = g_variant_new ("(u)", stats.queued);
+    } else if (!g_strcmp0(property_name, "QueueAdmitted")) {
+        v = g_variant_new ("(t)", stats.admitted);
+    } else if (!g_strcmp0(property_name, "QueueWaitMean")) {
+        v = g_variant_new ("(t)", stats.wait_mean);
+    } else if (!g_strcmp0(property_name, "QueueWaitMax")) {
+        v = g_variant_new ("(t)", stats.wait_max);
+    } else if (!g_strcmp0(property_name, "QueueWaitOldest")) {
+        v = g_variant_new ("(t)", stats.wait_oldest);
+    } else {
+        g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+                    "Unknown property %s", property_name);
+    }
+    return v;
 }
 
 static gboolean dbus_set_property (GDBusConnection *connection,
@@ -106,9 +343,45 @@ static gboolean dbus_set_property (GDBusConnection *connection,
                              GError **error,
                              gpointer user_data)
 {
+    ContejnerManagerInterface *self = user_data;
+    ContejnerManagerInterfacePrivate *priv = CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(self);
+
+    if (!g_strcmp0(property_name, "MaxRunning")) {
+        contejner_manager_set_max_running(priv->manager,
+                                          g_variant_get_uint32(value));
+        return TRUE;
+    }
+
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_PROPERTY_READ_ONLY,
+                "Property %s can not be changed", property_name);
     return FALSE;
 }
 
+/* Forward a batch of lifecycle events of the manager to D-Bus */
+static void send_events(ContejnerManager *manager,
+                        GVariant *events,
+                        gpointer user_data)
+{
+    GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON(user_data);
+    GDBusConnection *connection = g_dbus_interface_skeleton_get_connection(skeleton);
+    GError *error = NULL;
+
+    if (!connection) {
+        return;
+    }
+
+    if (!g_dbus_connection_emit_signal(connection,
+                                       NULL,
+                                       g_dbus_interface_skeleton_get_object_path(skeleton),
+                                       CONTEJNER_MANAGER_INTERFACE_DBUS_NAME,
+                                       "ContainerEvents",
+                                       g_variant_new("(@a(tsss))", events),
+                                       &error)) {
+        g_warning("Failed to emit signal: %s", error->message);
+        g_error_free(error);
+    }
+}
+
 static GDBusInterfaceVTable dbus_interface_vtable = {
     dbus_method_call,
     dbus_get_property,
@@ -179,6 +452,8 @@ ContejnerManagerInterface * contejner_manager_interface_new (ContejnerManager *c
    ContejnerManagerInterface *svc = g_object_new (CONTEJNER_TYPE_MANAGER_INTERFACE, NULL);
    ContejnerManagerInterfacePrivate *priv =
        CONTEJNER_MANAGER_INTERFACE_GET_PRIVATE(svc);
+   GDBusConnection *connection;
+   GSList *l;
 
    priv->manager = CONTEJNER_MANAGER (cmgr);
    priv->object_manager = G_DBUS_OBJECT_MANAGER_SERVER (mgr);
@@ -187,5 +462,18 @@ ContejnerManagerInterface * contejner_manager_interface_new (ContejnerManager *c
    g_dbus_object_manager_server_export(priv->object_manager,
                                        priv->container_objects);
 
+   /* Containers taken over from an earlier run of the service */
+   connection = g_dbus_object_manager_server_get_connection(priv->object_manager);
+   for (l = contejner_manager_get_instances(priv->manager); l; l = l->next) {
+       ContejnerInstanceInterface *container_interface =
+           contejner_instance_interface_new(l->data, priv->manager, connection);
+       g_dbus_object_skeleton_add_interface(priv->container_objects,
+                                            G_DBUS_INTERFACE_SKELETON(container_interface));
+       g_object_unref(container_interface);
+   }
+   g_object_unref(connection);
+
+   g_signal_connect(priv->manager, "events", G_CALLBACK(send_events), svc);
+
    return svc;
 }
@@ -21,12 +21,30 @@
 #include <error.h>
 #include <stdio.h>
 #include <sched.h>
+#include <sys/stat.h>
 #include "contejner-manager.h"
 #include "contejner-instance.h"
+#include "contejner-journal.h"
+#include "contejner-timer.h"
+#include "contejner-board.h"
 
 #define CONTAINER_NAME_SZ 20
+#define NUMA_NODE_PATH "/sys/devices/system/node"
 #define STACK_SIZE 1024 * 1024
 
+/* Number of lifecycle events kept for GetEventsSince, and how long events
+ * are collected before they are sent as one batch */
+#define EVENT_LOG_SZ 4096
+#define EVENT_BATCH_MS 20
+
+/* The resource usage of all running containers is sampled in one pass, at
+ * this interval */
+#define SAMPLE_INTERVAL_MS 1000
+
+/* Records on the status board. Its pages are only allocated as they are
+ * used. */
+#define BOARD_CAPACITY 65536
+
 /* List of namesapces to unshare */
 #define DEFAULT_UNSHARED_NAMESPACES     \
     CLONE_NEWNET                \
@@ -48,6 +66,92 @@ typedef struct _ContejnerManagerPrivate ContejnerManagerPrivate;
 struct _ContejnerManagerPrivate {
     int next_container_id;
     GSList *container_list;
+    char *output_dir;
+    ContejnerManagerPlacement placement;
+    GArray *numa_nodes;
+    /* Instance -> index + 1 of the NUMA node it was placed on */
+    GHashTable *placed;
+    GHashTable *templates;
+    int next_template_id;
+    ContejnerJournal *journal;
+
+    /* Label key -> label value -> set of instances */
+    GHashTable *label_index;
+
+    /* Lifecycle events. Event seq is kept in events[seq % EVENT_LOG_SZ]. */
+    struct event *events;
+    guint64 next_event_seq;
+    guint64 sent_event_seq;
+    guint event_source;
+
+    /* Run queue */
+    guint max_running;
+    GHashTable *running;
+    GHashTable *owner_queues;
+    GQueue owners;
+    guint queued;
+    guint admit_source;
+    guint64 admitted;
+    guint64 wait_total;
+    guint64 wait_max;
+
+    ContejnerTimer sample_timer;
+
+    /* Status board, and the slot + 1 of each instance on it */
+    ContejnerBoard *board;
+    GHashTable *board_slots;
+
+    /* Instance -> struct restart, of stopped containers waiting for their
+     * restart policy to run them again */
+    GHashTable *restarts;
+};
+
+struct restart {
+    ContejnerTimer timer;
+    ContejnerManager *manager;
+    ContejnerInstance *instance;
+};
+
+static void schedule_admit(ContejnerManager *manager);
+
+/* A lifecycle event of a container */
+struct event {
+    guint64 seq;
+    gchar *container;
+    const gchar *type;
+    gchar *detail;
+};
+
+enum {
+    SIGNAL_EVENTS,
+    N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+/* A container waiting to run */
+struct queued_run {
+    ContejnerInstance *instance;
+    gint64 queued_at;
+};
+
+/* Containers queued by one owner */
+struct owner_queue {
+    gchar *owner;
+    GQueue runs;
+};
+
+struct numa_node {
+    int id;
+    char *cpus;
+    guint load;
+};
+
+/* Placement of a running container, released when it stops */
+struct placement {
+    ContejnerManager *manager;
+    guint node;
+    gulong handler;
 };
 
 #define CONTEJNER_MANAGER_GET_PRIVATE(object)                           \
@@ -57,14 +161,51 @@ struct _ContejnerManagerPrivate {
 
 G_DEFINE_TYPE(ContejnerManager, contejner_manager, G_TYPE_OBJECT)
 
+static void owner_queue_free(gpointer data)
+{
+    struct owner_queue *queue = data;
+    g_free(queue->owner);
+    g_free(queue);
+}
+
+static void restart_free (gpointer data)
+{
+    struct restart *restart = data;
+
+    contejner_timer_cancel(&restart->timer);
+    g_free(restart);
+}
+
 static void contejner_manager_init (ContejnerManager *svc) {
     ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE (svc);
     priv->next_container_id = 0;
+    priv->running = g_hash_table_new(NULL, NULL);
+    priv->owner_queues = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                               NULL, owner_queue_free);
+    g_queue_init(&priv->owners);
+    priv->templates = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, g_object_unref);
+    priv->label_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                              (GDestroyNotify) g_hash_table_unref);
+    priv->events = g_new0(struct event, EVENT_LOG_SZ);
+    priv->next_event_seq = 1;
+    priv->board = contejner_board_new(BOARD_CAPACITY);
+    priv->board_slots = g_hash_table_new(NULL, NULL);
+    priv->placed = g_hash_table_new(NULL, NULL);
+    priv->restarts = g_hash_table_new_full(NULL, NULL, NULL, restart_free);
 }
 
 static void contejner_manager_class_init (ContejnerManagerClass *class)
 {
-    g_type_class_add_private(class, sizeof(ContejnerManager));
+    g_type_class_add_private(class, sizeof(ContejnerManagerPrivate));
+
+    /* A batch of lifecycle events, as an a(tsss) array of sequence number,
+     * container, event and detail */
+    signals[SIGNAL_EVENTS] = g_signal_new("events",
+                                          G_TYPE_FROM_CLASS(class),
+                                          G_SIGNAL_RUN_LAST,
+                                          0, NULL, NULL, NULL,
+                                          G_TYPE_NONE, 1, G_TYPE_VARIANT);
 }
 
 ContejnerManager * contejner_manager_new (void)
@@ -72,15 +213,788 @@ ContejnerManager * contejner_manager_new (void)
   return g_object_new (CONTEJNER_TYPE_MANAGER, NULL);
 }
 
-void contejner_manager_create (ContejnerManager *manager,
-                               ContejnerManagerCreateCallback cb,
+void contejner_manager_set_output_dir (ContejnerManager *manager,
+                                       const char *output_dir)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    g_free(priv->output_dir);
+    priv->output_dir = g_strdup(output_dir);
+}
+
+void contejner_manager_set_placement (ContejnerManager *manager,
+                                      ContejnerManagerPlacement placement)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    priv->placement = placement;
+}
+
+gboolean contejner_manager_placement_from_string (const char *str,
+                                                  ContejnerManagerPlacement *placement)
+{
+    if (!g_strcmp0(str, "none")) {
+        *placement = CONTEJNER_MANAGER_PLACEMENT_NONE;
+    } else if (!g_strcmp0(str, "spread")) {
+        *placement = CONTEJNER_MANAGER_PLACEMENT_SPREAD;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Find the NUMA nodes of the host which have CPUs attached */
+static GArray *load_numa_nodes(void)
+{
+    GArray *nodes = g_array_new(FALSE, TRUE, sizeof(struct numa_node));
+    GDir *dir = g_dir_open(NUMA_NODE_PATH, 0, NULL);
+    const gchar *name;
+
+    if (!dir) {
+        g_debug("No NUMA information available");
+        return nodes;
+    }
+
+    while ((name = g_dir_read_name(dir))) {
+        struct numa_node node = { 0 };
+        gchar *path;
+        gchar *end;
+
+        if (!g_str_has_prefix(name, "node")) {
+            continue;
+        }
+
+        node.id = g_ascii_strtoll(name + 4, &end, 10);
+        if (end == name + 4 || *end != '\0') {
+            continue;
+        }
+
+        path = g_build_filename(NUMA_NODE_PATH, name, "cpulist", NULL);
+        if (g_file_get_contents(path, &node.cpus, NULL, NULL)) {
+            g_strstrip(node.cpus);
+            if (*node.cpus) {
+                g_array_append_val(nodes, node);
+            } else {
+                g_free(node.cpus);
+            }
+        }
+        g_free(path);
+    }
+
+    g_dir_close(dir);
+    g_debug("Found %u NUMA nodes with CPUs", nodes->len);
+    return nodes;
+}
+
+static void placement_released(GObject *instance,
+                               GParamSpec *property,
                                gpointer user_data)
+{
+    struct placement *placement = user_data;
+    ContejnerManagerPrivate *priv =
+        CONTEJNER_MANAGER_GET_PRIVATE(placement->manager);
+    ContejnerInstanceStatus status;
+
+    g_object_get(instance, "status", &status, NULL);
+    if (status != CONTEJNER_INSTANCE_STATUS_STOPPED) {
+        return;
+    }
+
+    g_array_index(priv->numa_nodes, struct numa_node, placement->node).load--;
+    g_hash_table_remove(priv->placed, instance);
+
+    /* The next run is placed again, on whatever node is least loaded then */
+    contejner_instance_set_cpuset(CONTEJNER_INSTANCE(instance), NULL);
+    contejner_instance_set_mem_nodes(CONTEJNER_INSTANCE(instance), NULL);
+
+    g_signal_handler_disconnect(instance, placement->handler);
+}
+
+/* Count a container towards the load of a node until it stops */
+static void claim_node(ContejnerManager *manager,
+                       ContejnerInstance *instance,
+                       guint node)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    struct placement *placement;
+
+    g_array_index(priv->numa_nodes, struct numa_node, node).load++;
+    g_hash_table_insert(priv->placed, instance, GUINT_TO_POINTER(node + 1));
+
+    placement = g_new0(struct placement, 1);
+    placement->manager = manager;
+    placement->node = node;
+    placement->handler = g_signal_connect_data(instance,
+                                               "notify::status",
+                                               G_CALLBACK(placement_released),
+                                               placement,
+                                               (GClosureNotify) g_free,
+                                               0);
+}
+
+static void place_instance(ContejnerManager *manager,
+                           ContejnerInstance *instance)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    struct numa_node *node;
+    gchar *node_id;
+    guint i, best = 0;
+
+    if (*contejner_instance_get_cpuset(instance) ||
+        *contejner_instance_get_mem_nodes(instance)) {
+        return;
+    }
+
+    if (!priv->numa_nodes) {
+        priv->numa_nodes = load_numa_nodes();
+    }
+
+    if (priv->numa_nodes->len < 2) {
+        return;
+    }
+
+    for (i = 1; i < priv->numa_nodes->len; i++) {
+        if (g_array_index(priv->numa_nodes, struct numa_node, i).load <
+            g_array_index(priv->numa_nodes, struct numa_node, best).load) {
+            best = i;
+        }
+    }
+
+    node = &g_array_index(priv->numa_nodes, struct numa_node, best);
+    node_id = g_strdup_printf("%d", node->id);
+
+    if (!contejner_instance_set_cpuset(instance, node->cpus) ||
+        !contejner_instance_set_mem_nodes(instance, node_id)) {
+        g_warning("Failed to place container on NUMA node %d", node->id);
+        contejner_instance_set_cpuset(instance, NULL);
+        contejner_instance_set_mem_nodes(instance, NULL);
+        g_free(node_id);
+        return;
+    }
+    g_free(node_id);
+
+    claim_node(manager, instance, best);
+    g_debug("Container placed on NUMA node %d (cpus %s)", node->id, node->cpus);
+}
+
+/* A restored container placed by an earlier run of the service counts
+ * towards the load of its node again */
+static void reclaim_node(ContejnerManager *manager,
+                         ContejnerInstance *instance,
+                         int node_id)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    guint i;
+
+    if (!priv->numa_nodes) {
+        priv->numa_nodes = load_numa_nodes();
+    }
+
+    for (i = 0; i < priv->numa_nodes->len; i++) {
+        if (g_array_index(priv->numa_nodes, struct numa_node, i).id == node_id) {
+            claim_node(manager, instance, i);
+            return;
+        }
+    }
+
+    g_debug("Restored container placed on unknown NUMA node %d", node_id);
+}
+
+void contejner_manager_set_max_running (ContejnerManager *manager,
+                                        guint max_running)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    priv->max_running = max_running;
+    schedule_admit(manager);
+}
+
+guint contejner_manager_get_max_running (ContejnerManager *manager)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    return priv->max_running;
+}
+
+void contejner_manager_get_queue_stats (ContejnerManager *manager,
+                                        struct contejner_manager_queue_stats *stats)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    gint64 now = g_get_monotonic_time();
+    GList *l;
+
+    stats->running = g_hash_table_size(priv->running);
+    stats->queued = priv->queued;
+    stats->admitted = priv->admitted;
+    stats->wait_mean = priv->admitted ? priv->wait_total / priv->admitted : 0;
+    stats->wait_max = priv->wait_max;
+    stats->wait_oldest = 0;
+
+    for (l = priv->owners.head; l; l = l->next) {
+        struct owner_queue *queue = l->data;
+        struct queued_run *run = g_queue_peek_head(&queue->runs);
+        if (run && (guint64) (now - run->queued_at) > stats->wait_oldest) {
+            stats->wait_oldest = now - run->queued_at;
+        }
+    }
+}
+
+static gboolean has_capacity(ContejnerManagerPrivate *priv)
+{
+    return !priv->max_running ||
+           g_hash_table_size(priv->running) < priv->max_running;
+}
+
+static void queued_run_cb(ContejnerInstance *instance,
+                          enum contejner_error_code error,
+                          const char *message,
+                          gpointer user_data)
+{
+    if (error != CONTEJNER_OK) {
+        g_warning("Failed to start queued container: %s", message);
+    }
+}
+
+static void start_instance(ContejnerManager *manager,
+                           ContejnerInstance *instance,
+                           ContejnerInstanceRunCallback cb,
+                           gpointer user_data)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+
+    if (priv->placement == CONTEJNER_MANAGER_PLACEMENT_SPREAD) {
+        place_instance(manager, instance);
+    }
+
+    /* Counted as running before it starts, since a failed start reports
+     * STOPPED from within contejner_instance_run() */
+    g_hash_table_add(priv->running, instance);
+    contejner_instance_run(instance, cb, user_data);
+}
+
+/* Start queued containers while there is capacity, taking one container
+ * from each owner in turn */
+static gboolean admit(gpointer user_data)
+{
+    ContejnerManager *manager = user_data;
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+
+    priv->admit_source = 0;
+
+    while (priv->queued && has_capacity(priv)) {
+        struct owner_queue *queue = g_queue_pop_head(&priv->owners);
+        struct queued_run *run = g_queue_pop_head(&queue->runs);
+        guint64 wait = g_get_monotonic_time() - run->queued_at;
+
+        if (g_queue_is_empty(&queue->runs)) {
+            g_hash_table_remove(priv->owner_queues, queue->owner);
+        } else {
+            g_queue_push_tail(&priv->owners, queue);
+        }
+        priv->queued--;
+
+        priv->admitted++;
+        priv->wait_total += wait;
+        priv->wait_max = MAX(priv->wait_max, wait);
+        g_debug("Starting queued container after %" G_GUINT64_FORMAT " us",
+                wait);
+
+        start_instance(manager, run->instance, queued_run_cb, NULL);
+        g_object_unref(run->instance);
+        g_free(run);
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+static void schedule_admit(ContejnerManager *manager)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+
+    if (priv->queued && !priv->admit_source) {
+        priv->admit_source = g_idle_add(admit, manager);
+    }
+}
+
+/* The events after seq which are still kept, oldest first */
+static GVariant *events_since(ContejnerManagerPrivate *priv, guint64 seq)
+{
+    GVariantBuilder builder;
+    guint64 oldest = priv->next_event_seq > EVENT_LOG_SZ ?
+                     priv->next_event_seq - EVENT_LOG_SZ : 1;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(tsss)"));
+    for (seq = MAX(seq + 1, oldest); seq < priv->next_event_seq; seq++) {
+        struct event *event = &priv->events[seq % EVENT_LOG_SZ];
+        g_variant_builder_add(&builder, "(tsss)", event->seq, event->container,
+                              event->type, event->detail);
+    }
+
+    return g_variant_builder_end(&builder);
+}
+
+static gboolean send_events(gpointer user_data)
+{
+    ContejnerManager *manager = user_data;
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    GVariant *events = g_variant_ref_sink(events_since(priv,
+                                                       priv->sent_event_seq));
+
+    priv->event_source = 0;
+    priv->sent_event_seq = priv->next_event_seq - 1;
+
+    g_signal_emit(manager, signals[SIGNAL_EVENTS], 0, events);
+    g_variant_unref(events);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Record a lifecycle event. Events are sent in batches, so that a burst of
+ * events, like a KillMatching, is one signal rather than one per event. */
+static void add_event(ContejnerManager *manager,
+                      ContejnerInstance *instance,
+                      const gchar *type,
+                      gchar *detail)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    struct event *event = &priv->events[priv->next_event_seq % EVENT_LOG_SZ];
+
+    g_free(event->container);
+    g_free(event->detail);
+
+    event->seq = priv->next_event_seq++;
+    event->container = g_strdup_printf("%s%d", CONTEJNER_INSTANCE_INTERFACE_NAME,
+                                       contejner_instance_get_id(instance));
+    event->type = type;
+    event->detail = detail ? detail : g_strdup("");
+
+    if (!priv->event_source) {
+        priv->event_source = g_timeout_add(EVENT_BATCH_MS, send_events, manager);
+    }
+}
+
+static void status_event(ContejnerManager *manager,
+                         ContejnerInstance *instance,
+                         ContejnerInstanceStatus status)
+{
+    int exit_status;
+
+    switch (status) {
+        case CONTEJNER_INSTANCE_STATUS_QUEUED:
+            add_event(manager, instance, "queued", NULL);
+            break;
+        case CONTEJNER_INSTANCE_STATUS_RUNNING:
+            add_event(manager, instance, "running", NULL);
+            break;
+        case CONTEJNER_INSTANCE_STATUS_FROZEN:
+            add_event(manager, instance, "frozen", NULL);
+            break;
+        case CONTEJNER_INSTANCE_STATUS_STOPPED:
+            if (contejner_instance_get_timed_out(instance)) {
+                add_event(manager, instance, "timeout", NULL);
+            }
+            /* The detail is the exit status, empty when it is unknown */
+            exit_status = contejner_instance_get_exit_status(instance);
+            add_event(manager, instance, "stopped",
+                      exit_status < 0 ? NULL : g_strdup_printf("%d", exit_status));
+            break;
+        default:
+            break;
+    }
+}
+
+GVariant *contejner_manager_get_events_since (ContejnerManager *manager,
+                                              guint64 seq)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    return events_since(priv, seq);
+}
+
+/* Record a running container in the journal, so that it can be taken over
+ * after a restart. Containers with a terminal can not be taken over, their
+ * terminal goes away with the service. */
+static void journal_instance(ContejnerManagerPrivate *priv,
+                             ContejnerInstance *instance)
+{
+    GVariant *state;
+    GVariantDict dict;
+    guint node;
+
+    if (!priv->journal || contejner_instance_get_terminal(instance)) {
+        return;
+    }
+
+    /* The placement is kept with the state, so that the load of the node
+     * is known again after a restart */
+    state = g_variant_ref_sink(contejner_instance_save_state(instance));
+    g_variant_dict_init(&dict, state);
+    g_variant_unref(state);
+    node = GPOINTER_TO_UINT(g_hash_table_lookup(priv->placed, instance));
+    if (node) {
+        g_variant_dict_insert(&dict, "PlacedNode", "i",
+                              g_array_index(priv->numa_nodes, struct numa_node,
+                                            node - 1).id);
+    }
+    state = g_variant_ref_sink(g_variant_dict_end(&dict));
+    contejner_journal_put(priv->journal, contejner_instance_get_id(instance),
+                          state);
+    g_variant_unref(state);
+}
+
+static void sample_instances(ContejnerTimer *timer, gpointer user_data);
+
+/* Sampling goes on while any container is running */
+static void schedule_sampling(ContejnerManager *manager)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    ContejnerTimerWheel *wheel = contejner_timer_wheel_get_default();
+
+    if (wheel && g_hash_table_size(priv->running) &&
+        !contejner_timer_is_armed(&priv->sample_timer)) {
+        contejner_timer_arm(wheel, &priv->sample_timer, SAMPLE_INTERVAL_MS,
+                            sample_instances, manager);
+    }
+}
+
+static void sample_instances(ContejnerTimer *timer, gpointer user_data)
+{
+    ContejnerManager *manager = user_data;
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    gint64 now = g_get_real_time();
+    GHashTableIter iter;
+    gpointer instance;
+
+    g_hash_table_iter_init(&iter, priv->running);
+    while (g_hash_table_iter_next(&iter, &instance, NULL)) {
+        contejner_instance_sample(CONTEJNER_INSTANCE(instance), now);
+    }
+
+    schedule_sampling(manager);
+}
+
+/* Board records use the values of ContejnerInstanceStatus */
+G_STATIC_ASSERT((int) CONTEJNER_BOARD_STATUS_RUNNING == (int) CONTEJNER_INSTANCE_STATUS_RUNNING);
+G_STATIC_ASSERT((int) CONTEJNER_BOARD_STATUS_STOPPED == (int) CONTEJNER_INSTANCE_STATUS_STOPPED);
+G_STATIC_ASSERT((int) CONTEJNER_BOARD_STATUS_CREATED == (int) CONTEJNER_INSTANCE_STATUS_CREATED);
+G_STATIC_ASSERT((int) CONTEJNER_BOARD_STATUS_QUEUED == (int) CONTEJNER_INSTANCE_STATUS_QUEUED);
+G_STATIC_ASSERT((int) CONTEJNER_BOARD_STATUS_FROZEN == (int) CONTEJNER_INSTANCE_STATUS_FROZEN);
+
+/* Bring the record of a container on the status board up to date */
+static void publish_status(ContejnerManagerPrivate *priv,
+                           ContejnerInstance *instance)
+{
+    gint slot = GPOINTER_TO_INT(g_hash_table_lookup(priv->board_slots,
+                                                    instance)) - 1;
+    struct contejner_board_record *record;
+    ContejnerInstanceStatus status;
+
+    if (slot < 0) {
+        return;
+    }
+
+    g_object_get(instance, "status", &status, NULL);
+    record = contejner_board_begin(priv->board, slot);
+
+    /* A thawed container goes on with the same run */
+    if (status == CONTEJNER_INSTANCE_STATUS_RUNNING &&
+        record->status != CONTEJNER_BOARD_STATUS_RUNNING &&
+        record->status != CONTEJNER_BOARD_STATUS_FROZEN) {
+        record->runs++;
+        record->start_time = g_get_real_time();
+        record->stop_time = 0;
+    } else if (status == CONTEJNER_INSTANCE_STATUS_STOPPED &&
+               record->status != CONTEJNER_BOARD_STATUS_STOPPED) {
+        record->stop_time = g_get_real_time();
+    }
+
+    record->status = status;
+    record->pid = contejner_instance_get_pid(instance);
+    record->exit_status = contejner_instance_get_exit_status(instance);
+    record->flags =
+        (contejner_instance_was_oom_killed(instance) ? CONTEJNER_BOARD_OOM_KILLED : 0) |
+        (contejner_instance_get_timed_out(instance) ? CONTEJNER_BOARD_TIMED_OUT : 0);
+    record->oom_kills =
+        contejner_instance_get_cgroup_event_count(instance,
+                                                  CONTEJNER_CGROUP_EVENT_OOM_KILL);
+    record->memory_high_events =
+        contejner_instance_get_cgroup_event_count(instance,
+                                                  CONTEJNER_CGROUP_EVENT_MEMORY_HIGH);
+    record->memory_max_events =
+        contejner_instance_get_cgroup_event_count(instance,
+                                                  CONTEJNER_CGROUP_EVENT_MEMORY_MAX);
+
+    contejner_board_commit(priv->board, slot);
+}
+
+int contejner_manager_open_status_board (ContejnerManager *manager)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    return priv->board ? contejner_board_open(priv->board) : -1;
+}
+
+/* The detail is the number of times the event happened in the run. The
+ * cgroup being drained is told by the stopped event. */
+static void instance_cgroup_event(ContejnerInstance *instance,
+                                  ContejnerCgroupEvent event,
+                                  guint64 count,
+                                  gpointer user_data)
+{
+    ContejnerManager *manager = user_data;
+
+    publish_status(CONTEJNER_MANAGER_GET_PRIVATE(manager), instance);
+    if (event != CONTEJNER_CGROUP_EVENT_DRAINED) {
+        add_event(manager, instance, contejner_cgroup_event_to_string(event),
+                  g_strdup_printf("%" G_GUINT64_FORMAT, count));
+    }
+}
+
+static void restarted_cb(ContejnerInstance *instance,
+                         enum contejner_error_code error,
+                         const char *message,
+                         gpointer user_data)
+{
+    if (error != CONTEJNER_OK) {
+        g_warning("Failed to restart container %d: %s",
+                  contejner_instance_get_id(instance), message);
+    }
+}
+
+static void restart_expired(ContejnerTimer *timer, gpointer user_data)
+{
+    struct restart *restart = user_data;
+    ContejnerManager *manager = restart->manager;
+    ContejnerInstance *instance = restart->instance;
+
+    g_hash_table_remove(CONTEJNER_MANAGER_GET_PRIVATE(manager)->restarts,
+                        instance);
+    g_debug("Restarting container %d", contejner_instance_get_id(instance));
+    contejner_manager_run(manager, instance, NULL, restarted_cb, NULL);
+}
+
+/* Run a stopped container again later, if its restart policy says so. The
+ * detail of the restarting event is the delay in milliseconds. */
+static void schedule_restart(ContejnerManager *manager,
+                             ContejnerInstance *instance)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    ContejnerTimerWheel *wheel = contejner_timer_wheel_get_default();
+    gint64 delay = contejner_instance_get_restart_delay(instance);
+    struct restart *restart;
+
+    if (delay < 0 || !wheel) {
+        return;
+    }
+
+    restart = g_new0(struct restart, 1);
+    restart->manager = manager;
+    restart->instance = instance;
+    g_hash_table_replace(priv->restarts, instance, restart);
+    contejner_timer_arm(wheel, &restart->timer, delay,
+                        restart_expired, restart);
+    add_event(manager, instance, "restarting",
+              g_strdup_printf("%" G_GINT64_FORMAT, delay));
+}
+
+static void instance_status_changed(GObject *instance,
+                                    GParamSpec *property,
+                                    gpointer user_data)
+{
+    ContejnerManager *manager = user_data;
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    ContejnerInstanceStatus status;
+
+    g_object_get(instance, "status", &status, NULL);
+    status_event(manager, CONTEJNER_INSTANCE(instance), status);
+    publish_status(priv, CONTEJNER_INSTANCE(instance));
+
+    if (status == CONTEJNER_INSTANCE_STATUS_RUNNING) {
+        journal_instance(priv, CONTEJNER_INSTANCE(instance));
+        schedule_sampling(manager);
+    } else if (status == CONTEJNER_INSTANCE_STATUS_STOPPED && priv->journal) {
+        contejner_journal_remove(priv->journal,
+                                 contejner_instance_get_id(CONTEJNER_INSTANCE(instance)));
+    }
+
+    if (status == CONTEJNER_INSTANCE_STATUS_STOPPED &&
+        g_hash_table_remove(priv->running, instance)) {
+        schedule_admit(manager);
+    }
+
+    if (status == CONTEJNER_INSTANCE_STATUS_STOPPED) {
+        schedule_restart(manager, CONTEJNER_INSTANCE(instance));
+    } else {
+        /* Run some other way meanwhile */
+        g_hash_table_remove(priv->restarts, instance);
+    }
+}
+
+void contejner_manager_run (ContejnerManager *manager,
+                            ContejnerInstance *instance,
+                            const char *owner,
+                            ContejnerInstanceRunCallback cb,
+                            gpointer user_data)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    struct owner_queue *queue;
+    struct queued_run *run;
+    ContejnerInstanceStatus status;
+
+    g_object_get(instance, "status", &status, NULL);
+    if (contejner_instance_is_active(instance) ||
+        status == CONTEJNER_INSTANCE_STATUS_QUEUED) {
+        cb(instance, CONTEJNER_ERR_FAILED_TO_START,
+           "Container already running", user_data);
+        return;
+    }
+
+    /* Queued containers go first, so that a new submission can not
+     * overtake them */
+    if (!priv->queued && has_capacity(priv)) {
+        start_instance(manager, instance, cb, user_data);
+        return;
+    }
+
+    queue = g_hash_table_lookup(priv->owner_queues, owner ? owner : "");
+    if (!queue) {
+        queue = g_new0(struct owner_queue, 1);
+        queue->owner = g_strdup(owner ? owner : "");
+        g_queue_init(&queue->runs);
+        g_hash_table_insert(priv->owner_queues, queue->owner, queue);
+        g_queue_push_tail(&priv->owners, queue);
+    }
+
+    run = g_new0(struct queued_run, 1);
+    run->instance = g_object_ref(instance);
+    run->queued_at = g_get_monotonic_time();
+    g_queue_push_tail(&queue->runs, run);
+    priv->queued++;
+
+    g_debug("Container queued, %u waiting", priv->queued);
+    contejner_instance_set_queued(instance);
+    schedule_admit(manager);
+
+    cb(instance, CONTEJNER_OK, "Queued", user_data);
+}
+
+gboolean contejner_manager_dequeue (ContejnerManager *manager,
+                                    ContejnerInstance *instance)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    GList *l, *r;
+
+    for (l = priv->owners.head; l; l = l->next) {
+        struct owner_queue *queue = l->data;
+
+        for (r = queue->runs.head; r; r = r->next) {
+            struct queued_run *run = r->data;
+            if (run->instance != instance) {
+                continue;
+            }
+
+            g_queue_delete_link(&queue->runs, r);
+            if (g_queue_is_empty(&queue->runs)) {
+                g_queue_delete_link(&priv->owners, l);
+                g_hash_table_remove(priv->owner_queues, queue->owner);
+            }
+            priv->queued--;
+
+            g_debug("Container dequeued, %u waiting", priv->queued);
+            contejner_instance_set_dequeued(instance);
+            g_object_unref(run->instance);
+            g_free(run);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+void contejner_manager_rerun (ContejnerManager *manager,
+                              ContejnerInstance *instance,
+                              const char *owner,
+                              ContejnerInstanceRunCallback cb,
+                              gpointer user_data)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    ContejnerInstanceStatus status;
+
+    g_object_get(instance, "status", &status, NULL);
+    if (status != CONTEJNER_INSTANCE_STATUS_STOPPED) {
+        cb(instance, CONTEJNER_ERR_FAILED_TO_START,
+           "Container has not stopped", user_data);
+        return;
+    }
+
+    g_hash_table_remove(priv->restarts, instance);
+    contejner_instance_reset_restarts(instance);
+    contejner_manager_run(manager, instance, owner, cb, user_data);
+}
+
+/* Add the labels of a container to the label index, or remove them */
+static void index_labels (ContejnerManagerPrivate *priv,
+                          ContejnerInstance *instance,
+                          gboolean add)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init(&iter, contejner_instance_get_labels(instance));
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        GHashTable *values = g_hash_table_lookup(priv->label_index, key);
+        GHashTable *set = values ? g_hash_table_lookup(values, value) : NULL;
+
+        if (add) {
+            if (!values) {
+                values = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                               (GDestroyNotify) g_hash_table_unref);
+                g_hash_table_insert(priv->label_index, g_strdup(key), values);
+            }
+            if (!set) {
+                set = g_hash_table_new(NULL, NULL);
+                g_hash_table_insert(values, g_strdup(value), set);
+            }
+            g_hash_table_add(set, instance);
+        } else if (set) {
+            g_hash_table_remove(set, instance);
+            if (!g_hash_table_size(set)) {
+                g_hash_table_remove(values, value);
+            }
+            if (!g_hash_table_size(values)) {
+                g_hash_table_remove(priv->label_index, key);
+            }
+        }
+    }
+}
+
+static void add_instance (ContejnerManager *manager,
+                          ContejnerInstance *container)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+
+    index_labels(priv, container, TRUE);
+    priv->container_list = g_slist_prepend(priv->container_list, container);
+    if (priv->board) {
+        gint slot = contejner_board_add(priv->board,
+                                        contejner_instance_get_id(container));
+        if (slot >= 0) {
+            g_hash_table_insert(priv->board_slots, container,
+                                GINT_TO_POINTER(slot + 1));
+            publish_status(priv, container);
+        }
+    }
+    g_signal_connect(container,
+                     "notify::status",
+                     G_CALLBACK(instance_status_changed),
+                     manager);
+    g_signal_connect(container,
+                     "cgroup-event",
+                     G_CALLBACK(instance_cgroup_event),
+                     manager);
+}
+
+static ContejnerInstance *new_instance (ContejnerManager *manager)
 {
     ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
     ContejnerInstance *container;
     int id = priv->next_container_id++;
 
-    container = contejner_instance_new(id);
+    container = contejner_instance_new(id, priv->output_dir);
     GValue v = G_VALUE_INIT;
     g_value_init(&v, G_TYPE_STRING);
     g_object_get_property(G_OBJECT(container), "name", &v);
@@ -90,7 +1004,319 @@ void contejner_manager_create (ContejnerManager *manager,
         g_error ("Failed to allocate memory for container");
     }
 
-    priv->container_list = g_slist_append(priv->container_list, container);
+    add_instance(manager, container);
+    add_event(manager, container, "created", NULL);
+    return container;
+}
+
+static void restore_instance (gint32 id, GVariant *state, gpointer user_data)
+{
+    ContejnerManager *manager = user_data;
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    ContejnerInstance *container;
+    gint32 node_id;
+
+    priv->next_container_id = MAX(priv->next_container_id, id + 1);
+
+    container = contejner_instance_restore(id, state);
+    if (!container) {
+        contejner_journal_remove(priv->journal, id);
+        return;
+    }
+
+    g_debug("Container %d restored", id);
+    if (g_variant_lookup(state, "PlacedNode", "i", &node_id)) {
+        reclaim_node(manager, container, node_id);
+    }
+    add_instance(manager, container);
+    add_event(manager, container, "adopted", NULL);
+    g_hash_table_add(priv->running, container);
+    schedule_sampling(manager);
+}
+
+void contejner_manager_restore (ContejnerManager *manager)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    gchar *path;
+    gint64 start = g_get_monotonic_time();
+
+    if (g_mkdir_with_parents(priv->output_dir, S_IRWXU)) {
+        g_warning("Failed to create output directory %s", priv->output_dir);
+        return;
+    }
+
+    path = g_build_filename(priv->output_dir, "journal", NULL);
+    priv->journal = contejner_journal_open(path, restore_instance, manager);
+    if (!priv->journal) {
+        g_warning("Failed to open state journal %s", path);
+    } else {
+        g_debug("Restored %u containers in %" G_GINT64_FORMAT " us",
+                g_hash_table_size(priv->running),
+                g_get_monotonic_time() - start);
+    }
+
+    g_free(path);
+}
+
+GSList *contejner_manager_get_instances (ContejnerManager *manager)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    return priv->container_list;
+}
+
+void contejner_manager_create (ContejnerManager *manager,
+                               ContejnerManagerCreateCallback cb,
+                               gpointer user_data)
+{
+    cb (new_instance(manager), user_data);
+}
+
+const char *contejner_manager_create_template (ContejnerManager *manager,
+                                               GVariant *config,
+                                               GError **error)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    ContejnerInstance *prototype;
+    gchar *name;
+
+    prototype = contejner_instance_new(-1, NULL);
+    if (!contejner_instance_configure(prototype, config, error)) {
+        g_object_unref(prototype);
+        return NULL;
+    }
+
+    name = g_strdup_printf("Template%d", priv->next_template_id++);
+    g_hash_table_insert(priv->templates, name, prototype);
+    g_debug("Template created: %s", name);
+
+    return name;
+}
+
+gboolean contejner_manager_create_from_template (ContejnerManager *manager,
+                                                 const char *template_name,
+                                                 GVariant *overrides,
+                                                 ContejnerManagerCreateCallback cb,
+                                                 gpointer user_data,
+                                                 GError **error)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    ContejnerInstance *prototype;
+    ContejnerInstance *scratch = NULL;
+    ContejnerInstance *container;
+
+    prototype = g_hash_table_lookup(priv->templates, template_name);
+    if (!prototype) {
+        g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                    "No such template: %s", template_name);
+        return FALSE;
+    }
+
+    /* Only the overrides are validated, on a scratch copy so that nothing
+     * is created if they are invalid */
+    if (overrides && g_variant_n_children(overrides)) {
+        scratch = contejner_instance_new(-1, NULL);
+        contejner_instance_copy_config(scratch, prototype);
+        if (!contejner_instance_configure(scratch, overrides, error)) {
+            g_object_unref(scratch);
+            return FALSE;
+        }
+        prototype = scratch;
+    }
+
+    container = new_instance(manager);
+    contejner_instance_copy_config(container, prototype);
+    index_labels(priv, container, TRUE);
+    if (scratch) {
+        g_object_unref(scratch);
+    }
 
     cb (container, user_data);
+    return TRUE;
+}
+
+void contejner_manager_set_labels (ContejnerManager *manager,
+                                   ContejnerInstance *instance,
+                                   GVariant *labels)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+
+    index_labels(priv, instance, FALSE);
+    contejner_instance_set_labels(instance, labels);
+    index_labels(priv, instance, TRUE);
+
+    if (contejner_instance_is_active(instance)) {
+        journal_instance(priv, instance);
+    }
+}
+
+/* One comma separated term of a selector */
+struct selector_term {
+    gchar *key;
+    gchar *value;       /* NULL when only the presence of the key counts */
+    gboolean negate;
+};
+
+static void selector_term_free (gpointer data)
+{
+    struct selector_term *term = data;
+    g_free(term->key);
+    g_free(term->value);
+    g_free(term);
+}
+
+/* Parse "key=value", "key==value", "key!=value", "key" and "!key" terms */
+static GPtrArray *parse_selector (const char *selector, GError **error)
+{
+    GPtrArray *terms = g_ptr_array_new_with_free_func(selector_term_free);
+    gchar **parts = g_strsplit(selector, ",", -1);
+    int i;
+
+    for (i = 0; parts[i]; i++) {
+        struct selector_term *term;
+        gchar *part = g_strstrip(parts[i]);
+        gchar *op;
+
+        if (!*part && !parts[1]) {
+            break;      /* The empty selector matches everything */
+        }
+
+        term = g_new0(struct selector_term, 1);
+        g_ptr_array_add(terms, term);
+
+        if ((op = strstr(part, "!="))) {
+            term->negate = TRUE;
+            term->value = g_strdup(g_strstrip(op + 2));
+        } else if ((op = strstr(part, "=="))) {
+            term->value = g_strdup(g_strstrip(op + 2));
+        } else if ((op = strchr(part, '='))) {
+            term->value = g_strdup(g_strstrip(op + 1));
+        } else if (*part == '!') {
+            term->negate = TRUE;
+            part++;
+        }
+        if (op) {
+            *op = '\0';
+        }
+        term->key = g_strdup(g_strstrip(part));
+
+        if (!*term->key) {
+            g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                        "Invalid selector term: %s", parts[i]);
+            g_ptr_array_unref(terms);
+            terms = NULL;
+            break;
+        }
+    }
+
+    g_strfreev(parts);
+    return terms;
+}
+
+static gboolean selector_matches (GPtrArray *terms, ContejnerInstance *instance)
+{
+    GHashTable *labels = contejner_instance_get_labels(instance);
+    guint i;
+
+    for (i = 0; i < terms->len; i++) {
+        struct selector_term *term = g_ptr_array_index(terms, i);
+        const gchar *value = g_hash_table_lookup(labels, term->key);
+        gboolean match = term->value ? !g_strcmp0(value, term->value)
+                                     : value != NULL;
+        if (match == term->negate) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+GList *contejner_manager_select (ContejnerManager *manager,
+                                 const char *selector,
+                                 GError **error)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    GHashTable *smallest = NULL;
+    GList *matches = NULL;
+    GPtrArray *terms;
+    guint i;
+
+    terms = parse_selector(selector, error);
+    if (!terms) {
+        return NULL;
+    }
+
+    /* Only the containers of the smallest key=value term in the index are
+     * checked against the rest of the selector */
+    for (i = 0; i < terms->len; i++) {
+        struct selector_term *term = g_ptr_array_index(terms, i);
+        GHashTable *values, *set;
+
+        if (term->negate || !term->value) {
+            continue;
+        }
+
+        values = g_hash_table_lookup(priv->label_index, term->key);
+        set = values ? g_hash_table_lookup(values, term->value) : NULL;
+        if (!set) {
+            g_ptr_array_unref(terms);
+            return NULL;
+        }
+        if (!smallest || g_hash_table_size(set) < g_hash_table_size(smallest)) {
+            smallest = set;
+        }
+    }
+
+    if (smallest) {
+        GHashTableIter iter;
+        gpointer instance;
+
+        g_hash_table_iter_init(&iter, smallest);
+        while (g_hash_table_iter_next(&iter, &instance, NULL)) {
+            if (selector_matches(terms, instance)) {
+                matches = g_list_prepend(matches, instance);
+            }
+        }
+    } else {
+        GSList *l;
+
+        for (l = priv->container_list; l; l = l->next) {
+            if (selector_matches(terms, l->data)) {
+                matches = g_list_prepend(matches, l->data);
+            }
+        }
+    }
+
+    g_ptr_array_unref(terms);
+    return matches;
+}
+
+gboolean contejner_manager_destroy (ContejnerManager *manager,
+                                    ContejnerInstance *instance)
+{
+    ContejnerManagerPrivate *priv = CONTEJNER_MANAGER_GET_PRIVATE(manager);
+    ContejnerInstanceStatus status;
+    gint slot;
+
+    if (contejner_instance_is_active(instance)) {
+        return FALSE;
+    }
+
+    g_object_get(instance, "status", &status, NULL);
+    if (status == CONTEJNER_INSTANCE_STATUS_QUEUED) {
+        contejner_manager_dequeue(manager, instance);
+    }
+
+    g_debug("Destroying container %d", contejner_instance_get_id(instance));
+    add_event(manager, instance, "destroyed", NULL);
+
+    index_labels(priv, instance, FALSE);
+    priv->container_list = g_slist_remove(priv->container_list, instance);
+    g_hash_table_remove(priv->restarts, instance);
+    slot = GPOINTER_TO_INT(g_hash_table_lookup(priv->board_slots, instance));
+    if (slot) {
+        contejner_board_remove(priv->board, slot - 1);
+        g_hash_table_remove(priv->board_slots, instance);
+    }
+    g_signal_handlers_disconnect_by_data(instance, manager);
+    g_object_unref(instance);
+    return TRUE;
 }
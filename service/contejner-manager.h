@@ -37,12 +37,117 @@ G_DECLARE_FINAL_TYPE(ContejnerManager,
 typedef void (*ContejnerManagerCreateCallback)(ContejnerInstance *c,
                                               gpointer user_data);
 
+typedef enum {
+    CONTEJNER_MANAGER_PLACEMENT_NONE,
+    CONTEJNER_MANAGER_PLACEMENT_SPREAD,
+} ContejnerManagerPlacement;
+
 
 /**
  * Create a new ContainerManager
  */
 ContejnerManager *contejner_manager_new (void);
 
+/**
+ * Set the directory under which container output logs are stored
+ */
+void contejner_manager_set_output_dir (ContejnerManager *manager,
+                                       const char *output_dir);
+
+/**
+ * Set how containers without an explicit CpuSet or MemNodes are placed on
+ * the NUMA nodes of the host
+ */
+void contejner_manager_set_placement (ContejnerManager *manager,
+                                      ContejnerManagerPlacement placement);
+
+/**
+ * Parse a placement policy name ("none" or "spread")
+ */
+gboolean contejner_manager_placement_from_string (const char *str,
+                                                  ContejnerManagerPlacement *placement);
+
+/**
+ * Open the state journal in the output directory and take over the
+ * containers still running from an earlier run of the service. From then
+ * on, running containers are recorded in the journal.
+ */
+void contejner_manager_restore (ContejnerManager *manager);
+
+/**
+ * The containers of the manager, newest first. Owned by the manager.
+ */
+GSList *contejner_manager_get_instances (ContejnerManager *manager);
+
+/**
+ * Replace the labels of a container, given as an a{ss} dictionary
+ */
+void contejner_manager_set_labels (ContejnerManager *manager,
+                                   ContejnerInstance *instance,
+                                   GVariant *labels);
+
+/**
+ * Find the containers matching a label selector, a comma separated list of
+ * "key=value", "key!=value", "key" (has the label) and "!key" terms that
+ * must all hold. The empty selector matches every container. Returns a
+ * list of containers owned by the manager, or NULL with @error set for an
+ * invalid selector.
+ */
+GList *contejner_manager_select (ContejnerManager *manager,
+                                 const char *selector,
+                                 GError **error);
+
+/**
+ * Take a queued container off the run queue, which leaves it STOPPED.
+ * Returns FALSE if the container is not queued.
+ */
+gboolean contejner_manager_dequeue (ContejnerManager *manager,
+                                    ContejnerInstance *instance);
+
+/**
+ * Remove a container from the manager and free it. Queued containers are
+ * taken off the run queue first. Running containers are not destroyed, and
+ * FALSE is returned for them.
+ */
+gboolean contejner_manager_destroy (ContejnerManager *manager,
+                                    ContejnerInstance *instance);
+
+/**
+ * The lifecycle events after sequence number @seq, as an a(tsss) array of
+ * sequence number, container, event and detail. Only the most recent events
+ * are kept, a gap between @seq and the first event returned means events
+ * were missed. New events are also sent in batches by the "events" signal.
+ */
+GVariant *contejner_manager_get_events_since (ContejnerManager *manager,
+                                              guint64 seq);
+
+/**
+ * A new read only descriptor of the status board, owned by the caller, or -1
+ * if the service has none. The board holds a record of every container, see
+ * contejner-status-board.h.
+ */
+int contejner_manager_open_status_board (ContejnerManager *manager);
+
+/**
+ * Create a template from a configuration dictionary (see
+ * contejner_instance_configure). The configuration is validated once, here.
+ * Returns the name of the template, or NULL on error.
+ */
+const char *contejner_manager_create_template (ContejnerManager *manager,
+                                               GVariant *config,
+                                               GError **error);
+
+/**
+ * Create a new ContejnerInstance with the configuration of a template, with
+ * the entries of @overrides applied on top
+ */
+gboolean contejner_manager_create_from_template (ContejnerManager *manager,
+                                                 const char *template_name,
+                                                 GVariant *overrides,
+                                                 ContejnerManagerCreateCallback cb,
+                                                 gpointer user_data,
+                                                 GError **error);
+
 /**
  * Create a new ContejnerInstance using the ContejnerManager
  */
@@ -50,6 +155,55 @@ void contejner_manager_create (ContejnerManager *manager,
                               ContejnerManagerCreateCallback cb,
                               gpointer user_data);
 
+/**
+ * Set the maximum number of containers running at the same time. Containers
+ * run beyond this are queued. 0 means no limit.
+ */
+void contejner_manager_set_max_running (ContejnerManager *manager,
+                                        guint max_running);
+
+guint contejner_manager_get_max_running (ContejnerManager *manager);
+
+/**
+ * Statistics of the run queue. Wait times are in microseconds and cover all
+ * containers started from the queue.
+ */
+struct contejner_manager_queue_stats {
+    guint running;
+    guint queued;
+    guint64 admitted;
+    guint64 wait_mean;
+    guint64 wait_max;
+    guint64 wait_oldest;
+};
+
+void contejner_manager_get_queue_stats (ContejnerManager *manager,
+                                        struct contejner_manager_queue_stats *stats);
+
+/**
+ * Run a ContejnerInstance, applying the placement policy of the manager.
+ * When the maximum number of containers are already running, the instance
+ * is queued and cb is called right away. Queued instances are started in
+ * round-robin order between owners (D-Bus senders).
+ */
+void contejner_manager_run (ContejnerManager *manager,
+                            ContejnerInstance *instance,
+                            const char *owner,
+                            ContejnerInstanceRunCallback cb,
+                            gpointer user_data);
+
+/**
+ * Run a stopped ContejnerInstance again, with its configuration and output
+ * log, like contejner_manager_run(). A pending automatic restart is
+ * replaced, and the restart delay starts over. Fails for containers that
+ * have not run and stopped.
+ */
+void contejner_manager_rerun (ContejnerManager *manager,
+                              ContejnerInstance *instance,
+                              const char *owner,
+                              ContejnerInstanceRunCallback cb,
+                              gpointer user_data);
+
 G_END_DECLS
 
 #endif /* DBUS_SERVICE_INTERFACE_H */
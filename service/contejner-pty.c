@@ -0,0 +1,362 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <glib-unix.h>
+
+#include "contejner-pty.h"
+
+#define PTY_NAME_SZ 64
+#define RELAY_BUF_SZ 64 * 1024
+
+struct _ContejnerPty {
+    int master;
+    int slave;
+    guint master_watch;
+    gboolean started;
+    gboolean hung_up;
+    GSList *clients;
+    ContejnerPtyOutputFunc output_func;
+    gpointer user_data;
+};
+
+struct pty_client {
+    ContejnerPty *pty;
+    int fd;
+    guint in_watch;
+    guint out_watch;
+    GByteArray *pending;
+};
+
+static gboolean master_readable (gint fd,
+                                 GIOCondition condition,
+                                 gpointer user_data);
+
+static void watch_master (ContejnerPty *pty)
+{
+    if (pty->master_watch || !pty->started || pty->hung_up) {
+        return;
+    }
+
+    pty->master_watch = g_unix_fd_add(pty->master,
+                                      G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                      master_readable,
+                                      pty);
+}
+
+static gboolean clients_blocked (const ContejnerPty *pty)
+{
+    GSList *l;
+    for (l = pty->clients; l != NULL; l = l->next) {
+        struct pty_client *client = l->data;
+        if (client->pending->len > 0) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void client_detach (struct pty_client *client)
+{
+    ContejnerPty *pty = client->pty;
+
+    if (client->in_watch) {
+        g_source_remove(client->in_watch);
+    }
+    if (client->out_watch) {
+        g_source_remove(client->out_watch);
+    }
+
+    close(client->fd);
+    g_byte_array_free(client->pending, TRUE);
+    pty->clients = g_slist_remove(pty->clients, client);
+    g_free(client);
+
+    /* A detached client can no longer hold back the terminal */
+    watch_master(pty);
+}
+
+static gboolean client_writable (gint fd,
+                                 GIOCondition condition,
+                                 gpointer user_data)
+{
+    struct pty_client *client = user_data;
+
+    ssize_t w = send(client->fd, client->pending->data, client->pending->len,
+                     MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (w == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return G_SOURCE_CONTINUE;
+    } else if (w == -1) {
+        g_debug("Terminal client went away: %s", strerror(errno));
+        client->out_watch = 0;
+        client_detach(client);
+        return G_SOURCE_REMOVE;
+    }
+
+    g_byte_array_remove_range(client->pending, 0, w);
+    if (client->pending->len > 0) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    client->out_watch = 0;
+    watch_master(client->pty);
+    return G_SOURCE_REMOVE;
+}
+
+/* Returns FALSE if the client had to be detached */
+static gboolean client_send (struct pty_client *client,
+                             const char *buf,
+                             gsize len)
+{
+    ssize_t w = 0;
+
+    if (client->pending->len == 0) {
+        w = send(client->fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (w == -1 && errno != EAGAIN && errno != EINTR) {
+            g_debug("Terminal client went away: %s", strerror(errno));
+            client_detach(client);
+            return FALSE;
+        }
+        w = MAX(w, 0);
+    }
+
+    if ((gsize) w < len) {
+        /* The client is slow; keep the rest and stop reading the terminal
+         * until it has caught up, so that the writer in the container is
+         * held back by the terminal instead of us buffering without limit */
+        g_byte_array_append(client->pending, (const guint8 *) buf + w, len - w);
+        if (!client->out_watch) {
+            client->out_watch = g_unix_fd_add(client->fd,
+                                              G_IO_OUT,
+                                              client_writable,
+                                              client);
+        }
+    }
+
+    return TRUE;
+}
+
+static void hang_up (ContejnerPty *pty)
+{
+    pty->hung_up = TRUE;
+
+    while (pty->clients) {
+        client_detach(pty->clients->data);
+    }
+}
+
+static gboolean master_readable (gint fd,
+                                 GIOCondition condition,
+                                 gpointer user_data)
+{
+    ContejnerPty *pty = user_data;
+    char buf[RELAY_BUF_SZ];
+
+    while (TRUE) {
+        ssize_t r = read(pty->master, buf, sizeof(buf));
+        if (r > 0) {
+            GSList *l = pty->clients;
+
+            if (pty->output_func) {
+                pty->output_func(buf, r, pty->user_data);
+            }
+
+            while (l != NULL) {
+                GSList *next = l->next;
+                client_send(l->data, buf, r);
+                l = next;
+            }
+
+            if (clients_blocked(pty)) {
+                pty->master_watch = 0;
+                return G_SOURCE_REMOVE;
+            }
+        } else if (r == -1 && errno == EINTR) {
+            continue;
+        } else if (r == -1 && errno == EAGAIN) {
+            return G_SOURCE_CONTINUE;
+        } else {
+            /* EOF or EIO: the last slave was closed, the container is gone */
+            pty->master_watch = 0;
+            hang_up(pty);
+            return G_SOURCE_REMOVE;
+        }
+    }
+}
+
+static gboolean client_readable (gint fd,
+                                 GIOCondition condition,
+                                 gpointer user_data)
+{
+    struct pty_client *client = user_data;
+    ContejnerPty *pty = client->pty;
+    char buf[RELAY_BUF_SZ];
+
+    ssize_t r = read(client->fd, buf, sizeof(buf));
+    if (r == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return G_SOURCE_CONTINUE;
+    } else if (r <= 0) {
+        client->in_watch = 0;
+        client_detach(client);
+        return G_SOURCE_REMOVE;
+    }
+
+    ssize_t off = 0;
+    while (off < r) {
+        ssize_t w = write(pty->master, buf + off, r - off);
+        if (w == -1 && errno == EINTR) {
+            continue;
+        } else if (w == -1) {
+            /* Like a real terminal, input is discarded when the input
+             * queue is full */
+            g_debug("Dropping %zd bytes of terminal input: %s",
+                    r - off, strerror(errno));
+            break;
+        }
+        off += w;
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+ContejnerPty *contejner_pty_new (void)
+{
+    char slave_name[PTY_NAME_SZ];
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master == -1) {
+        g_warning("Failed to allocate terminal: %s", strerror(errno));
+        return NULL;
+    }
+
+    if (grantpt(master) || unlockpt(master) ||
+        ptsname_r(master, slave_name, sizeof(slave_name))) {
+        g_warning("Failed to set up terminal: %s", strerror(errno));
+        close(master);
+        return NULL;
+    }
+
+    int slave = open(slave_name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slave == -1) {
+        g_warning("Failed to open %s: %s", slave_name, strerror(errno));
+        close(master);
+        return NULL;
+    }
+
+    int flags = fcntl(master, F_GETFL, 0);
+    fcntl(master, F_SETFL, flags | O_NONBLOCK);
+
+    ContejnerPty *pty = g_new0(ContejnerPty, 1);
+    pty->master = master;
+    pty->slave = slave;
+
+    return pty;
+}
+
+int contejner_pty_get_slave (const ContejnerPty *pty)
+{
+    return pty->slave;
+}
+
+void contejner_pty_close_slave (ContejnerPty *pty)
+{
+    if (pty->slave != -1) {
+        close(pty->slave);
+        pty->slave = -1;
+    }
+}
+
+void contejner_pty_start (ContejnerPty *pty,
+                          ContejnerPtyOutputFunc output_func,
+                          gpointer user_data)
+{
+    pty->output_func = output_func;
+    pty->user_data = user_data;
+    pty->started = TRUE;
+
+    watch_master(pty);
+}
+
+int contejner_pty_attach (ContejnerPty *pty)
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv)) {
+        g_warning("Failed to create terminal socket: %s", strerror(errno));
+        return -1;
+    }
+
+    if (pty->hung_up) {
+        /* Nothing left to relay, let the client see EOF right away */
+        close(sv[0]);
+        return sv[1];
+    }
+
+    int flags = fcntl(sv[0], F_GETFL, 0);
+    fcntl(sv[0], F_SETFL, flags | O_NONBLOCK);
+
+    struct pty_client *client = g_new0(struct pty_client, 1);
+    client->pty = pty;
+    client->fd = sv[0];
+    client->pending = g_byte_array_new();
+    client->in_watch = g_unix_fd_add(client->fd,
+                                     G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                     client_readable,
+                                     client);
+    pty->clients = g_slist_prepend(pty->clients, client);
+
+    return sv[1];
+}
+
+gboolean contejner_pty_resize (ContejnerPty *pty,
+                               guint16 rows,
+                               guint16 cols)
+{
+    struct winsize ws = { 0 };
+    ws.ws_row = rows;
+    ws.ws_col = cols;
+
+    /* The kernel delivers SIGWINCH to the foreground process group */
+    if (ioctl(pty->master, TIOCSWINSZ, &ws)) {
+        g_warning("Failed to resize terminal: %s", strerror(errno));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void contejner_pty_free (ContejnerPty *pty)
+{
+    if (pty->master_watch) {
+        g_source_remove(pty->master_watch);
+    }
+
+    hang_up(pty);
+    contejner_pty_close_slave(pty);
+    close(pty->master);
+    g_free(pty);
+}
@@ -0,0 +1,83 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CONTEJNER_PTY_H
+#define CONTEJNER_PTY_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ContejnerPty ContejnerPty;
+
+/* Called with every block of output read from the terminal */
+typedef void (*ContejnerPtyOutputFunc)(const char *buf,
+                                       gsize len,
+                                       gpointer user_data);
+
+/**
+ * contejner_pty_new:
+ *
+ * Allocate a new pseudo terminal pair. The slave side is kept open until
+ * contejner_pty_close_slave() is called, so that it can be inherited by the
+ * container process.
+ *
+ * Returns: a new #ContejnerPty, or NULL if no terminal could be allocated
+ */
+ContejnerPty *contejner_pty_new (void);
+
+int contejner_pty_get_slave (const ContejnerPty *pty);
+
+void contejner_pty_close_slave (ContejnerPty *pty);
+
+/**
+ * contejner_pty_start:
+ * @pty: a #ContejnerPty
+ * @output_func: called for every block read from the terminal
+ * @user_data: passed to @output_func
+ *
+ * Start relaying data between the terminal and attached clients. Output is
+ * read in bulk whenever the main loop reports the master as readable and is
+ * handed to @output_func as well as every attached client.
+ */
+void contejner_pty_start (ContejnerPty *pty,
+                          ContejnerPtyOutputFunc output_func,
+                          gpointer user_data);
+
+/**
+ * contejner_pty_attach:
+ * @pty: a #ContejnerPty
+ *
+ * Attach a new client to the terminal. The returned file descriptor is one
+ * end of a socket pair; data written to it is forwarded to the terminal and
+ * terminal output can be read from it. The caller owns the descriptor.
+ *
+ * Returns: a file descriptor, or -1 on failure
+ */
+int contejner_pty_attach (ContejnerPty *pty);
+
+gboolean contejner_pty_resize (ContejnerPty *pty,
+                               guint16 rows,
+                               guint16 cols);
+
+void contejner_pty_free (ContejnerPty *pty);
+
+G_END_DECLS
+
+#endif /* CONTEJNER_PTY_H */
@@ -0,0 +1,136 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "contejner-series.h"
+
+struct sample {
+    gint64 time;
+    ContejnerCgroupStats stats;
+};
+
+struct _ContejnerSeries {
+    struct sample *samples;
+    guint capacity;
+    guint len;
+    /* Where the next sample goes */
+    guint head;
+};
+
+static const struct {
+    const char *name;
+    gsize offset;
+} metrics[] = {
+    { "cpu", G_STRUCT_OFFSET(ContejnerCgroupStats, cpu_usec) },
+    { "memory", G_STRUCT_OFFSET(ContejnerCgroupStats, memory_bytes) },
+    { "io-read", G_STRUCT_OFFSET(ContejnerCgroupStats, io_read_bytes) },
+    { "io-write", G_STRUCT_OFFSET(ContejnerCgroupStats, io_write_bytes) },
+};
+
+ContejnerSeries *contejner_series_new (guint capacity)
+{
+    ContejnerSeries *series = g_new0(ContejnerSeries, 1);
+
+    series->capacity = MAX(capacity, 1);
+    series->samples = g_new0(struct sample, series->capacity);
+    return series;
+}
+
+void contejner_series_add (ContejnerSeries *series,
+                           gint64 time,
+                           const ContejnerCgroupStats *stats)
+{
+    struct sample *sample = &series->samples[series->head];
+
+    sample->time = time;
+    sample->stats = *stats;
+    series->head = (series->head + 1) % series->capacity;
+    series->len = MIN(series->len + 1, series->capacity);
+}
+
+static int find_metric (const char *metric)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(metrics); i++) {
+        if (!g_strcmp0(metric, metrics[i].name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+gboolean contejner_series_is_metric (const char *metric)
+{
+    return find_metric(metric) != -1;
+}
+
+GVariant *contejner_series_get (ContejnerSeries *series,
+                                const char *metric,
+                                gint64 since)
+{
+    int m = find_metric(metric);
+    gint64 *times;
+    guint64 *values;
+    guint n, i;
+    GVariant *result;
+
+    g_return_val_if_fail(m != -1, NULL);
+
+    /* The newest samples are the ones asked for, so the scan goes backwards
+     * and costs no more than the samples returned */
+    for (n = 0; n < series->len; n++) {
+        guint idx = (series->head + series->capacity - 1 - n) % series->capacity;
+        if (series->samples[idx].time <= since) {
+            break;
+        }
+    }
+
+    times = g_new(gint64, n);
+    values = g_new(guint64, n);
+    for (i = 0; i < n; i++) {
+        const struct sample *sample =
+            &series->samples[(series->head + series->capacity - n + i) %
+                             series->capacity];
+        times[i] = sample->time;
+        values[i] = G_STRUCT_MEMBER(guint64, &sample->stats, metrics[m].offset);
+    }
+
+    result = g_variant_new("(@ax@at)",
+                           g_variant_new_fixed_array(G_VARIANT_TYPE_INT64,
+                                                     times, n, sizeof(gint64)),
+                           g_variant_new_fixed_array(G_VARIANT_TYPE_UINT64,
+                                                     values, n, sizeof(guint64)));
+    g_free(times);
+    g_free(values);
+    return result;
+}
+
+void contejner_series_clear (ContejnerSeries *series)
+{
+    series->len = 0;
+    series->head = 0;
+}
+
+void contejner_series_free (ContejnerSeries *series)
+{
+    g_free(series->samples);
+    g_free(series);
+}
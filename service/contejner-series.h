@@ -0,0 +1,70 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CONTEJNER_SERIES_H
+#define CONTEJNER_SERIES_H
+
+#include <glib.h>
+
+#include "contejner-cgroup.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ContejnerSeries ContejnerSeries;
+
+/**
+ * contejner_series_new:
+ * @capacity: number of samples kept
+ *
+ * Create a ring buffer of resource usage samples, of fixed size records.
+ * Once it is full, every new sample replaces the oldest one.
+ *
+ * Returns: a new #ContejnerSeries
+ */
+ContejnerSeries *contejner_series_new (guint capacity);
+
+/* Add a sample taken at @time, in microseconds of wall clock time */
+void contejner_series_add (ContejnerSeries *series,
+                           gint64 time,
+                           const ContejnerCgroupStats *stats);
+
+/* Whether @metric is one of cpu (microseconds of CPU time), memory (bytes),
+ * io-read or io-write (bytes) */
+gboolean contejner_series_is_metric (const char *metric);
+
+/**
+ * contejner_series_get:
+ * @series: a #ContejnerSeries
+ * @metric: name of the metric, see contejner_series_is_metric()
+ * @since: only samples taken after this time are returned
+ *
+ * Returns: a floating (axat) tuple of the times of the samples and the
+ *          values of @metric, oldest first
+ */
+GVariant *contejner_series_get (ContejnerSeries *series,
+                                const char *metric,
+                                gint64 since);
+
+void contejner_series_clear (ContejnerSeries *series);
+
+void contejner_series_free (ContejnerSeries *series);
+
+G_END_DECLS
+
+#endif /* CONTEJNER_SERIES_H */
@@ -0,0 +1,309 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <glib-unix.h>
+
+#include "contejner-timer.h"
+
+/* Six wheels of 64 slots at 10 ms per tick cover 2^36 ticks, about 21
+ * years. Timers further away than that expire at the end of the range. */
+#define TICK_US (10 * 1000)
+#define SLOT_BITS 6
+#define SLOTS (1 << SLOT_BITS)
+#define LEVELS 6
+#define MAX_DELTA ((G_GUINT64_CONSTANT(1) << (SLOT_BITS * LEVELS)) - 1)
+
+/* A timer in wheel l expires in a slot of 64^l ticks. When the inner wheels
+ * wrap around, the timers of the next slot of wheel l move into the inner
+ * ones, down to wheel 0, whose slots are single ticks. Each slot is a
+ * circular list with a dummy timer as its head, and each wheel has a bitmap
+ * of its occupied slots, so that the next tick with anything to do is found
+ * without visiting the empty ones. */
+struct _ContejnerTimerWheel {
+    int fd;
+    guint watch;
+    gint64 origin;
+    guint64 now;
+    guint64 armed;
+    guint size;
+    guint64 occupied[LEVELS];
+    ContejnerTimer slots[LEVELS * SLOTS];
+};
+
+static guint64 current_tick (const ContejnerTimerWheel *wheel)
+{
+    return (g_get_monotonic_time() - wheel->origin) / TICK_US;
+}
+
+static void link_timer (ContejnerTimerWheel *wheel, ContejnerTimer *timer)
+{
+    guint64 delta = timer->expires - wheel->now;
+    ContejnerTimer *head;
+    guint level = 0;
+
+    if (delta > MAX_DELTA) {
+        timer->expires = wheel->now + MAX_DELTA;
+        delta = MAX_DELTA;
+    }
+    while (delta >> (SLOT_BITS * (level + 1))) {
+        level++;
+    }
+
+    timer->slot = level * SLOTS +
+                  ((timer->expires >> (SLOT_BITS * level)) & (SLOTS - 1));
+    head = &wheel->slots[timer->slot];
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+    wheel->occupied[level] |= G_GUINT64_CONSTANT(1) << (timer->slot % SLOTS);
+}
+
+static void unlink_timer (ContejnerTimerWheel *wheel, ContejnerTimer *timer)
+{
+    ContejnerTimer *head = &wheel->slots[timer->slot];
+
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+    if (head->next == head) {
+        wheel->occupied[timer->slot / SLOTS] &=
+            ~(G_GUINT64_CONSTANT(1) << (timer->slot % SLOTS));
+    }
+}
+
+/* The next tick after now at which a slot with timers is reached, or 0 if
+ * there are no timers */
+static guint64 next_event (const ContejnerTimerWheel *wheel)
+{
+    guint64 next = 0;
+    guint level;
+
+    for (level = 0; level < LEVELS; level++) {
+        guint shift = SLOT_BITS * level;
+        guint rotate = (((wheel->now >> shift) + 1) & (SLOTS - 1));
+        guint64 bits = wheel->occupied[level];
+        guint64 tick;
+
+        if (!bits) {
+            continue;
+        }
+        /* Slots after the current one, starting with bit 0 */
+        if (rotate) {
+            bits = (bits >> rotate) | (bits << (SLOTS - rotate));
+        }
+        tick = ((wheel->now >> shift) + __builtin_ctzll(bits) + 1) << shift;
+        if (!next || tick < next) {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+/* Set the timerfd for the next event, if it is not set for it already */
+static void schedule (ContejnerTimerWheel *wheel)
+{
+    struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+    guint64 next = next_event(wheel);
+    gint64 at;
+
+    if (next == wheel->armed) {
+        return;
+    }
+
+    if (next) {
+        at = wheel->origin + next * TICK_US;
+        spec.it_value.tv_sec = at / G_USEC_PER_SEC;
+        spec.it_value.tv_nsec = (at % G_USEC_PER_SEC) * 1000;
+    }
+    if (timerfd_settime(wheel->fd, TFD_TIMER_ABSTIME, &spec, NULL)) {
+        g_warning("Failed to set timer: %s", strerror(errno));
+        return;
+    }
+    wheel->armed = next;
+}
+
+/* Move the timers of a slot of an outer wheel into the inner ones */
+static void cascade (ContejnerTimerWheel *wheel, guint slot)
+{
+    ContejnerTimer *head = &wheel->slots[slot];
+    ContejnerTimer *timer = head->next;
+
+    head->next = head->prev = head;
+    wheel->occupied[slot / SLOTS] &= ~(G_GUINT64_CONSTANT(1) << (slot % SLOTS));
+
+    while (timer != head) {
+        ContejnerTimer *next = timer->next;
+        link_timer(wheel, timer);
+        timer = next;
+    }
+}
+
+static void process_tick (ContejnerTimerWheel *wheel)
+{
+    ContejnerTimer *head = &wheel->slots[wheel->now & (SLOTS - 1)];
+    guint level;
+
+    for (level = 1; level < LEVELS; level++) {
+        guint shift = SLOT_BITS * level;
+        if (wheel->now & ((G_GUINT64_CONSTANT(1) << shift) - 1)) {
+            break;
+        }
+        cascade(wheel, level * SLOTS + ((wheel->now >> shift) & (SLOTS - 1)));
+    }
+
+    /* Timers armed by the callbacks expire after this tick at the earliest,
+     * so they do not end up here */
+    while (head->next != head) {
+        ContejnerTimer *timer = head->next;
+
+        unlink_timer(wheel, timer);
+        wheel->size--;
+        timer->func(timer, timer->user_data);
+    }
+}
+
+static gboolean timer_expired (gint fd,
+                               GIOCondition condition,
+                               gpointer user_data)
+{
+    ContejnerTimerWheel *wheel = user_data;
+    guint64 target = current_tick(wheel);
+    guint64 expirations;
+    guint64 tick;
+
+    while (read(fd, &expirations, sizeof(expirations)) == -1 && errno == EINTR);
+    wheel->armed = 0;
+
+    /* Straight from one event to the next, the ticks in between have
+     * nothing to do */
+    while ((tick = next_event(wheel)) && tick <= target) {
+        wheel->now = tick;
+        process_tick(wheel);
+    }
+    if (target > wheel->now) {
+        wheel->now = target;
+    }
+
+    schedule(wheel);
+    return G_SOURCE_CONTINUE;
+}
+
+ContejnerTimerWheel *contejner_timer_wheel_new (void)
+{
+    ContejnerTimerWheel *wheel;
+    guint i;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        g_warning("Failed to create timerfd: %s", strerror(errno));
+        return NULL;
+    }
+
+    wheel = g_new0(ContejnerTimerWheel, 1);
+    wheel->fd = fd;
+    wheel->origin = g_get_monotonic_time();
+    for (i = 0; i < LEVELS * SLOTS; i++) {
+        wheel->slots[i].next = wheel->slots[i].prev = &wheel->slots[i];
+    }
+    wheel->watch = g_unix_fd_add(fd, G_IO_IN, timer_expired, wheel);
+
+    return wheel;
+}
+
+ContejnerTimerWheel *contejner_timer_wheel_get_default (void)
+{
+    static ContejnerTimerWheel *wheel;
+
+    if (!wheel) {
+        wheel = contejner_timer_wheel_new();
+    }
+    return wheel;
+}
+
+void contejner_timer_arm (ContejnerTimerWheel *wheel,
+                          ContejnerTimer *timer,
+                          guint64 delay_ms,
+                          ContejnerTimerFunc func,
+                          gpointer user_data)
+{
+    contejner_timer_cancel(timer);
+
+    /* The wheel catches up with the clock when the timerfd fires, until then
+     * it may lag behind. An empty wheel can simply skip ahead. Timers expire
+     * on the first tick after their delay, and never before the next
+     * tick. */
+    if (!wheel->size) {
+        wheel->now = MAX(wheel->now, current_tick(wheel));
+    }
+    timer->wheel = wheel;
+    timer->expires = (g_get_monotonic_time() - wheel->origin +
+                      delay_ms * 1000 + TICK_US - 1) / TICK_US;
+    timer->expires = MAX(timer->expires, wheel->now + 1);
+    timer->func = func;
+    timer->user_data = user_data;
+    link_timer(wheel, timer);
+    wheel->size++;
+
+    if (!wheel->armed || timer->expires < wheel->armed) {
+        schedule(wheel);
+    }
+}
+
+void contejner_timer_cancel (ContejnerTimer *timer)
+{
+    /* The timerfd may still fire for it, and then finds nothing to do */
+    if (timer->next) {
+        unlink_timer(timer->wheel, timer);
+        timer->wheel->size--;
+    }
+}
+
+gboolean contejner_timer_is_armed (const ContejnerTimer *timer)
+{
+    return timer->next != NULL;
+}
+
+guint contejner_timer_wheel_get_size (const ContejnerTimerWheel *wheel)
+{
+    return wheel->size;
+}
+
+void contejner_timer_wheel_free (ContejnerTimerWheel *wheel)
+{
+    guint i;
+
+    /* Armed timers are left disarmed, since their owners may outlive the
+     * wheel */
+    for (i = 0; i < LEVELS * SLOTS; i++) {
+        while (wheel->slots[i].next != &wheel->slots[i]) {
+            unlink_timer(wheel, wheel->slots[i].next);
+        }
+    }
+    g_source_remove(wheel->watch);
+    close(wheel->fd);
+    g_free(wheel);
+}
@@ -0,0 +1,88 @@
+/*
+ * Contejner - a d-bus interface to cgroups and namespaces
+ * Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef CONTEJNER_TIMER_H
+#define CONTEJNER_TIMER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _ContejnerTimerWheel ContejnerTimerWheel;
+typedef struct _ContejnerTimer ContejnerTimer;
+
+typedef void (*ContejnerTimerFunc)(ContejnerTimer *timer,
+                                   gpointer user_data);
+
+/* A timer is embedded in its owner and must be zeroed before first use.
+ * Arming and cancelling it never allocate. The fields are private. */
+struct _ContejnerTimer {
+    ContejnerTimer *next;
+    ContejnerTimer *prev;
+    ContejnerTimerWheel *wheel;
+    guint64 expires;
+    guint slot;
+    ContejnerTimerFunc func;
+    gpointer user_data;
+};
+
+/**
+ * contejner_timer_wheel_new:
+ *
+ * Create a hierarchical timer wheel, driven from the main loop by a single
+ * timerfd. Timers have a resolution of 10 ms and are armed and cancelled in
+ * constant time, however many there are. The timerfd is only set for the
+ * next timer to expire, or for the next time timers of an outer wheel move
+ * inwards, so a wheel with only distant timers rarely wakes up. Timers due
+ * in the same tick fire in the order they were armed.
+ *
+ * Returns: a new #ContejnerTimerWheel, or NULL if no timerfd could be created
+ */
+ContejnerTimerWheel *contejner_timer_wheel_new (void);
+
+/* The wheel shared by all containers of the service, created on first use */
+ContejnerTimerWheel *contejner_timer_wheel_get_default (void);
+
+/**
+ * contejner_timer_arm:
+ * @wheel: a #ContejnerTimerWheel
+ * @timer: a #ContejnerTimer, which is cancelled first if armed
+ * @delay_ms: milliseconds from now until @func is called
+ * @func: called once the timer expires, after which it is disarmed
+ * @user_data: passed to @func
+ */
+void contejner_timer_arm (ContejnerTimerWheel *wheel,
+                          ContejnerTimer *timer,
+                          guint64 delay_ms,
+                          ContejnerTimerFunc func,
+                          gpointer user_data);
+
+/* Does nothing if @timer is not armed */
+void contejner_timer_cancel (ContejnerTimer *timer);
+
+gboolean contejner_timer_is_armed (const ContejnerTimer *timer);
+
+/* Number of armed timers */
+guint contejner_timer_wheel_get_size (const ContejnerTimerWheel *wheel);
+
+void contejner_timer_wheel_free (ContejnerTimerWheel *wheel);
+
+G_END_DECLS
+
+#endif /* CONTEJNER_TIMER_H */
@@ -72,12 +72,19 @@ int main (int argc, char *argv[])
     GBusNameOwnerFlags flags;
     gboolean opt_replace;
     gboolean opt_allow_replacement;
+    gchar *opt_output_dir;
+    gchar *opt_placement;
+    gint opt_max_running;
+    ContejnerManagerPlacement placement;
     GOptionContext *opt_context;
     GError *error;
     GOptionEntry opt_entries[] =
     {
         { "replace", 'r', 0, G_OPTION_ARG_NONE, &opt_replace, "Replace existing name if possible", NULL },
         { "allow-replacement", 'a', 0, G_OPTION_ARG_NONE, &opt_allow_replacement, "Allow replacement", NULL },
+        { "output-dir", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output_dir, "Directory to store container output in", "DIR" },
+        { "placement", 'p', 0, G_OPTION_ARG_STRING, &opt_placement, "NUMA placement of containers: none or spread", "POLICY" },
+        { "max-running", 'm', 0, G_OPTION_ARG_INT, &opt_max_running, "Maximum number of containers running at once, others are queued (0 for no limit)", "N" },
         { NULL}
     };
     ContejnerManager *manager;
@@ -86,6 +93,9 @@ int main (int argc, char *argv[])
     error = NULL;
     opt_replace = FALSE;
     opt_allow_replacement = FALSE;
+    opt_output_dir = NULL;
+    opt_placement = NULL;
+    opt_max_running = 0;
     opt_context = g_option_context_new ("g_bus_own_name() example");
     g_option_context_add_main_entries (opt_context, opt_entries, NULL);
     if (!g_option_context_parse (opt_context, &argc, &argv, &error))
@@ -105,6 +115,28 @@ int main (int argc, char *argv[])
         g_error ("Failed to create container manager");
     }
 
+    if (!opt_output_dir) {
+        opt_output_dir = g_build_filename(g_get_user_cache_dir(),
+                                          "contejner",
+                                          NULL);
+    }
+    contejner_manager_set_output_dir(manager, opt_output_dir);
+    contejner_manager_restore(manager);
+
+    placement = CONTEJNER_MANAGER_PLACEMENT_NONE;
+    if (opt_placement &&
+        !contejner_manager_placement_from_string(opt_placement, &placement)) {
+        g_printerr ("Unknown placement policy: %s\n", opt_placement);
+        return 1;
+    }
+    contejner_manager_set_placement(manager, placement);
+
+    if (opt_max_running < 0) {
+        g_printerr ("Invalid maximum number of running containers\n");
+        return 1;
+    }
+    contejner_manager_set_max_running(manager, opt_max_running);
+
     owner_id = g_bus_own_name (G_BUS_TYPE_SESSION,
                                CONTEJNER_MANAGER_INTERFACE_DBUS_NAME,
                                flags,
@@ -2,8 +2,209 @@
 #  Copyright (C) 2016 Johan Thelin <e8johan@gmail.com>
 #  Licensed under GPLv2, see file LICENSE in this source tree.
 #
-# Usage: xml2h <variable> <input>
+# Usage: xml2h <variable> <input> [<prefix> <type>]
+#
+# Embeds the introspection XML <input> as the string <variable>. With a
+# <prefix> and a handler data <type>, method dispatch for the interface in
+# <input> is generated as well:
+#
+#  - a prototype of a typed handler for every method, which the includer
+#    implements:
+#      static void handle_<Method>(<type> *self,
+#                                  GDBusMethodInvocation *invocation,
+#                                  <in arguments>);
+#    Strings are passed as const gchar *, string arrays as const gchar **,
+#    basic types as their GLib types and other types as a GVariant. All of
+#    them are owned by the caller.
+#  - a stub per method unpacking the arguments and calling the handler
+#  - <prefix>_lookup(), finding a method in a perfect hash table of the
+#    method names, and <prefix>_dispatch(), which calls the stub of a method
+#    and returns FALSE for unknown methods.
+#
+# Defining XML2H_LOOKUP_ONLY before including the output leaves out the
+# handlers and stubs, for using the table on its own.
 
 echo -n "const char $1[] = {"
 hexdump -ve '1/1 "0x%x,"' $2
 echo "0x00};"
+
+if [ -z "$3" ]; then
+    exit 0
+fi
+
+awk -v prefix="$3" -v type="$4" '
+function attr(line, name,    m) {
+    if (match(line, name "=\"[^\"]*\"")) {
+        m = substr(line, RSTART + length(name) + 2, RLENGTH - length(name) - 3)
+        return m
+    }
+    return ""
+}
+
+# The same hash is computed by the generated C code
+function hash(str, seed,    h, i) {
+    h = 0
+    for (i = 1; i <= length(str); i++) {
+        h = (h * seed + ord[substr(str, i, 1)]) % 1000003
+    }
+    return h
+}
+
+BEGIN {
+    for (i = 0; i < 256; i++) {
+        ord[sprintf("%c", i)] = i
+    }
+    n = 0
+}
+
+/<method / {
+    method = attr($0, "name")
+    methods[n] = method
+    nargs[n] = 0
+    n++
+    in_method = 1
+}
+
+in_method && /<arg / && attr($0, "direction") == "in" {
+    a = nargs[n - 1]++
+    argname[n - 1, a] = attr($0, "name")
+    argtype[n - 1, a] = attr($0, "type")
+}
+
+/<\/method>/ {
+    in_method = 0
+}
+
+END {
+    # Find the smallest power of two table, and a seed, without collisions
+    found = 0
+    for (size = 1; size < n; size *= 2);
+    for (; !found; size *= 2) {
+        for (seed = 2; seed < 1000 && !found; seed++) {
+            delete used
+            found = 1
+            for (m = 0; m < n; m++) {
+                slot[m] = hash(methods[m], seed) % size
+                if (slot[m] in used) {
+                    found = 0
+                    break
+                }
+                used[slot[m]] = 1
+            }
+        }
+    }
+    size /= 2
+    seed--
+
+    print ""
+    print "#ifndef XML2H_LOOKUP_ONLY"
+    for (m = 0; m < n; m++) {
+        params = ""
+        for (a = 0; a < nargs[m]; a++) {
+            t = argtype[m, a]
+            if (t == "s" || t == "o" || t == "g") {
+                ctype[m, a] = "const gchar *"; fmt[m, a] = "&" t
+            } else if (t == "as") {
+                ctype[m, a] = "const gchar **"; fmt[m, a] = "^a&s"
+            } else if (t == "b") {
+                ctype[m, a] = "gboolean "; fmt[m, a] = t
+            } else if (t == "y") {
+                ctype[m, a] = "guchar "; fmt[m, a] = t
+            } else if (t == "n") {
+                ctype[m, a] = "gint16 "; fmt[m, a] = t
+            } else if (t == "q") {
+                ctype[m, a] = "guint16 "; fmt[m, a] = t
+            } else if (t == "i" || t == "h") {
+                ctype[m, a] = "gint32 "; fmt[m, a] = t
+            } else if (t == "u") {
+                ctype[m, a] = "guint32 "; fmt[m, a] = t
+            } else if (t == "x") {
+                ctype[m, a] = "gint64 "; fmt[m, a] = t
+            } else if (t == "t") {
+                ctype[m, a] = "guint64 "; fmt[m, a] = t
+            } else if (t == "d") {
+                ctype[m, a] = "gdouble "; fmt[m, a] = t
+            } else {
+                ctype[m, a] = "GVariant *"; fmt[m, a] = "@" t
+            }
+            params = params ",\n        " ctype[m, a] argname[m, a]
+        }
+        printf "static void handle_%s(%s *self,\n        GDBusMethodInvocation *invocation%s);\n",
+               methods[m], type, params
+    }
+
+    for (m = 0; m < n; m++) {
+        printf "\nstatic void %s_%s_stub(%s *self,\n        GVariant *parameters,\n        GDBusMethodInvocation *invocation)\n{\n",
+               prefix, methods[m], type
+        if (nargs[m] == 0) {
+            printf "    handle_%s(self, invocation);\n}\n", methods[m]
+            continue
+        }
+        format = ""
+        refs = ""
+        call = ""
+        for (a = 0; a < nargs[m]; a++) {
+            printf "    %s%s;\n", ctype[m, a], argname[m, a]
+            format = format fmt[m, a]
+            refs = refs ", &" argname[m, a]
+            call = call ", " argname[m, a]
+        }
+        printf "\n    g_variant_get(parameters, \"(%s)\"%s);\n", format, refs
+        printf "    handle_%s(self, invocation%s);\n", methods[m], call
+        for (a = 0; a < nargs[m]; a++) {
+            if (ctype[m, a] == "const gchar **") {
+                printf "    g_free(%s);\n", argname[m, a]
+            } else if (ctype[m, a] == "GVariant *") {
+                printf "    g_variant_unref(%s);\n", argname[m, a]
+            }
+        }
+        print "}"
+    }
+    print ""
+    printf "#define %s_STUB(stub) stub\n", toupper(prefix)
+    print "#else"
+    printf "#define %s_STUB(stub) NULL\n", toupper(prefix)
+    print "#endif /* XML2H_LOOKUP_ONLY */"
+
+    print ""
+    printf "struct %s_method {\n", prefix
+    print "    const char *name;"
+    printf "    void (*stub)(%s *self,\n                 GVariant *parameters,\n                 GDBusMethodInvocation *invocation);\n", type
+    print "};"
+    print ""
+    printf "#define %s_TABLE_SZ %d\n", toupper(prefix), size
+    print ""
+    printf "static const struct %s_method %s_methods[%s_TABLE_SZ] = {\n", prefix, prefix, toupper(prefix)
+    for (m = 0; m < n; m++) {
+        printf "    [%d] = { \"%s\", %s_STUB(%s_%s_stub) },\n", slot[m], methods[m], toupper(prefix), prefix, methods[m]
+    }
+    print "};"
+    print ""
+    printf "static inline const struct %s_method *%s_lookup(const gchar *name)\n{\n", prefix, prefix
+    print "    const struct " prefix "_method *method;"
+    print "    const guchar *c;"
+    print "    guint32 h = 0;"
+    print ""
+    print "    for (c = (const guchar *) name; *c; c++) {"
+    printf "        h = (h * %d + *c) %% 1000003;\n", seed
+    print "    }"
+    print ""
+    printf "    method = &%s_methods[h %% %s_TABLE_SZ];\n", prefix, toupper(prefix)
+    print "    if (!method->name || strcmp(method->name, name)) {"
+    print "        return NULL;"
+    print "    }"
+    print "    return method;"
+    print "}"
+    print ""
+    print "#ifndef XML2H_LOOKUP_ONLY"
+    printf "static inline gboolean %s_dispatch(%s *self,\n        const gchar *name,\n        GVariant *parameters,\n        GDBusMethodInvocation *invocation)\n{\n", prefix, type
+    printf "    const struct %s_method *method = %s_lookup(name);\n\n", prefix, prefix
+    print "    if (!method) {"
+    print "        return FALSE;"
+    print "    }"
+    print "    method->stub(self, parameters, invocation);"
+    print "    return TRUE;"
+    print "}"
+    print "#endif /* XML2H_LOOKUP_ONLY */"
+}
+' $2
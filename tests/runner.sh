@@ -36,12 +36,48 @@ function ASSERT_STREQUAL {
     fi
 }
 
-export -f ASSERT ASSERT_STREQUAL
+# The pid of the init process of the running container $1
+function CONTAINER_PID {
+    ${CLIENT} --status-board | sed -n "s/^${1#org.jonatan.Contejner.} [A-Z]* pid \([1-9][0-9]*\) .*/\1/p"
+}
+
+# The cgroup of the running container $1
+function CONTAINER_CGROUP {
+    local pid=$(CONTAINER_PID "$1")
+    if [ -n "$pid" ]; then
+        echo "/sys/fs/cgroup$(sed -n 's/^0:://p' /proc/$pid/cgroup)"
+    fi
+}
+
+# Whether the service could enable controller $2 for container cgroup $1,
+# which needs the controller to be delegated and no process but the service
+# in the group above
+function CONTROLLER_DELEGATED {
+    local parent=$(dirname "$1")
+    [ -n "$1" ] && [ -z "$(cat "$parent/cgroup.procs")" ] &&
+        grep --silent -w "$2" "$parent/cgroup.controllers"
+}
+
+export -f ASSERT ASSERT_STREQUAL CONTAINER_PID CONTAINER_CGROUP CONTROLLER_DELEGATED
+
+# The service hands controllers down from its cgroup, where nothing else may
+# run, so the tests run in a cgroup of their own and the service is moved
+# back
+CGROUP="/sys/fs/cgroup$(sed -n 's/^0:://p' /proc/self/cgroup)"
+if grep --silent "^0::" /proc/self/cgroup && [ -w "$CGROUP" ] &&
+   mkdir -p "$CGROUP/tests" && echo $$ > "$CGROUP/tests/cgroup.procs"; then
+    export SERVICE_CGROUP="$CGROUP"
+fi
 
 # Start a new D-Bus
 eval `dbus-launch --sh-syntax`
 export G_MESSAGES_DEBUG=all
-(${SERVICE} > contejner_output)&
+(
+    if [ -n "$SERVICE_CGROUP" ]; then
+        echo $BASHPID > "$SERVICE_CGROUP/cgroup.procs"
+    fi
+    exec ${SERVICE} > contejner_output
+)&
 SERVICE_PID=$!
 
 # Give the service a second to start up
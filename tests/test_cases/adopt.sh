@@ -0,0 +1,73 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+# The service is restarted here, so it gets a bus and an output directory
+# of its own
+OUTPUT_DIR=$(mktemp -d)
+eval `dbus-launch --sh-syntax`
+trap 'kill $ADOPT_SERVICE $DBUS_SESSION_BUS_PID; rm -rf "$OUTPUT_DIR"' EXIT
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+GET="$CALL --method org.freedesktop.DBus.Properties.Get"
+
+function start_service {
+    ${SERVICE} --output-dir "$OUTPUT_DIR" >> "$OUTPUT_DIR/service.log" 2>&1 &
+    ADOPT_SERVICE=$!
+    sleep 1
+}
+
+function restart_service {
+    kill $ADOPT_SERVICE
+    wait $ADOPT_SERVICE
+    start_service
+}
+
+start_service
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$CALL --method "$NAME.SetCommand" /bin/sh "['-c', 'echo before; sleep 2; echo after; sleep 30']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+
+# A running container is taken over by the next service
+restart_service
+$INTROSPECT --object-path /org/jonatan/Contejner/Containers | grep --silent -w "$NAME"
+ASSERT_STREQUAL "$?" "0" "Container was not adopted"
+$GET "$NAME" Status | grep --silent "RUNNING"
+ASSERT_STREQUAL "$?" "0" "Adopted container is not RUNNING"
+
+# Output written while the service was away, and after, is kept
+sleep 2
+OUTPUT=$(${CLIENT} -c "$NAME" --tail 2 | tr '\n' ' ')
+ASSERT_STREQUAL "$OUTPUT" "before after " "Output of the adopted container was lost"
+
+# The adopted container stops like any other
+timeout 5 $CALL --method "$NAME.Stop" 0 > /dev/null
+$GET "$NAME" Status | grep --silent "STOPPED"
+ASSERT_STREQUAL "$?" "0" "Adopted container did not stop"
+
+# Stopped containers are not taken over again
+restart_service
+$INTROSPECT --object-path /org/jonatan/Contejner/Containers | grep --silent -w "$NAME"
+ASSERT_STREQUAL "$?" "1" "Stopped container was adopted"
+
+# Every run leaves a stale record or two, and the journal is compacted once
+# they are the majority
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+for NS in Mount Network IPC PID UTS User; do
+    $CALL --method org.freedesktop.DBus.Properties.Set "$NAME" ${NS}NamespaceEnabled "<false>" > /dev/null
+done
+$CALL --method "$NAME.SetCommand" /bin/true "[]" > /dev/null
+for i in $(seq 1200); do
+    $CALL --method "$NAME.Run" > /dev/null 2>&1
+done
+grep --silent "Compacted journal" "$OUTPUT_DIR/service.log"
+ASSERT_STREQUAL "$?" "0" "Journal was not compacted"
+
+# A compacted journal is read back like any other
+$CALL --method "$NAME.SetCommand" /bin/sleep "['30']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+restart_service
+$GET "$NAME" Status | grep --silent "RUNNING"
+ASSERT_STREQUAL "$?" "0" "Container was not adopted from a compacted journal"
+timeout 5 $CALL --method "$NAME.Stop" 0 > /dev/null
@@ -0,0 +1,31 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+
+# Share a host directory read-only with a container
+DATA=$(mktemp -d)
+echo "shared" > "$DATA/file"
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$CALL --method "$NAME.AddMount" "$DATA" /mnt "uint32 1" > /dev/null
+ASSERT_STREQUAL "$?" "0" "Failed to add bind mount"
+$CALL --method "$NAME.SetCommand" /bin/sh "['-c', 'cat /mnt/file; touch /mnt/new || echo read-only']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+
+OUTPUT=$(${CLIENT} -c "$NAME" --tail 2 | tr '\n' ' ')
+ASSERT_STREQUAL "$OUTPUT" "shared read-only " "Bind mount was not read-only"
+ASSERT_STREQUAL "$(ls "$DATA")" "file" "Container wrote to the host directory"
+
+# The bind mount is listed in the Mounts property
+$CALL --method org.freedesktop.DBus.Properties.Get "$NAME" Mounts | grep --silent "'/mnt', uint32 1"
+ASSERT_STREQUAL "$?" "0" "Mounts property does not list the bind mount"
+
+# Relative paths and unknown flags are refused
+$CALL --method "$NAME.AddMount" "$DATA" mnt "uint32 0" > /dev/null 2>&1
+ASSERT_STREQUAL "$?" "1" "Relative container path was accepted"
+$CALL --method "$NAME.AddMount" "$DATA" /mnt "uint32 4" > /dev/null 2>&1
+ASSERT_STREQUAL "$?" "1" "Unknown flags were accepted"
+
+rm -r "$DATA"
@@ -0,0 +1,54 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+GET="$CALL --method org.freedesktop.DBus.Properties.Get"
+
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+for PROPERTY in MemoryHighEvents MemoryMaxEvents OOMKills; do
+    $GET "$NAME" $PROPERTY | grep --silent "uint64 0"
+    ASSERT_STREQUAL "$?" "0" "$PROPERTY of a new container is not 0"
+done
+
+# Containers only have a cgroup when the service has one to delegate
+if ! grep --silent "^0::" /proc/self/cgroup || [ ! -w "/sys/fs/cgroup$(sed -n 's/^0:://p' /proc/self/cgroup)" ]; then
+    exit 0
+fi
+
+# A process left behind by the init process keeps the container running,
+# until the cgroup is drained
+$CALL --method org.freedesktop.DBus.Properties.Set "$NAME" PIDNamespaceEnabled "<false>" > /dev/null
+$CALL --method "$NAME.SetCommand" /bin/sh "['-c', 'sleep 3 > /dev/null 2>&1 &']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+$GET "$NAME" Status | grep --silent "RUNNING"
+ASSERT_STREQUAL "$?" "0" "Container stopped while its cgroup was populated"
+
+sleep 4
+$GET "$NAME" Status | grep --silent "STOPPED"
+ASSERT_STREQUAL "$?" "0" "Container did not stop once its cgroup was drained"
+
+# A process that allocates past memory.max is OOM killed, once the memory
+# controller could be enabled for the container
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$CALL --method org.freedesktop.DBus.Properties.Set "$NAME" PIDNamespaceEnabled "<false>" > /dev/null
+$CALL --method "$NAME.SetCommand" /bin/sh "['-c', 'sleep 2; head -c 268435456 /dev/zero | tail']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+CGROUP=$(CONTAINER_CGROUP "$NAME")
+if CONTROLLER_DELEGATED "$CGROUP" memory; then
+    [ -e "$CGROUP/memory.events" ]
+    ASSERT_STREQUAL "$?" "0" "Memory controller is not enabled for the container"
+
+    echo 33554432 > "$CGROUP/memory.max"
+    if [ -e "$CGROUP/memory.swap.max" ]; then
+        echo 0 > "$CGROUP/memory.swap.max"
+    fi
+    sleep 4
+    for PROPERTY in MemoryMaxEvents OOMKills; do
+        $GET "$NAME" $PROPERTY | grep --silent "uint64 0"
+        ASSERT_STREQUAL "$?" "1" "$PROPERTY did not count the OOM kill"
+    done
+fi
+timeout 5 $CALL --method "$NAME.Stop" 0 > /dev/null 2>&1
@@ -0,0 +1,54 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner"
+
+# Output well past the uncompressed tail
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$NAME" --compress-output -e "/usr/bin/seq 1 1000000" > /dev/null
+sleep 2
+
+GET="$CALL --object-path /org/jonatan/Contejner/Containers --method org.freedesktop.DBus.Properties.Get $NAME"
+SIZE=$($GET OutputSize | sed 's/.*uint64 \([0-9]*\).*/\1/')
+STORED=$($GET StoredOutputSize | sed 's/.*uint64 \([0-9]*\).*/\1/')
+ASSERT_STREQUAL "$SIZE" "$(seq 1 1000000 | wc -c)" "Output size is wrong"
+ASSERT "$(( STORED * 2 < SIZE ))" "Output was not compressed: $STORED of $SIZE bytes"
+
+# Reads from the compressed part, and across into the uncompressed one
+FIRST=$(${CLIENT} -c "$NAME" --tail 1000000 | head -3 | tr '\n' ' ')
+ASSERT_STREQUAL "$FIRST" "1 2 3 " "Compressed output was not read back"
+ALL=$(${CLIENT} -c "$NAME" --tail 1000000 | md5sum)
+ASSERT_STREQUAL "$ALL" "$(seq 1 1000000 | md5sum)" "Output was changed by compression"
+
+# Output written slowly is cut into small chunks, which are compressed
+# together in frames of 64 KiB. A service of its own keeps nothing plain, so
+# that little output is enough, and keeps the log where it can be looked at.
+OUTPUT_DIR=$(mktemp -d)
+eval `dbus-launch --sh-syntax`
+CONTEJNER_LOG_HOT_SIZE=0 ${SERVICE} --output-dir "$OUTPUT_DIR" > /dev/null 2>&1 &
+SLOW_SERVICE=$!
+trap 'kill $SLOW_SERVICE $DBUS_SESSION_BUS_PID; rm -rf "$OUTPUT_DIR"' EXIT
+sleep 1
+
+# 18 blocks of 4 KiB, more than a second apart, so every block is a chunk
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+GET="$CALL --method org.freedesktop.DBus.Properties.Get"
+SLOW='for i in $(seq 0 17); do seq -f %063g $((i * 64)) $((i * 64 + 63)); sleep 1.2; done'
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$CALL --method org.freedesktop.DBus.Properties.Set "$NAME" CompressOutput "<true>" > /dev/null
+$CALL --method "$NAME.SetCommand" /bin/sh "['-c', '$SLOW']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 23
+
+SIZE=$($GET $NAME OutputSize | sed 's/.*uint64 \([0-9]*\).*/\1/')
+STORED=$($GET $NAME StoredOutputSize | sed 's/.*uint64 \([0-9]*\).*/\1/')
+ASSERT_STREQUAL "$SIZE" "$(( 18 * 4096 ))" "Slow output size is wrong"
+ASSERT "$(( STORED * 2 < SIZE ))" "Slow output was not compressed: $STORED of $SIZE bytes"
+
+# A header of 16 bytes and one frame record of 24
+ZINDEX_SIZE=$(stat -c %s "$OUTPUT_DIR"/*/stdout.zdx)
+ASSERT_STREQUAL "$ZINDEX_SIZE" "40" "Slow output was not compressed in one frame: $ZINDEX_SIZE bytes of index"
+
+ALL=$(${CLIENT} -c "$NAME" --tail 2000 | md5sum)
+ASSERT_STREQUAL "$ALL" "$(seq -f %063g 0 1151 | md5sum)" "Slow output was changed by compression"
@@ -0,0 +1,27 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner"
+
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+CONTAINER="$CALL --object-path /org/jonatan/Contejner/Containers"
+
+# Arguments of every type reach the handlers
+$CONTAINER --method "$NAME.SetCommand" /usr/bin/seq "['1', '2']" > /dev/null
+ASSERT_STREQUAL "$?" "0" "SetCommand failed"
+$CONTAINER --method "$NAME.SetLabels" "{'role': 'dispatch'}" > /dev/null
+ASSERT_STREQUAL "$?" "0" "SetLabels failed"
+$CONTAINER --method "$NAME.Run" > /dev/null
+sleep 1
+
+OUTPUT=$(${CLIENT} -c "$NAME" --tail 2 | tr '\n' ' ')
+ASSERT_STREQUAL "$OUTPUT" "1 2 " "Command arguments were not passed on"
+
+OUTPUT=$($CONTAINER --method "$NAME.ReadOutput" stdout 0 1 lines)
+ASSERT_STREQUAL "$OUTPUT" "(b'1\n', uint64 0, uint64 2)" "ReadOutput arguments were not passed on"
+
+# Freeze and Thaw have handlers of their own
+ERROR=$($CONTAINER --method "$NAME.Thaw" 2>&1)
+echo "$ERROR" | grep -q "Thaw.Error.NotFrozen"
+ASSERT_STREQUAL "$?" "0" "Thaw of a stopped container was not refused"
@@ -0,0 +1,21 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+# Watch the events of a container which runs and fails
+${CLIENT} --events > events_output &
+WATCHER=$!
+sleep 1
+
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$NAME" -e "/bin/false"
+sleep 1
+kill $WATCHER
+
+EVENTS=$(grep " $NAME " events_output | cut -d' ' -f3- | paste -sd,)
+rm -f events_output
+ASSERT_STREQUAL "$EVENTS" "created,running,stopped 1" "Events were not sent"
+
+# The events are also kept for clients which start watching later
+EVENTS=$(timeout 1 ${CLIENT} --events | grep " $NAME " | cut -d' ' -f3- | paste -sd,)
+ASSERT_STREQUAL "$EVENTS" "created,running,stopped 1" "Events were not kept"
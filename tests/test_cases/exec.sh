@@ -0,0 +1,16 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+# Start a long running container and run commands next to it
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$NAME" -e "/bin/sleep 10"
+sleep 1
+
+OUTPUT=$(${CLIENT} -c "$NAME" -x "/bin/echo hello")
+ASSERT_STREQUAL "$OUTPUT" "hello" "Failed to read the output of an exec'd command"
+
+${CLIENT} -c "$NAME" -x "/bin/false"
+ASSERT_STREQUAL "$?" "1" "Exit status of an exec'd command was lost"
+
+${CLIENT} -c "$NAME" -k 9
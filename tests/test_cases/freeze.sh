@@ -0,0 +1,57 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+GET="$CALL --method org.freedesktop.DBus.Properties.Get"
+LOG="$PWD/freeze.log"
+trap 'rm -f "$LOG"' EXIT
+
+# Only running containers can be frozen, and only frozen ones thawed
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$CALL --method "$NAME.Freeze" 2>&1 | grep --silent "Freeze.Error.NotRunning"
+ASSERT_STREQUAL "$?" "0" "Container that is not running was frozen"
+$CALL --method "$NAME.Thaw" 2>&1 | grep --silent "Thaw.Error.NotFrozen"
+ASSERT_STREQUAL "$?" "0" "Container that is not frozen was thawed"
+
+# The freezer needs a cgroup for the container
+if ! grep --silent "^0::" /proc/self/cgroup || [ ! -w "/sys/fs/cgroup$(sed -n 's/^0:://p' /proc/self/cgroup)" ]; then
+    exit 0
+fi
+
+# A frozen container makes no progress until it is thawed
+$CALL --method org.freedesktop.DBus.Properties.Set "$NAME" PIDNamespaceEnabled "<false>" > /dev/null
+$CALL --method "$NAME.SetCommand" /bin/sh "['-c', 'while true; do echo >> $LOG; sleep 0.1; done']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+${CLIENT} -c "$NAME" --freeze
+$GET "$NAME" Status | grep --silent "FROZEN"
+ASSERT_STREQUAL "$?" "0" "Container is not FROZEN"
+sleep 0.5
+LINES=$(wc -l < "$LOG")
+sleep 1
+ASSERT_STREQUAL "$(wc -l < "$LOG")" "$LINES" "Frozen container kept running"
+
+${CLIENT} -c "$NAME" --thaw
+$GET "$NAME" Status | grep --silent "RUNNING"
+ASSERT_STREQUAL "$?" "0" "Thawed container is not RUNNING"
+sleep 1
+[ "$(wc -l < "$LOG")" -gt "$LINES" ]
+ASSERT_STREQUAL "$?" "0" "Thawed container did not continue"
+
+# A frozen container can still be stopped
+$CALL --method "$NAME.Freeze" > /dev/null
+STATUS=$(timeout 5 $CALL --method "$NAME.Stop" 500)
+ASSERT_STREQUAL "$?" "0" "Frozen container could not be stopped"
+$GET "$NAME" Status | grep --silent "STOPPED"
+ASSERT_STREQUAL "$?" "0" "Stopped frozen container is not STOPPED"
+
+# And killed, through cgroup.kill on the frozen cgroup
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+$CALL --method "$NAME.Freeze" > /dev/null
+$CALL --method "$NAME.Kill" 9 > /dev/null
+ASSERT_STREQUAL "$?" "0" "Frozen container could not be killed"
+sleep 1
+$GET "$NAME" Status | grep --silent "STOPPED"
+ASSERT_STREQUAL "$?" "0" "Killed frozen container did not stop"
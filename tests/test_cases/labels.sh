@@ -0,0 +1,25 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+# Start two labelled containers of one job, and a third one of another
+PROD=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$PROD" -e "/bin/sleep 10" --label job=labels-test --label stage=prod
+TEST=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$TEST" -e "/bin/sleep 10" --label job=labels-test --label stage=test
+OTHER=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$OTHER" -e "/bin/true" --label job=other
+sleep 1
+
+OUTPUT=$(${CLIENT} -l -s "job=labels-test,stage!=prod")
+ASSERT_STREQUAL "$OUTPUT" " - $TEST" "Selector matched the wrong containers"
+
+OUTPUT=$(${CLIENT} -k 9 -s "job=labels-test")
+ASSERT_STREQUAL "$OUTPUT" "Killed 2 containers" "Failed to kill the containers of a job"
+sleep 1
+
+OUTPUT=$(${CLIENT} --destroy -s "job")
+ASSERT_STREQUAL "$OUTPUT" "Destroyed 3 containers" "Failed to destroy labelled containers"
+
+OUTPUT=$(${CLIENT} -l -s "job")
+ASSERT_STREQUAL "$OUTPUT" "" "Destroyed containers are still listed"
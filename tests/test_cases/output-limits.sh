@@ -0,0 +1,43 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+
+function get {
+    $CALL --method org.freedesktop.DBus.Properties.Get "$1" "$2" | sed 's/.*uint[0-9]* \([0-9]*\).*/\1/'
+}
+
+function set {
+    $CALL --method org.freedesktop.DBus.Properties.Set "$1" "$2" "$3" > /dev/null
+}
+
+# Output beyond the volume limit is dropped and counted
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+set "$NAME" OutputVolumeLimit "<uint64 1000>"
+set "$NAME" OutputLimitPolicy "<'drop'>"
+${CLIENT} -c "$NAME" -e "/usr/bin/seq 1 10000" -o > /dev/null
+ASSERT_STREQUAL "$(get "$NAME" OutputSize)" "1000" "Output beyond the volume limit was kept"
+ASSERT_STREQUAL "$(get "$NAME" OutputDropped)" "$(( $(seq 1 10000 | wc -c) - 1000 ))" "Dropped output was not counted"
+ASSERT_STREQUAL "$(get "$NAME" OutputLimitHits)" "1" "Limit hit was not counted"
+
+# The kill policy stops the container
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+set "$NAME" OutputVolumeLimit "<uint64 1000>"
+set "$NAME" OutputLimitPolicy "<'kill'>"
+${CLIENT} -c "$NAME" -e "/usr/bin/yes" -o > /dev/null
+ASSERT_STREQUAL "$?" "137" "Container was not killed at the volume limit"
+
+# The block policy slows the writer down to the rate limit
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+set "$NAME" OutputRateLimit "<uint64 100000>"
+START=$(date +%s%N)
+${CLIENT} -c "$NAME" -e "/usr/bin/head -c 300000 /dev/zero" -o > /dev/null
+ELAPSED=$(( ($(date +%s%N) - START) / 1000000 ))
+ASSERT "$(( ELAPSED >= 1500 ))" "Output was not rate limited, took $ELAPSED ms"
+ASSERT_STREQUAL "$(get "$NAME" OutputSize)" "300000" "Blocked output was lost"
+ASSERT_STREQUAL "$(get "$NAME" OutputDropped)" "0" "Blocked output was dropped"
+
+# Unknown policies are refused
+$CALL --method org.freedesktop.DBus.Properties.Set "$NAME" OutputLimitPolicy "<'slow'>" > /dev/null 2>&1
+ASSERT_STREQUAL "$?" "1" "Unknown policy was accepted"
@@ -0,0 +1,61 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+SET="$CALL --method org.freedesktop.DBus.Properties.Set"
+
+# The init process of a container only runs on the CPUs of its CpuSet
+CPU=$(sed 's/[-,].*//' /sys/devices/system/cpu/online)
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$SET "$NAME" PIDNamespaceEnabled "<false>" > /dev/null
+$SET "$NAME" CpuSet "<'$CPU'>" > /dev/null
+${CLIENT} -c "$NAME" -e "/bin/sleep 30" > /dev/null
+sleep 1
+ALLOWED=$(sed -n 's/^Cpus_allowed_list:\s*//p' /proc/$(CONTAINER_PID "$NAME")/status)
+$CALL --method "$NAME.Stop" 0 > /dev/null
+ASSERT_STREQUAL "$ALLOWED" "$CPU" "Container is not pinned to its CpuSet"
+
+# Spreading needs NUMA nodes, and a service started with --placement
+# spread. It gets a bus of its own, and is restarted to check that adopted
+# containers still count towards the load of their node.
+NODES=$(ls -d /sys/devices/system/node/node[0-9]* 2> /dev/null | wc -l)
+if [ "$NODES" -lt 2 ]; then
+    exit 0
+fi
+
+OUTPUT_DIR=$(mktemp -d)
+eval `dbus-launch --sh-syntax`
+trap 'kill $PLACEMENT_SERVICE $DBUS_SESSION_BUS_PID; rm -rf "$OUTPUT_DIR"' EXIT
+
+# The cpus of the node container $1 was placed on
+function placed_cpus {
+    sed -n 's/^Cpus_allowed_list:\s*//p' /proc/$(CONTAINER_PID "$1")/status
+}
+
+${SERVICE} --output-dir "$OUTPUT_DIR" --placement spread > /dev/null 2>&1 &
+PLACEMENT_SERVICE=$!
+sleep 1
+FIRST=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$SET "$FIRST" PIDNamespaceEnabled "<false>" > /dev/null
+${CLIENT} -c "$FIRST" -e "/bin/sleep 30" > /dev/null
+sleep 1
+FIRST_CPUS=$(placed_cpus "$FIRST")
+grep --silent -x "$FIRST_CPUS" /sys/devices/system/node/node*/cpulist
+ASSERT_STREQUAL "$?" "0" "Container was not placed on the CPUs of a node"
+
+kill $PLACEMENT_SERVICE
+wait $PLACEMENT_SERVICE
+${SERVICE} --output-dir "$OUTPUT_DIR" --placement spread > /dev/null 2>&1 &
+PLACEMENT_SERVICE=$!
+sleep 1
+
+SECOND=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$SET "$SECOND" PIDNamespaceEnabled "<false>" > /dev/null
+${CLIENT} -c "$SECOND" -e "/bin/sleep 30" > /dev/null
+sleep 1
+SECOND_CPUS=$(placed_cpus "$SECOND")
+$CALL --method "$FIRST.Stop" 0 > /dev/null
+$CALL --method "$SECOND.Stop" 0 > /dev/null
+[ -n "$SECOND_CPUS" ] && [ "$SECOND_CPUS" != "$FIRST_CPUS" ]
+ASSERT_STREQUAL "$?" "0" "Container was placed on the node of an adopted container"
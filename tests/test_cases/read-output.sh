@@ -0,0 +1,35 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+# Create a container and run 'seq' in it
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$NAME" -e "/usr/bin/seq 1 1000"
+sleep 1
+
+# Read back the last 3 lines of output
+OUTPUT=$(${CLIENT} -c "$NAME" --tail 3 | tr '\n' ' ')
+
+ASSERT_STREQUAL "$OUTPUT" "998 999 1000 " "Failed to read the last lines of output"
+
+# Output written slowly does not get an index record per write. A service of
+# its own keeps the log where it can be looked at.
+OUTPUT_DIR=$(mktemp -d)
+eval `dbus-launch --sh-syntax`
+${SERVICE} --output-dir "$OUTPUT_DIR" > /dev/null 2>&1 &
+SLOW_SERVICE=$!
+trap 'kill $SLOW_SERVICE $DBUS_SESSION_BUS_PID; rm -rf "$OUTPUT_DIR"' EXIT
+sleep 1
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$CALL --method "$NAME.SetCommand" /bin/sh "['-c', 'for i in \$(seq 1 15); do echo \$i; sleep 0.2; done']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 4
+
+OUTPUT=$(${CLIENT} -c "$NAME" --tail 3 | tr '\n' ' ')
+ASSERT_STREQUAL "$OUTPUT" "13 14 15 " "Failed to read the last lines of slow output"
+
+# A header of 16 bytes and one record of 24
+INDEX_SIZE=$(stat -c %s "$OUTPUT_DIR"/*/stdout.idx)
+ASSERT_STREQUAL "$INDEX_SIZE" "40" "Slow output was split into chunks: $INDEX_SIZE bytes of index"
@@ -0,0 +1,58 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+SET="$CALL --method org.freedesktop.DBus.Properties.Set"
+GET="$CALL --method org.freedesktop.DBus.Properties.Get"
+
+# A failing command is restarted, after a growing delay
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$SET "$NAME" RestartPolicy "<'on-failure'>" > /dev/null
+$CALL --method "$NAME.SetCommand" /bin/false "[]" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+$SET "$NAME" RestartPolicy "<'never'>" > /dev/null
+RESTARTS=$($GET "$NAME" Restarts | sed 's/.*uint32 \([0-9]*\).*/\1/')
+[ "$RESTARTS" -ge 2 ] && [ "$RESTARTS" -le 4 ]
+ASSERT_STREQUAL "$?" "0" "Failing container was restarted $RESTARTS times"
+
+# A command that succeeds is only restarted by the always policy
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$SET "$NAME" RestartPolicy "<'on-failure'>" > /dev/null
+$CALL --method "$NAME.SetCommand" /bin/true "[]" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+ASSERT_STREQUAL "$($GET "$NAME" Restarts)" "(<uint32 0>,)" "Successful container was restarted"
+
+# Runs that never started a process are not restarted
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$SET "$NAME" RestartPolicy "<'always'>" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+ASSERT_STREQUAL "$($GET "$NAME" Restarts)" "(<uint32 0>,)" "Container without a command was restarted"
+
+# Containers stopped on request stay stopped
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$SET "$NAME" RestartPolicy "<'always'>" > /dev/null
+$CALL --method "$NAME.SetCommand" /bin/sleep "['30']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+timeout 5 $CALL --method "$NAME.Stop" 0 > /dev/null
+sleep 1
+$GET "$NAME" Status | grep --silent "STOPPED"
+ASSERT_STREQUAL "$?" "0" "Stopped container was restarted"
+
+# Stopped containers can be run again by hand, but not new ones
+$SET "$NAME" RestartPolicy "<'never'>" > /dev/null
+$CALL --method "$NAME.SetCommand" /bin/true "[]" > /dev/null
+ERROR=$($CALL --method "$NAME.Rerun" | sed 's/(\([0-9]*\),.*/\1/')
+ASSERT_STREQUAL "$ERROR" "0" "Stopped container could not be run again"
+
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+ERROR=$($CALL --method "$NAME.Rerun" | sed 's/(\([0-9]*\),.*/\1/')
+[ "$ERROR" != "0" ]
+ASSERT_STREQUAL "$?" "0" "Container that never ran was run again"
+
+# Unknown policies are refused
+$SET "$NAME" RestartPolicy "<'sometimes'>" > /dev/null 2>&1
+ASSERT_STREQUAL "$?" "1" "Unknown restart policy was accepted"
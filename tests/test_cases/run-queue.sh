@@ -0,0 +1,75 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+MANAGER="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner --method org.freedesktop.DBus.Properties"
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+GET="$CALL --method org.freedesktop.DBus.Properties.Get"
+LOG="$PWD/run-queue.log"
+rm -f "$LOG"
+
+# A container that writes its name to the log when it runs
+function new_container {
+    local name=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+    $CALL --method "$name.SetCommand" /bin/sh "['-c', 'echo $1 >> $LOG']" > /dev/null
+    echo "$name"
+}
+
+# Only allow one container to run at a time, until the test ends
+$MANAGER.Set org.jonatan.Contejner MaxRunning "<uint32 1>" > /dev/null
+trap '$MANAGER.Set org.jonatan.Contejner MaxRunning "<uint32 0>" > /dev/null; rm -f "$LOG"' EXIT
+
+BLOCKER=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$BLOCKER" -e "/bin/sleep 2"
+
+# Every gdbus call is a client of its own, so these are admitted in order
+FIRST=$(new_container first)
+SECOND=$(new_container second)
+CANCELLED=$(new_container cancelled)
+for NAME in $FIRST $SECOND $CANCELLED; do
+    $CALL --method "$NAME.Run" > /dev/null
+done
+
+$GET "$SECOND" Status | grep --silent QUEUED
+ASSERT_STREQUAL "$?" "0" "Second container was not queued"
+ASSERT_STREQUAL "$($MANAGER.Get org.jonatan.Contejner QueueDepth)" "(<uint32 3>,)" "Queue depth was not reported"
+
+# Stopping a queued container takes it off the queue
+ASSERT_STREQUAL "$($CALL --method "$CANCELLED.Stop" 0)" "(-1,)" "Queued container was not stopped"
+$GET "$CANCELLED" Status | grep --silent STOPPED
+ASSERT_STREQUAL "$?" "0" "Stopped queued container is not STOPPED"
+ASSERT_STREQUAL "$($MANAGER.Get org.jonatan.Contejner QueueDepth)" "(<uint32 2>,)" "Stopped container is still queued"
+
+# So does destroying it
+DESTROYED=$(new_container destroyed)
+$CALL --method "$DESTROYED.SetLabels" "{'run-queue': 'destroy'}" > /dev/null
+$CALL --method "$DESTROYED.Run" > /dev/null
+gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner \
+    --method org.jonatan.Contejner.DestroyMatching run-queue=destroy > /dev/null
+ASSERT_STREQUAL "$($MANAGER.Get org.jonatan.Contejner QueueDepth)" "(<uint32 2>,)" "Destroyed container is still queued"
+
+sleep 4
+ASSERT_STREQUAL "$(cat "$LOG" | tr '\n' ' ')" "first second " "Queued containers were not admitted in order"
+
+# Containers of one client alternate with those of others. Several Run
+# calls over one connection need more than gdbus.
+if python3 -c "from gi.repository import Gio" 2> /dev/null; then
+    rm -f "$LOG"
+    ${CLIENT} -c "$BLOCKER" -e "/bin/sleep 2"
+    A1=$(new_container a1)
+    A2=$(new_container a2)
+    A3=$(new_container a3)
+    B1=$(new_container b1)
+    python3 - "$A1" "$A2" "$A3" <<'PYTHON'
+import sys
+from gi.repository import Gio
+bus = Gio.bus_get_sync(Gio.BusType.SESSION, None)
+for name in sys.argv[1:]:
+    bus.call_sync("org.jonatan.Contejner", "/org/jonatan/Contejner/Containers",
+                  name, "Run", None, None, Gio.DBusCallFlags.NONE, -1, None)
+PYTHON
+    $CALL --method "$B1.Run" > /dev/null
+
+    sleep 4
+    ASSERT_STREQUAL "$(cat "$LOG" | tr '\n' ' ')" "a1 b1 a2 a3 " "Clients were not admitted in turn"
+fi
@@ -0,0 +1,17 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+# Run 'sleep' as a low priority batch job
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$NAME" -e "/bin/sleep 2" --nice 10 --sched-policy BATCH --io-priority idle
+
+GET="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers --method org.freedesktop.DBus.Properties.Get $NAME"
+
+# Check that the values are in effect while it runs
+$GET Nice | grep --silent "10"
+ASSERT_STREQUAL "$?" "0" "Nice value was not applied"
+$GET SchedPolicy | grep --silent "BATCH"
+ASSERT_STREQUAL "$?" "0" "Scheduling policy was not applied"
+$GET IOPriority | grep --silent "idle"
+ASSERT_STREQUAL "$?" "0" "I/O priority was not applied"
@@ -0,0 +1,20 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+
+# Give the container one megabyte of scratch space in /tmp
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$NAME" --scratch /tmp=1M -e "/usr/bin/stat -f -c %T:%b:%S /tmp"
+sleep 1
+
+OUTPUT=$(${CLIENT} -c "$NAME" --tail 1)
+ASSERT_STREQUAL "${OUTPUT%%:*}" "tmpfs" "Scratch space was not mounted"
+BLOCKS=${OUTPUT#*:}
+ASSERT_STREQUAL "$(( ${BLOCKS%%:*} * ${BLOCKS#*:} ))" "1048576" "Scratch space has the wrong size"
+
+# Scratch space needs a mount namespace to go into
+$CALL --method org.freedesktop.DBus.Properties.Set "$NAME" MountNamespaceEnabled "<false>"
+$CALL --method "$NAME.Run" > /dev/null 2>&1
+ASSERT_STREQUAL "$?" "1" "Ran with scratch space but no mount namespace"
@@ -0,0 +1,50 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$NAME" -e "/bin/sleep 3"
+sleep 2
+
+# Every metric can be asked for, and samples are only taken in a cgroup
+for METRIC in cpu memory io-read io-write; do
+    SERIES=$($CALL --method "$NAME.GetSeries" $METRIC 0)
+    ASSERT_STREQUAL "$?" "0" "GetSeries $METRIC failed"
+done
+if grep --silent "^0::" /proc/self/cgroup && [ -w "/sys/fs/cgroup$(sed -n 's/^0:://p' /proc/self/cgroup)" ]; then
+    echo "$SERIES" | grep --silent "int64"
+    ASSERT_STREQUAL "$?" "0" "No samples of a running container"
+fi
+
+# Memory and I/O are sampled once their controllers could be enabled, here
+# for a workload holding 64 MiB and doing direct I/O on the test filesystem
+DATA="$PWD/series.data"
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$CALL --method org.freedesktop.DBus.Properties.Set "$NAME" PIDNamespaceEnabled "<false>" > /dev/null
+$CALL --method "$NAME.SetCommand" /bin/sh "['-c', 'dd if=/dev/zero of=$DATA bs=1M count=16 oflag=direct 2> /dev/null; dd if=$DATA of=/dev/null bs=1M iflag=direct 2> /dev/null; head -c 67108864 /dev/zero | tail | sleep 4']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+CGROUP=$(CONTAINER_CGROUP "$NAME")
+sleep 3
+METRICS=""
+if CONTROLLER_DELEGATED "$CGROUP" memory; then
+    METRICS="memory"
+fi
+if CONTROLLER_DELEGATED "$CGROUP" io && df --output=source "$PWD" | tail -n 1 | grep --silent "^/dev/"; then
+    METRICS="$METRICS io-read io-write"
+fi
+for METRIC in $METRICS; do
+    $CALL --method "$NAME.GetSeries" $METRIC 0 | sed 's/.*\], \[//; s/uint64//' | grep --silent "[1-9]"
+    ASSERT_STREQUAL "$?" "0" "Only zero samples of $METRIC"
+done
+rm -f "$DATA"
+
+# Only samples after the given time are returned
+SERIES=$($CALL --method "$NAME.GetSeries" cpu 9223372036854775807)
+ASSERT_STREQUAL "$SERIES" "(@ax [], @at [])" "Samples from the future were returned"
+
+ERROR=$($CALL --method "$NAME.GetSeries" temperature 0 2>&1)
+echo "$ERROR" | grep --silent "GetSeries.Error.UnknownMetric"
+ASSERT_STREQUAL "$?" "0" "Unknown metric was not refused"
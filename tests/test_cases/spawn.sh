@@ -0,0 +1,55 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+
+# Containers only have a cgroup when the service has one to delegate
+if grep --silent "^0::" /proc/self/cgroup && [ -w "/sys/fs/cgroup$(sed -n 's/^0:://p' /proc/self/cgroup)" ]; then
+    CGROUPS=1
+fi
+
+# Run cat /proc/self/cgroup in a new container, with namespaces or without
+# any (which takes posix_spawn), and check that it started in its cgroup
+function check_spawn {
+    local name=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+    local ns output
+    if [ "$1" == "plain" ]; then
+        for ns in Mount Network IPC PID UTS User; do
+            $CALL --method org.freedesktop.DBus.Properties.Set "$name" ${ns}NamespaceEnabled "<false>" > /dev/null
+        done
+    fi
+    $CALL --method "$name.SetCommand" /bin/cat "['/proc/self/cgroup']" > /dev/null
+    $CALL --method "$name.Run" > /dev/null
+    sleep 1
+
+    output=$($CALL --method "$name.ReadOutput" stdout 0 1 lines)
+    echo "$output" | grep --silent "0::"
+    ASSERT_STREQUAL "$?" "0" "$2: command did not run: $output"
+    if [ -n "$CGROUPS" ]; then
+        echo "$output" | grep --silent "/[0-9][0-9]*-[0-9][0-9]*\\\\n'"
+        ASSERT_STREQUAL "$?" "0" "$2: command did not start in its cgroup: $output"
+    fi
+}
+
+check_spawn plain "posix_spawn"
+check_spawn namespaces "clone3"
+
+# Failures between clone and exec are reported in the output
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$CALL --method "$NAME.SetCommand" /nonexistent "[]" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+$CALL --method "$NAME.ReadOutput" stderr 0 1 lines | grep --silent "exec failed, errno 2"
+ASSERT_STREQUAL "$?" "0" "Failed exec was not reported"
+
+# The clone() fallback for kernels without clone3(), in a service of its
+# own
+OUTPUT_DIR=$(mktemp -d)
+eval `dbus-launch --sh-syntax`
+CONTEJNER_NO_CLONE3=1 ${SERVICE} --output-dir "$OUTPUT_DIR" > /dev/null 2>&1 &
+SPAWN_SERVICE=$!
+trap 'kill $SPAWN_SERVICE $DBUS_SESSION_BUS_PID; rm -rf "$OUTPUT_DIR"' EXIT
+sleep 1
+
+check_spawn namespaces "clone"
@@ -0,0 +1,13 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+CONTAINER=${NAME#org.jonatan.Contejner.}
+
+${CLIENT} --status-board | grep --silent "^$CONTAINER CREATED pid 0 exit -1 runs 0 "
+ASSERT_STREQUAL "$?" "0" "New container is not on the status board"
+
+timeout 5 ${CLIENT} -c "$NAME" -e "/bin/false" -o > /dev/null
+${CLIENT} --status-board | grep --silent "^$CONTAINER STOPPED pid 0 exit 1 runs 1 "
+ASSERT_STREQUAL "$?" "0" "Stopped container is not on the status board"
@@ -0,0 +1,26 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+
+# A command that stops on SIGTERM is not killed
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$CALL --method org.freedesktop.DBus.Properties.Set "$NAME" PIDNamespaceEnabled "<false>" > /dev/null
+${CLIENT} -c "$NAME" -e "/bin/sleep 30" > /dev/null
+timeout 5 ${CLIENT} -c "$NAME" --stop 5000
+ASSERT_STREQUAL "$?" "143" "Container was not terminated"
+
+# A command that ignores SIGTERM is killed after the grace period, with
+# the processes it started
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$CALL --method "$NAME.SetCommand" /bin/sh "['-c', 'trap \"\" TERM; sleep 30 & sleep 30']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 1
+STATUS=$(timeout 5 $CALL --method "$NAME.Stop" 500)
+ASSERT_STREQUAL "$STATUS" "(137,)" "Container was not killed after the grace period"
+
+# Only running containers can be stopped
+ERROR=$($CALL --method "$NAME.Stop" 0 2>&1)
+echo "$ERROR" | grep --silent "Stop.Error.NotRunning"
+ASSERT_STREQUAL "$?" "0" "Stopped container was stopped again"
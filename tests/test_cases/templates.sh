@@ -0,0 +1,22 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner"
+
+# Create a template running 'seq', and a container from it with other arguments
+TEMPLATE=$($CALL --object-path /org/jonatan/Contejner --method org.jonatan.Contejner.CreateTemplate \
+    "{'Command': <'/usr/bin/seq'>, 'Arguments': <['1', '3']>}" | sed "s/^('\(.*\)',)$/\1/")
+NAME=$($CALL --object-path /org/jonatan/Contejner --method org.jonatan.Contejner.CreateFromTemplate \
+    "$TEMPLATE" "{'Arguments': <['1', '5']>}" | sed "s/^('\(.*\)',)$/\1/")
+
+$CALL --object-path /org/jonatan/Contejner/Containers --method "$NAME.Run" > /dev/null
+sleep 1
+
+OUTPUT=$(${CLIENT} -c "$NAME" --tail 1 | tr '\n' ' ')
+ASSERT_STREQUAL "$OUTPUT" "5 " "Container was not created from template"
+
+# Invalid configuration is refused
+$CALL --object-path /org/jonatan/Contejner --method org.jonatan.Contejner.CreateTemplate \
+    "{'Nice': <100>}" > /dev/null 2>&1
+ASSERT_STREQUAL "$?" "1" "Invalid template was accepted"
@@ -0,0 +1,21 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+
+# The command runs with a terminal as its standard streams
+OUTPUT=$(set -o pipefail; timeout 10 ${CLIENT} -t -e "$(command -v tty)" < /dev/null | tr -d '\r')
+ASSERT_STREQUAL "$?" "0" "Terminal session did not end with the command"
+echo "$OUTPUT" | grep --silent "^/dev/"
+ASSERT_STREQUAL "$?" "0" "Command has no terminal: $OUTPUT"
+
+# Input goes to the command, and its output comes back over the terminal
+OUTPUT=$(echo world | timeout 10 ${CLIENT} -t -e "$(command -v sed) s/world/WORLD/;q" | tr -d '\r')
+echo "$OUTPUT" | grep --silent -x "WORLD"
+ASSERT_STREQUAL "$?" "0" "Terminal input did not reach the command: $OUTPUT"
+
+# Containers without a terminal have none to attach to
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+$CALL --method "$NAME.AttachTerminal" 2>&1 | grep --silent "AttachTerminal.Error.NoTerminal"
+ASSERT_STREQUAL "$?" "0" "Attached to a container without a terminal"
@@ -0,0 +1,37 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+CALL="gdbus call --session --dest org.jonatan.Contejner --object-path /org/jonatan/Contejner/Containers"
+GET="$CALL --method org.freedesktop.DBus.Properties.Get"
+
+function set {
+    $CALL --method org.freedesktop.DBus.Properties.Set "$1" "$2" "$3" > /dev/null
+}
+
+# A command that stops on SIGTERM is not killed. As the init process of a
+# PID namespace, it would only get signals it has a handler for.
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+set "$NAME" PIDNamespaceEnabled "<false>"
+timeout 10 ${CLIENT} -c "$NAME" -e "/bin/sleep 30" -o --timeout 1:5 > /dev/null
+ASSERT_STREQUAL "$?" "143" "Container was not terminated at its deadline"
+
+# A command that ignores SIGTERM is killed after the grace period
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+set "$NAME" Timeout "<uint32 1>"
+set "$NAME" TimeoutGracePeriod "<uint32 1>"
+$CALL --method "$NAME.SetCommand" /bin/sh "['-c', 'trap \"\" TERM; sleep 30']" > /dev/null
+$CALL --method "$NAME.Run" > /dev/null
+sleep 4
+
+$GET "$NAME" ExitStatus | grep --silent "137"
+ASSERT_STREQUAL "$?" "0" "Container was not killed after the grace period"
+$GET "$NAME" TimedOut | grep --silent "true"
+ASSERT_STREQUAL "$?" "0" "Container was not marked as timed out"
+
+# A run that finishes in time is left alone
+NAME=$(${CLIENT} -n | sed -n 's/^Created new container: //p')
+${CLIENT} -c "$NAME" -e "/bin/true" --timeout 1 -o > /dev/null
+ASSERT_STREQUAL "$?" "0" "Container that finished in time failed"
+$GET "$NAME" TimedOut | grep --silent "false"
+ASSERT_STREQUAL "$?" "0" "Container that finished in time was marked as timed out"
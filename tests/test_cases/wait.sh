@@ -0,0 +1,13 @@
+#!/bin/bash
+#  Copyright (C) 2016 Jonatan Pålsson <jonatan.p@gmail.com>
+#  Licensed under GPLv2, see file LICENSE in this source tree.
+
+# The client follows the output of a container until it stops, and exits
+# with its exit status
+timeout 5 ${CLIENT} -e "/bin/false" -o > /dev/null
+ASSERT_STREQUAL "$?" "1" "Exit status of the container was lost"
+
+OUTPUT=$(timeout 5 ${CLIENT} -e "/bin/echo waited" -o)
+ASSERT_STREQUAL "$?" "0" "Client did not exit when the container stopped"
+echo "$OUTPUT" | grep --silent waited
+ASSERT_STREQUAL "$?" "0" "Output of the container was lost"